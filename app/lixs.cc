@@ -37,20 +37,34 @@
 #include "lixs_conf.hh"
 
 #include <lixs/event_mgr.hh>
+#include <lixs/iomux.hh>
 #include <lixs/log/logger.hh>
+#include <lixs/mstore/read_view.hh>
 #include <lixs/mstore/store.hh>
-#include <lixs/os_linux/epoll.hh>
+#include <lixs/mstore/wal.hh>
+#include <lixs/os_linux/io_thread.hh>
+#include <lixs/os_linux/io_uring.hh>
+#include <lixs/os_linux/mailbox.hh>
+#include <lixs/os_linux/timer.hh>
+#include <lixs/rate_limiter.hh>
+#include <lixs/reactor.hh>
+#include <lixs/scheduler.hh>
 #include <lixs/unix_sock_server.hh>
 #include <lixs/os_linux/dom_exc.hh>
+#include <lixs/os_linux/xen_hypervisor.hh>
 #include <lixs/xenbus.hh>
 #include <lixs/xenstore.hh>
+#include <lixs/xs_proto_v1/trace.hh>
 
 #include <csignal>
 #include <cstdio>
+#include <cstring>
 #include <fcntl.h>
 #include <memory>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <unistd.h>
+#include <vector>
 
 
 using lixs::log::level;
@@ -58,6 +72,7 @@ using lixs::log::LOG;
 
 static lixs::log::logger* log_ptr = NULL;
 static lixs::event_mgr* emgr_ptr = NULL;
+static lixs::xs_proto_v1::trace_writer* trace_ptr = NULL;
 
 static void signal_handler(int sig)
 {
@@ -67,12 +82,29 @@ static void signal_handler(int sig)
     }
 }
 
-static void setup_signal_handler(lixs::event_mgr& emgr, lixs::log::logger& log)
+static void fatal_signal_handler(int sig)
+{
+    /* The requests leading to a crash are the ones worth having in the trace. */
+    trace_ptr->flush();
+
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+static void setup_signal_handler(lixs::event_mgr& emgr, lixs::log::logger& log,
+        lixs::xs_proto_v1::trace_writer& trace)
 {
     emgr_ptr = &emgr;
     log_ptr = &log;
+    trace_ptr = &trace;
 
     signal(SIGINT, signal_handler);
+
+    if (trace.enabled()) {
+        for (int sig : { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT }) {
+            signal(sig, fatal_signal_handler);
+        }
+    }
 }
 
 static int daemonize(void)
@@ -123,6 +155,23 @@ static int remove_pid_file(const std::string& pid_file)
     return ret;
 }
 
+static void raise_fd_limit(lixs::log::logger& log)
+{
+    struct rlimit rlim;
+
+    /* Each unix socket client takes a file descriptor. Allow as many as the hard limit permits
+     * so that hosts with many guests and toolstack connections don't hit the soft limit.
+     */
+    if (getrlimit(RLIMIT_NOFILE, &rlim) == 0 && rlim.rlim_cur < rlim.rlim_max) {
+        rlim.rlim_cur = rlim.rlim_max;
+
+        if (setrlimit(RLIMIT_NOFILE, &rlim) != 0) {
+            LOG<level::WARN>::logf(log, "Failed to raise file descriptor limit: %s",
+                    std::strerror(errno));
+        }
+    }
+}
+
 int main(int argc, char** argv)
 {
     app::lixs_conf conf(argc, argv);
@@ -173,14 +222,129 @@ int main(int argc, char** argv)
     }
 
 
+    lixs::event_mgr emgr;
+    std::unique_ptr<lixs::xs_proto_v1::trace_writer> trace;
+
+    try {
+        if (conf.trace) {
+            trace = std::unique_ptr<lixs::xs_proto_v1::trace_writer>(
+                    new lixs::xs_proto_v1::trace_writer(conf.trace_file, emgr));
+        } else {
+            trace = std::unique_ptr<lixs::xs_proto_v1::trace_writer>(
+                    new lixs::xs_proto_v1::trace_writer());
+        }
+    } catch (lixs::xs_proto_v1::trace_error& e) {
+        LOG<level::ERROR>::logf(*log, "Failed to enable tracing: %s", e.what());
+        return -1;
+    }
+
+
     LOG<level::INFO>::logf(*log, "Starting server...");
 
-    lixs::event_mgr emgr;
-    lixs::os_linux::epoll epoll(emgr);
+    raise_fd_limit(*log);
+
+    std::unique_ptr<lixs::iomux> io;
+
+    try {
+        io = std::unique_ptr<lixs::iomux>(lixs::os_linux::new_iomux(conf.iomux, emgr));
+    } catch (lixs::os_linux::io_uring_error& e) {
+        LOG<level::ERROR>::logf(*log, "Failed to set up io_uring: %s", e.what());
+        return -1;
+    }
+
+    lixs::os_linux::xen_hypervisor hv;
+    lixs::mstore::read_view view;
     lixs::mstore::store store(*log);
-    lixs::xenstore xs(store, emgr, epoll);
 
-    lixs::domain_mgr dmgr(xs, emgr, epoll, *log);
+    /* Entries are restored before anything is created in the store. */
+    std::unique_ptr<lixs::os_linux::timer> wal_timer;
+    std::unique_ptr<lixs::mstore::wal> wal;
+
+    if (conf.wal) {
+        int ret;
+
+        try {
+            wal_timer = std::unique_ptr<lixs::os_linux::timer>(new lixs::os_linux::timer(*io));
+            wal = std::unique_ptr<lixs::mstore::wal>(new lixs::mstore::wal(conf.wal_file,
+                        conf.wal_sync_interval, emgr, *wal_timer, *log));
+        } catch (lixs::os_linux::timer_error& e) {
+            LOG<level::ERROR>::logf(*log, "Failed to enable the write-ahead log: %s", e.what());
+            return -1;
+        } catch (lixs::mstore::wal_error& e) {
+            LOG<level::ERROR>::logf(*log, "Failed to enable the write-ahead log: %s", e.what());
+            return -1;
+        }
+
+        ret = store.enable_wal(*wal);
+        if (ret) {
+            LOG<level::ERROR>::logf(*log, "Failed to restore the store from %s: %s",
+                    conf.wal_file.c_str(), std::strerror(ret));
+            return -1;
+        }
+    }
+
+    lixs::xenstore xs(store, emgr, *io);
+
+    if (conf.wal) {
+        xs.set_commit_log(wal.get());
+    }
+
+    /* Must outlive every connection, domains included. */
+    std::unique_ptr<lixs::scheduler> sched;
+
+    if (conf.sched_budget > 0) {
+        sched = std::unique_ptr<lixs::scheduler>(new lixs::scheduler(emgr, conf.sched_budget));
+        sched->set_weight(lixs::sched_class::dom0, conf.sched_dom0_weight);
+        xs.set_scheduler(sched.get());
+    }
+
+    /* Same as the scheduler. */
+    std::unique_ptr<lixs::os_linux::timer> rate_timer;
+    std::unique_ptr<lixs::rate_limiter> limiter;
+    if (conf.rate_limit > 0) {
+        try {
+            rate_timer = std::unique_ptr<lixs::os_linux::timer>(new lixs::os_linux::timer(*io));
+        } catch (lixs::os_linux::timer_error& e) {
+            LOG<level::ERROR>::logf(*log, "Failed to enable rate limiting: %s", e.what());
+            return -1;
+        }
+
+        limiter = std::unique_ptr<lixs::rate_limiter>(
+                new lixs::rate_limiter(*rate_timer, conf.rate_limit, conf.rate_burst));
+        xs.set_rate_limiter(limiter.get());
+    }
+
+    xs.set_quota(conf.quota_nodes, conf.quota_bytes, conf.quota_watches);
+
+    lixs::domain_mgr dmgr(xs, emgr, *io, hv, *trace, *log);
+
+    /* Requests are handled by this thread, which owns the store. I/O threads take over reading
+     * and writing unix socket clients, and serve their plain reads from a view of the store.
+     */
+    std::unique_ptr<lixs::os_linux::mailbox> mbox;
+    std::unique_ptr<lixs::reactor_pool> reactors;
+    std::vector<std::unique_ptr<lixs::os_linux::io_thread> > io_threads;
+
+    try {
+        mbox = std::unique_ptr<lixs::os_linux::mailbox>(new lixs::os_linux::mailbox(*io));
+        reactors = std::unique_ptr<lixs::reactor_pool>(new lixs::reactor_pool(*mbox,
+                    conf.io_threads > 0 ? &view : NULL));
+
+        if (conf.io_threads > 0) {
+            store.enable_view(view);
+        }
+
+        for (unsigned int i = 0; i < conf.io_threads; i++) {
+            io_threads.emplace_back(new lixs::os_linux::io_thread(conf.iomux));
+            reactors->add(*io_threads.back());
+        }
+    } catch (lixs::os_linux::mailbox_error& e) {
+        LOG<level::ERROR>::logf(*log, "Failed to start I/O threads: %s", e.what());
+        return -1;
+    } catch (lixs::os_linux::io_uring_error& e) {
+        LOG<level::ERROR>::logf(*log, "Failed to start I/O threads: %s", e.what());
+        return -1;
+    }
 
     std::unique_ptr<lixs::unix_sock_server> nix;
     std::unique_ptr<lixs::xenbus> xenbus;
@@ -189,7 +353,7 @@ int main(int argc, char** argv)
     if (conf.unix_sockets) {
         try {
             nix = std::unique_ptr<lixs::unix_sock_server>(
-                    new lixs::unix_sock_server(xs, dmgr, emgr, epoll, *log,
+                    new lixs::unix_sock_server(xs, dmgr, emgr, *io, *reactors, *trace, *log,
                         conf.unix_socket_path, conf.unix_socket_ro_path));
         } catch (lixs::unix_sock_server_error& e) {
             LOG<level::ERROR>::logf(*log, "Failed to enable unix sockets: %s", e.what());
@@ -200,7 +364,7 @@ int main(int argc, char** argv)
     if (conf.xenbus) {
         try {
             xenbus = std::unique_ptr<lixs::xenbus>(
-                    new lixs::xenbus(xs, dmgr, emgr, epoll, *log));
+                    new lixs::xenbus(xs, dmgr, emgr, *io, hv, *trace, *log));
         } catch (lixs::xenbus_error& e) {
             LOG<level::ERROR>::logf(*log, "Failed to enable xenbus: %s", e.what());
             return -1;
@@ -210,7 +374,7 @@ int main(int argc, char** argv)
     if (conf.virq_dom_exc) {
         try {
             dom_exc = std::unique_ptr<lixs::os_linux::dom_exc>(
-                    new lixs::os_linux::dom_exc(xs, dmgr, epoll));
+                    new lixs::os_linux::dom_exc(xs, dmgr, emgr, *io, hv));
         } catch (lixs::os_linux::dom_exc_error& e) {
             LOG<level::ERROR>::logf(*log, "Failed to enable DOM_EXC handler: %s", e.what());
             return -1;
@@ -219,7 +383,7 @@ int main(int argc, char** argv)
 
     emgr.enable();
 
-    setup_signal_handler(emgr, *log);
+    setup_signal_handler(emgr, *log, *trace);
 
     emgr.run();
 
@@ -38,6 +38,7 @@
 
 #include <lixs/log/logger.hh>
 
+#include <cstdlib>
 #include <getopt.h>
 #include <string>
 
@@ -58,6 +59,22 @@ app::lixs_conf::lixs_conf(int argc, char** argv)
     unix_socket_path("/run/xenstored/socket"),
     unix_socket_ro_path("/run/xenstored/socket_ro"),
 
+    io_threads(0),
+    iomux(lixs::os_linux::iomux_type::epoll),
+
+    sched_budget(16),
+    sched_dom0_weight(4),
+    rate_limit(0),
+    rate_burst(64),
+    quota_nodes(1000),
+    quota_bytes(0),
+    quota_watches(128),
+
+    wal(false),
+    wal_sync_interval(100),
+
+    trace(false),
+
     error(false),
 
     cmd(argv[0])
@@ -79,6 +96,18 @@ app::lixs_conf::lixs_conf(int argc, char** argv)
         { "unix-sockets"       , no_argument       , NULL , 'u' },
         { "socket-path"        , required_argument , NULL , 's' },
         { "socket_ro-path"     , required_argument , NULL , 'r' },
+        { "io-threads"         , required_argument , NULL , 'T' },
+        { "iomux"              , required_argument , NULL , 'M' },
+        { "sched-budget"       , required_argument , NULL , 'B' },
+        { "sched-dom0-weight"  , required_argument , NULL , 'W' },
+        { "rate-limit"         , required_argument , NULL , 'R' },
+        { "rate-burst"         , required_argument , NULL , 'S' },
+        { "quota-nodes"        , required_argument , NULL , 'N' },
+        { "quota-bytes"        , required_argument , NULL , 'Y' },
+        { "quota-watches"      , required_argument , NULL , 'V' },
+        { "wal-file"           , required_argument , NULL , 'J' },
+        { "wal-sync"           , required_argument , NULL , 'F' },
+        { "trace-file"         , required_argument , NULL , 't' },
         { NULL , 0 , NULL , 0 }
     };
 
@@ -159,6 +188,157 @@ app::lixs_conf::lixs_conf(int argc, char** argv)
                 unix_socket_ro_path = std::string(optarg);
                 break;
 
+            case 'T':
+                {
+                    char* end;
+                    long int val = strtol(optarg, &end, 10);
+
+                    if (*optarg == '\0' || *end != '\0' || val < 0 || val > io_threads_max) {
+                        printf("Invalid number of I/O threads %s\n", optarg);
+                        error = true;
+                    } else {
+                        io_threads = val;
+                    }
+                }
+                break;
+
+            case 'M':
+                optarg_str = std::string(optarg);
+
+                if (optarg_str == "epoll") {
+                    iomux = lixs::os_linux::iomux_type::epoll;
+                } else if (optarg_str == "epoll_et") {
+                    iomux = lixs::os_linux::iomux_type::epoll_et;
+                } else if (optarg_str == "io_uring") {
+                    iomux = lixs::os_linux::iomux_type::io_uring;
+                } else {
+                    printf("Invalid I/O multiplexer %s\n", optarg);
+                    error = true;
+                }
+                break;
+
+            case 'B':
+                {
+                    char* end;
+                    long int val = strtol(optarg, &end, 10);
+
+                    if (*optarg == '\0' || *end != '\0' || val < 0 || val > sched_max) {
+                        printf("Invalid scheduling budget %s\n", optarg);
+                        error = true;
+                    } else {
+                        sched_budget = val;
+                    }
+                }
+                break;
+
+            case 'W':
+                {
+                    char* end;
+                    long int val = strtol(optarg, &end, 10);
+
+                    if (*optarg == '\0' || *end != '\0' || val < 1 || val > sched_max) {
+                        printf("Invalid dom0 scheduling weight %s\n", optarg);
+                        error = true;
+                    } else {
+                        sched_dom0_weight = val;
+                    }
+                }
+                break;
+
+            case 'R':
+                {
+                    char* end;
+                    long int val = strtol(optarg, &end, 10);
+
+                    if (*optarg == '\0' || *end != '\0' || val < 0 || val > rate_max) {
+                        printf("Invalid rate limit %s\n", optarg);
+                        error = true;
+                    } else {
+                        rate_limit = val;
+                    }
+                }
+                break;
+
+            case 'S':
+                {
+                    char* end;
+                    long int val = strtol(optarg, &end, 10);
+
+                    if (*optarg == '\0' || *end != '\0' || val < 1 || val > rate_max) {
+                        printf("Invalid rate burst %s\n", optarg);
+                        error = true;
+                    } else {
+                        rate_burst = val;
+                    }
+                }
+                break;
+
+            case 'N':
+                {
+                    char* end;
+                    long int val = strtol(optarg, &end, 10);
+
+                    if (*optarg == '\0' || *end != '\0' || val < 0) {
+                        printf("Invalid node quota %s\n", optarg);
+                        error = true;
+                    } else {
+                        quota_nodes = val;
+                    }
+                }
+                break;
+
+            case 'Y':
+                {
+                    char* end;
+                    long int val = strtol(optarg, &end, 10);
+
+                    if (*optarg == '\0' || *end != '\0' || val < 0) {
+                        printf("Invalid byte quota %s\n", optarg);
+                        error = true;
+                    } else {
+                        quota_bytes = val;
+                    }
+                }
+                break;
+
+            case 'V':
+                {
+                    char* end;
+                    long int val = strtol(optarg, &end, 10);
+
+                    if (*optarg == '\0' || *end != '\0' || val < 0) {
+                        printf("Invalid watch quota %s\n", optarg);
+                        error = true;
+                    } else {
+                        quota_watches = val;
+                    }
+                }
+                break;
+
+            case 'J':
+                wal = true;
+                wal_file = std::string(optarg);
+                break;
+
+            case 'F':
+                {
+                    char* end;
+                    long int val = strtol(optarg, &end, 10);
+
+                    if (*optarg == '\0' || *end != '\0' || val < 0 || val > wal_sync_max) {
+                        printf("Invalid log sync interval %s\n", optarg);
+                        error = true;
+                    } else {
+                        wal_sync_interval = val;
+                    }
+                }
+                break;
+
+            case 't':
+                trace = true;
+                trace_file = std::string(optarg);
+                break;
+
             default:
                 error = true;
                 break;
@@ -198,5 +378,52 @@ void app::lixs_conf::print_usage() {
            "                         Read/write socket path. Default: /run/xenstored/socket.\n");
     printf("      --socket_ro-path <file>\n"
            "                         Read-only socket path. Default: /run/xenstored/socket_ro.\n");
+    printf("      --io-threads <n>   Service unix socket clients from n I/O threads. Plain\n"
+           "                         reads are served concurrently by the I/O threads, other\n"
+           "                         requests are processed one at a time by the main thread.\n"
+           "                         Default: 0, everything runs on the main thread.\n");
+    printf("      --iomux <type>     I/O multiplexer, one of [ epoll, epoll_et, io_uring ].\n"
+           "                         epoll_et is edge triggered, changing interest in an fd\n"
+           "                         costs no system call. With io_uring unix sockets are\n"
+           "                         served on completions. Default: epoll.\n");
+    printf("\n");
+    printf("Scheduling:\n");
+    printf("      --sched-budget <n> Requests a connection handles before giving the others a\n"
+           "                         turn. 0 lets each connection handle everything it has\n"
+           "                         queued. Clients of I/O threads are not scheduled.\n"
+           "                         Default: 16.\n");
+    printf("      --sched-dom0-weight <n>\n"
+           "                         Budget multiplier for dom0 connections, which are also\n"
+           "                         served first on every round. Default: 4.\n");
+    printf("\n");
+    printf("Limits:\n");
+    printf("      --rate-limit <n>   Requests per second each guest can make, further requests\n"
+           "                         wait in the guest's ring. 0 disables rate limiting.\n"
+           "                         Default: 0.\n");
+    printf("      --rate-burst <n>   Requests a guest can make at once after being idle.\n"
+           "                         Default: 64.\n");
+    printf("      --quota-nodes <n>  Entries each domain other than dom0 can own. Requests from\n"
+           "                         guests going over quota fail with ENOSPC. 0 means no\n"
+           "                         limit. Default: 1000.\n");
+    printf("      --quota-bytes <n>  Bytes of paths and values each domain other than dom0 can\n"
+           "                         own. 0 means no limit. Default: 0.\n");
+    printf("      --quota-watches <n>\n"
+           "                         Watches each domain other than dom0 can register. 0 means\n"
+           "                         no limit. Default: 128.\n");
+    printf("\n");
+    printf("Persistence:\n");
+    printf("      --wal-file <file>  Log every change to the store to file, and restore the\n"
+           "                         store from it on start up. Disabled by default, the store\n"
+           "                         is then lost on exit.\n");
+    printf("      --wal-sync <ms>    Sync the log to disk at most once every ms milliseconds,\n"
+           "                         changes made since the last sync are lost if the host\n"
+           "                         crashes. 0 syncs once per batch of requests and replies\n"
+           "                         only once the batch is synced, so acknowledged changes\n"
+           "                         are never lost. Default: 100.\n");
+    printf("\n");
+    printf("Debugging:\n");
+    printf("      --trace-file <file>\n"
+           "                         Capture every request received to file, to be replayed\n"
+           "                         with xs-replay.\n");
 }
 
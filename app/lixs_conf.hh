@@ -38,12 +38,22 @@
 #define __LIXS_CONF_HH__
 
 #include <lixs/log/logger.hh>
+#include <lixs/os_linux/io_thread.hh>
 
 #include <string>
 
 
 namespace app {
 
+/* Upper bound for --io-threads */
+const long int io_threads_max = 64;
+/* Upper bound for --sched-budget and --sched-dom0-weight */
+const long int sched_max = 65536;
+/* Upper bound for --rate-limit and --rate-burst */
+const long int rate_max = 1000000;
+/* Upper bound for --wal-sync, in milliseconds */
+const long int wal_sync_max = 60000;
+
 struct lixs_conf {
 public:
     lixs_conf(int argc, char** argv);
@@ -67,6 +77,25 @@ public:
     std::string unix_socket_path;
     std::string unix_socket_ro_path;
 
+    unsigned int io_threads;
+    lixs::os_linux::iomux_type iomux;
+
+    unsigned int sched_budget;
+    unsigned int sched_dom0_weight;
+
+    unsigned int rate_limit;
+    unsigned int rate_burst;
+    unsigned long int quota_nodes;
+    unsigned long int quota_bytes;
+    unsigned long int quota_watches;
+
+    bool wal;
+    std::string wal_file;
+    unsigned int wal_sync_interval;
+
+    bool trace;
+    std::string trace_file;
+
     bool error;
 
 private:
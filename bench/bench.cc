@@ -0,0 +1,112 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <bench.hh>
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace bench {
+
+registry& get_registry(void)
+{
+    /* Benchmarks register from static initializers, make sure the registry exists by then. */
+    static registry benchmarks;
+
+    return benchmarks;
+}
+
+registrar::registrar(const char* name, benchmark_fn fn)
+{
+    get_registry().push_back({name, fn});
+}
+
+
+timer::timer(void)
+    : begin(std::chrono::steady_clock::now())
+{
+}
+
+void timer::start(void)
+{
+    begin = std::chrono::steady_clock::now();
+}
+
+unsigned long long int timer::elapsed_ns(void)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - begin).count();
+}
+
+
+context::context(double scale)
+    : scale(scale)
+{
+}
+
+unsigned long int context::scaled(unsigned long int n)
+{
+    unsigned long int s = n * scale;
+
+    return s > 0 ? s : 1;
+}
+
+void context::report(const std::string& name, const fields& params,
+        unsigned long long int ops, unsigned long long int ns, const fields& counters)
+{
+    printf("{\"bench\":\"%s\"", name.c_str());
+
+    for (auto& p : params) {
+        printf(",\"%s\":%lld", p.first.c_str(), p.second);
+    }
+
+    printf(",\"ops\":%llu,\"ns\":%llu,\"ns_per_op\":%.2f",
+            ops, ns, ops > 0 ? static_cast<double>(ns) / ops : 0.0);
+
+    for (auto& c : counters) {
+        printf(",\"%s\":%lld", c.first.c_str(), c.second);
+    }
+
+    printf("}\n");
+    fflush(stdout);
+}
+
+} /* namespace bench */
+
@@ -0,0 +1,105 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#ifndef __BENCH_BENCH_HH__
+#define __BENCH_BENCH_HH__
+
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace bench {
+
+/* Named integer values, used both for benchmark parameters and extra result counters. */
+typedef std::vector<std::pair<std::string, long long int> > fields;
+
+
+class timer {
+public:
+    timer(void);
+
+public:
+    void start(void);
+    unsigned long long int elapsed_ns(void);
+
+private:
+    std::chrono::steady_clock::time_point begin;
+};
+
+
+class context {
+public:
+    context(double scale);
+
+public:
+    /* Scale an iteration count by the factor given on the command line. */
+    unsigned long int scaled(unsigned long int n);
+
+    /* Print one result as a single line JSON object:
+     *
+     *   {"bench":"<name>",<params>,"ops":<ops>,"ns":<ns>,"ns_per_op":<ns/ops>,<counters>}
+     */
+    void report(const std::string& name, const fields& params,
+            unsigned long long int ops, unsigned long long int ns,
+            const fields& counters = fields());
+
+private:
+    double scale;
+};
+
+
+typedef void (*benchmark_fn)(context& ctx);
+typedef std::vector<std::pair<std::string, benchmark_fn> > registry;
+
+registry& get_registry(void);
+
+class registrar {
+public:
+    registrar(const char* name, benchmark_fn fn);
+};
+
+} /* namespace bench */
+
+
+#define BENCHMARK(name, fn) \
+    static void fn(bench::context& ctx); \
+    static bench::registrar fn ## _registrar(name, fn); \
+    static void fn(bench::context& ctx)
+
+#endif /* __BENCH_BENCH_HH__ */
+
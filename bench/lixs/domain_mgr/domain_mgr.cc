@@ -0,0 +1,234 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <bench.hh>
+
+#include <lixs/domain_mgr.hh>
+#include <lixs/event_mgr.hh>
+#include <lixs/iomux.hh>
+#include <lixs/log/logger.hh>
+#include <lixs/mstore/store.hh>
+#include <lixs/os_linux/dom_exc.hh>
+#include <lixs/os_linux/fake_hypervisor.hh>
+#include <lixs/permissions.hh>
+#include <lixs/xenstore.hh>
+#include <lixs/xs_proto_v1/trace.hh>
+
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+
+/* The event channels are never polled, domain exceptions are delivered by calling the handler
+ * directly after changing the domain state, once per VIRQ the hypervisor would raise.
+ */
+class null_iomux : public lixs::iomux {
+public:
+    null_iomux(lixs::event_mgr& emgr)
+        : iomux(emgr)
+    { }
+
+public:
+    void add(int fd, bool read, bool write, lixs::io_cb cb) { }
+    void set(int fd, bool read, bool write) { }
+    void rem(int fd) { }
+};
+
+struct guest {
+    domid_t domid;
+    evtchn_port_t port;
+    unsigned int mfn;
+};
+
+/* Each connected domain holds an event channel file descriptor. */
+static void raise_fd_limit(void)
+{
+    struct rlimit rlim;
+
+    if (getrlimit(RLIMIT_NOFILE, &rlim) == 0 && rlim.rlim_cur < rlim.rlim_max) {
+        rlim.rlim_cur = rlim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rlim);
+    }
+}
+
+static void create_guests(lixs::os_linux::fake_hypervisor& hv, int domains,
+        std::vector<guest>& guests)
+{
+    guest g;
+
+    for (int d = 1; d <= domains; d++) {
+        g.domid = d;
+        if (hv.create_domain(g.domid, g.port, g.mfn) == 0) {
+            guests.push_back(g);
+        }
+    }
+}
+
+/* Frontend entries as written for a guest with one disk and one network interface, owned by the
+ * guest and therefore removed when it's destroyed.
+ */
+static const char* guest_entries[] = {
+    "device/vbd/51712/state", "device/vbd/51712/ring-ref", "device/vbd/51712/event-channel",
+    "device/vif/0/state", "device/vif/0/tx-ring-ref", "device/vif/0/rx-ring-ref",
+    "device/vif/0/event-channel", "control/shutdown", "data/updated",
+};
+
+static void populate_guests(lixs::mstore::store& store, const std::vector<guest>& guests)
+{
+    std::string path;
+
+    for (auto& g : guests) {
+        path = "/local/domain/" + std::to_string(g.domid);
+
+        store.update(0, 0, path + "/name", "guest");
+
+        for (auto& e : { "device", "control", "data" }) {
+            store.update(0, 0, path + "/" + e, "");
+            store.set_perms(0, 0, path + "/" + e, { lixs::permission(g.domid, false, false) });
+        }
+
+        for (auto& e : guest_entries) {
+            store.update(0, 0, path + "/" + e, "value");
+        }
+    }
+}
+
+static unsigned long int introduce_guests(lixs::xenstore& xs, lixs::domain_mgr& dmgr,
+        const std::vector<guest>& guests)
+{
+    unsigned long int failed = 0;
+
+    for (auto& g : guests) {
+        if (dmgr.create(g.domid, g.port, g.mfn) == 0) {
+            xs.domain_introduce(g.domid);
+        } else {
+            failed++;
+        }
+    }
+
+    return failed;
+}
+
+
+BENCHMARK("domain_mgr/introduce_release", introduce_release) {
+    raise_fd_limit();
+
+    for (int domains : { 1000, 10000 }) {
+        unsigned long int failed;
+        unsigned long int queries;
+        unsigned long long int ns;
+        std::vector<guest> guests;
+        bench::timer t;
+
+        lixs::log::logger log(lixs::log::level::OFF);
+        lixs::event_mgr emgr;
+        null_iomux io(emgr);
+        lixs::os_linux::fake_hypervisor hv;
+        lixs::mstore::store store(log);
+        lixs::xenstore xs(store, emgr, io);
+        lixs::xs_proto_v1::trace_writer trace;
+        lixs::domain_mgr dmgr(xs, emgr, io, hv, trace, log);
+        lixs::os_linux::dom_exc dom_exc(xs, dmgr, emgr, io, hv);
+
+        emgr.enable();
+
+        create_guests(hv, domains, guests);
+        populate_guests(store, guests);
+
+        t.start();
+        failed = introduce_guests(xs, dmgr, guests);
+        ns = t.elapsed_ns();
+
+        ctx.report("domain_mgr/introduce", {{"domains", domains}}, guests.size(), ns,
+                {{"failed", failed}});
+
+        /* All domains go away in a burst, before the event loop gets to run. */
+        queries = hv.domain_queries();
+
+        t.start();
+        for (auto& g : guests) {
+            hv.destroy_domain(g.domid);
+            dom_exc.callback(true, false, false);
+        }
+        emgr.run();
+        ns = t.elapsed_ns();
+
+        ctx.report("domain_mgr/release_all", {{"domains", domains}}, guests.size(), ns,
+                {{"queries", hv.domain_queries() - queries}});
+    }
+}
+
+BENCHMARK("domain_mgr/release_each", release_each) {
+    raise_fd_limit();
+
+    for (int domains : { 1000, 10000 }) {
+        unsigned long int queries;
+        unsigned long long int ns;
+        std::vector<guest> guests;
+        bench::timer t;
+
+        lixs::log::logger log(lixs::log::level::OFF);
+        lixs::event_mgr emgr;
+        null_iomux io(emgr);
+        lixs::os_linux::fake_hypervisor hv;
+        lixs::mstore::store store(log);
+        lixs::xenstore xs(store, emgr, io);
+        lixs::xs_proto_v1::trace_writer trace;
+        lixs::domain_mgr dmgr(xs, emgr, io, hv, trace, log);
+        lixs::os_linux::dom_exc dom_exc(xs, dmgr, emgr, io, hv);
+
+        emgr.enable();
+
+        create_guests(hv, domains, guests);
+        populate_guests(store, guests);
+        introduce_guests(xs, dmgr, guests);
+
+        /* Domains go away one by one, the event loop running after each one. */
+        queries = hv.domain_queries();
+
+        t.start();
+        for (auto& g : guests) {
+            hv.destroy_domain(g.domid);
+            dom_exc.callback(true, false, false);
+            emgr.run();
+        }
+        ns = t.elapsed_ns();
+
+        ctx.report("domain_mgr/release_each", {{"domains", domains}}, guests.size(), ns,
+                {{"queries", hv.domain_queries() - queries}});
+    }
+}
+
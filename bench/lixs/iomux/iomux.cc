@@ -0,0 +1,76 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <bench.hh>
+
+#include <lixs/event_mgr.hh>
+#include <lixs/os_linux/epoll.hh>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+/* Interest flipped as a connection does around every message it reads. */
+BENCHMARK("iomux/set_interest", set_interest) {
+    for (bool edge : { false, true }) {
+        unsigned long int ops;
+        int sv[2];
+        bench::timer t;
+
+        lixs::event_mgr emgr;
+        lixs::os_linux::epoll io(emgr, edge);
+
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == -1) {
+            return;
+        }
+
+        io.add(sv[0], false, false, [] (bool read, bool write, bool error) { });
+
+        ops = ctx.scaled(200000);
+
+        t.start();
+        for (unsigned long int i = 0; i < ops; i++) {
+            io.set(sv[0], true, false);
+            io.set(sv[0], false, false);
+        }
+
+        ctx.report("iomux/set_interest", {{"edge", edge ? 1 : 0}}, ops, t.elapsed_ns(), {});
+
+        io.rem(sv[0]);
+        close(sv[0]);
+        close(sv[1]);
+    }
+}
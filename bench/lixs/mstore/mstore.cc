@@ -0,0 +1,530 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <bench.hh>
+
+#include <lixs/log/logger.hh>
+#include <lixs/mstore/read_view.hh>
+#include <lixs/mstore/sharded_store.hh>
+#include <lixs/mstore/store.hh>
+
+#include <atomic>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+/* Entries written by the toolstack and the frontend/backend drivers for a typical PV guest with
+ * one disk and one network interface, relative to /local/domain/<id> and to the backend domain.
+ */
+static const char* domain_entries[] = {
+    "name", "domid", "vm", "memory/target", "memory/static-max", "memory/videoram",
+    "cpu/0/availability", "cpu/1/availability", "control/shutdown",
+    "control/platform-feature-multiprocessor-suspend", "data", "drivers",
+    "console/ring-ref", "console/port", "console/limit", "console/type",
+    "device/vbd/51712/backend", "device/vbd/51712/backend-id", "device/vbd/51712/state",
+    "device/vbd/51712/virtual-device", "device/vbd/51712/device-type",
+    "device/vbd/51712/ring-ref", "device/vbd/51712/event-channel", "device/vbd/51712/protocol",
+    "device/vif/0/backend", "device/vif/0/backend-id", "device/vif/0/state",
+    "device/vif/0/handle", "device/vif/0/mac", "device/vif/0/tx-ring-ref",
+    "device/vif/0/rx-ring-ref", "device/vif/0/event-channel", "device/vif/0/request-rx-copy",
+    "device/vif/0/feature-rx-notify", "device/vif/0/feature-sg",
+};
+
+static const char* backend_entries[] = {
+    "vbd/%d/51712/frontend", "vbd/%d/51712/frontend-id", "vbd/%d/51712/online",
+    "vbd/%d/51712/state", "vbd/%d/51712/params", "vbd/%d/51712/mode",
+    "vbd/%d/51712/sectors", "vbd/%d/51712/sector-size", "vbd/%d/51712/feature-barrier",
+    "vif/%d/0/frontend", "vif/%d/0/frontend-id", "vif/%d/0/online", "vif/%d/0/state",
+    "vif/%d/0/script", "vif/%d/0/mac", "vif/%d/0/handle", "vif/%d/0/feature-sg",
+};
+
+static void domain_paths(int domid, std::vector<std::string>& paths)
+{
+    char buff[128];
+    std::string dom_path = "/local/domain/" + std::to_string(domid) + "/";
+
+    for (auto& e : domain_entries) {
+        paths.push_back(dom_path + e);
+    }
+
+    for (auto& e : backend_entries) {
+        snprintf(buff, sizeof(buff), e, domid);
+        paths.push_back(std::string("/local/domain/0/backend/") + buff);
+    }
+}
+
+static void populate(lixs::store& store, const std::vector<std::string>& paths)
+{
+    for (auto& p : paths) {
+        store.update(0, 0, p, "value");
+    }
+}
+
+
+BENCHMARK("mstore/create_domains", create_domains) {
+    lixs::log::logger log(lixs::log::level::OFF);
+
+    for (int domains : { 16, 256, 1024 }) {
+        unsigned long int reps;
+        unsigned long long int ns;
+        std::vector<std::string> paths;
+        bench::timer t;
+
+        for (int d = 1; d <= domains; d++) {
+            domain_paths(d, paths);
+        }
+
+        reps = ctx.scaled(4096 / domains);
+
+        ns = 0;
+        for (unsigned long int r = 0; r < reps; r++) {
+            lixs::mstore::store store(log);
+
+            t.start();
+            populate(store, paths);
+            ns += t.elapsed_ns();
+        }
+
+        ctx.report("mstore/create_domains", {{"domains", domains}}, reps * paths.size(), ns);
+    }
+}
+
+/* Same domain layout as create_domains, but each domain is cloned from a template domain
+ * instead of being written entry by entry. Only the domain's own directory is cloned, backend
+ * entries live elsewhere.
+ */
+BENCHMARK("mstore/clone_domains", clone_domains) {
+    lixs::log::logger log(lixs::log::level::OFF);
+    std::vector<std::string> tmpl;
+
+    for (auto& e : domain_entries) {
+        tmpl.push_back(std::string("/template/") + e);
+    }
+
+    for (int domains : { 16, 256, 1024 }) {
+        unsigned long int reps;
+        unsigned long long int ns;
+        bench::timer t;
+
+        reps = ctx.scaled(4096 / domains);
+
+        ns = 0;
+        for (unsigned long int r = 0; r < reps; r++) {
+            lixs::mstore::store store(log);
+
+            populate(store, tmpl);
+
+            t.start();
+            for (int d = 1; d <= domains; d++) {
+                store.clone(0, 0, "/template", "/local/domain/" + std::to_string(d), 0, d);
+            }
+            ns += t.elapsed_ns();
+        }
+
+        ctx.report("mstore/clone_domains", {{"domains", domains}},
+                reps * domains * tmpl.size(), ns);
+    }
+}
+
+BENCHMARK("mstore/read", read) {
+    int ret;
+    unsigned long int ops;
+    unsigned long int sum;
+    std::string val;
+    std::vector<std::string> paths;
+    bench::timer t;
+
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::mstore::store store(log);
+
+    for (int d = 1; d <= 256; d++) {
+        domain_paths(d, paths);
+    }
+    populate(store, paths);
+
+    ops = ctx.scaled(1000000);
+
+    /* Use a fixed stride over the keys so that the access pattern doesn't follow the key order
+     * and no time is spent generating random numbers.
+     */
+    sum = 0;
+    t.start();
+    for (unsigned long int i = 0; i < ops; i++) {
+        ret = store.read(0, 0, paths[(i * 7919) % paths.size()], val);
+        sum += ret + val.length();
+    }
+
+    ctx.report("mstore/read", {{"keys", static_cast<long long int>(paths.size())}}, ops,
+            t.elapsed_ns(), {{"check", static_cast<long long int>(sum)}});
+}
+
+BENCHMARK("mstore/update", update) {
+    unsigned long int ops;
+    std::vector<std::string> paths;
+    bench::timer t;
+
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::mstore::store store(log);
+
+    for (int d = 1; d <= 256; d++) {
+        domain_paths(d, paths);
+    }
+    populate(store, paths);
+
+    ops = ctx.scaled(1000000);
+
+    t.start();
+    for (unsigned long int i = 0; i < ops; i++) {
+        store.update(0, 0, paths[(i * 7919) % paths.size()], (i & 1) ? "connected" : "closed");
+    }
+
+    ctx.report("mstore/update", {{"keys", static_cast<long long int>(paths.size())}}, ops,
+            t.elapsed_ns());
+}
+
+BENCHMARK("mstore/get_children", get_children) {
+    lixs::log::logger log(lixs::log::level::OFF);
+
+    for (int width : { 16, 1024, 16384 }) {
+        unsigned long int ops;
+        unsigned long int sum;
+        std::set<std::string> children;
+        bench::timer t;
+
+        lixs::mstore::store store(log);
+
+        for (int i = 0; i < width; i++) {
+            store.update(0, 0, "/wide/" + std::to_string(i), "");
+        }
+
+        ops = ctx.scaled(16 * 1024 * 1024 / width / 16);
+
+        sum = 0;
+        t.start();
+        for (unsigned long int i = 0; i < ops; i++) {
+            store.get_children(0, 0, "/wide", children);
+            sum += children.size();
+        }
+
+        ctx.report("mstore/get_children", {{"width", width}}, ops, t.elapsed_ns(),
+                {{"children", static_cast<long long int>(sum)}});
+
+        /* Same listing, visiting the names in place instead of copying them into a set. */
+        sum = 0;
+        t.start();
+        for (unsigned long int i = 0; i < ops; i++) {
+            store.get_children(0, 0, "/wide", [&sum] (const std::string& name) {
+                sum++;
+            });
+        }
+
+        ctx.report("mstore/get_children_cb", {{"width", width}}, ops, t.elapsed_ns(),
+                {{"children", static_cast<long long int>(sum)}});
+    }
+}
+
+static unsigned long int build_tree(lixs::mstore::store& store,
+        const std::string& path, int width, int depth)
+{
+    unsigned long int nodes = 1;
+
+    store.update(0, 0, path, "");
+
+    if (depth > 0) {
+        for (int i = 0; i < width; i++) {
+            nodes += build_tree(store, path + "/" + std::to_string(i), width, depth - 1);
+        }
+    }
+
+    return nodes;
+}
+
+BENCHMARK("mstore/del_subtree", del_subtree) {
+    lixs::log::logger log(lixs::log::level::OFF);
+
+    /* Deep chains and a bushy tree of comparable size. */
+    for (auto& shape : std::vector<std::pair<int, int> >{ {1, 16}, {1, 128}, {1, 512}, {4, 6} }) {
+        int width = shape.first;
+        int depth = shape.second;
+        unsigned long int reps;
+        unsigned long int nodes;
+        unsigned long long int ns;
+        bench::timer t;
+
+        lixs::mstore::store store(log);
+
+        reps = ctx.scaled(width == 1 ? 16384 / depth : 64);
+
+        ns = 0;
+        nodes = 0;
+        for (unsigned long int r = 0; r < reps; r++) {
+            nodes = build_tree(store, "/tree", width, depth);
+
+            t.start();
+            store.del(0, 0, "/tree");
+            ns += t.elapsed_ns();
+        }
+
+        ctx.report("mstore/del_subtree", {{"width", width}, {"depth", depth}}, reps, ns,
+                {{"nodes", static_cast<long long int>(nodes)}});
+    }
+}
+
+BENCHMARK("mstore/transaction", transaction) {
+    const int keys = 4096;
+
+    lixs::log::logger log(lixs::log::level::OFF);
+
+    for (int reads : { 1, 16 }) {
+        for (int writes : { 1, 16 }) {
+            for (int conflict_pct : { 0, 10, 50 }) {
+                bool success;
+                unsigned int tid;
+                unsigned long int ops;
+                unsigned long int commits;
+                unsigned long int aborts;
+                std::string val;
+                std::vector<std::string> paths;
+                std::mt19937 rng(42);
+                std::uniform_int_distribution<int> key_dist(0, keys - 1);
+                std::uniform_int_distribution<int> pct_dist(0, 99);
+                bench::timer t;
+
+                lixs::mstore::store store(log);
+
+                for (int i = 0; i < keys; i++) {
+                    paths.push_back("/tx/" + std::to_string(i));
+                }
+                populate(store, paths);
+
+                ops = ctx.scaled(100000 / (reads + writes));
+
+                commits = 0;
+                aborts = 0;
+                t.start();
+                for (unsigned long int i = 0; i < ops; i++) {
+                    int base = key_dist(rng);
+
+                    store.branch(tid);
+
+                    for (int r = 0; r < reads; r++) {
+                        store.read(0, tid, paths[(base + r) % keys], val);
+                    }
+
+                    for (int w = 0; w < writes; w++) {
+                        store.update(0, tid, paths[(base + reads + w) % keys], "value");
+                    }
+
+                    /* Simulate a concurrent writer touching the read set. */
+                    if (pct_dist(rng) < conflict_pct) {
+                        store.update(0, 0, paths[base], "conflict");
+                    }
+
+                    store.merge(tid, success);
+
+                    if (success) {
+                        commits++;
+                    } else {
+                        aborts++;
+                    }
+                }
+
+                ctx.report("mstore/transaction",
+                        {{"reads", reads}, {"writes", writes}, {"conflict_pct", conflict_pct}},
+                        ops, t.elapsed_ns(), {{"commits", static_cast<long long int>(commits)},
+                         {"aborts", static_cast<long long int>(aborts)}});
+            }
+        }
+    }
+}
+
+/* Read-modify-write of a single key, as done by backend state handshakes, with a transaction and
+ * with a conditional update.
+ */
+BENCHMARK("mstore/read_modify_write", read_modify_write) {
+    const int keys = 4096;
+
+    lixs::log::logger log(lixs::log::level::OFF);
+
+    for (bool cond : { false, true }) {
+        bool success;
+        unsigned int tid;
+        unsigned long int ops;
+        unsigned long int version;
+        std::string val;
+        std::vector<std::string> paths;
+        bench::timer t;
+
+        lixs::mstore::store store(log);
+
+        for (int i = 0; i < keys; i++) {
+            paths.push_back("/rmw/" + std::to_string(i) + "/state");
+        }
+        populate(store, paths);
+
+        ops = ctx.scaled(200000);
+
+        t.start();
+        for (unsigned long int i = 0; i < ops; i++) {
+            const std::string& path = paths[i % keys];
+
+            if (cond) {
+                store.read(0, 0, path, val, version);
+                store.update_if(0, 0, path, "state", version);
+            } else {
+                store.branch(tid);
+                store.read(0, tid, path, val);
+                store.update(0, tid, path, "state");
+                store.merge(tid, success);
+            }
+        }
+
+        ctx.report("mstore/read_modify_write", {{"conditional", cond}}, ops, t.elapsed_ns());
+    }
+}
+
+/* Reads of domain entries served from a read view by a number of reader threads, while the store
+ * thread keeps updating entries. With 0 threads reads go to the store, one at a time, as they do
+ * on the store thread. Throughput only scales as far as there are cores to run the readers.
+ */
+BENCHMARK("mstore/view_reads", view_reads) {
+    const int domains = 256;
+
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::mstore::read_view view;
+    lixs::mstore::store store(log);
+    std::vector<std::string> paths;
+
+    for (int d = 1; d <= domains; d++) {
+        domain_paths(d, paths);
+    }
+    populate(store, paths);
+    store.enable_view(view);
+
+    for (int threads : { 0, 1, 2, 4 }) {
+        unsigned long int ops;
+        unsigned long int writes;
+        std::atomic<int> running(threads);
+        std::vector<std::thread> readers;
+        std::string val;
+        bench::timer t;
+
+        ops = ctx.scaled(1000000);
+
+        t.start();
+        for (int i = 0; i < threads; i++) {
+            unsigned int reader = view.add_reader();
+
+            readers.emplace_back([&view, &paths, &running, reader, ops, threads, i] () {
+                std::string val;
+
+                for (unsigned long int n = i; n < ops; n += threads) {
+                    view.read(reader, 0, paths[(n * 7919) % paths.size()], val);
+                }
+                running--;
+            });
+        }
+
+        writes = 0;
+        if (threads == 0) {
+            for (unsigned long int n = 0; n < ops; n++) {
+                store.read(0, 0, paths[(n * 7919) % paths.size()], val);
+            }
+        } else {
+            while (running.load() > 0) {
+                store.update(0, 0, paths[(writes * 31) % paths.size()], "value");
+                writes++;
+            }
+        }
+
+        for (auto& r : readers) {
+            r.join();
+        }
+
+        ctx.report("mstore/view_reads", {{"threads", threads}}, ops, t.elapsed_ns(),
+                {{"writes", writes}});
+    }
+}
+
+/* Aggregate throughput of writers updating entries of their own domains, the guests' subtrees
+ * and their backends, concurrently. With a single shard writers are serialized as on a store
+ * behind a lock. Scaling with the number of writers requires as many cores.
+ */
+BENCHMARK("mstore/sharded_writes", sharded_writes) {
+    const int domains = 16;
+
+    for (unsigned int shards : { 1, 16 }) {
+        for (int threads : { 1, 4, 16 }) {
+            unsigned long int ops;
+            std::vector<std::thread> writers;
+            std::vector<std::vector<std::string>> paths(threads);
+            bench::timer t;
+
+            lixs::log::logger log(lixs::log::level::OFF);
+            lixs::mstore::sharded_store store(log, shards);
+
+            for (int d = 1; d <= domains; d++) {
+                domain_paths(d, paths[d % threads]);
+            }
+            for (auto& p : paths) {
+                populate(store, p);
+            }
+
+            ops = ctx.scaled(400000);
+
+            t.start();
+            for (int i = 0; i < threads; i++) {
+                writers.emplace_back([&store, &paths, ops, threads, i] () {
+                    const std::vector<std::string>& own = paths[i];
+
+                    for (unsigned long int n = 0; n < ops / threads; n++) {
+                        store.update(0, 0, own[(n * 7919) % own.size()], "value");
+                    }
+                });
+            }
+
+            for (auto& w : writers) {
+                w.join();
+            }
+
+            ctx.report("mstore/sharded_writes", {{"shards", shards}, {"threads", threads}},
+                    ops / threads * threads, t.elapsed_ns());
+        }
+    }
+}
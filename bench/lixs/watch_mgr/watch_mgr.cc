@@ -0,0 +1,123 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <bench.hh>
+
+#include <lixs/event_mgr.hh>
+#include <lixs/watch.hh>
+#include <lixs/watch_mgr.hh>
+
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+class count_watch : public lixs::watch_cb {
+public:
+    count_watch(const std::string& path, unsigned int depth, unsigned long int& events)
+        : watch_cb(path, "token", false, depth), events(events)
+    { }
+
+public:
+    void operator()(const std::string& path)
+    {
+        events++;
+    }
+
+    void operator()(const std::string& path, const lixs::watch_value& value)
+    {
+        events++;
+    }
+
+private:
+    unsigned long int& events;
+};
+
+
+/* Toolstack daemons watching all of /local/domain while guests go through their device
+ * handshakes. Broad watches fire for every write below them, watches limited to the domain
+ * directories (depth 1) aren't even visited.
+ */
+BENCHMARK("watch_mgr/broad_watches", broad_watches) {
+    const int domains = 256;
+
+    for (unsigned int depth : { lixs::watch_depth_any, 1u }) {
+        for (int watchers : { 1, 16, 64 }) {
+            unsigned long int ops;
+            unsigned long int events;
+            std::vector<std::string> paths;
+            std::list<std::unique_ptr<count_watch> > watches;
+            bench::timer t;
+
+            lixs::event_mgr emgr;
+            lixs::watch_mgr wmgr(emgr);
+
+            emgr.enable();
+
+            for (int d = 1; d <= domains; d++) {
+                paths.push_back("/local/domain/" + std::to_string(d) + "/device/vif/0/state");
+            }
+
+            events = 0;
+            for (int w = 0; w < watchers; w++) {
+                watches.emplace_back(new count_watch("/local/domain", depth, events));
+                wmgr.add(*watches.back());
+            }
+            emgr.run();
+
+            ops = ctx.scaled(100000);
+
+            events = 0;
+            t.start();
+            for (unsigned long int i = 0; i < ops; i++) {
+                wmgr.fire(0, paths[i % domains], lixs::watch_value_ptr());
+                wmgr.fire_parents(0, paths[i % domains], lixs::watch_value_ptr());
+                emgr.run();
+            }
+
+            ctx.report("watch_mgr/broad_watches",
+                    {{"depth", depth == lixs::watch_depth_any ? -1 : (int) depth},
+                     {"watchers", watchers}},
+                    ops, t.elapsed_ns(), {{"events", static_cast<long long int>(events)}});
+
+            for (auto& w : watches) {
+                wmgr.del(*w);
+            }
+        }
+    }
+}
+
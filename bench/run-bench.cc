@@ -0,0 +1,133 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <bench.hh>
+
+#include <cstdio>
+#include <cstdlib>
+#include <getopt.h>
+#include <string>
+
+
+static void print_usage(const char* cmd)
+{
+    printf("Usage: %s [OPTION]...\n", cmd);
+    printf("Run the LiXS benchmarks, printing one JSON object per result.\n");
+    printf("\n");
+    printf("Options:\n");
+    printf("  -h, --help            Display this help and exit.\n");
+    printf("  -l, --list            List the available benchmarks and exit.\n");
+    printf("  -f, --filter <str>    Only run benchmarks whose name contains <str>.\n");
+    printf("  -s, --scale <factor>  Scale the number of iterations by <factor>.\n");
+    printf("                        Defaults to 1.\n");
+}
+
+int main(int argc, char** argv)
+{
+    const char *short_opts = "hlf:s:";
+    const struct option long_opts[] = {
+        { "help"               , no_argument       , NULL , 'h' },
+        { "list"               , no_argument       , NULL , 'l' },
+        { "filter"             , required_argument , NULL , 'f' },
+        { "scale"              , required_argument , NULL , 's' },
+        { NULL , 0 , NULL , 0 }
+    };
+
+    int opt;
+    int opt_index;
+    bool list;
+    double scale;
+    std::string filter;
+
+    list = false;
+    scale = 1.0;
+
+    while (1) {
+        opt = getopt_long(argc, argv, short_opts, long_opts, &opt_index);
+
+        if (opt == -1) {
+            break;
+        }
+
+        switch (opt) {
+            case 'h':
+                print_usage(argv[0]);
+                return EXIT_SUCCESS;
+
+            case 'l':
+                list = true;
+                break;
+
+            case 'f':
+                filter = optarg;
+                break;
+
+            case 's':
+                scale = atof(optarg);
+                if (scale <= 0) {
+                    print_usage(argv[0]);
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            default:
+                print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind != argc) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bench::context ctx(scale);
+
+    for (auto& b : bench::get_registry()) {
+        if (b.first.find(filter) == std::string::npos) {
+            continue;
+        }
+
+        if (list) {
+            printf("%s\n", b.first.c_str());
+        } else {
+            b.second(ctx);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
@@ -0,0 +1,1016 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <getopt.h>
+#include <random>
+#include <string>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+extern "C" {
+#include <xen/io/xs_wire.h>
+}
+
+
+/*
+ * Load generator for the xenstore unix socket interface.
+ *
+ * Every connection works on its own set of keys under /bench/<connection>/ and keeps a
+ * configurable number of operations in flight. The supported operations are:
+ *
+ *   read, write, directory  single request on the connection's keys
+ *   watch                   write to a path watched by the connection, completes when both the
+ *                           reply and the watch event are received
+ *   transaction             start, read, write and commit
+ *   batch                   write batch_writes keys in a single batch request (a lixs
+ *                           extension)
+ *
+ * Latencies are measured from sending the first request of an operation to receiving the last
+ * reply. The watch delivery latency is measured from sending the write to receiving the event.
+ */
+
+namespace xs_load {
+
+typedef std::chrono::steady_clock clock;
+
+enum op {
+    op_read,
+    op_write,
+    op_directory,
+    op_watch,
+    op_transaction,
+    op_batch,
+    op_max,
+};
+
+static const char* op_names[op_max] = {
+    "read", "write", "directory", "watch", "transaction", "batch",
+};
+
+/* See xs_batch in lixs/xs_proto_v1/xs_proto.hh */
+static const uint32_t xs_batch = 128;
+static const int batch_writes = 8;
+
+
+struct config {
+    config(void)
+        : help(false), error(false), socket_path("/run/xenstored/socket"), connections(1000),
+        threads(1), pipeline(1), duration(10), keys(16), value_size(16),
+        weights{60, 20, 10, 5, 5, 0}
+    { }
+
+
+    bool help;
+    bool error;
+
+    std::string socket_path;
+    int connections;
+    int threads;
+    int pipeline;
+    int duration;
+    int keys;
+    int value_size;
+    int weights[op_max];
+};
+
+
+/* Log-linear histogram: values are grouped by power of two and each group is split in
+ * 2^sub_bits buckets, which bounds the relative error to about 3%.
+ */
+class histogram {
+public:
+    histogram(void);
+
+public:
+    void record(unsigned long long int v);
+    void merge(const histogram& other);
+    unsigned long long int count(void) const;
+    unsigned long long int percentile(double p) const;
+
+private:
+    static const int sub_bits = 5;
+    static const int n_buckets = (64 - sub_bits + 1) << sub_bits;
+
+    static int index(unsigned long long int v);
+    static unsigned long long int value(int index);
+
+private:
+    std::vector<unsigned long long int> buckets;
+    unsigned long long int total;
+};
+
+histogram::histogram(void)
+    : buckets(n_buckets, 0), total(0)
+{
+}
+
+void histogram::record(unsigned long long int v)
+{
+    buckets[index(v)]++;
+    total++;
+}
+
+void histogram::merge(const histogram& other)
+{
+    for (int i = 0; i < n_buckets; i++) {
+        buckets[i] += other.buckets[i];
+    }
+
+    total += other.total;
+}
+
+unsigned long long int histogram::count(void) const
+{
+    return total;
+}
+
+unsigned long long int histogram::percentile(double p) const
+{
+    unsigned long long int seen;
+    unsigned long long int target;
+
+    target = total * p;
+    if (target >= total && total > 0) {
+        target = total - 1;
+    }
+
+    seen = 0;
+    for (int i = 0; i < n_buckets; i++) {
+        seen += buckets[i];
+        if (seen > target) {
+            return value(i);
+        }
+    }
+
+    return 0;
+}
+
+int histogram::index(unsigned long long int v)
+{
+    int e;
+
+    if (v < (1ULL << sub_bits)) {
+        return v;
+    }
+
+    e = 63 - __builtin_clzll(v);
+
+    return ((e - sub_bits + 1) << sub_bits) + ((v >> (e - sub_bits)) & ((1 << sub_bits) - 1));
+}
+
+unsigned long long int histogram::value(int index)
+{
+    int e;
+
+    if (index < (1 << sub_bits)) {
+        return index;
+    }
+
+    e = (index >> sub_bits) + sub_bits - 1;
+
+    return ((1ULL << sub_bits) + (index & ((1 << sub_bits) - 1))) << (e - sub_bits);
+}
+
+
+struct slot {
+    int op;
+    int step;
+    bool wait_reply;
+    bool wait_event;
+    uint32_t req_id;
+    uint32_t tx_id;
+    clock::time_point start;
+};
+
+struct connection {
+    int fd;
+    bool want_write;
+    uint32_t next_req_id;
+
+    std::string base;
+    std::string watch_base;
+
+    std::string in;
+    std::string out;
+
+    std::vector<slot> slots;
+};
+
+class worker {
+public:
+    worker(const config& conf, int id, int first, int count);
+    ~worker();
+
+public:
+    int setup(void);
+    void run(clock::time_point end);
+
+public:
+    histogram latency[op_max];
+    histogram watch_latency;
+    unsigned long long int errors[op_max];
+    unsigned long long int aborts;
+
+private:
+    bool connect_socket(connection& conn);
+    bool setup_connection(connection& conn);
+
+    void start_op(connection& conn, slot& s);
+    void complete_op(connection& conn, slot& s);
+    void handle_msg(connection& conn, const struct xsd_sockmsg& hdr, const char* body);
+    void handle_event(connection& conn, const char* body);
+    void handle_reply(connection& conn, slot& s, const struct xsd_sockmsg& hdr,
+            const char* body);
+
+    void send(connection& conn, slot& s, uint32_t type, uint32_t tx_id, const std::string& body);
+    bool flush(connection& conn);
+    bool receive(connection& conn);
+
+    std::string key_path(connection& conn);
+    std::string batch_body(connection& conn);
+
+private:
+    const config& conf;
+
+    int epfd;
+    bool running;
+    unsigned long int in_flight;
+
+    std::vector<connection> conns;
+
+    std::mt19937 rng;
+    std::discrete_distribution<int> op_dist;
+    std::uniform_int_distribution<int> key_dist;
+    std::string value;
+};
+
+worker::worker(const config& conf, int id, int first, int count)
+    : aborts(0), conf(conf), epfd(-1), running(false), in_flight(0), conns(count),
+    rng(id), op_dist(conf.weights, conf.weights + op_max), key_dist(0, conf.keys - 1),
+    value(conf.value_size, 'x')
+{
+    for (int i = 0; i < op_max; i++) {
+        errors[i] = 0;
+    }
+
+    for (int i = 0; i < count; i++) {
+        conns[i].fd = -1;
+        conns[i].want_write = false;
+        conns[i].next_req_id = 1;
+        conns[i].base = "/bench/" + std::to_string(first + i);
+        conns[i].watch_base = conns[i].base + "/watch/";
+        conns[i].slots.resize(conf.pipeline);
+    }
+}
+
+worker::~worker()
+{
+    for (auto& c : conns) {
+        if (c.fd != -1) {
+            close(c.fd);
+        }
+    }
+
+    if (epfd != -1) {
+        close(epfd);
+    }
+}
+
+int worker::setup(void)
+{
+    struct epoll_event ev;
+
+    epfd = epoll_create1(0);
+    if (epfd == -1) {
+        fprintf(stderr, "xs-load: Failed to create epoll: %s\n", std::strerror(errno));
+        return -1;
+    }
+
+    for (auto& c : conns) {
+        if (!connect_socket(c) || !setup_connection(c)) {
+            return -1;
+        }
+
+        ev.events = EPOLLIN;
+        ev.data.ptr = &c;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, c.fd, &ev) == -1) {
+            fprintf(stderr, "xs-load: Failed to add socket: %s\n", std::strerror(errno));
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+void worker::run(clock::time_point end)
+{
+    int n;
+    struct epoll_event events[256];
+    clock::time_point drain_end;
+
+    running = true;
+
+    for (auto& c : conns) {
+        for (auto& s : c.slots) {
+            start_op(c, s);
+        }
+        flush(c);
+    }
+
+    /* Stop issuing operations at the end of the run, but wait a bit for the ones in flight so
+     * that slow replies show up in the latencies.
+     */
+    drain_end = end + std::chrono::seconds(5);
+
+    while (in_flight > 0) {
+        clock::time_point now = clock::now();
+
+        if (running && now >= end) {
+            running = false;
+        }
+
+        if (now >= drain_end) {
+            break;
+        }
+
+        n = epoll_wait(epfd, events, 256, 10);
+        if (n == -1 && errno != EINTR) {
+            fprintf(stderr, "xs-load: epoll_wait failed: %s\n", std::strerror(errno));
+            break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            connection& c = *static_cast<connection*>(events[i].data.ptr);
+
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                fprintf(stderr, "xs-load: Connection %s closed\n", c.base.c_str());
+                epoll_ctl(epfd, EPOLL_CTL_DEL, c.fd, NULL);
+                continue;
+            }
+
+            if ((events[i].events & EPOLLIN) && !receive(c)) {
+                epoll_ctl(epfd, EPOLL_CTL_DEL, c.fd, NULL);
+                continue;
+            }
+
+            flush(c);
+        }
+    }
+}
+
+bool worker::connect_socket(connection& conn)
+{
+    struct sockaddr_un addr;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, conf.socket_path.c_str(), sizeof(addr.sun_path) - 1);
+
+    conn.fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (conn.fd == -1) {
+        fprintf(stderr, "xs-load: Failed to create socket: %s\n", std::strerror(errno));
+        return false;
+    }
+
+    if (connect(conn.fd, (struct sockaddr*) &addr, sizeof(addr)) == -1) {
+        fprintf(stderr, "xs-load: Failed to connect to %s: %s\n",
+                conf.socket_path.c_str(), std::strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+bool worker::setup_connection(connection& conn)
+{
+    int replies;
+    struct xsd_sockmsg hdr;
+    std::vector<char> body;
+    slot s;
+
+    /* Create the keys and register the watch synchronously, before going non-blocking. */
+    for (int k = 0; k < conf.keys; k++) {
+        send(conn, s, XS_WRITE, 0, conn.base + "/k" + std::to_string(k) + '\0' + value);
+    }
+    send(conn, s, XS_WATCH, 0, conn.watch_base.substr(0, conn.watch_base.length() - 1)
+            + '\0' + "w" + '\0');
+
+    if (write(conn.fd, conn.out.data(), conn.out.length()) != (ssize_t) conn.out.length()) {
+        fprintf(stderr, "xs-load: Failed to send setup requests\n");
+        return false;
+    }
+    conn.out.clear();
+
+    replies = 0;
+    while (replies < conf.keys + 1) {
+        if (recv(conn.fd, &hdr, sizeof(hdr), MSG_WAITALL) != sizeof(hdr)) {
+            fprintf(stderr, "xs-load: Failed to receive setup replies\n");
+            return false;
+        }
+
+        body.resize(hdr.len);
+        if (hdr.len > 0 && recv(conn.fd, body.data(), hdr.len, MSG_WAITALL) != hdr.len) {
+            fprintf(stderr, "xs-load: Failed to receive setup replies\n");
+            return false;
+        }
+
+        if (hdr.type == XS_ERROR) {
+            fprintf(stderr, "xs-load: Setup request failed: %.*s\n", hdr.len, body.data());
+            return false;
+        }
+
+        if (hdr.type != XS_WATCH_EVENT) {
+            replies++;
+        }
+    }
+
+    if (fcntl(conn.fd, F_SETFL, fcntl(conn.fd, F_GETFL) | O_NONBLOCK) == -1) {
+        fprintf(stderr, "xs-load: Failed to set socket non-blocking\n");
+        return false;
+    }
+
+    return true;
+}
+
+std::string worker::key_path(connection& conn)
+{
+    return conn.base + "/k" + std::to_string(key_dist(rng));
+}
+
+void worker::start_op(connection& conn, slot& s)
+{
+    s.op = op_dist(rng);
+    s.step = 0;
+    s.wait_reply = true;
+    s.wait_event = false;
+    s.tx_id = 0;
+    s.start = clock::now();
+
+    in_flight++;
+
+    switch (s.op) {
+        case op_read:
+            send(conn, s, XS_READ, 0, key_path(conn) + '\0');
+            break;
+
+        case op_write:
+            send(conn, s, XS_WRITE, 0, key_path(conn) + '\0' + value);
+            break;
+
+        case op_directory:
+            send(conn, s, XS_DIRECTORY, 0, conn.base + '\0');
+            break;
+
+        case op_watch:
+            s.wait_event = true;
+            send(conn, s, XS_WRITE, 0,
+                    conn.watch_base + std::to_string(&s - conn.slots.data()) + '\0' + value);
+            break;
+
+        case op_transaction:
+            send(conn, s, XS_TRANSACTION_START, 0, std::string(1, '\0'));
+            break;
+
+        case op_batch:
+            send(conn, s, xs_batch, 0, batch_body(conn));
+            break;
+    }
+}
+
+std::string worker::batch_body(connection& conn)
+{
+    uint32_t sub[2];
+    std::string op;
+    std::string body;
+
+    for (int i = 0; i < batch_writes; i++) {
+        op = key_path(conn) + '\0' + value;
+
+        sub[0] = XS_WRITE;
+        sub[1] = op.length();
+
+        body.append(reinterpret_cast<char*>(sub), sizeof(sub));
+        body.append(op);
+    }
+
+    return body;
+}
+
+void worker::complete_op(connection& conn, slot& s)
+{
+    latency[s.op].record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                clock::now() - s.start).count());
+
+    in_flight--;
+
+    if (running) {
+        start_op(conn, s);
+    }
+}
+
+void worker::handle_msg(connection& conn, const struct xsd_sockmsg& hdr, const char* body)
+{
+    if (hdr.type == XS_WATCH_EVENT) {
+        handle_event(conn, body);
+        return;
+    }
+
+    for (auto& s : conn.slots) {
+        if (s.wait_reply && s.req_id == hdr.req_id) {
+            handle_reply(conn, s, hdr, body);
+            return;
+        }
+    }
+}
+
+void worker::handle_event(connection& conn, const char* body)
+{
+    unsigned long int index;
+
+    /* Ignore the event fired when registering the watch. */
+    if (strncmp(body, conn.watch_base.c_str(), conn.watch_base.length()) != 0) {
+        return;
+    }
+
+    index = strtoul(body + conn.watch_base.length(), NULL, 10);
+    if (index >= conn.slots.size()) {
+        return;
+    }
+
+    slot& s = conn.slots[index];
+
+    if (s.op == op_watch && s.wait_event) {
+        watch_latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    clock::now() - s.start).count());
+
+        s.wait_event = false;
+        if (!s.wait_reply) {
+            complete_op(conn, s);
+        }
+    }
+}
+
+void worker::handle_reply(connection& conn, slot& s, const struct xsd_sockmsg& hdr,
+        const char* body)
+{
+    s.wait_reply = false;
+
+    if (hdr.type == XS_ERROR) {
+        if (s.op == op_transaction && s.step == 3 && strcmp(body, "EAGAIN") == 0) {
+            aborts++;
+        } else {
+            errors[s.op]++;
+        }
+
+        /* Don't leave transactions open on failure. */
+        if (s.op == op_transaction && s.step > 0 && s.step < 3) {
+            s.step = 3;
+            s.wait_reply = true;
+            send(conn, s, XS_TRANSACTION_END, s.tx_id, std::string("F") + '\0');
+            return;
+        }
+
+        s.wait_event = false;
+        complete_op(conn, s);
+        return;
+    }
+
+    switch (s.op) {
+        case op_watch:
+            if (!s.wait_event) {
+                complete_op(conn, s);
+            }
+            break;
+
+        case op_transaction:
+            s.wait_reply = true;
+
+            switch (s.step++) {
+                case 0:
+                    s.tx_id = strtoul(body, NULL, 10);
+                    send(conn, s, XS_READ, s.tx_id, key_path(conn) + '\0');
+                    break;
+
+                case 1:
+                    send(conn, s, XS_WRITE, s.tx_id, key_path(conn) + '\0' + value);
+                    break;
+
+                case 2:
+                    send(conn, s, XS_TRANSACTION_END, s.tx_id, std::string("T") + '\0');
+                    break;
+
+                default:
+                    s.wait_reply = false;
+                    complete_op(conn, s);
+                    break;
+            }
+            break;
+
+        default:
+            complete_op(conn, s);
+            break;
+    }
+}
+
+void worker::send(connection& conn, slot& s, uint32_t type, uint32_t tx_id,
+        const std::string& body)
+{
+    struct xsd_sockmsg hdr;
+
+    hdr.type = type;
+    hdr.req_id = conn.next_req_id++;
+    hdr.tx_id = tx_id;
+    hdr.len = body.length();
+
+    s.req_id = hdr.req_id;
+
+    conn.out.append(reinterpret_cast<char*>(&hdr), sizeof(hdr));
+    conn.out.append(body);
+}
+
+bool worker::flush(connection& conn)
+{
+    ssize_t n;
+    bool want_write;
+    struct epoll_event ev;
+
+    while (!conn.out.empty()) {
+        n = write(conn.fd, conn.out.data(), conn.out.length());
+        if (n == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return false;
+        }
+
+        conn.out.erase(0, n);
+    }
+
+    want_write = !conn.out.empty();
+    if (want_write != conn.want_write) {
+        ev.events = EPOLLIN | (want_write ? EPOLLOUT : 0);
+        ev.data.ptr = &conn;
+        epoll_ctl(epfd, EPOLL_CTL_MOD, conn.fd, &ev);
+        conn.want_write = want_write;
+    }
+
+    return true;
+}
+
+bool worker::receive(connection& conn)
+{
+    ssize_t n;
+    size_t pos;
+    char buff[65536];
+    struct xsd_sockmsg hdr;
+
+    while (true) {
+        n = read(conn.fd, buff, sizeof(buff));
+        if (n == 0) {
+            return false;
+        }
+
+        if (n == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                break;
+            }
+            return false;
+        }
+
+        conn.in.append(buff, n);
+    }
+
+    for (pos = 0; conn.in.length() - pos >= sizeof(hdr); pos += sizeof(hdr) + hdr.len) {
+        memcpy(&hdr, conn.in.data() + pos, sizeof(hdr));
+
+        if (conn.in.length() - pos - sizeof(hdr) < hdr.len) {
+            break;
+        }
+
+        /* Copy the body so that it is null terminated. */
+        std::string body(conn.in, pos + sizeof(hdr), hdr.len);
+        handle_msg(conn, hdr, body.c_str());
+    }
+
+    conn.in.erase(0, pos);
+
+    return true;
+}
+
+
+static void print_usage(const char* cmd)
+{
+    printf("Usage: %s [OPTION]...\n", cmd);
+    printf("Generate load on a xenstore unix socket and report throughput and latencies.\n");
+    printf("Results are printed as one JSON object per line.\n");
+    printf("\n");
+    printf("Options:\n");
+    printf("  -h, --help                Display this help and exit.\n");
+    printf("  -s, --socket-path <path>  Path for the socket. Defaults to\n");
+    printf("                            /run/xenstored/socket.\n");
+    printf("  -c, --connections <n>     Number of connections. Defaults to 1000.\n");
+    printf("  -j, --threads <n>         Number of client threads. Defaults to 1.\n");
+    printf("  -p, --pipeline <n>        Operations in flight per connection. Defaults to 1.\n");
+    printf("  -d, --duration <s>        Duration of the run in seconds. Defaults to 10.\n");
+    printf("  -k, --keys <n>            Keys per connection. Defaults to 16.\n");
+    printf("  -v, --value-size <n>      Size of written values. Defaults to 16.\n");
+    printf("  -m, --mix <op=w,...>      Relative weight of each operation. Operations are\n");
+    printf("                            read, write, directory, watch, transaction and\n");
+    printf("                            batch.\n");
+    printf("                            Defaults to\n");
+    printf("                            read=60,write=20,directory=10,watch=5,transaction=5.\n");
+}
+
+static bool parse_mix(const std::string& mix, int* weights)
+{
+    size_t pos;
+    size_t end;
+    size_t eq;
+    std::string item;
+
+    for (int i = 0; i < op_max; i++) {
+        weights[i] = 0;
+    }
+
+    for (pos = 0; pos < mix.length(); pos = end + 1) {
+        end = mix.find(',', pos);
+        if (end == std::string::npos) {
+            end = mix.length();
+        }
+
+        item = mix.substr(pos, end - pos);
+
+        eq = item.find('=');
+        if (eq == std::string::npos) {
+            return false;
+        }
+
+        int i;
+        for (i = 0; i < op_max; i++) {
+            if (item.compare(0, eq, op_names[i]) == 0 && strlen(op_names[i]) == eq) {
+                break;
+            }
+        }
+
+        if (i == op_max) {
+            return false;
+        }
+
+        weights[i] = atoi(item.c_str() + eq + 1);
+        if (weights[i] < 0) {
+            return false;
+        }
+    }
+
+    for (int i = 0; i < op_max; i++) {
+        if (weights[i] > 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void parse_args(int argc, char** argv, config& conf)
+{
+    const char *short_opts = "hs:c:j:p:d:k:v:m:";
+    const struct option long_opts[] = {
+        { "help"               , no_argument       , NULL , 'h' },
+        { "socket-path"        , required_argument , NULL , 's' },
+        { "connections"        , required_argument , NULL , 'c' },
+        { "threads"            , required_argument , NULL , 'j' },
+        { "pipeline"           , required_argument , NULL , 'p' },
+        { "duration"           , required_argument , NULL , 'd' },
+        { "keys"               , required_argument , NULL , 'k' },
+        { "value-size"         , required_argument , NULL , 'v' },
+        { "mix"                , required_argument , NULL , 'm' },
+        { NULL , 0 , NULL , 0 }
+    };
+
+    int opt;
+    int opt_index;
+
+    while (1) {
+        opt = getopt_long(argc, argv, short_opts, long_opts, &opt_index);
+
+        if (opt == -1) {
+            break;
+        }
+
+        switch (opt) {
+            case 'h':
+                conf.help = true;
+                break;
+
+            case 's':
+                conf.socket_path = optarg;
+                break;
+
+            case 'c':
+                conf.connections = atoi(optarg);
+                break;
+
+            case 'j':
+                conf.threads = atoi(optarg);
+                break;
+
+            case 'p':
+                conf.pipeline = atoi(optarg);
+                break;
+
+            case 'd':
+                conf.duration = atoi(optarg);
+                break;
+
+            case 'k':
+                conf.keys = atoi(optarg);
+                break;
+
+            case 'v':
+                conf.value_size = atoi(optarg);
+                break;
+
+            case 'm':
+                if (!parse_mix(optarg, conf.weights)) {
+                    conf.error = true;
+                }
+                break;
+
+            default:
+                conf.error = true;
+                break;
+        }
+    }
+
+    if (optind != argc || conf.connections < 1 || conf.threads < 1 || conf.pipeline < 1
+            || conf.duration < 1 || conf.keys < 1 || conf.value_size < 0) {
+        conf.error = true;
+    }
+
+    if (conf.threads > conf.connections) {
+        conf.threads = conf.connections;
+    }
+}
+
+static void report(const char* name, const config& conf, const histogram& h,
+        double seconds, unsigned long long int errors, long long int aborts)
+{
+    printf("{\"bench\":\"xs-load/%s\",\"connections\":%d,\"threads\":%d,\"pipeline\":%d,"
+            "\"ops\":%llu,\"ops_per_sec\":%.1f,\"errors\":%llu,"
+            "\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f",
+            name, conf.connections, conf.threads, conf.pipeline,
+            h.count(), h.count() / seconds, errors,
+            h.percentile(0.5) / 1000.0, h.percentile(0.99) / 1000.0,
+            h.percentile(0.999) / 1000.0);
+
+    if (aborts >= 0) {
+        printf(",\"aborts\":%lld", aborts);
+    }
+
+    printf("}\n");
+}
+
+} /* namespace xs_load */
+
+
+int main(int argc, char** argv)
+{
+    int first;
+    double seconds;
+    struct rlimit rlim;
+    std::vector<std::thread> threads;
+    std::vector<xs_load::worker*> workers;
+    xs_load::clock::time_point start;
+    xs_load::clock::time_point end;
+    xs_load::config conf;
+
+    xs_load::parse_args(argc, argv, conf);
+
+    if (conf.error) {
+        xs_load::print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (conf.help) {
+        xs_load::print_usage(argv[0]);
+        return EXIT_SUCCESS;
+    }
+
+    /* Each connection takes a file descriptor. */
+    if (getrlimit(RLIMIT_NOFILE, &rlim) == 0 && rlim.rlim_cur < rlim.rlim_max) {
+        rlim.rlim_cur = rlim.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rlim);
+    }
+
+    first = 0;
+    for (int t = 0; t < conf.threads; t++) {
+        int count = conf.connections / conf.threads + (t < conf.connections % conf.threads);
+
+        workers.push_back(new xs_load::worker(conf, t, first, count));
+        first += count;
+    }
+
+    for (auto& w : workers) {
+        if (w->setup() != 0) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    start = xs_load::clock::now();
+    end = start + std::chrono::seconds(conf.duration);
+
+    for (auto& w : workers) {
+        threads.push_back(std::thread(&xs_load::worker::run, w, end));
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    seconds = std::chrono::duration<double>(xs_load::clock::now() - start).count();
+
+    xs_load::histogram total;
+    xs_load::histogram watch;
+    unsigned long long int total_errors = 0;
+    unsigned long long int aborts = 0;
+
+    for (int i = 0; i < xs_load::op_max; i++) {
+        xs_load::histogram h;
+        unsigned long long int errors = 0;
+
+        for (auto& w : workers) {
+            h.merge(w->latency[i]);
+            errors += w->errors[i];
+        }
+
+        total.merge(h);
+        total_errors += errors;
+
+        if (h.count() > 0) {
+            xs_load::report(xs_load::op_names[i], conf, h, seconds, errors, -1);
+        }
+    }
+
+    for (auto& w : workers) {
+        watch.merge(w->watch_latency);
+        aborts += w->aborts;
+    }
+
+    if (watch.count() > 0) {
+        xs_load::report("watch_delivery", conf, watch, seconds, 0, -1);
+    }
+
+    xs_load::report("total", conf, total, seconds, total_errors, aborts);
+
+    for (auto& w : workers) {
+        delete w;
+    }
+
+    return EXIT_SUCCESS;
+}
+
@@ -0,0 +1,341 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <bench.hh>
+
+#include <lixs/client.hh>
+#include <lixs/domain_mgr.hh>
+#include <lixs/event_mgr.hh>
+#include <lixs/iomux.hh>
+#include <lixs/log/logger.hh>
+#include <lixs/mstore/store.hh>
+#include <lixs/os_linux/fake_hypervisor.hh>
+#include <lixs/xenstore.hh>
+#include <lixs/xs_proto_v1/trace.hh>
+#include <lixs/xs_proto_v1/xs_proto.hh>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <getopt.h>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+extern "C" {
+#include <xen/io/xs_wire.h>
+}
+
+
+/*
+ * Replays a trace captured with lixs --trace-file against an in-process xenstore. Each traced
+ * connection is recreated with the same domain id and its requests are fed to the protocol
+ * handling code, responses are discarded. Watches fire as usual through the event manager,
+ * which is run to completion after each request.
+ */
+
+namespace xs_replay {
+
+/* No file descriptors are ever used, but the xenstore needs an iomux. */
+class null_iomux : public lixs::iomux {
+public:
+    null_iomux(lixs::event_mgr& emgr)
+        : iomux(emgr)
+    { }
+
+public:
+    void add(int fd, bool read, bool write, lixs::io_cb cb) { }
+    void set(int fd, bool read, bool write) { }
+    void rem(int fd) { }
+};
+
+
+/* In-memory connection fed from the trace. */
+class replay_conn {
+public:
+    void feed(const std::string& data);
+
+protected:
+    replay_conn(void);
+    virtual ~replay_conn();
+
+protected:
+    bool read(char*& buff, int& bytes);
+    bool write(char*& buff, int& bytes);
+
+    void need_rx(void) { }
+    void need_tx(void) { }
+
+    virtual void process_rx(void) = 0;
+    virtual void process_tx(void) = 0;
+
+private:
+    std::string in;
+    size_t in_pos;
+};
+
+replay_conn::replay_conn(void)
+    : in_pos(0)
+{
+}
+
+replay_conn::~replay_conn()
+{
+}
+
+void replay_conn::feed(const std::string& data)
+{
+    in.erase(0, in_pos);
+    in_pos = 0;
+    in.append(data);
+
+    process_rx();
+}
+
+bool replay_conn::read(char*& buff, int& bytes)
+{
+    int len;
+
+    len = std::min<size_t>(bytes, in.length() - in_pos);
+
+    memcpy(buff, in.data() + in_pos, len);
+    in_pos += len;
+    buff += len;
+    bytes -= len;
+
+    return bytes == 0;
+}
+
+bool replay_conn::write(char*& buff, int& bytes)
+{
+    buff += bytes;
+    bytes = 0;
+
+    return true;
+}
+
+
+class replay_client : public lixs::client<lixs::xs_proto_v1::xs_proto<replay_conn> > {
+public:
+    replay_client(uint32_t conn, domid_t domid, lixs::xenstore& xs, lixs::domain_mgr& dmgr,
+            lixs::xs_proto_v1::trace_writer& trace, lixs::log::logger& log)
+        : client("R" + std::to_string(conn), log, domid, xs, dmgr, trace, log)
+    { }
+};
+
+
+static const char* type_names[] = {
+    "debug", "directory", "read", "get_perms", "watch", "unwatch", "transaction_start",
+    "transaction_end", "introduce", "release", "get_domain_path", "write", "mkdir", "rm",
+    "set_perms", "watch_event", "error", "is_domain_introduced", "resume", "set_target",
+    "restrict", "reset_watches", "directory_part",
+};
+
+static std::string type_name(uint32_t type)
+{
+    if (type < sizeof(type_names) / sizeof(type_names[0])) {
+        return type_names[type];
+    }
+
+    return "type" + std::to_string(type);
+}
+
+struct type_stats {
+    type_stats(void)
+        : ops(0), ns(0)
+    { }
+
+
+    unsigned long long int ops;
+    unsigned long long int ns;
+};
+
+
+static void print_usage(const char* cmd)
+{
+    printf("Usage: %s [OPTION]... <trace>\n", cmd);
+    printf("Replay a trace captured with lixs --trace-file against an in-process xenstore.\n");
+    printf("Results are printed as one JSON object per request type.\n");
+    printf("\n");
+    printf("Options:\n");
+    printf("  -h, --help             Display this help and exit.\n");
+    printf("  -o, --original-timing  Replay requests at their original timing instead of as\n");
+    printf("                         fast as possible.\n");
+}
+
+} /* namespace xs_replay */
+
+
+int main(int argc, char** argv)
+{
+    const char *short_opts = "ho";
+    const struct option long_opts[] = {
+        { "help"               , no_argument       , NULL , 'h' },
+        { "original-timing"    , no_argument       , NULL , 'o' },
+        { NULL , 0 , NULL , 0 }
+    };
+
+    int opt;
+    int opt_index;
+    bool original_timing;
+    unsigned long int connections;
+    std::string body;
+    std::string data;
+    std::map<uint32_t, xs_replay::replay_client*> clients;
+    std::map<uint32_t, xs_replay::type_stats> stats;
+    std::chrono::steady_clock::time_point start;
+    lixs::xs_proto_v1::trace_record rec;
+    xs_replay::type_stats total;
+    bench::timer wall;
+    bench::timer t;
+
+    original_timing = false;
+
+    while (1) {
+        opt = getopt_long(argc, argv, short_opts, long_opts, &opt_index);
+
+        if (opt == -1) {
+            break;
+        }
+
+        switch (opt) {
+            case 'h':
+                xs_replay::print_usage(argv[0]);
+                return EXIT_SUCCESS;
+
+            case 'o':
+                original_timing = true;
+                break;
+
+            default:
+                xs_replay::print_usage(argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (optind != argc - 1) {
+        xs_replay::print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::unique_ptr<lixs::xs_proto_v1::trace_reader> reader;
+
+    try {
+        reader = std::unique_ptr<lixs::xs_proto_v1::trace_reader>(
+                new lixs::xs_proto_v1::trace_reader(argv[optind]));
+    } catch (lixs::xs_proto_v1::trace_error& e) {
+        fprintf(stderr, "xs-replay: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::event_mgr emgr;
+    xs_replay::null_iomux io(emgr);
+    lixs::os_linux::fake_hypervisor hv;
+    lixs::mstore::store store(log);
+    lixs::xenstore xs(store, emgr, io);
+    lixs::xs_proto_v1::trace_writer trace;
+    lixs::domain_mgr dmgr(xs, emgr, io, hv, trace, log);
+    bench::context ctx(1.0);
+
+    emgr.enable();
+
+    connections = 0;
+    start = std::chrono::steady_clock::now();
+    wall.start();
+
+    try {
+        while (reader->next(rec, body)) {
+            if (original_timing) {
+                std::this_thread::sleep_until(start + std::chrono::nanoseconds(rec.time_ns));
+            }
+
+            if (rec.hdr.type == lixs::xs_proto_v1::trace_conn_closed) {
+                std::map<uint32_t, xs_replay::replay_client*>::iterator it;
+
+                it = clients.find(rec.conn);
+                if (it != clients.end()) {
+                    delete it->second;
+                    clients.erase(it);
+                    emgr.run();
+                }
+
+                continue;
+            }
+
+            xs_replay::replay_client*& client = clients[rec.conn];
+            if (client == NULL) {
+                client = new xs_replay::replay_client(rec.conn, rec.domid, xs, dmgr, trace, log);
+                connections++;
+            }
+
+            data.assign(reinterpret_cast<const char*>(&rec.hdr), sizeof(rec.hdr));
+            data.append(body);
+
+            t.start();
+            client->feed(data);
+            emgr.run();
+
+            xs_replay::type_stats& s = stats[rec.hdr.type];
+            s.ops++;
+            s.ns += t.elapsed_ns();
+        }
+    } catch (lixs::xs_proto_v1::trace_error& e) {
+        fprintf(stderr, "xs-replay: %s\n", e.what());
+        return EXIT_FAILURE;
+    }
+
+    for (auto& s : stats) {
+        ctx.report("xs-replay/" + xs_replay::type_name(s.first), {}, s.second.ops, s.second.ns);
+
+        total.ops += s.second.ops;
+        total.ns += s.second.ns;
+    }
+
+    ctx.report("xs-replay/total", {{"connections", connections}}, total.ops, total.ns,
+            {{"wall_ns", static_cast<long long int>(wall.elapsed_ns())}});
+
+    for (auto& c : clients) {
+        delete c.second;
+    }
+
+    return EXIT_SUCCESS;
+}
+
@@ -0,0 +1,91 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#ifndef __LIXS_COMMIT_LOG_HH__
+#define __LIXS_COMMIT_LOG_HH__
+
+#include <list>
+
+
+namespace lixs {
+
+class commit_log;
+
+/* Work waiting for the changes committed so far to be durable, e.g. replies acknowledging them. */
+class commit_waiter {
+private:
+    friend commit_log;
+
+public:
+    commit_waiter(void);
+    virtual ~commit_waiter();
+
+protected:
+    virtual void durable(void) = 0;
+
+private:
+    bool waiting;
+    unsigned long int round;
+    std::list<commit_waiter*>::iterator it;
+};
+
+/* Log making committed changes durable some time after they are committed. Waiters are released
+ * together once every change committed before they started waiting is durable.
+ */
+class commit_log {
+public:
+    commit_log(void);
+    virtual ~commit_log();
+
+public:
+    /* Whether changes were committed that aren't durable yet. */
+    virtual bool pending(void) = 0;
+
+    void wait(commit_waiter& w);
+    void cancel(commit_waiter& w);
+
+protected:
+    /* Called once the changes committed so far are durable. */
+    void release(void);
+
+private:
+    unsigned long int round;
+    std::list<commit_waiter*> waiters;
+};
+
+} /* namespace lixs */
+
+#endif /* __LIXS_COMMIT_LOG_HH__ */
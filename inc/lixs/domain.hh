@@ -40,17 +40,16 @@
 #include <lixs/client.hh>
 #include <lixs/domain_mgr.hh>
 #include <lixs/event_mgr.hh>
+#include <lixs/hypervisor.hh>
 #include <lixs/log/logger.hh>
 #include <lixs/ring_conn.hh>
 #include <lixs/xenstore.hh>
 #include <lixs/xs_proto_v1/xs_proto.hh>
 
 #include <cerrno>
-#include <sys/mman.h>
 
 extern "C" {
 #include <xenctrl.h>
-#include <xen/grant_table.h>
 }
 
 
@@ -62,21 +61,22 @@ class foreign_ring_mapper_error : public std::runtime_error {
 
 class foreign_ring_mapper {
 protected:
-    foreign_ring_mapper(domid_t domid, unsigned int mfn);
+    foreign_ring_mapper(hypervisor& hv, domid_t domid, unsigned int mfn);
     virtual ~foreign_ring_mapper();
 
 protected:
     struct xenstore_domain_interface* interface;
 
 private:
-    xc_gnttab *xcg_handle;
+    hypervisor& hv;
 };
 
 
 class domain : public client<xs_proto_v1::xs_proto<ring_conn<foreign_ring_mapper> > > {
 public:
     domain(ev_cb dead_cb, xenstore& xs, domain_mgr& dmgr, event_mgr& emgr, iomux& io,
-            log::logger& log, domid_t domid, evtchn_port_t port, unsigned int mfn);
+            hypervisor& hv, xs_proto_v1::trace_writer& trace, log::logger& log,
+            domid_t domid, evtchn_port_t port, unsigned int mfn);
     ~domain();
 
     bool is_active(void);
@@ -38,9 +38,11 @@
 #define __LIXS_DOMAIN_MGR_HH__
 
 #include <lixs/event_mgr.hh>
+#include <lixs/hypervisor.hh>
 #include <lixs/iomux.hh>
 #include <lixs/log/logger.hh>
 #include <lixs/xenstore.hh>
+#include <lixs/xs_proto_v1/trace.hh>
 
 #include <cerrno>
 #include <map>
@@ -59,7 +61,8 @@ public:
     typedef std::map<domid_t, domain*>::iterator iterator;
 
 public:
-    domain_mgr(xenstore& xs, event_mgr& emgr, iomux& io, log::logger& log);
+    domain_mgr(xenstore& xs, event_mgr& emgr, iomux& io, hypervisor& hv,
+            xs_proto_v1::trace_writer& trace, log::logger& log);
     ~domain_mgr();
 
     int create(domid_t domid, evtchn_port_t port, unsigned int mfn);
@@ -78,6 +81,8 @@ private:
     xenstore& xs;
     event_mgr& emgr;
     iomux& io;
+    hypervisor& hv;
+    xs_proto_v1::trace_writer& trace;
     log::logger& log;
 
     domain_map domains;
@@ -0,0 +1,106 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+
+#ifndef __LIXS_EPOCH_HH__
+#define __LIXS_EPOCH_HH__
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <utility>
+
+
+namespace lixs {
+
+/* Epoch based reclamation, for structures updated by a single writer thread and read without
+ * locks from any number of reader threads.
+ *
+ * Readers announce the epoch they started in while reading. Memory unlinked by the writer is
+ * retired with the current epoch and only freed once every active reader started in a later
+ * epoch, i.e. once no reader can still be holding a reference to it. Readers are registered by
+ * the writer thread before they start reading, each reader thread uses its own id.
+ */
+class epoch_mgr {
+public:
+    epoch_mgr(void);
+    ~epoch_mgr();
+
+public:
+    unsigned int add_reader(void);
+
+    void enter(unsigned int reader);
+    void leave(unsigned int reader);
+
+    void retire(std::function<void(void)> free);
+    void sync(void);
+
+    unsigned long int pending(void);
+
+private:
+    typedef std::pair<unsigned long int, std::function<void(void)> > retired_item;
+
+private:
+    std::atomic<unsigned long int> epoch;
+
+    /* Epoch each reader started in, 0 if not reading. Deques don't move elements on push_back. */
+    std::deque<std::atomic<unsigned long int> > readers;
+
+    std::deque<retired_item> retired;
+};
+
+/* Keeps a reader in its epoch for the lifetime of the guard. */
+class epoch_guard {
+public:
+    epoch_guard(epoch_mgr& mgr, unsigned int reader)
+        : mgr(mgr), reader(reader)
+    {
+        mgr.enter(reader);
+    }
+
+    ~epoch_guard()
+    {
+        mgr.leave(reader);
+    }
+
+private:
+    epoch_mgr& mgr;
+    unsigned int reader;
+};
+
+} /* namespace lixs */
+
+#endif /* __LIXS_EPOCH_HH__ */
@@ -57,6 +57,8 @@ public:
 
     void enqueue_event(ev_cb);
 
+    unsigned long int size(void);
+
 private:
     typedef std::list<ev_cb> event_list;
 
@@ -0,0 +1,104 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#ifndef __LIXS_HYPERVISOR_HH__
+#define __LIXS_HYPERVISOR_HH__
+
+#include <cerrno>
+#include <vector>
+
+extern "C" {
+#include <xenctrl.h>
+#include <xen/io/xs_wire.h>
+}
+
+
+namespace lixs {
+
+struct domain_info {
+    domain_info(void)
+        : domid(0), dying(false), shutdown(false), crashed(false)
+    { }
+
+    domid_t domid;
+    bool dying;
+    bool shutdown;
+    bool crashed;
+};
+
+/* Event channel handle. Ports bound through a handle are signalled through its file descriptor.
+ * Methods follow the libxenctrl conventions: ports are returned as (evtchn_port_t)(-1) and other
+ * methods return -1 on failure, with errno set.
+ */
+class event_channel {
+public:
+    virtual ~event_channel() { }
+
+public:
+    virtual int fd(void) = 0;
+    virtual evtchn_port_t bind_interdomain(domid_t domid, evtchn_port_t remote_port) = 0;
+    virtual evtchn_port_t bind_virq(unsigned int virq) = 0;
+    virtual int notify(evtchn_port_t port) = 0;
+    virtual evtchn_port_t pending(void) = 0;
+    virtual int unmask(evtchn_port_t port) = 0;
+};
+
+/* Hypervisor services used to talk to domains: event channels, mapping of the xenstore ring and
+ * domain state queries. Methods returning pointers return NULL on failure, with errno set.
+ */
+class hypervisor {
+public:
+    virtual ~hypervisor() { }
+
+public:
+    virtual event_channel* evtchn_open(void) = 0;
+
+    virtual xenstore_domain_interface* map_ring(domid_t domid, unsigned int mfn) = 0;
+    virtual void unmap_ring(xenstore_domain_interface* interface) = 0;
+
+    /* Returns 0 on success, ENOENT if the domain doesn't exist or an error number. */
+    virtual int get_domain_info(domid_t domid, domain_info& info) = 0;
+
+    /* Get the state of up to max domains with an id equal or higher than first, in ascending id
+     * order, with a single query. Returns 0 on success or an error number.
+     */
+    virtual int list_domains(domid_t first, unsigned int max, std::vector<domain_info>& infos) = 0;
+};
+
+} /* namespace lixs */
+
+#endif /* __LIXS_HYPERVISOR_HH__ */
+
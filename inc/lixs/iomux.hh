@@ -39,6 +39,7 @@
 
 #include <lixs/event_mgr.hh>
 
+#include <cstddef>
 #include <functional>
 
 
@@ -46,17 +47,42 @@ namespace lixs {
 
 typedef std::function<void(bool, bool, bool)> io_cb;
 
+/* Data received on a stream: len > 0 bytes at data, 0 once the peer closed it, or -errno. */
+typedef std::function<void(const char*, int)> recv_cb;
+/* Progress of sends on a stream: bytes still queued, or -errno on failure. */
+typedef std::function<void(int)> send_cb;
+
+/* Completion based I/O on stream sockets, for multiplexers that can do better than readiness
+ * notifications. Received data is pushed to the stream as it arrives, and sent data is copied and
+ * owned by the multiplexer until the kernel is done with it. Callbacks run from the multiplexer's
+ * loop and never after the fd is removed with iomux::rem.
+ */
+class stream_io {
+public:
+    virtual void attach(int fd, recv_cb rx, send_cb tx) = 0;
+    virtual void set_recv(int fd, bool on) = 0;
+    virtual void send(int fd, const char* buff, int bytes) = 0;
+};
+
 class iomux {
 public:
     iomux(event_mgr& emgr)
         : emgr(emgr)
     { }
 
+    virtual ~iomux()
+    { }
+
 public:
     virtual void add(int fd, bool read, bool write, io_cb cb) = 0;
     virtual void set(int fd, bool read, bool write) = 0;
     virtual void rem(int fd) = 0;
 
+    virtual stream_io* get_stream_io(void)
+    {
+        return NULL;
+    }
+
 protected:
     event_mgr& emgr;
 };
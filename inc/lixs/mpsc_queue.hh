@@ -0,0 +1,134 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+
+#ifndef __LIXS_MPSC_QUEUE_HH__
+#define __LIXS_MPSC_QUEUE_HH__
+
+#include <atomic>
+#include <utility>
+
+
+namespace lixs {
+
+/* Unbounded lock-free queue with many producers and a single consumer.
+ *
+ * Producers link a new node by swapping the head pointer, so push never blocks nor retries. The
+ * consumer owns the tail and always keeps one (already consumed) node around, which avoids
+ * special casing the empty queue. A pop racing with a push might not see the element being
+ * pushed, it will be seen by a later pop. Elements from a given producer are popped in the order
+ * they were pushed.
+ */
+template < typename T >
+class mpsc_queue {
+public:
+    mpsc_queue(void);
+    ~mpsc_queue();
+
+    mpsc_queue(const mpsc_queue&) = delete;
+    mpsc_queue& operator=(const mpsc_queue&) = delete;
+
+public:
+    void push(T value);
+    bool pop(T& value);
+
+private:
+    struct node {
+        node(void)
+            : next(nullptr)
+        { }
+
+        node(T&& value)
+            : next(nullptr), value(std::move(value))
+        { }
+
+        std::atomic<node*> next;
+        T value;
+    };
+
+private:
+    std::atomic<node*> head;
+    node* tail;
+};
+
+
+template < typename T >
+mpsc_queue<T>::mpsc_queue(void)
+    : head(new node()), tail(head.load())
+{
+}
+
+template < typename T >
+mpsc_queue<T>::~mpsc_queue()
+{
+    node* next;
+
+    while (tail != nullptr) {
+        next = tail->next.load(std::memory_order_relaxed);
+        delete tail;
+        tail = next;
+    }
+}
+
+template < typename T >
+void mpsc_queue<T>::push(T value)
+{
+    node* n = new node(std::move(value));
+    node* prev = head.exchange(n, std::memory_order_acq_rel);
+
+    prev->next.store(n, std::memory_order_release);
+}
+
+template < typename T >
+bool mpsc_queue<T>::pop(T& value)
+{
+    node* next = tail->next.load(std::memory_order_acquire);
+
+    if (next == nullptr) {
+        return false;
+    }
+
+    value = std::move(next->value);
+
+    delete tail;
+    tail = next;
+
+    return true;
+}
+
+} /* namespace lixs */
+
+#endif /* __LIXS_MPSC_QUEUE_HH__ */
@@ -39,10 +39,14 @@
 
 #include <lixs/log/logger.hh>
 #include <lixs/permissions.hh>
+#include <lixs/store.hh>
 
+#include <atomic>
 #include <map>
+#include <memory>
 #include <set>
 #include <string>
+#include <vector>
 
 
 namespace lixs {
@@ -51,7 +55,7 @@ namespace mstore {
 class entry {
 public:
     entry ()
-        : write_seq(0), delete_seq(0), write_children_seq(0)
+        : children_gen(0), write_gen(0), write_seq(0), delete_seq(0), write_children_seq(0)
     { }
 
     /* Data */
@@ -60,6 +64,13 @@ public:
 
     /* Metadata for tree management */
     std::set<std::string> children;
+    /* Changes whenever the children list changes, see database::generation. */
+    unsigned long int children_gen;
+
+    /* Changes whenever the entry is written to. Unlike write_seq it isn't reset, so it is given
+     * to clients as the entry's version.
+     */
+    unsigned long int write_gen;
 
     /* Metadata for transaction management */
     long int write_seq;
@@ -70,8 +81,8 @@ public:
 class tentry {
 public:
     tentry ()
-        : init_seq(0), init_valid(false), read_seq(0), write_seq(0), delete_seq(0),
-        read_children_seq(0)
+        : children_gen(0), init_seq(0), init_valid(false), read_seq(0), write_seq(0),
+        delete_seq(0), read_children_seq(0)
     { }
 
     /* Data */
@@ -82,6 +93,7 @@ public:
     std::set<std::string> children;
     std::set<std::string> children_add;
     std::set<std::string> children_rem;
+    unsigned long int children_gen;
 
     /* Metadata for transaction management */
     long int init_seq;
@@ -96,6 +108,105 @@ public:
 
 typedef std::map<unsigned int, tentry> tentry_map;
 
+class database;
+
+
+/* Implemented by stores splitting the tree across several databases, see sharded_store. Each
+ * entry is kept in the database owning its path. Only entries at the top of a database's subtrees
+ * have parents in other databases, and only some entries have subtrees spanning databases.
+ */
+class shard_map {
+public:
+    virtual database& owner(const std::string& path) = 0;
+    virtual bool spans(const std::string& path) = 0;
+    virtual const std::vector<database*>& databases(void) = 0;
+};
+
+
+/* Nodes and bytes used by the entries owned by each domain, i.e. the domain given by their first
+ * permission. Usage is kept up to date incrementally by database::account, and can be shared by
+ * several databases, each updated from its own thread. Entries owned by dom0 or by ids out of the
+ * range of domain ids are accounted for but never limited.
+ */
+class quota {
+public:
+    quota(void)
+        : nodes_max(0), bytes_max(0), table(new usage[owners_max]())
+    { }
+
+    /* Limits on each domain's usage, 0 meaning no limit. */
+    void set_limits(unsigned long int nodes, unsigned long int bytes)
+    {
+        nodes_max = nodes;
+        bytes_max = bytes;
+    }
+
+    bool enabled(void)
+    {
+        return nodes_max != 0 || bytes_max != 0;
+    }
+
+    /* Whether owner can grow by nodes and bytes, shrinking being always allowed. Databases
+     * updated concurrently might both be allowed to take the last of a domain's quota.
+     */
+    bool check(cid_t owner, long int nodes, long int bytes)
+    {
+        if (owner == 0 || owner >= owners_max) {
+            return true;
+        }
+
+        usage& u = table[owner];
+
+        if (nodes > 0 && nodes_max != 0
+                && u.nodes.load(std::memory_order_relaxed) + nodes
+                > static_cast<long int>(nodes_max)) {
+            return false;
+        }
+
+        if (bytes > 0 && bytes_max != 0
+                && u.bytes.load(std::memory_order_relaxed) + bytes
+                > static_cast<long int>(bytes_max)) {
+            return false;
+        }
+
+        return true;
+    }
+
+    void account(cid_t owner, long int nodes, long int bytes)
+    {
+        if (owner < owners_max) {
+            table[owner].nodes.fetch_add(nodes, std::memory_order_relaxed);
+            table[owner].bytes.fetch_add(bytes, std::memory_order_relaxed);
+        }
+    }
+
+    void get(cid_t owner, unsigned long int& nodes, unsigned long int& bytes)
+    {
+        nodes = 0;
+        bytes = 0;
+
+        if (owner < owners_max) {
+            nodes = table[owner].nodes.load(std::memory_order_relaxed);
+            bytes = table[owner].bytes.load(std::memory_order_relaxed);
+        }
+    }
+
+private:
+    /* DOMID_FIRST_RESERVED, ids from there on aren't domains. */
+    static const cid_t owners_max = 0x7ff0;
+
+    struct usage {
+        std::atomic<long int> nodes;
+        std::atomic<long int> bytes;
+    };
+
+private:
+    unsigned long int nodes_max;
+    unsigned long int bytes_max;
+
+    std::unique_ptr<usage[]> table;
+};
+
 
 class record {
 public:
@@ -109,7 +220,80 @@ public:
     long int next_seq;
 };
 
-typedef std::map<std::string, record> database;
+class database : public std::map<std::string, record> {
+public:
+    database()
+        : nodes(0), bytes(0), generation(0), track_changes(false), shards(NULL), quotas(NULL)
+    { }
+
+    /* The database keeping path, which is always this one unless the tree is sharded. */
+    database& owner(const std::string& path)
+    {
+        return shards == NULL ? *this : shards->owner(path);
+    }
+
+    /* The databases keeping the entries below path, i.e. whose paths start with "<path>/". */
+    void below(const std::string& path, std::vector<database*>& dbs)
+    {
+        dbs.clear();
+
+        if (shards == NULL) {
+            dbs.push_back(this);
+        } else if (shards->spans(path)) {
+            dbs = shards->databases();
+        } else {
+            dbs.push_back(&shards->owner(path));
+        }
+    }
+
+    /* Called by the access classes whenever an entry's committed data (value, permissions,
+     * children or validity) changes.
+     */
+    void touch(const std::string& path)
+    {
+        if (track_changes) {
+            changed.push_back(path);
+        }
+    }
+
+    /* Account for a change in the number or size of the valid entries owned by the first
+     * permission in perms.
+     */
+    void account(const permission_list& perms, long int nodes, long int bytes)
+    {
+        this->nodes += nodes;
+        this->bytes += bytes;
+
+        if (quotas != NULL) {
+            quotas->account(get_owner(perms), nodes, bytes);
+        }
+    }
+
+    /* Statistics about valid entries. These are kept up to date by the access classes, through
+     * account, whenever an entry is created, updated or deleted outside of a transaction.
+     */
+    unsigned long int nodes;
+    unsigned long int bytes;
+
+    /* Source of children generations and entry versions. Unlike sequence numbers, which are per
+     * record and reset, generations are never reused so a listing can't mistake a changed
+     * children list for the one it started with, even if the entry was deleted and created again
+     * in between.
+     */
+    unsigned long int generation;
+
+    /* Entries changed since the last time changes were collected, possibly repeated. Only tracked
+     * if enabled, see store::enable_view.
+     */
+    bool track_changes;
+    std::vector<std::string> changed;
+
+    /* Set when the database only keeps a shard of the tree. */
+    shard_map* shards;
+
+    /* Usage by owner, set when entries are accounted for by owner. */
+    quota* quotas;
+};
 
 
 class db_access {
@@ -120,10 +304,11 @@ public:
 
     virtual int create(cid_t cid, const std::string& path, bool& created) = 0;
     virtual int read(cid_t cid, const std::string& path, std::string& val) = 0;
-    virtual int update(cid_t cid, const std::string& path, const std::string& val) = 0;
+    virtual int update(cid_t cid, const std::string& path, std::string val) = 0;
     virtual int del(cid_t cid, const std::string& path) = 0;
 
-    virtual int get_children(cid_t cid, const std::string& path, std::set<std::string>& resp) = 0;
+    virtual int get_children(cid_t cid, const std::string& path, const std::string& start,
+            const children_part_cb& cb, unsigned long int& gen) = 0;
 
     virtual int get_perms(cid_t cid, const std::string& path, permission_list& perms) = 0;
     virtual int set_perms(cid_t cid, const std::string& path, const permission_list& perms) = 0;
@@ -134,10 +319,6 @@ protected:
     log::logger& log;
 };
 
-
-bool has_read_access(cid_t cid, const permission_list& perms);
-bool has_write_access(cid_t cid, const permission_list& perms);
-
 } /* namespace mstore */
 } /* namespace lixs */
 
@@ -0,0 +1,143 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+
+#ifndef __LIXS_MSTORE_READ_VIEW_HH__
+#define __LIXS_MSTORE_READ_VIEW_HH__
+
+#include <lixs/epoch.hh>
+#include <lixs/mstore/database.hh>
+#include <lixs/permissions.hh>
+#include <lixs/store.hh>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace lixs {
+namespace mstore {
+
+/* Copy of the committed entries of a database that can be read without locks.
+ *
+ * Entries are kept in a hash table of immutable nodes. The store thread publishes a new node for
+ * each entry it changes, linking it in place of the old one with a single atomic store, so
+ * readers either see the old or the new node. Unlinked nodes are reclaimed through an epoch_mgr.
+ * When the table gets too loaded a bigger copy is built and swapped in the same way.
+ *
+ * Children lists are kept apart from the entry, as sorted chunks of up to chunk_max names shared
+ * between the versions of a node. They are updated as children are published and removed, so
+ * adding a child copies a single chunk, not the whole list, and nodes changing otherwise reuse it.
+ */
+class read_view : public store_view {
+public:
+    read_view(void);
+    ~read_view();
+
+public:
+    unsigned int add_reader(void);
+
+    int read(unsigned int reader, cid_t cid, const std::string& path, std::string& val);
+    int get_children(unsigned int reader, cid_t cid,
+            const std::string& path, const children_cb& cb);
+    int get_perms(unsigned int reader, cid_t cid,
+            const std::string& path, permission_list& perms);
+
+    /* Writer side, only to be called from the thread updating the database. */
+    void publish(const std::string& path, const entry& e);
+    void remove(const std::string& path);
+    void sync(void);
+
+    unsigned long int size(void);
+
+private:
+    typedef std::vector<std::string> chunk;
+    typedef std::vector<std::shared_ptr<const chunk> > child_list;
+    typedef std::shared_ptr<const child_list> child_list_ptr;
+
+    struct node {
+        node(const std::string& path, std::size_t hash, const entry& e,
+                const child_list_ptr& children);
+        node(const node& n, const child_list_ptr& children);
+        node(const node& n);
+
+        const std::string path;
+        const std::size_t hash;
+
+        const std::string value;
+        const permission_list perms;
+        /* Null when empty. */
+        const child_list_ptr children;
+
+        std::atomic<node*> next;
+    };
+
+    struct table {
+        table(std::size_t size);
+        ~table();
+
+        const std::size_t mask;
+        std::atomic<node*>* const buckets;
+    };
+
+private:
+    const node* find(const std::string& path);
+    std::atomic<node*>* find_link(table* t, const std::string& path, std::size_t hash);
+    void replace(std::atomic<node*>* link, node* old, node* n);
+    void retire(node* n);
+    void grow(void);
+
+    void add_child(const std::string& path);
+    void remove_child(const std::string& path);
+    bool find_parent(const std::string& path, std::atomic<node*>*& link, std::string& name);
+
+private:
+    static const std::size_t initial_size = 1024;
+    static const std::size_t max_load = 2;
+    static const std::size_t chunk_max = 64;
+
+    epoch_mgr epochs;
+
+    std::atomic<table*> current;
+    unsigned long int entries;
+};
+
+} /* namespace mstore */
+} /* namespace lixs */
+
+#endif /* __LIXS_MSTORE_READ_VIEW_HH__ */
@@ -0,0 +1,176 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#ifndef __LIXS_MSTORE_SHARDED_STORE_HH__
+#define __LIXS_MSTORE_SHARDED_STORE_HH__
+
+#include <lixs/log/logger.hh>
+#include <lixs/store.hh>
+#include <lixs/mstore/database.hh>
+#include <lixs/mstore/simple_access.hh>
+#include <lixs/mstore/transaction.hh>
+
+#include <deque>
+#include <list>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+
+namespace lixs {
+namespace mstore {
+
+/* Same as store, but with the tree split into shards by domain so that it can be used from several
+ * threads at once, operations on different domains running in parallel.
+ *
+ * The subtrees of a domain, /local/domain/<domid> and the backends of its devices at
+ * /local/domain/<backend>/backend/<type>/<domid>, are kept by shard domid % shards, everything
+ * else by the first shard. Each shard has its own database, sequence numbers and lock. Operations
+ * within a domain's subtree only lock the domain's shard, and transactions only lock the shards
+ * they referenced to commit. Operations changing the tree across shards, i.e. creating or deleting
+ * the top of a domain's subtree, deleting a subtree spanning shards, del_owned and clone, lock all
+ * the shards, always in the same order.
+ */
+class sharded_store : public lixs::store, private shard_map {
+public:
+    sharded_store(log::logger& log, unsigned int shards);
+    ~sharded_store();
+
+    void branch(unsigned int& tid);
+    int merge(unsigned int tid, bool& success);
+    int abort(unsigned int tid);
+
+    int create(cid_t cid, unsigned int tid,
+            const std::string& path, bool& created);
+    int read(cid_t cid, unsigned int tid,
+            const std::string& path, std::string& val);
+    int update(cid_t cid, unsigned int tid,
+            const std::string& path, std::string val);
+    int del(cid_t cid, unsigned int tid,
+            const std::string& path);
+
+    int read(cid_t cid, unsigned int tid, const std::string& path,
+            std::string& val, unsigned long int& version);
+    int update_if(cid_t cid, unsigned int tid, const std::string& path,
+            std::string val, unsigned long int& version);
+    int update_if(cid_t cid, unsigned int tid, const std::string& path,
+            std::string val, const std::string& expected, unsigned long int& version);
+
+    int del_owned(cid_t owner, const std::string& path, std::list<std::string>& removed);
+    int clone(cid_t cid, unsigned int tid, const std::string& src,
+            const std::string& dst, cid_t from, cid_t to);
+
+    int get_children(cid_t cid, unsigned int tid,
+            const std::string& path, std::set<std::string>& resp);
+    int get_children(cid_t cid, unsigned int tid,
+            const std::string& path, const children_cb& cb);
+    int get_children_part(cid_t cid, unsigned int tid, const std::string& path,
+            const std::string& start, const children_part_cb& cb, unsigned long int& gen);
+
+    int get_perms(cid_t cid, unsigned int tid,
+            const std::string& path, permission_list& perms);
+    int set_perms(cid_t cid, unsigned int tid,
+            const std::string& path, const permission_list& perms);
+
+    void set_quota(unsigned long int nodes, unsigned long int bytes);
+
+    void get_stats(store_stats& stats);
+    void get_owner_stats(cid_t owner, owner_stats& stats);
+    void get_transaction_stats(std::list<transaction_stats>& stats);
+    int get_usage(const std::string& path, const std::string& cursor,
+            unsigned long int max_entries, std::list<store_usage>& usage, std::string& next);
+
+private:
+    class shard {
+    public:
+        shard(log::logger& log);
+
+        database db;
+        simple_access access;
+
+        std::mutex lock;
+    };
+
+    /* Shard locks held by an operation, released when it returns. */
+    class guard {
+    public:
+        guard(sharded_store& store);
+        ~guard();
+
+        void lock(unsigned int shard);
+        void lock(const std::set<unsigned int>& shards);
+        void lock_all(void);
+
+    private:
+        void unlock(void);
+
+        sharded_store& store;
+        std::vector<unsigned int> held;
+    };
+
+    typedef std::map<unsigned int, transaction> transaction_db;
+
+private:
+    database& owner(const std::string& path);
+    bool spans(const std::string& path);
+    const std::vector<database*>& databases(void);
+
+    unsigned int shard_of(const std::string& path);
+    bool is_root(const std::string& path);
+    bool missing_root(const std::string& path, transaction* trans);
+    transaction* get_transaction(unsigned int tid);
+
+private:
+    std::deque<shard> shards;
+    std::vector<database*> dbs;
+
+    /* Shared by the shards, a domain's entries might be kept by more than one of them. */
+    quota quotas;
+
+    std::mutex trans_lock;
+    unsigned int next_tid;
+    transaction_db trans;
+
+    log::logger& log;
+};
+
+} /* namespace mstore */
+} /* namespace lixs */
+
+#endif /* __LIXS_MSTORE_SHARDED_STORE_HH__ */
+
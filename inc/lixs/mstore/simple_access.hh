@@ -40,6 +40,7 @@
 #include <lixs/log/logger.hh>
 #include <lixs/mstore/database.hh>
 
+#include <list>
 #include <set>
 #include <string>
 
@@ -53,19 +54,40 @@ public:
 
     int create(cid_t cid, const std::string& path, bool& created);
     int read(cid_t cid, const std::string& path, std::string& val);
-    int update(cid_t cid, const std::string& path, const std::string& val);
+    int update(cid_t cid, const std::string& path, std::string val);
     int del(cid_t cid, const std::string& path);
 
-    int get_children(cid_t cid, const std::string& path, std::set<std::string>& resp);
+    int read(cid_t cid, const std::string& path, std::string& val, unsigned long int& version);
+    int update_if(cid_t cid, const std::string& path, std::string val,
+            unsigned long int& version);
+    int update_if(cid_t cid, const std::string& path, std::string val,
+            const std::string& expected, unsigned long int& version);
+
+    int del_owned(cid_t owner, const std::string& path, std::list<std::string>& removed);
+    int clone(cid_t cid, const std::string& src, const std::string& dst, cid_t from, cid_t to);
+
+    int get_children(cid_t cid, const std::string& path, const std::string& start,
+            const children_part_cb& cb, unsigned long int& gen);
 
     int get_perms(cid_t cid, const std::string& path, permission_list& perms);
     int set_perms(cid_t cid, const std::string& path, const permission_list& perms);
 
 private:
+    /* Quotas only limit requests from domains other than dom0. Changes fail with ENOSPC if they
+     * would take an entry's owner over its quota.
+     */
+    bool limited(cid_t cid);
+    int check_quota(const std::string& path, const record* rec, size_t len);
+    void new_branch(const std::string& path, cid_t& owner, long int& nodes, long int& bytes);
+
+    int create_entry(cid_t cid, const std::string& path, bool& created);
+    int update_entry(cid_t cid, const std::string& path, record& rec, std::string val);
     void register_with_parent(const std::string& path);
     void unregister_from_parent(const std::string& path);
     void ensure_branch(cid_t cid, const std::string& path);
-    void delete_branch(const std::string& path, record& rec);
+    void delete_branch(const std::string& path);
+    database::iterator delete_entry(database::iterator it);
+    void clone_entry(const entry& src, const std::string& path, record& rec, cid_t from, cid_t to);
     void get_parent_perms(const std::string& path, permission_list& perms);
 };
 
@@ -40,9 +40,12 @@
 #include <lixs/log/logger.hh>
 #include <lixs/store.hh>
 #include <lixs/mstore/database.hh>
+#include <lixs/mstore/read_view.hh>
 #include <lixs/mstore/simple_access.hh>
 #include <lixs/mstore/transaction.hh>
+#include <lixs/mstore/wal.hh>
 
+#include <list>
 #include <map>
 #include <set>
 #include <string>
@@ -61,33 +64,74 @@ public:
     int abort(unsigned int tid);
 
     int create(cid_t cid, unsigned int tid,
-            std::string path, bool& created);
+            const std::string& path, bool& created);
     int read(cid_t cid, unsigned int tid,
-            std::string key, std::string& val);
+            const std::string& path, std::string& val);
     int update(cid_t cid, unsigned int tid,
-            std::string key, std::string val);
+            const std::string& path, std::string val);
     int del(cid_t cid, unsigned int tid,
-            std::string key);
+            const std::string& path);
 
+    int read(cid_t cid, unsigned int tid, const std::string& path,
+            std::string& val, unsigned long int& version);
+    int update_if(cid_t cid, unsigned int tid, const std::string& path,
+            std::string val, unsigned long int& version);
+    int update_if(cid_t cid, unsigned int tid, const std::string& path,
+            std::string val, const std::string& expected, unsigned long int& version);
+
+    int del_owned(cid_t owner, const std::string& path, std::list<std::string>& removed);
+    int clone(cid_t cid, unsigned int tid, const std::string& src,
+            const std::string& dst, cid_t from, cid_t to);
+
+    int get_children(cid_t cid, unsigned int tid,
+            const std::string& path, std::set<std::string>& resp);
     int get_children(cid_t cid, unsigned int tid,
-            std::string key, std::set<std::string>& resp);
+            const std::string& path, const children_cb& cb);
+    int get_children_part(cid_t cid, unsigned int tid, const std::string& path,
+            const std::string& start, const children_part_cb& cb, unsigned long int& gen);
 
     int get_perms(cid_t cid, unsigned int tid,
-            std::string path, permission_list& perms);
+            const std::string& path, permission_list& perms);
     int set_perms(cid_t cid, unsigned int tid,
-            std::string path, const permission_list& perms);
+            const std::string& path, const permission_list& perms);
+
+    void set_quota(unsigned long int nodes, unsigned long int bytes);
+
+    void get_stats(store_stats& stats);
+    void get_owner_stats(cid_t owner, owner_stats& stats);
+    void get_transaction_stats(std::list<transaction_stats>& stats);
+    int get_usage(const std::string& path, const std::string& cursor,
+            unsigned long int max_entries, std::list<store_usage>& usage, std::string& next);
+
+    /* Keep view up to date with every committed change. Changes are published when the store
+     * operation making them returns, before any watch is fired for them.
+     */
+    void enable_view(read_view& view);
+
+    /* Restore the entries logged to w, and log every committed change to it from then on. To be
+     * enabled before any entry is created.
+     */
+    int enable_wal(wal& w);
 
 private:
     typedef std::map<unsigned int, transaction> transaction_db;
 
+private:
+    int publish(int ret);
+
+private:
 
     database db;
+    quota quotas;
 
     simple_access access;
 
     unsigned int next_tid;
     transaction_db trans;
 
+    read_view* view;
+    wal* journal;
+
     log::logger& log;
 };
 
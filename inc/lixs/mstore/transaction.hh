@@ -40,6 +40,7 @@
 #include <lixs/log/logger.hh>
 #include <lixs/mstore/database.hh>
 
+#include <chrono>
 #include <set>
 #include <string>
 
@@ -52,26 +53,40 @@ public:
     transaction(unsigned int id, database& db, log::logger& log);
 
     void abort();
-    void merge(bool& success);
+    /* Fails with ENOSPC, aborting, if a domain other than dom0 wrote to the transaction and
+     * committing it would take an owner over its quota.
+     */
+    int merge(bool& success);
+
+    unsigned long int size(void);
+    unsigned long int age_ms(void);
+
+    /* Paths of the entries referenced by the transaction so far. */
+    const std::set<std::string>& get_records(void);
+    /* Whether path exists from the transaction's point of view, without referencing it. */
+    bool exists(const std::string& path);
 
     int create(cid_t cid, const std::string& path, bool& created);
     int read(cid_t cid, const std::string& path, std::string& val);
-    int update(cid_t cid, const std::string& path, const std::string& val);
+    int update(cid_t cid, const std::string& path, std::string val);
     int del(cid_t cid, const std::string& path);
 
-    int get_children(cid_t cid, const std::string& path, std::set<std::string>& resp);
+    int get_children(cid_t cid, const std::string& path, const std::string& start,
+            const children_part_cb& cb, unsigned long int& gen);
 
     int get_perms(cid_t cid, const std::string& path, permission_list& perms);
     int set_perms(cid_t cid, const std::string& path, const permission_list& perms);
 
 private:
     bool can_merge();
+    bool check_quota();
     void do_merge();
 
     void register_with_parent(const std::string& path);
     void unregister_from_parent(const std::string& path);
     void ensure_branch(cid_t cid, const std::string& path);
-    void delete_branch(const std::string& path, tentry& te);
+    void delete_branch(const std::string& path);
+    void clear_children(database& d, tentry& te);
     void get_parent_perms(const std::string& path, permission_list& perms);
     tentry& get_tentry(const std::string& path, record& rec);
     void fetch_tentry_data(tentry& te, record& rec);
@@ -79,6 +94,11 @@ private:
 
     unsigned int id;
     std::set<std::string> records;
+
+    /* Whether a domain other than dom0 wrote to the transaction. */
+    bool limited;
+
+    std::chrono::steady_clock::time_point start;
 };
 
 } /* namespace mstore */
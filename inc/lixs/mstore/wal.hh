@@ -0,0 +1,189 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+
+#ifndef __LIXS_MSTORE_WAL_HH__
+#define __LIXS_MSTORE_WAL_HH__
+
+#include <lixs/commit_log.hh>
+#include <lixs/event_mgr.hh>
+#include <lixs/log/logger.hh>
+#include <lixs/mstore/database.hh>
+#include <lixs/permissions.hh>
+#include <lixs/timer.hh>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <sys/types.h>
+#include <thread>
+
+
+namespace lixs {
+namespace mstore {
+
+class wal_error : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+
+/*
+ * A log file starts with wal_magic followed by a sequence of records. Each record is a wal_record
+ * immediately followed by len bytes of body, all in host byte order. The body holds the changes
+ * of one commit, each one being the change type and the entry's path, each string being preceded
+ * by its length. Writes follow with the entry's value, the number of permissions and, for each,
+ * the domain id and a byte with the read and write flags in bits 0 and 1.
+ */
+const char wal_magic[8] = { 'L', 'I', 'X', 'S', 'W', 'A', 'L', '1' };
+const uint8_t wal_write = 'W';
+const uint8_t wal_remove = 'R';
+
+struct wal_record {
+    uint32_t len;
+    /* FNV-1a hash of the body, a record not matching it was torn by a crash. */
+    uint32_t sum;
+};
+
+/* Last state logged for each entry present in the store, see wal::recover. */
+struct wal_entry {
+    std::string value;
+    permission_list perms;
+};
+
+typedef std::map<std::string, wal_entry> wal_state;
+
+
+/* Write-ahead log of the changes committed to a store, used to restore its entries on restart.
+ *
+ * Each change is logged as the resulting state of the entry, its value and permissions, or its
+ * removal, so replaying the log in order gives the last state of every entry. The changes of a
+ * commit, e.g. a transaction or a batch, form a single record. Records are buffered and written
+ * together once per event loop iteration, and written records are synced to disk at most once
+ * every sync_interval milliseconds, or right after being written if 0. Waiters, e.g. connections
+ * holding their replies, are released once the records are written and, with an interval of 0,
+ * synced. So acknowledged changes survive a crash of lixs, and with an interval of 0 a host crash
+ * as well, otherwise a host crash loses at most the last interval of changes.
+ *
+ * Records of entries changed again are stale, so the log is compacted in the background once it
+ * grows to compact_ratio times its size after the last compaction.
+ */
+class wal : public commit_log {
+public:
+    wal(const std::string& path, unsigned int sync_interval,
+            event_mgr& emgr, timer& t, log::logger& log);
+    ~wal();
+
+public:
+    /* Read back the state logged so far. A torn or corrupted record, left by a crash in the
+     * middle of a write, ends the log and is truncated away with everything after it, so the
+     * changes of a commit are either all restored or none is.
+     */
+    int recover(wal_state& state);
+    /* Replace the log with a copy of the valid entries in db, dropping every stale record. */
+    int compact(database& db);
+    /* As above without stalling the event loop: the copy is taken by a deferred event and
+     * written by a thread of its own. The log is replaced by the next write or sync after that
+     * thread is done, records written meanwhile are copied over first.
+     */
+    void compact_later(database& db);
+    /* Whether the log grew enough since the last compaction to compact it again. */
+    bool compact_due(void);
+
+    void write(const std::string& path, const entry& e);
+    void remove(const std::string& path);
+    /* Log the changes written or removed since the last commit as a single record. */
+    void commit(void);
+
+    /* Write the buffered records and sync the log to disk. */
+    void sync(void);
+
+    bool pending(void);
+
+private:
+    void flush(void);
+    void expired(void);
+
+    std::string tmp_path(void);
+    int install(int nfd, off_t len);
+
+    void start_compaction(database& db);
+    void write_snapshot(void);
+    void finish_compaction(bool wait);
+
+private:
+    static const off_t compact_min = 1 << 20;
+    static const off_t compact_ratio = 4;
+    /* Milliseconds before writing records that failed to be written again. */
+    static const unsigned int retry_interval = 1000;
+
+private:
+    const std::string path;
+    const std::chrono::milliseconds sync_interval;
+
+    event_mgr& emgr;
+    timer& t;
+
+    int fd;
+    /* Length of the records known to be completely written. */
+    off_t length;
+    off_t compact_at;
+
+    std::string group;
+    std::string buffer;
+    bool flush_queued;
+    bool sync_pending;
+
+    /* Background compaction, the thread only touches compact_fd, compact_data and compact_err
+     * until it sets compact_done.
+     */
+    bool compacting;
+    std::thread compactor;
+    std::atomic<bool> compact_done;
+    int compact_fd;
+    int compact_err;
+    std::string compact_data;
+    std::string compact_tail;
+
+    log::logger& log;
+};
+
+} /* namespace mstore */
+} /* namespace lixs */
+
+#endif /* __LIXS_MSTORE_WAL_HH__ */
@@ -38,11 +38,14 @@
 #define __LIXS_OS_LINUX_DOM_EXC_HH__
 
 #include <lixs/domain_mgr.hh>
+#include <lixs/event_mgr.hh>
+#include <lixs/hypervisor.hh>
 #include <lixs/iomux.hh>
 #include <lixs/xenstore.hh>
 
 #include <cerrno>
 #include <stdexcept>
+#include <vector>
 
 extern "C" {
 #include <xenctrl.h>
@@ -58,22 +61,31 @@ class dom_exc_error : public std::runtime_error {
 
 class dom_exc {
 public:
-    dom_exc(xenstore& xs, domain_mgr& dmgr, iomux& io);
+    dom_exc(xenstore& xs, domain_mgr& dmgr, event_mgr& emgr, iomux& io, hypervisor& hv);
     virtual ~dom_exc();
 
     void callback(bool read, bool write, bool error);
 
 private:
+    void scan(void);
+
+private:
+    static const unsigned int scan_batch = 256;
+
     xenstore& xs;
     domain_mgr& dmgr;
+    event_mgr& emgr;
     iomux& io;
+    hypervisor& hv;
 
     int fd;
 
     bool alive;
+    bool scan_pending;
+
+    std::vector<domain_info> infos;
 
-    xc_interface* xc_handle;
-    xc_evtchn *xce_handle;
+    event_channel* evtchn;
     evtchn_port_t virq_port;
 };
 
@@ -39,16 +39,22 @@
 
 #include <lixs/iomux.hh>
 
-#include <map>
 #include <sys/epoll.h>
+#include <vector>
 
 
 namespace lixs {
 namespace os_linux {
 
+/* Level triggered by default. When edge triggered, set only updates the interest kept here and
+ * readiness from edges is remembered until there is interest in it, then reported once. Callbacks
+ * must read or write until they would block. fds are registered for reading up front and for
+ * writing the first time it's wanted, as write space edges would otherwise wake the loop every
+ * time a peer reads.
+ */
 class epoll : public iomux {
 public:
-    epoll(event_mgr& emgr);
+    epoll(event_mgr& emgr, bool edge = false);
     ~epoll();
 
     void add(int fd, bool read, bool write, io_cb cb);
@@ -56,10 +62,25 @@ public:
     void rem(int fd);
 
 private:
-    typedef std::map<int, io_cb> cb_map;
+    struct handler {
+        handler(void);
+
+        bool used;
+        io_cb cb;
+
+        bool read;
+        bool write;
+
+        uint32_t events;
+        bool ready_read;
+        bool ready_write;
+        bool error;
+    };
 
 private:
     void handle(void);
+    void dispatch(handler& h);
+    handler* get(int fd);
 
     uint32_t inline get_events(bool read, bool write);
     bool inline is_read(const uint32_t ev);
@@ -71,10 +92,12 @@ private:
     static const int timeout = 100;
     static const int epoll_max_events = 1000;
 
+    bool edge;
     int epfd;
     struct epoll_event epev[epoll_max_events];
 
-    cb_map callbacks;
+    /* Indexed by fd */
+    std::vector<handler> handlers;
 };
 
 } /* namespace os_linux */
@@ -0,0 +1,162 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#ifndef __LIXS_OS_LINUX_FAKE_HYPERVISOR_HH__
+#define __LIXS_OS_LINUX_FAKE_HYPERVISOR_HH__
+
+#include <lixs/hypervisor.hh>
+
+#include <map>
+#include <vector>
+
+extern "C" {
+#include <xenctrl.h>
+#include <xen/io/xs_wire.h>
+}
+
+
+namespace lixs {
+namespace os_linux {
+
+class fake_hypervisor;
+
+/* Event channel backed by an eventfd. A handle can only have a single port bound, which is how
+ * lixs uses event channels.
+ */
+class fake_event_channel : public event_channel {
+public:
+    fake_event_channel(fake_hypervisor& hv, int efd);
+    ~fake_event_channel();
+
+    int fd(void);
+    evtchn_port_t bind_interdomain(domid_t domid, evtchn_port_t remote_port);
+    evtchn_port_t bind_virq(unsigned int virq);
+    int notify(evtchn_port_t port);
+    evtchn_port_t pending(void);
+    int unmask(evtchn_port_t port);
+
+    void signal(void);
+
+private:
+    fake_hypervisor& hv;
+
+    int efd;
+
+    evtchn_port_t port;
+    domid_t domid;
+    bool virq;
+};
+
+/* In-process hypervisor for testing and benchmarking without Xen. Each domain gets a xenstore
+ * ring in a memfd, mapped once for the store and once for the guest side, and a domain table
+ * entry with the dying/shutdown/crashed flags. Changes to the domain state raise VIRQ_DOM_EXC on
+ * the channels bound to it.
+ *
+ * The guest side methods are meant to be used by test harnesses to play the role of the guests.
+ * Domain state queries are counted, to check how often the store goes to the hypervisor.
+ */
+class fake_hypervisor : public hypervisor {
+public:
+    fake_hypervisor(void);
+    ~fake_hypervisor();
+
+    event_channel* evtchn_open(void);
+
+    xenstore_domain_interface* map_ring(domid_t domid, unsigned int mfn);
+    void unmap_ring(xenstore_domain_interface* interface);
+
+    int get_domain_info(domid_t domid, domain_info& info);
+    int list_domains(domid_t first, unsigned int max, std::vector<domain_info>& infos);
+
+public:
+    int create_domain(domid_t domid, evtchn_port_t& port, unsigned int& mfn);
+    int shutdown_domain(domid_t domid, bool crashed);
+    int kill_domain(domid_t domid);
+    int destroy_domain(domid_t domid);
+
+    xenstore_domain_interface* guest_ring(domid_t domid);
+    int guest_notify(domid_t domid);
+    unsigned long int guest_notifications(domid_t domid);
+
+    unsigned long int domain_queries(void);
+
+private:
+    friend class fake_event_channel;
+
+    struct fake_domain {
+        fake_domain(void)
+            : destroyed(false), remote_port(0), channel(NULL),
+            guest_ring(NULL), host_ring(NULL), mapped(false), notifications(0)
+        { }
+
+        domain_info info;
+        bool destroyed;
+
+        evtchn_port_t remote_port;
+        fake_event_channel* channel;
+
+        xenstore_domain_interface* guest_ring;
+        xenstore_domain_interface* host_ring;
+        bool mapped;
+
+        unsigned long int notifications;
+    };
+
+    typedef std::map<domid_t, fake_domain> domain_map;
+    typedef std::map<xenstore_domain_interface*, domid_t> ring_map;
+    typedef std::map<fake_event_channel*, unsigned int> virq_map;
+
+private:
+    fake_domain* find_domain(domid_t domid);
+    void release_domain(domain_map::iterator it);
+    void raise_virq(unsigned int virq);
+
+private:
+    size_t ring_size;
+    evtchn_port_t next_port;
+
+    unsigned long int queries;
+
+    domain_map domains;
+    ring_map rings;
+    virq_map virqs;
+};
+
+} /* namespace os_linux */
+} /* namespace lixs */
+
+#endif /* __LIXS_OS_LINUX_FAKE_HYPERVISOR_HH__ */
+
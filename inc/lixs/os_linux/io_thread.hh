@@ -0,0 +1,89 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+
+#ifndef __LIXS_OS_LINUX_IO_THREAD_HH__
+#define __LIXS_OS_LINUX_IO_THREAD_HH__
+
+#include <lixs/event_mgr.hh>
+#include <lixs/iomux.hh>
+#include <lixs/os_linux/mailbox.hh>
+#include <lixs/reactor.hh>
+
+#include <memory>
+#include <thread>
+
+
+namespace lixs {
+namespace os_linux {
+
+enum class iomux_type {
+    epoll,
+    epoll_et,
+    io_uring,
+};
+
+/* Creates the multiplexer of the given type. Throws io_uring_error if io_uring is unavailable. */
+iomux* new_iomux(iomux_type type, event_mgr& emgr);
+
+/* Reactor running an I/O loop on a thread of its own. The thread starts on construction and is
+ * stopped and joined on destruction.
+ */
+class io_thread : public reactor {
+public:
+    io_thread(iomux_type type = iomux_type::epoll);
+    ~io_thread();
+
+public:
+    void post(ev_cb cb);
+    iomux& get_iomux(void);
+    void run_sync(ev_cb cb);
+
+private:
+    void run(void);
+
+private:
+    event_mgr emgr;
+    std::unique_ptr<iomux> io;
+    mailbox mbox;
+
+    std::thread thread;
+};
+
+} /* namespace os_linux */
+} /* namespace lixs */
+
+#endif /* __LIXS_OS_LINUX_IO_THREAD_HH__ */
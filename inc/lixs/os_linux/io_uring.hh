@@ -0,0 +1,190 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#ifndef __LIXS_OS_LINUX_IO_URING_HH__
+#define __LIXS_OS_LINUX_IO_URING_HH__
+
+#include <lixs/event_mgr.hh>
+#include <lixs/iomux.hh>
+
+#include <cstdint>
+#include <deque>
+#include <linux/io_uring.h>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+namespace lixs {
+namespace os_linux {
+
+class io_uring_error : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+/* iomux on top of io_uring, talking to the kernel through the raw system calls.
+ *
+ * Generic fds get one-shot poll requests, re-armed after each completion so they keep the level
+ * triggered semantics of epoll. Stream sockets are served on completions instead: a multishot
+ * receive per socket draws from a ring of provided buffers, and sends are coalesced per socket
+ * into a single request in flight. Requests are queued during a pass of the loop and submitted
+ * together with the wait for completions, so each pass costs one system call.
+ *
+ * Needs Linux 5.19 for provided buffer rings, receives fall back to one-shot before 6.0.
+ */
+class io_uring : public iomux, public stream_io {
+public:
+    io_uring(event_mgr& emgr);
+    ~io_uring();
+
+    void add(int fd, bool read, bool write, io_cb cb);
+    void set(int fd, bool read, bool write);
+    void rem(int fd);
+
+    stream_io* get_stream_io(void);
+
+    void attach(int fd, recv_cb rx, send_cb tx);
+    void set_recv(int fd, bool on);
+    void send(int fd, const char* buff, int bytes);
+
+private:
+    enum class op : uint8_t {
+        poll,
+        recv,
+        send,
+        cancel,
+    };
+
+    struct entry {
+        entry(void);
+
+        bool used;
+        bool stream;
+        bool queued;
+        uint32_t tag;
+
+        io_cb cb;
+        bool read;
+        bool write;
+        bool poll_armed;
+        uint32_t poll_mask;
+
+        recv_cb rx;
+        bool recv_on;
+        bool recv_armed;
+        bool recv_cancel;
+
+        send_cb tx;
+        bool send_armed;
+        std::string out;
+        std::string sending;
+        std::string::size_type sent;
+    };
+
+private:
+    void handle(void);
+
+    bool prepare(void);
+    void prepare(int fd, entry& e);
+    void reap(void);
+    void complete_poll(int fd, uint32_t tag, int res);
+    void complete_recv(int fd, uint32_t tag, int res, uint32_t flags);
+    void complete_send(uint64_t data, int fd, uint32_t tag, int res);
+
+    entry* get(int fd);
+    entry* get(int fd, uint32_t tag);
+    void reset(entry& e);
+    void queue(int fd);
+
+    unsigned int sq_space(void);
+    struct io_uring_sqe* get_sqe(void);
+    int enter(unsigned int to_submit, unsigned int min_complete, unsigned int flags);
+    void give_buffer(uint16_t bid);
+    void destroy(void);
+
+    static inline uint64_t user_data(op type, int fd, uint32_t tag);
+    static inline uint32_t get_events(bool read, bool write);
+
+private:
+    /* TODO: make this configurable */
+    static const int timeout = 100;
+    static const unsigned int sq_size = 256;
+    static const unsigned int cq_size = 4096;
+    static const unsigned int buff_count = 256;
+    static const unsigned int buff_size = 4096;
+    static const uint16_t buff_group = 0;
+
+    int ring_fd;
+    bool multishot;
+    uint32_t next_tag;
+
+    void* sq_ring;
+    size_t sq_ring_size;
+    void* cq_ring;
+    size_t cq_ring_size;
+    struct io_uring_sqe* sqes;
+    size_t sqes_size;
+
+    unsigned int* sq_head;
+    unsigned int* sq_tail;
+    unsigned int sq_mask;
+    unsigned int sq_entries;
+    unsigned int sq_local_tail;
+
+    unsigned int* cq_head;
+    unsigned int* cq_tail;
+    unsigned int cq_mask;
+    struct io_uring_cqe* cqes;
+
+    struct io_uring_buf_ring* buff_ring;
+    size_t buff_ring_size;
+    char* buffs;
+    uint16_t buff_tail;
+
+    /* Indexed by fd. A deque keeps entries in place as it grows, as callbacks run from them. */
+    std::deque<entry> fds;
+    std::vector<int> pending;
+    std::vector<int> released;
+    std::vector<uint64_t> cancels;
+    /* Send buffers of removed fds, kept until their request completes. */
+    std::map<uint64_t, std::string> orphans;
+};
+
+} /* namespace os_linux */
+} /* namespace lixs */
+
+#endif /* __LIXS_OS_LINUX_IO_URING_HH__ */
@@ -0,0 +1,80 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#ifndef __LIXS_OS_LINUX_TIMER_HH__
+#define __LIXS_OS_LINUX_TIMER_HH__
+
+#include <lixs/event_mgr.hh>
+#include <lixs/iomux.hh>
+#include <lixs/timer.hh>
+
+#include <chrono>
+#include <stdexcept>
+
+
+namespace lixs {
+namespace os_linux {
+
+class timer_error : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+/* Timer backed by a timerfd registered with the iomux of the owning thread. Expiry times are
+ * absolute on CLOCK_MONOTONIC, which is what std::chrono::steady_clock reads.
+ */
+class timer : public lixs::timer {
+public:
+    timer(iomux& io);
+    ~timer();
+
+public:
+    void set(std::chrono::steady_clock::time_point expiry, ev_cb cb);
+    void clear(void);
+
+private:
+    void callback(bool read, bool write, bool error);
+
+private:
+    iomux& io;
+
+    int fd;
+    ev_cb cb;
+};
+
+} /* namespace os_linux */
+} /* namespace lixs */
+
+#endif /* __LIXS_OS_LINUX_TIMER_HH__ */
@@ -0,0 +1,99 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#ifndef __LIXS_OS_LINUX_XEN_HYPERVISOR_HH__
+#define __LIXS_OS_LINUX_XEN_HYPERVISOR_HH__
+
+#include <lixs/hypervisor.hh>
+
+#include <vector>
+
+extern "C" {
+#include <xenctrl.h>
+#include <xen/io/xs_wire.h>
+}
+
+
+namespace lixs {
+namespace os_linux {
+
+class xen_event_channel : public event_channel {
+public:
+    xen_event_channel(xc_evtchn* xce_handle);
+    ~xen_event_channel();
+
+    int fd(void);
+    evtchn_port_t bind_interdomain(domid_t domid, evtchn_port_t remote_port);
+    evtchn_port_t bind_virq(unsigned int virq);
+    int notify(evtchn_port_t port);
+    evtchn_port_t pending(void);
+    int unmask(evtchn_port_t port);
+
+private:
+    xc_evtchn* xce_handle;
+};
+
+/* Hypervisor backed by libxenctrl. Handles are only opened on first use so that running without
+ * Xen (e.g. unix sockets only) doesn't require access to the hypervisor.
+ */
+class xen_hypervisor : public hypervisor {
+public:
+    xen_hypervisor(void);
+    ~xen_hypervisor();
+
+    event_channel* evtchn_open(void);
+
+    xenstore_domain_interface* map_ring(domid_t domid, unsigned int mfn);
+    void unmap_ring(xenstore_domain_interface* interface);
+
+    int get_domain_info(domid_t domid, domain_info& info);
+    int list_domains(domid_t first, unsigned int max, std::vector<domain_info>& infos);
+
+private:
+    int open_xc(void);
+
+private:
+    xc_interface* xc_handle;
+    xc_gnttab* xcg_handle;
+
+    std::vector<xc_domaininfo_t> list_buff;
+};
+
+} /* namespace os_linux */
+} /* namespace lixs */
+
+#endif /* __LIXS_OS_LINUX_XEN_HYPERVISOR_HH__ */
+
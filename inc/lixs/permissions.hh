@@ -73,6 +73,13 @@ public:
 typedef struct permission permission;
 typedef std::list<permission> permission_list;
 
+
+/* The owner is given by the first permission, dom0 if there's none. */
+cid_t get_owner(const permission_list& perms);
+
+bool has_read_access(cid_t cid, const permission_list& perms);
+bool has_write_access(cid_t cid, const permission_list& perms);
+
 } /* namespace lixs */
 
 #endif /* __LIXS_PERMISSIONS_HH__ */
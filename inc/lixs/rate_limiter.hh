@@ -0,0 +1,112 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#ifndef __LIXS_RATE_LIMITER_HH__
+#define __LIXS_RATE_LIMITER_HH__
+
+#include <lixs/event_mgr.hh>
+#include <lixs/timer.hh>
+
+#include <chrono>
+#include <map>
+
+
+namespace lixs {
+
+class rate_limiter;
+
+/* Tokens of a connection, see rate_limiter. Buckets start full. */
+class token_bucket {
+private:
+    friend rate_limiter;
+
+    typedef std::chrono::steady_clock::time_point time_point;
+    typedef std::multimap<time_point, token_bucket*> wait_map;
+
+public:
+    token_bucket(ev_cb resume);
+
+public:
+    /* Number of times the connection ran out of tokens. */
+    unsigned long int get_throttled(void);
+
+private:
+    ev_cb resume;
+
+    double tokens;
+    time_point last;
+
+    bool waiting;
+    wait_map::iterator it;
+
+    unsigned long int throttled;
+};
+
+/* Token bucket rate limiting for connections serviced by the same event loop. Buckets hold up to
+ * burst tokens and are refilled at rate tokens per second. A connection takes a token before
+ * handling each request. Once its bucket is empty it stops reading requests, which holds further
+ * requests back in the connection, until the bucket holds a token again and resume is called.
+ */
+class rate_limiter {
+public:
+    rate_limiter(timer& t, unsigned int rate, unsigned int burst);
+    ~rate_limiter();
+
+public:
+    /* Takes a token, returns false if there's none and resume is to be called later. */
+    bool take(token_bucket& b);
+    void cancel(token_bucket& b);
+
+private:
+    typedef token_bucket::time_point time_point;
+
+private:
+    void refill(token_bucket& b, time_point now);
+    void arm(void);
+    void expired(void);
+
+private:
+    timer& t;
+
+    double rate;
+    double burst;
+
+    token_bucket::wait_map waiting;
+};
+
+} /* namespace lixs */
+
+#endif /* __LIXS_RATE_LIMITER_HH__ */
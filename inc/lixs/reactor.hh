@@ -0,0 +1,99 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+
+#ifndef __LIXS_REACTOR_HH__
+#define __LIXS_REACTOR_HH__
+
+#include <lixs/event_mgr.hh>
+#include <lixs/iomux.hh>
+#include <lixs/store.hh>
+
+#include <vector>
+
+
+namespace lixs {
+
+/* Runs callbacks on the thread owning it. Callbacks can be posted from any thread and run in the
+ * order they were posted.
+ */
+class executor {
+public:
+    virtual void post(ev_cb cb) = 0;
+};
+
+/* A thread with its own event loop. File descriptors registered with its iomux are serviced by
+ * that thread only, therefore the iomux must only be used from callbacks running on it.
+ */
+class reactor : public executor {
+public:
+    virtual iomux& get_iomux(void) = 0;
+
+    /* Runs cb on the reactor and waits for it to complete. While it runs the calling thread is
+     * blocked, so cb can also touch state owned by the caller.
+     */
+    virtual void run_sync(ev_cb cb) = 0;
+};
+
+/* Reactors connections are spread over, together with the executor of the thread owning the
+ * store. Without reactors every connection is serviced by the store thread. If a store view is
+ * given each reactor is registered as one of its readers.
+ */
+class reactor_pool {
+public:
+    reactor_pool(executor& store, store_view* view);
+    ~reactor_pool();
+
+public:
+    void add(reactor& r);
+    bool empty(void);
+
+    reactor& next(unsigned int& reader);
+    executor& get_store(void);
+    store_view* get_view(void);
+
+private:
+    executor& store;
+    store_view* view;
+
+    std::vector<reactor*> reactors;
+    std::vector<unsigned int> readers;
+    std::vector<reactor*>::size_type next_reactor;
+};
+
+} /* namespace lixs */
+
+#endif /* __LIXS_REACTOR_HH__ */
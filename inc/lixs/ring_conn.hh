@@ -37,6 +37,7 @@
 #ifndef __LIXS_RING_CONN_HH__
 #define __LIXS_RING_CONN_HH__
 
+#include <lixs/hypervisor.hh>
 #include <lixs/iomux.hh>
 
 #include <cerrno>
@@ -63,7 +64,7 @@ private:
     friend ring_conn_cb;
 
 protected:
-    ring_conn_base(iomux& io, domid_t domid,
+    ring_conn_base(iomux& io, hypervisor& hv, domid_t domid,
             evtchn_port_t port, xenstore_domain_interface* interface);
     virtual ~ring_conn_base();
 
@@ -97,7 +98,7 @@ private:
     evtchn_port_t local_port;
     evtchn_port_t remote_port;
 
-    xc_evtchn *xce_handle;
+    event_channel* evtchn;
     xenstore_domain_interface* interface;
 };
 
@@ -117,16 +118,17 @@ template < typename MAPPER >
 class ring_conn : public MAPPER, public ring_conn_base {
 protected:
     template < typename... ARGS >
-    ring_conn(iomux& io, domid_t domid, evtchn_port_t port, ARGS&&... args);
+    ring_conn(iomux& io, hypervisor& hv, domid_t domid, evtchn_port_t port, ARGS&&... args);
     virtual ~ring_conn();
 };
 
 
 template < typename MAPPER >
 template < typename... ARGS >
-ring_conn<MAPPER>::ring_conn(iomux& io, domid_t domid, evtchn_port_t port, ARGS&&... args)
-    : MAPPER(domid, std::forward<ARGS>(args)...),
-    ring_conn_base(io, domid, port, MAPPER::interface)
+ring_conn<MAPPER>::ring_conn(iomux& io, hypervisor& hv, domid_t domid, evtchn_port_t port,
+        ARGS&&... args)
+    : MAPPER(hv, domid, std::forward<ARGS>(args)...),
+    ring_conn_base(io, hv, domid, port, MAPPER::interface)
 {
 }
 
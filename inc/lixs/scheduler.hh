@@ -0,0 +1,105 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#ifndef __LIXS_SCHEDULER_HH__
+#define __LIXS_SCHEDULER_HH__
+
+#include <lixs/event_mgr.hh>
+
+#include <list>
+
+
+namespace lixs {
+
+class scheduler;
+
+/* Priority classes, in the order they are served. */
+enum class sched_class {
+    dom0,
+    guest,
+    max,
+};
+
+/* Work that ran out of budget with more to do, resumed when its turn comes. */
+class sched_task {
+private:
+    friend scheduler;
+
+public:
+    sched_task(void);
+    virtual ~sched_task();
+
+protected:
+    virtual void resume(void) = 0;
+
+private:
+    bool queued;
+    sched_class cls;
+    std::list<sched_task*>::iterator it;
+};
+
+/* Weighted round robin between connections serviced by the same event loop. A connection handles
+ * up to budget(class) requests in a turn and then yields. Each pass gives a turn to every task
+ * queued when it starts, dom0 before guests, and runs behind the events already queued, so I/O
+ * keeps being serviced between passes. Budgets are in requests: the budget times the class weight.
+ */
+class scheduler {
+public:
+    scheduler(event_mgr& emgr, unsigned int budget);
+
+public:
+    void set_weight(sched_class c, unsigned int weight);
+    unsigned int budget(sched_class c);
+
+    void yield(sched_task& t, sched_class c);
+    void cancel(sched_task& t);
+
+private:
+    void run(void);
+
+private:
+    event_mgr& emgr;
+
+    unsigned int base;
+    unsigned int weights[static_cast<int>(sched_class::max)];
+    std::list<sched_task*> queues[static_cast<int>(sched_class::max)];
+
+    bool scheduled;
+};
+
+} /* namespace lixs */
+
+#endif /* __LIXS_SCHEDULER_HH__ */
@@ -53,7 +53,8 @@ namespace lixs {
 class sock_client : public client<xs_proto_v1::xs_proto<sock_conn> > {
 public:
     sock_client(long unsigned int id, std::function<void(void)> dead_cb,
-            xenstore& xs, domain_mgr& dmgr, event_mgr& emgr, iomux& io, log::logger& log, int fd);
+            xenstore& xs, domain_mgr& dmgr, event_mgr& emgr, iomux& io,
+            xs_proto_v1::trace_writer& trace, log::logger& log, int fd);
     ~sock_client();
 
 private:
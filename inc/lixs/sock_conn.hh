@@ -41,6 +41,7 @@
 
 #include <memory>
 #include <stdexcept>
+#include <string>
 
 
 namespace lixs {
@@ -51,6 +52,10 @@ class sock_conn_error : public std::runtime_error {
 
 class sock_conn_cb;
 
+/* Socket connection. Uses the multiplexer's stream_io when it has one, in which case data is
+ * received ahead into a backlog and sends are handed over to the multiplexer. Otherwise reads
+ * and writes go straight to the socket when it is ready.
+ */
 class sock_conn {
 private:
     friend sock_conn_cb;
@@ -71,7 +76,19 @@ protected:
     virtual void conn_dead(void) = 0;
 
 private:
+    bool stream_read(char*& buff, int& bytes);
+    bool stream_write(char*& buff, int& bytes);
+    void stream_recv(const char* data, int len);
+    void stream_sent(int queued);
+    void kill(void);
+
+private:
+    /* Backpressure thresholds for stream mode */
+    static const std::string::size_type rx_max = 64 * 1024;
+    static const int tx_max = 64 * 1024;
+
     iomux& io;
+    stream_io* sio;
 
     int fd;
     bool ev_read;
@@ -79,6 +96,13 @@ private:
 
     bool alive;
 
+    std::string rx_data;
+    std::string::size_type rx_off;
+    bool rx_paused;
+    bool rx_closed;
+    int tx_queued;
+    bool tx_blocked;
+
     std::shared_ptr<sock_conn_cb> cb;
 };
 
@@ -39,12 +39,77 @@
 
 #include <lixs/permissions.hh>
 
+#include <functional>
+#include <list>
 #include <set>
 #include <string>
 
 
 namespace lixs {
 
+struct store_stats {
+public:
+    store_stats(void)
+        : nodes(0), bytes(0), transactions(0)
+    { }
+
+
+    /* Number of valid entries and bytes used by their paths and values. */
+    unsigned long int nodes;
+    unsigned long int bytes;
+
+    /* Number of currently open transactions. */
+    unsigned long int transactions;
+};
+
+struct store_usage {
+public:
+    store_usage(void)
+        : nodes(0), bytes(0)
+    { }
+
+
+    /* Name of the child of the inspected path the entries belong to. */
+    std::string name;
+    /* Last entry accounted for, can be used to resume the inspection. */
+    std::string last;
+
+    unsigned long int nodes;
+    unsigned long int bytes;
+};
+
+struct owner_stats {
+public:
+    owner_stats(void)
+        : nodes(0), bytes(0)
+    { }
+
+
+    /* Number of valid entries owned by a domain and bytes used by their paths and values. */
+    unsigned long int nodes;
+    unsigned long int bytes;
+};
+
+struct transaction_stats {
+public:
+    transaction_stats(void)
+        : tid(0), records(0), age_ms(0)
+    { }
+
+
+    unsigned int tid;
+    unsigned long int records;
+    unsigned long int age_ms;
+};
+
+/* Called once per child name, in order. The name is only valid during the call. */
+typedef std::function<void(const std::string&)> children_cb;
+/* As above, returning false stops the listing. */
+typedef std::function<bool(const std::string&)> children_part_cb;
+
+/* Paths are passed by reference and only copied into the database when a new entry is created.
+ * Values are taken by value so that callers can move them all the way into the entry.
+ */
 class store {
 public:
     virtual void branch(unsigned int& tid) = 0;
@@ -52,21 +117,86 @@ public:
     virtual int abort(unsigned int tid) = 0;
 
     virtual int create(cid_t cid, unsigned int tid,
-            std::string path, bool& created) = 0;
+            const std::string& path, bool& created) = 0;
     virtual int read(cid_t cid, unsigned int tid,
-            std::string path, std::string& val) = 0;
+            const std::string& path, std::string& val) = 0;
     virtual int update(cid_t cid, unsigned int tid,
-            std::string path, std::string val) = 0;
+            const std::string& path, std::string val) = 0;
     virtual int del(cid_t cid, unsigned int tid,
-            std::string path) = 0;
+            const std::string& path) = 0;
+
+    /* Conditional updates, for read-modify-write cycles on a single entry without a transaction.
+     * The value is only written if the entry's version matches version (0 meaning the entry must
+     * not exist), or if its value matches expected, otherwise EAGAIN is returned. Either way
+     * version is set to the entry's current version. Versions are only available outside of
+     * transactions.
+     */
+    virtual int read(cid_t cid, unsigned int tid, const std::string& path,
+            std::string& val, unsigned long int& version) = 0;
+    virtual int update_if(cid_t cid, unsigned int tid, const std::string& path,
+            std::string val, unsigned long int& version) = 0;
+    virtual int update_if(cid_t cid, unsigned int tid, const std::string& path,
+            std::string val, const std::string& expected, unsigned long int& version) = 0;
+
+    /* Delete, in a single pass, every entry below path owned by owner together with its subtree.
+     * The roots of the deleted subtrees are returned in removed.
+     */
+    virtual int del_owned(cid_t owner, const std::string& path,
+            std::list<std::string>& removed) = 0;
+
+    /* Copy the subtree at src to dst, which must not exist yet. Permissions for from are given
+     * to to in the copy. Cloning is only supported outside of transactions, and only dom0 can
+     * clone, others get EACCES.
+     */
+    virtual int clone(cid_t cid, unsigned int tid, const std::string& src,
+            const std::string& dst, cid_t from, cid_t to) = 0;
 
     virtual int get_children(cid_t cid, unsigned int tid,
-            std::string path, std::set<std::string>& resp) = 0;
+            const std::string& path, std::set<std::string>& resp) = 0;
+    virtual int get_children(cid_t cid, unsigned int tid,
+            const std::string& path, const children_cb& cb) = 0;
+
+    /* List children from the first one not sorting before start, until cb returns false. The
+     * children generation returned in gen changes whenever the children list changes, so that
+     * listings split across calls can detect concurrent modifications.
+     */
+    virtual int get_children_part(cid_t cid, unsigned int tid, const std::string& path,
+            const std::string& start, const children_part_cb& cb, unsigned long int& gen) = 0;
 
     virtual int get_perms(cid_t cid, unsigned int tid,
-            std::string path, permission_list& perms) = 0;
+            const std::string& path, permission_list& perms) = 0;
+    /* Only dom0 can change an entry's owner, i.e. its first permission, others get EACCES. */
     virtual int set_perms(cid_t cid, unsigned int tid,
-            std::string path, const permission_list& perms) = 0;
+            const std::string& path, const permission_list& perms) = 0;
+
+    /* Limits on the entries owned by each domain other than dom0, 0 meaning no limit. Requests
+     * from domains other than dom0 that would take the owner of the entries they change over its
+     * limits fail with ENOSPC. Transactions are checked as a whole when merged. Usage is tracked
+     * whether limits are set or not.
+     */
+    virtual void set_quota(unsigned long int nodes, unsigned long int bytes) = 0;
+
+    virtual void get_stats(store_stats& stats) = 0;
+    virtual void get_owner_stats(cid_t owner, owner_stats& stats) = 0;
+    virtual void get_transaction_stats(std::list<transaction_stats>& stats) = 0;
+    virtual int get_usage(const std::string& path, const std::string& cursor,
+            unsigned long int max_entries, std::list<store_usage>& usage, std::string& next) = 0;
+};
+
+/* Read-only access to committed entries, usable from any thread while the store is being updated.
+ * Results are the same as reading from the store outside of a transaction. Each thread reads
+ * through a reader of its own, added before it starts reading.
+ */
+class store_view {
+public:
+    virtual unsigned int add_reader(void) = 0;
+
+    virtual int read(unsigned int reader, cid_t cid,
+            const std::string& path, std::string& val) = 0;
+    virtual int get_children(unsigned int reader, cid_t cid,
+            const std::string& path, const children_cb& cb) = 0;
+    virtual int get_perms(unsigned int reader, cid_t cid,
+            const std::string& path, permission_list& perms) = 0;
 };
 
 } /* namespace lixs */
@@ -41,8 +41,10 @@
 #include <lixs/event_mgr.hh>
 #include <lixs/iomux.hh>
 #include <lixs/log/logger.hh>
+#include <lixs/reactor.hh>
 #include <lixs/sock_client.hh>
 #include <lixs/xenstore.hh>
+#include <lixs/xs_proto_v1/trace.hh>
 
 #include <stdexcept>
 #include <string>
@@ -56,25 +58,31 @@ class unix_sock_server_error : public std::runtime_error {
 
 class unix_sock_server {
 public:
-    unix_sock_server(xenstore& xs, domain_mgr& dmgr, event_mgr& emgr, iomux& io, log::logger& log,
+    unix_sock_server(xenstore& xs, domain_mgr& dmgr, event_mgr& emgr, iomux& io,
+            reactor_pool& reactors, xs_proto_v1::trace_writer& trace, log::logger& log,
             const std::string& rw_path, const std::string& ro_path);
     ~unix_sock_server();
 
 private:
     void callback(bool read, bool write, bool error, int fd);
+    void new_client(int client_fd);
 
 private:
     int bind_socket(const std::string& path, std::string& err_msg);
     void client_dead(long unsigned int id);
+    void client_delete(sock_client* client, reactor* r);
 
 private:
-    typedef std::map<long unsigned int, sock_client*> client_map;
+    /* Clients and the reactor servicing them, NULL if serviced by this thread. */
+    typedef std::map<long unsigned int, std::pair<sock_client*, reactor*> > client_map;
 
 private:
     xenstore& xs;
     domain_mgr& dmgr;
     event_mgr& emgr;
     iomux& io;
+    reactor_pool& reactors;
+    xs_proto_v1::trace_writer& trace;
     log::logger& log;
 
     std::string rw_path;
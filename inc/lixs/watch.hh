@@ -37,23 +37,60 @@
 #ifndef __LIXS_WATCH_HH__
 #define __LIXS_WATCH_HH__
 
+#include <lixs/permissions.hh>
+
+#include <limits>
+#include <memory>
 #include <string>
 
 
 namespace lixs {
 
+/* State of the fired path right after the change that fired the watch. A single instance is
+ * shared by all the events of a change.
+ */
+class watch_value {
+public:
+    watch_value(bool deleted)
+        : deleted(deleted)
+    { }
+
+
+    bool deleted;
+    std::string value;
+    permission_list perms;
+};
+
+typedef std::shared_ptr<const watch_value> watch_value_ptr;
+
+/* Depth of watches firing for changes anywhere below their path. A watch limited to depth 0 only
+ * fires for changes to its path, one limited to depth 1 also for changes to its children, etc.
+ * Removing the watched path or one of its parents fires watches of any depth.
+ */
+const unsigned int watch_depth_any = std::numeric_limits<unsigned int>::max();
+
 class watch_cb {
 public:
-    watch_cb(const std::string& path, const std::string& token)
-        : path(path), token(token)
+    watch_cb(const std::string& path, const std::string& token, bool with_value,
+            unsigned int depth, cid_t owner = 0)
+        : path(path), token(token), with_value(with_value), depth(depth), owner(owner)
     { }
 
 public:
     virtual void operator()(const std::string& path) = 0;
 
+    /* Only called for watches registered with_value, when the state of the fired path is known.
+     * The caller doesn't check whether the watcher can read it.
+     */
+    virtual void operator()(const std::string& path, const watch_value& value) = 0;
+
 public:
     const std::string path;
     const std::string token;
+    const bool with_value;
+    const unsigned int depth;
+    /* Domain the watch is accounted to, see watch_mgr::set_quota. */
+    const cid_t owner;
 };
 
 } /* namespace lixs */
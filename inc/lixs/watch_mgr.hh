@@ -49,50 +49,125 @@
 
 namespace lixs {
 
+struct watch_fanout {
+public:
+    watch_fanout(void)
+        : path_watches(0), children_watches(0)
+    { }
+
+
+    std::string path;
+
+    /* Watches registered on the path itself. */
+    unsigned long int path_watches;
+    /* Watches registered on paths below this one. */
+    unsigned long int children_watches;
+};
+
 class watch_mgr {
 public:
     watch_mgr(event_mgr& emgr);
     ~watch_mgr();
 
-    void add(watch_cb& cb);
+    /* Fails with ENOSPC if the watch's owner already has as many watches as its quota. */
+    int add(watch_cb& cb);
     void del(watch_cb& cb);
+    void del(const std::list<watch_cb*>& cbs);
+
+    /* Limit on the number of watches of each domain other than dom0, 0 meaning no limit. */
+    void set_quota(unsigned long int watches);
+    unsigned long int owner_size(cid_t owner);
 
-    void fire(unsigned int tid, const std::string& path);
-    void fire_parents(unsigned int tid, const std::string& path);
-    void fire_children(unsigned int tid, const std::string& path);
+    /* The value is given to watches registered with_value, it can be null if unknown. Building
+     * it is only worth it if has_value_watches returns true.
+     */
+    void fire(unsigned int tid, const std::string& path, const watch_value_ptr& value);
+    void fire_parents(unsigned int tid, const std::string& path, const watch_value_ptr& value);
+    void fire_children(unsigned int tid, const std::string& path, const watch_value_ptr& value);
 
     void fire_transaction(unsigned int tid);
     void abort_transaction(unsigned int tid);
 
+    unsigned long int size(void);
+    bool has_value_watches(void);
+    void get_fanout(unsigned long int offset, unsigned long int count,
+            std::list<watch_fanout>& fanout);
+
 private:
     typedef std::set<watch_cb*> watch_set;
+    /* Watches by depth, so that firing for a change some levels below can start straight at the
+     * first watch deep enough.
+     */
+    typedef std::map<unsigned int, watch_set> depth_map;
+
     struct record {
-        watch_set path;
+        record(void)
+            : n_path(0)
+        { }
+
+
+        /* Watches registered on the path. */
+        depth_map path;
+        unsigned long int n_path;
+
+        /* Watches registered on paths below this one. */
         watch_set children;
     };
 
     typedef std::map<std::string, record> database;
 
+    /* Paths with watches registered on them, most watched first and then by path. Kept up to date
+     * as watches come and go, so that XS_DEBUG can page through it without sorting.
+     */
+    struct rank_order {
+        bool operator()(const database::iterator& a, const database::iterator& b) const
+        {
+            return a->second.n_path > b->second.n_path
+                || (a->second.n_path == b->second.n_path && a->first < b->first);
+        }
+    };
+
+    typedef std::set<database::iterator, rank_order> ranking;
+
     typedef std::list<std::function<void(void)> > fire_list;
     typedef std::map<unsigned int, fire_list> transaction_database;
 
+    typedef std::map<cid_t, unsigned long int> owner_map;
+
 private:
-    void callback(const std::string& key, watch_cb* cb, const std::string& path);
-
-    void _fire(const std::string& path, const std::string& fire_path);
-    void _tfire(unsigned int tid, const std::string& path, const std::string& fire_path);
-    void _fire_parents(const std::string& path, const std::string& fire_path);
-    void _tfire_parents(unsigned int tid, const std::string& path, const std::string& fire_path);
-    void _fire_children(const std::string& path);
-    void _tfire_children(unsigned int tid, const std::string& path);
+    void callback(const std::string& key, watch_cb* cb, const std::string& path,
+            const watch_value_ptr& value);
+
+    void add_path(database::iterator it, watch_cb* cb);
+    void del_path(database::iterator it, watch_cb* cb);
+
+    void _fire(const std::string& path, const std::string& fire_path, unsigned int depth,
+            const watch_value_ptr& value);
+    void _tfire(unsigned int tid, const std::string& path, const std::string& fire_path,
+            unsigned int depth, const watch_value_ptr& value);
+    void _fire_parents(const std::string& path, const std::string& fire_path,
+            unsigned int depth, const watch_value_ptr& value);
+    void _tfire_parents(unsigned int tid, const std::string& path, const std::string& fire_path,
+            unsigned int depth, const watch_value_ptr& value);
+    void _fire_children(const std::string& path, const watch_value_ptr& value);
+    void _tfire_children(unsigned int tid, const std::string& path, const watch_value_ptr& value);
     void register_with_parents(const std::string& path, watch_cb& cb);
     void unregister_from_parents(const std::string& path, watch_cb& cb);
+    void release(cid_t owner);
 
 private:
     event_mgr& emgr;
 
     database db;
+    ranking ranked;
     transaction_database tdb;
+
+    unsigned long int n_watches;
+    unsigned long int n_value_watches;
+
+    /* Watches by owner, only owners with watches are kept. */
+    owner_map owners;
+    unsigned long int owner_max;
 };
 
 } /* namespace lixs */
@@ -40,6 +40,7 @@
 #include <lixs/client.hh>
 #include <lixs/domain_mgr.hh>
 #include <lixs/event_mgr.hh>
+#include <lixs/hypervisor.hh>
 #include <lixs/iomux.hh>
 #include <lixs/log/logger.hh>
 #include <lixs/ring_conn.hh>
@@ -63,7 +64,7 @@ class xenbus_error : public std::runtime_error {
 
 class xenbus_mapper {
 protected:
-    xenbus_mapper(domid_t domid);
+    xenbus_mapper(hypervisor& hv, domid_t domid);
     virtual ~xenbus_mapper();
 
 protected:
@@ -76,7 +77,8 @@ private:
 
 class xenbus : public client<xs_proto_v1::xs_proto<ring_conn<xenbus_mapper> > > {
 public:
-    xenbus(xenstore& xs, domain_mgr& dmgr, event_mgr& emgr, iomux& io, log::logger& log);
+    xenbus(xenstore& xs, domain_mgr& dmgr, event_mgr& emgr, iomux& io, hypervisor& hv,
+            xs_proto_v1::trace_writer& trace, log::logger& log);
     ~xenbus();
 
 private:
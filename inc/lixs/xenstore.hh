@@ -37,15 +37,24 @@
 #ifndef __LIXS_XENSTORE_HH__
 #define __LIXS_XENSTORE_HH__
 
+#include <lixs/commit_log.hh>
 #include <lixs/event_mgr.hh>
 #include <lixs/iomux.hh>
 #include <lixs/permissions.hh>
+#include <lixs/rate_limiter.hh>
+#include <lixs/scheduler.hh>
 #include <lixs/store.hh>
+#include <lixs/watch.hh>
 #include <lixs/watch_mgr.hh>
 
 #include <cerrno>
+#include <chrono>
+#include <list>
+#include <map>
 #include <string>
 #include <set>
+#include <utility>
+#include <vector>
 
 extern "C" {
 #include <xenctrl.h>
@@ -54,6 +63,69 @@ extern "C" {
 
 namespace lixs {
 
+struct op_stats {
+public:
+    op_stats(void)
+        : count(0), total_ns(0), max_ns(0)
+    { }
+
+
+    unsigned long int count;
+    unsigned long long int total_ns;
+    unsigned long long int max_ns;
+};
+
+struct xenstore_stats {
+public:
+    xenstore_stats(void)
+        : watches(0), events(0)
+    { }
+
+
+    store_stats store;
+
+    unsigned long int watches;
+    unsigned long int events;
+
+    std::map<std::string, op_stats> ops;
+};
+
+struct domain_stats {
+public:
+    domain_stats(void)
+        : watches(0)
+    { }
+
+
+    /* Entries owned by the domain. */
+    owner_stats store;
+
+    unsigned long int watches;
+};
+
+enum class batch_type {
+    write,
+    mkdir,
+    rm,
+    set_perms,
+};
+
+/* A single operation of a batch, see xenstore::store_batch. Only the fields used by the operation
+ * type need to be set.
+ */
+struct batch_op {
+public:
+    batch_op(batch_type type, std::string path)
+        : type(type), path(std::move(path))
+    { }
+
+
+    batch_type type;
+    std::string path;
+    std::string value;
+    permission_list perms;
+};
+
 class xenstore {
 public:
     xenstore(store& st, event_mgr& emgr, iomux& io);
@@ -62,33 +134,132 @@ public:
     int store_read(cid_t cid, unsigned int tid,
             const std::string& path, std::string& val);
     int store_write(cid_t cid, unsigned int tid,
-            const std::string& path, const std::string& val);
+            const std::string& path, std::string val);
+
+    /* Versioned reads and conditional writes, see store::update_if. */
+    int store_read(cid_t cid, unsigned int tid, const std::string& path,
+            std::string& val, unsigned long int& version);
+    int store_write_if(cid_t cid, unsigned int tid, const std::string& path,
+            std::string val, unsigned long int& version);
+    int store_write_if(cid_t cid, unsigned int tid, const std::string& path,
+            std::string val, const std::string& expected, unsigned long int& version);
+
     int store_mkdir(cid_t cid, unsigned int tid,
             const std::string& path);
     int store_rm(cid_t cid, unsigned int tid,
             const std::string& path);
     int store_dir(cid_t cid, unsigned int tid,
-            const std::string& path, std::set<std::string>& res);
+            const std::string& path, const children_cb& cb);
+    int store_dir_part(cid_t cid, unsigned int tid, const std::string& path,
+            const std::string& start, const children_part_cb& cb, unsigned long int& gen);
     int store_get_perms(cid_t cid, unsigned int tid,
             const std::string& path, permission_list& perms);
     int store_set_perms(cid_t cid, unsigned int tid,
             const std::string& path, const permission_list& perms);
 
+    /* Run the operations in order, stopping at the first failure. Results of the operations run
+     * are returned in results. Outside of a transaction the batch is applied atomically, either
+     * all operations succeed or none is applied, and watches fire once it's done. Inside a
+     * transaction operations are applied to it as they would be one by one, and a failure is
+     * returned and dooms the transaction: it can only be aborted, committing it aborts it and
+     * returns the same error, so a partial batch is never committed.
+     */
+    int store_batch(cid_t cid, unsigned int tid,
+            std::vector<batch_op>& batch, std::vector<int>& results);
+    int store_clone(cid_t cid, unsigned int tid, const std::string& src,
+            const std::string& dst, cid_t from, cid_t to);
+
     int transaction_start(cid_t cid, unsigned int* tid);
     int transaction_end(cid_t cid, unsigned int tid, bool commit);
 
-    void watch_add(watch_cb& cb);
+    int watch_add(watch_cb& cb);
     void watch_del(watch_cb& cb);
+    void watch_del(const std::list<watch_cb*>& cbs);
 
     /* FIXME: should domain operations also receive a client id? */
     void domain_path(domid_t domid, std::string& path);
     void domain_introduce(domid_t domid);
     void domain_release(domid_t domid);
+    void domain_teardown(domid_t domid);
+
+    /* Scheduler of the connections serviced by the thread owning the store, NULL by default. */
+    void set_scheduler(scheduler* sched);
+    scheduler* get_scheduler(void);
+
+    /* Log making changes durable, replies are held until the changes before them are. NULL by
+     * default.
+     */
+    void set_commit_log(commit_log* clog);
+    commit_log* get_commit_log(void);
+
+    /* Rate limiter of the guest connections, NULL by default. */
+    void set_rate_limiter(rate_limiter* limiter);
+    rate_limiter* get_rate_limiter(void);
+
+    /* Per domain limits, 0 meaning no limit, see store::set_quota and watch_mgr::set_quota. */
+    void set_quota(unsigned long int nodes, unsigned long int bytes, unsigned long int watches);
+
+    void get_stats(xenstore_stats& stats);
+    void get_domain_stats(domid_t domid, domain_stats& stats);
+    void get_transaction_stats(std::list<transaction_stats>& stats);
+    void get_watch_fanout(unsigned long int offset, unsigned long int count,
+            std::list<watch_fanout>& fanout);
+    int get_usage(const std::string& path, const std::string& cursor,
+            unsigned long int max_entries, std::list<store_usage>& usage, std::string& next);
+
+private:
+    enum op {
+        op_read,
+        op_write,
+        op_write_if,
+        op_mkdir,
+        op_rm,
+        op_dir,
+        op_dir_part,
+        op_get_perms,
+        op_set_perms,
+        op_batch,
+        op_clone,
+        op_transaction_start,
+        op_transaction_end,
+        op_max,
+    };
+
+    class op_timer {
+    public:
+        op_timer(op_stats& stats);
+        ~op_timer();
+
+    private:
+        op_stats& stats;
+        std::chrono::steady_clock::time_point start;
+    };
 
 private:
+    int apply_write(cid_t cid, unsigned int tid, const std::string& path, std::string val);
+    int apply_mkdir(cid_t cid, unsigned int tid, const std::string& path);
+    int apply_rm(cid_t cid, unsigned int tid, const std::string& path);
+    int apply_set_perms(cid_t cid, unsigned int tid, const std::string& path,
+            const permission_list& perms);
+
+    watch_value_ptr current_value(unsigned int tid, const std::string& path);
+    watch_value_ptr deleted_value(void);
+
+private:
+    static const char* op_names[op_max];
+
     store& st;
+    event_mgr& emgr;
+    scheduler* sched;
+    commit_log* clog;
+    rate_limiter* limiter;
 
     watch_mgr wmgr;
+
+    /* Transactions a batch failed in, with the error to fail their commit with. */
+    std::map<unsigned int, int> doomed;
+
+    op_stats ops[op_max];
 };
 
 } /* namespace lixs */
@@ -0,0 +1,140 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#ifndef __LIXS_XS_PROTO_V1_TRACE_HH__
+#define __LIXS_XS_PROTO_V1_TRACE_HH__
+
+#include <lixs/event_mgr.hh>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+
+extern "C" {
+#include <xen/xen.h>
+#include <xen/io/xs_wire.h>
+}
+
+
+namespace lixs {
+namespace xs_proto_v1 {
+
+class trace_error : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+
+/*
+ * A trace file starts with trace_magic followed by a sequence of records. Each record is a
+ * trace_record immediately followed by hdr.len bytes of message body, all in host byte order.
+ * A record of type trace_conn_closed, without body, marks the end of a connection.
+ */
+const char trace_magic[8] = { 'L', 'I', 'X', 'S', 'T', 'R', 'C', '1' };
+const uint32_t trace_conn_closed = XS_INVALID;
+
+struct trace_record {
+    /* Time since the start of the capture */
+    uint64_t time_ns;
+    /* Connection id, unique within the trace */
+    uint32_t conn;
+    uint32_t domid;
+    struct xsd_sockmsg hdr;
+};
+
+
+/* Records are buffered and written once per event loop iteration, so a crash loses at most the
+ * requests of the iteration it happened in, and none if flush is called on the way down.
+ */
+class trace_writer {
+public:
+    /* Tracing disabled */
+    trace_writer(void);
+    trace_writer(const std::string& path, event_mgr& emgr);
+    ~trace_writer();
+
+public:
+    bool enabled(void)
+    {
+        return fd != -1;
+    }
+
+    uint32_t conn_open(void);
+    void conn_closed(uint32_t conn, domid_t domid);
+    void record(uint32_t conn, domid_t domid, const struct xsd_sockmsg& hdr, const char* body);
+
+    /* Write the buffered records. Only uses async-signal-safe calls, so it can be called from
+     * the handler of a fatal signal.
+     */
+    void flush(void);
+
+private:
+    void append(const void* data, std::size_t len);
+    void flush_event(void);
+
+private:
+    int fd;
+    event_mgr* emgr;
+
+    char* buff;
+    std::size_t used;
+    bool flush_queued;
+
+    uint32_t next_conn;
+    std::chrono::steady_clock::time_point start;
+};
+
+
+class trace_reader {
+public:
+    trace_reader(const std::string& path);
+    ~trace_reader();
+
+public:
+    /* Returns false at the end of the trace. */
+    bool next(trace_record& rec, std::string& body);
+
+private:
+    std::FILE* fp;
+};
+
+} /* namespace xs_proto_v1 */
+} /* namespace lixs */
+
+#endif /* __LIXS_XS_PROTO_V1_TRACE_HH__ */
+
@@ -37,16 +37,27 @@
 #ifndef __LIXS_XS_PROTO_V1_XS_PROTO_HH__
 #define __LIXS_XS_PROTO_V1_XS_PROTO_HH__
 
+#include <lixs/commit_log.hh>
 #include <lixs/domain_mgr.hh>
 #include <lixs/log/logger.hh>
 #include <lixs/permissions.hh>
+#include <lixs/rate_limiter.hh>
+#include <lixs/reactor.hh>
+#include <lixs/scheduler.hh>
+#include <lixs/store.hh>
+#include <lixs/xs_proto_v1/trace.hh>
 #include <lixs/watch.hh>
 #include <lixs/xenstore.hh>
 
+#include <atomic>
 #include <cstring>
+#include <functional>
 #include <list>
+#include <mutex>
+#include <set>
 #include <string>
 #include <utility>
+#include <vector>
 
 extern "C" {
 #include <xen/xen.h>
@@ -60,6 +71,64 @@ namespace xs_proto_v1 {
 /* /local/domain/<id> */
 const int dom_path_length_max = 35;
 
+/* Read-only virtual subtree exposing runtime statistics */
+const std::string stats_path = "@stats";
+
+/* Maximum number of store entries inspected by a single XS_DEBUG mem request */
+const unsigned long int debug_mem_scan_max = 16384;
+
+/* XS_DIRECTORY_PART is missing from older Xen headers, its value is fixed by the protocol */
+const uint32_t xs_directory_part = 22;
+
+/* Batch of operations, a lixs extension. The body is a sequence of sub-requests, each made of a
+ * batch_hdr followed by the body of the equivalent single request. XS_WRITE, XS_MKDIR, XS_RM and
+ * XS_SET_PERMS can be batched. The reply holds the result of each operation run, in order, as
+ * "OK" or an error name. Inside a transaction a failing operation fails the batch with its error
+ * instead, and the transaction must then be aborted. See xenstore::store_batch for how the batch
+ * is applied.
+ */
+const uint32_t xs_batch = 128;
+
+/* Subtree clone, a lixs extension. The body holds the source path, the destination path and two
+ * domain ids: permissions for the first are given to the second in the copy.
+ */
+const uint32_t xs_clone = 129;
+
+/* Versioned read and conditional writes, lixs extensions. XS_READ_VERSION replies with the entry's
+ * version followed by its value. XS_WRITE_VERSION ("path\0version\0value") writes only if the
+ * entry's version matches, 0 meaning it must not exist, and XS_WRITE_MATCH ("path\0expected\0
+ * value") only if its value matches. Conditional writes reply with the new version, or with
+ * EAGAIN followed by the current version on a mismatch.
+ */
+const uint32_t xs_read_version = 130;
+const uint32_t xs_write_version = 131;
+const uint32_t xs_write_match = 132;
+
+/* Watch flags, a lixs extension, are given as a third comma separated XS_WATCH argument:
+ *
+ * * "value": events carry the state of the fired path after the token, "V" followed by the
+ *   value, "D" if the path was deleted or "U" if the state is unknown or the path can't be read
+ *   by the watcher;
+ * * "exact": only changes to the watched path fire the watch;
+ * * "depth=N": only changes up to N levels below the watched path fire the watch.
+ */
+const std::string watch_flag_value = "value";
+const std::string watch_flag_exact = "exact";
+const std::string watch_flag_depth = "depth=";
+const std::string watch_state_value = "V";
+const std::string watch_state_deleted = "D";
+const std::string watch_state_unknown = "U";
+
+struct batch_hdr {
+    uint32_t type;
+    uint32_t len;
+};
+
+/* Room for child names in a XS_DIRECTORY_PART reply: the generation (up to 20 digits) and the
+ * end of list marker take the rest, each followed by a null byte.
+ */
+const unsigned int dir_part_names_max = XENSTORE_PAYLOAD_MAX - 22;
+
 
 class xs_proto_base;
 
@@ -106,11 +175,15 @@ public:
 
 class watch_cb : public lixs::watch_cb {
 public:
-    watch_cb(xs_proto_base& proto,
-            const std::string& path, const std::string& token, bool relative);
+    watch_cb(xs_proto_base& proto, const std::string& path, const std::string& token,
+            bool relative, bool with_value, unsigned int depth);
 
 public:
     void operator()(const std::string& fire_path);
+    void operator()(const std::string& fire_path, const watch_value& value);
+
+private:
+    void send(const std::string& fire_path, std::list<std::string> state, bool terminator);
 
 private:
     xs_proto_base& proto;
@@ -121,19 +194,50 @@ typedef std::pair<std::string, std::string> watch_key;
 typedef std::map<watch_key, watch_cb> watch_map;
 
 
+/* Where the last XS_DIRECTORY_PART reply of a connection stopped. A request for the next page
+ * resumes from the child it stopped at instead of walking all the children before it.
+ */
+struct dir_part_cursor {
+public:
+    dir_part_cursor(void)
+        : tx_id(0), offset(0)
+    { }
+
+
+    std::string path;
+    uint32_t tx_id;
+    unsigned int offset;
+    std::string next;
+};
+
+
 enum class io_state {
     p,
     hdr,
     body,
+    wait,
 };
 
 
-class xs_proto_base {
+class xs_proto_base : public sched_task, public commit_waiter {
 protected:
     friend watch_cb;
 
+public:
+    unsigned long int queue_length(void);
+    unsigned long int watch_count(void);
+    unsigned long int throttle_count(void);
+
+    /* Moves request processing to the store thread, run by `store`. The connection stays with the
+     * reactor run by `io`, where framing and serialization happen. If a view is given, reads are
+     * served from it by the reactor, using `reader`. Must be called on the reactor before the
+     * connection is first serviced.
+     */
+    void offload(executor& store, executor& io, store_view* view, unsigned int reader);
+
 protected:
-    xs_proto_base(domid_t domid, xenstore& xs, domain_mgr& dmgr, log::logger& log);
+    xs_proto_base(domid_t domid, xenstore& xs, domain_mgr& dmgr, trace_writer& trace,
+            log::logger& log);
     virtual ~xs_proto_base();
 
 protected:
@@ -143,7 +247,10 @@ protected:
 
 protected:
     void handle_rx(void);
+    bool handle_rx_view(void);
+    void flush_tx(void);
     bool prepare_tx(void);
+    void durable(void);
 
 private:
     void op_read(void);
@@ -151,22 +258,45 @@ private:
     void op_mkdir(void);
     void op_rm(void);
     void op_directory(void);
+    void op_directory_part(void);
     void op_transaction_start(void);
     void op_transaction_end(void);
     void op_get_domain_path(void);
     void op_get_perms(void);
     void op_set_perms(void);
+    void op_batch(void);
+    void op_clone(void);
+    void op_read_version(void);
+    void op_write_version(void);
+    void op_write_match(void);
+    void write_if_reply(int ret, unsigned long int version);
+    bool parse_watch_flags(const char* flags, bool& with_value, unsigned int& depth);
     void op_watch(void);
     void op_unwatch(void);
     void op_introduce(void);
     void op_release(void);
     void op_is_domain_introduced(void);
+    void op_debug(void);
     void op_unimplemented(void);
 
+    bool is_stats_path(const std::string& path);
+    int stats_read(const std::string& path, std::string& val);
+    int stats_dir(const std::string& path, std::set<std::string>& res);
+    int stats_node(const std::string& path, std::string& val, std::set<std::string>& children);
+
+    int debug_mem(char* arg, std::string& out);
+    int debug_watches(char* arg, std::string& out);
+    int debug_transactions(char* arg, std::string& out);
+    int debug_connections(char* arg, std::string& out);
+    int debug_alloc(char* arg, std::string& out);
+
+    bool parse_batch(std::vector<batch_op>& batch);
+
     void perm2str(const permission& perm, std::string& str);
     bool str2perm(const std::string& str, permission& perm);
     std::string err2str(int err);
     std::string path2rel(std::string path);
+    std::string rel2abs(const char* path);
 
     char* get_arg1(void);
     char* get_arg2(void);
@@ -178,11 +308,19 @@ private:
     int get_int(const char* arg, int_t& number);
 
     void build_hdr(uint32_t type, uint32_t req_id, uint32_t tx_id);
-    bool build_body(std::string elem, bool terminator);
-    bool build_body(std::list<std::string> elems, bool terminator);
+    bool build_body(const std::string& elem, bool terminator);
+    bool build_body(const std::list<std::string>& elems, bool terminator);
 
     static std::string get_dom_path(domid_t domid, xenstore& xs);
 
+private:
+    /* Every live connection, for XS_DEBUG connections. Connections might come and go on other
+     * threads, so the list is locked.
+     */
+    static std::mutex registry_lock;
+    static std::list<xs_proto_base*> registry;
+    std::list<xs_proto_base*>::iterator registry_it;
+
 protected:
     domid_t domid;
     std::string dom_path;
@@ -190,13 +328,53 @@ protected:
     wire rx_msg;
     wire tx_msg;
 
+    /* Replies are queued to tx_queue while handling requests and moved over to tx_out, owned by
+     * the thread servicing the connection, once handling is done.
+     */
     std::list<message> tx_queue;
+    std::list<message> tx_out;
+    std::atomic<unsigned long int> tx_pending;
+
+    /* Replies held until the changes committed before them are durable, when there is a commit
+     * log. Offloaded connections stop reading until they are released.
+     */
+    commit_log* clog;
+    std::list<message> tx_held;
+    bool holding;
+    bool rx_held;
     watch_map watches;
+    dir_part_cursor dir_part;
 
     xenstore& xs;
     domain_mgr& dmgr;
 
+    trace_writer& trace;
+    uint32_t trace_conn;
+
     log::logger& log;
+
+    executor* store_exec;
+    executor* io_exec;
+
+    store_view* view;
+    unsigned int view_reader;
+
+    /* Requests are handled in turns of a limited budget when set, never when offloaded. */
+    scheduler* sched;
+    sched_class sched_cls;
+
+    /* Guests take a token from their bucket for each request when set. */
+    rate_limiter* limiter;
+    token_bucket bucket;
+
+    /* Set by the store thread, watch events are only ordered with replies from that thread. */
+    std::atomic<bool> watching;
+
+    /* Where reading stands after the last pass, published by the thread servicing the connection
+     * for XS_DEBUG: the state and the bytes of the message being read still to come.
+     */
+    std::atomic<io_state> rx_stage;
+    std::atomic<int> rx_missing;
 };
 
 
@@ -204,7 +382,8 @@ template < typename CONNECTION >
 class xs_proto: public CONNECTION, public xs_proto_base {
 protected:
     template < typename... ARGS >
-    xs_proto(domid_t domid, xenstore& xs, domain_mgr& dmgr, log::logger& log, ARGS&&... args);
+    xs_proto(domid_t domid, xenstore& xs, domain_mgr& dmgr, trace_writer& trace, log::logger& log,
+            ARGS&&... args);
     ~xs_proto();
 
 protected:
@@ -212,8 +391,13 @@ protected:
 
 private:
     void process_rx(void);
+    void receive(void);
     void process_tx(void);
 
+    void handle_rx_offloaded(void);
+    void resume_rx(void);
+    void resume(void);
+
 private:
     io_state rx_state;
     io_state tx_state;
@@ -222,14 +406,16 @@ private:
     char* tx_buff;
     int rx_bytes;
     int tx_bytes;
+
+    unsigned int rx_turn;
 };
 
 template < typename CONNECTION >
 template < typename... ARGS >
-xs_proto<CONNECTION>::xs_proto(domid_t domid, xenstore& xs, domain_mgr& dmgr, log::logger& log,
-        ARGS&&... args)
-    : CONNECTION(std::forward<ARGS>(args)...), xs_proto_base(domid, xs, dmgr, log),
-    rx_state(io_state::p), tx_state(io_state::p)
+xs_proto<CONNECTION>::xs_proto(domid_t domid, xenstore& xs, domain_mgr& dmgr, trace_writer& trace,
+        log::logger& log, ARGS&&... args)
+    : CONNECTION(std::forward<ARGS>(args)...), xs_proto_base(domid, xs, dmgr, trace, log),
+    rx_state(io_state::p), tx_state(io_state::p), rx_turn(0)
 {
     CONNECTION::need_rx();
 }
@@ -237,17 +423,39 @@ xs_proto<CONNECTION>::xs_proto(domid_t domid, xenstore& xs, domain_mgr& dmgr, lo
 template < typename CONNECTION >
 xs_proto<CONNECTION>::~xs_proto()
 {
+    std::list<lixs::watch_cb*> cbs;
+
     for (auto& w : watches) {
-        xs.watch_del(w.second);
+        cbs.push_back(&(w.second));
     }
+
+    xs.watch_del(cbs);
 }
 
 template < typename CONNECTION >
 void xs_proto<CONNECTION>::process_rx(void)
 {
+    receive();
+
+    rx_stage.store(rx_state, std::memory_order_relaxed);
+    rx_missing.store(rx_state == io_state::hdr || rx_state == io_state::body ? rx_bytes : 0,
+            std::memory_order_relaxed);
+}
+
+template < typename CONNECTION >
+void xs_proto<CONNECTION>::receive(void)
+{
+    rx_turn = 0;
+
     while (true) {
         switch(rx_state) {
             case io_state::p:
+                /* Out of tokens, reading resumes once the bucket is refilled. */
+                if (limiter != NULL && !limiter->take(bucket)) {
+                    rx_state = io_state::wait;
+                    return;
+                }
+
                 rx_buff = reinterpret_cast<char*>(&(rx_msg.hdr));
                 rx_bytes = sizeof(rx_msg.hdr);
 
@@ -275,14 +483,67 @@ void xs_proto<CONNECTION>::process_rx(void)
                 log::LOG<log::level::TRACE>::logf(log, "[%4s] %s %s",
                         cid().c_str(), ">", static_cast<std::string>(rx_msg).c_str());
 
-                handle_rx();
+                /* When offloaded, reads might be served right here. Otherwise stop reading until
+                 * the store thread is done with rx_msg.
+                 */
+                if (store_exec != NULL) {
+                    if (view == NULL || !handle_rx_view()) {
+                        rx_state = io_state::wait;
+                        store_exec->post(std::bind(&xs_proto::handle_rx_offloaded, this));
+                        return;
+                    }
+
+                    process_tx();
+                } else {
+                    handle_rx();
+
+                    /* Out of budget, reading resumes once the others had their turn. */
+                    if (sched != NULL && ++rx_turn >= sched->budget(sched_cls)) {
+                        rx_state = io_state::wait;
+                        sched->yield(*this, sched_cls);
+                        return;
+                    }
+                }
 
                 rx_state = io_state::p;
                 break;
+
+            case io_state::wait:
+                return;
         }
     }
 }
 
+template < typename CONNECTION >
+void xs_proto<CONNECTION>::handle_rx_offloaded(void)
+{
+    handle_rx();
+
+    /* Resumed once the replies are released instead, reading the next request from the view
+     * before that would return changes not durable yet.
+     */
+    if (holding) {
+        rx_held = true;
+        return;
+    }
+
+    /* Posted after the replies, so they are serialized before the next request is read. */
+    io_exec->post(std::bind(&xs_proto::resume_rx, this));
+}
+
+template < typename CONNECTION >
+void xs_proto<CONNECTION>::resume_rx(void)
+{
+    rx_state = io_state::p;
+    process_rx();
+}
+
+template < typename CONNECTION >
+void xs_proto<CONNECTION>::resume(void)
+{
+    resume_rx();
+}
+
 template < typename CONNECTION >
 void xs_proto<CONNECTION>::process_tx(void)
 {
@@ -320,6 +581,9 @@ void xs_proto<CONNECTION>::process_tx(void)
 
                 tx_state = io_state::p;
                 break;
+
+            case io_state::wait:
+                return;
         }
     }
 }
@@ -0,0 +1,95 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <lixs/commit_log.hh>
+
+#include <list>
+
+
+lixs::commit_waiter::commit_waiter(void)
+    : waiting(false), round(0)
+{
+}
+
+lixs::commit_waiter::~commit_waiter()
+{
+}
+
+lixs::commit_log::commit_log(void)
+    : round(0)
+{
+}
+
+lixs::commit_log::~commit_log()
+{
+}
+
+void lixs::commit_log::wait(commit_waiter& w)
+{
+    if (w.waiting) {
+        return;
+    }
+
+    w.waiting = true;
+    w.round = round;
+    w.it = waiters.insert(waiters.end(), &w);
+}
+
+void lixs::commit_log::cancel(commit_waiter& w)
+{
+    if (!w.waiting) {
+        return;
+    }
+
+    waiters.erase(w.it);
+    w.waiting = false;
+}
+
+void lixs::commit_log::release(void)
+{
+    /* Waiters might start waiting again, for changes committed while others are released, and
+     * are left for the next round.
+     */
+    round++;
+
+    while (!waiters.empty() && waiters.front()->round != round) {
+        commit_waiter* w = waiters.front();
+
+        waiters.pop_front();
+        w->waiting = false;
+        w->durable();
+    }
+}
@@ -37,46 +37,39 @@
 #include <lixs/domain.hh>
 #include <lixs/domain_mgr.hh>
 #include <lixs/event_mgr.hh>
+#include <lixs/hypervisor.hh>
 #include <lixs/log/logger.hh>
 #include <lixs/xenstore.hh>
 
 #include <cerrno>
 #include <cstddef>
-#include <sys/mman.h>
+#include <cstring>
 
 extern "C" {
 #include <xenctrl.h>
-#include <xen/grant_table.h>
 }
 
 
-lixs::foreign_ring_mapper::foreign_ring_mapper(domid_t domid, unsigned int mfn)
+lixs::foreign_ring_mapper::foreign_ring_mapper(hypervisor& hv, domid_t domid, unsigned int mfn)
+    : hv(hv)
 {
-    xcg_handle = xc_gnttab_open(NULL, 0);
-    if (xcg_handle == NULL) {
-        throw foreign_ring_mapper_error("Failed to open gnttab handle: " +
-                std::string(std::strerror(errno)));
-    }
-
-    interface = (xenstore_domain_interface*) xc_gnttab_map_grant_ref(xcg_handle, domid,
-            GNTTAB_RESERVED_XENSTORE, PROT_READ|PROT_WRITE);
+    interface = hv.map_ring(domid, mfn);
     if (interface == NULL) {
-        xc_gnttab_close(xcg_handle);
-        throw foreign_ring_mapper_error("Failed to open gnttab handle: " +
+        throw foreign_ring_mapper_error("Failed to map ring: " +
                 std::string(std::strerror(errno)));
     }
 }
 
 lixs::foreign_ring_mapper::~foreign_ring_mapper()
 {
-    xc_gnttab_munmap(xcg_handle, interface, 1);
-    xc_gnttab_close(xcg_handle);
+    hv.unmap_ring(interface);
 }
 
 
 lixs::domain::domain(ev_cb dead_cb, xenstore& xs, domain_mgr& dmgr, event_mgr& emgr, iomux& io,
-        log::logger& log, domid_t domid, evtchn_port_t port, unsigned int mfn)
-    : client(get_id(domid), log, domid, xs, dmgr, log, io, domid, port, mfn),
+        hypervisor& hv, xs_proto_v1::trace_writer& trace, log::logger& log,
+        domid_t domid, evtchn_port_t port, unsigned int mfn)
+    : client(get_id(domid), log, domid, xs, dmgr, trace, log, io, hv, domid, port, mfn),
     emgr(emgr), dead_cb(dead_cb), active(true), domid(domid)
 {
 }
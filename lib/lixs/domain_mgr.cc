@@ -37,6 +37,7 @@
 #include <lixs/domain.hh>
 #include <lixs/domain_mgr.hh>
 #include <lixs/event_mgr.hh>
+#include <lixs/hypervisor.hh>
 #include <lixs/iomux.hh>
 #include <lixs/log/logger.hh>
 
@@ -48,8 +49,9 @@ extern "C" {
 }
 
 
-lixs::domain_mgr::domain_mgr(xenstore& xs, event_mgr& emgr, iomux& io, log::logger& log)
-    : xs(xs), emgr(emgr), io(io), log(log)
+lixs::domain_mgr::domain_mgr(xenstore& xs, event_mgr& emgr, iomux& io, hypervisor& hv,
+        xs_proto_v1::trace_writer& trace, log::logger& log)
+    : xs(xs), emgr(emgr), io(io), hv(hv), trace(trace), log(log)
 {
 }
 
@@ -71,7 +73,7 @@ int lixs::domain_mgr::create(domid_t domid, evtchn_port_t port, unsigned int mfn
         std::function<void(void)> cb = std::bind(&domain_mgr::domain_dead, this, domid);
 
         try {
-            dom = new domain(cb, xs, *this, emgr, io, log, domid, port, mfn);
+            dom = new domain(cb, xs, *this, emgr, io, hv, trace, log, domid, port, mfn);
         } catch (ring_conn_error& e) {
             log::LOG<log::level::ERROR>::logf(log, "[Domain %d] %s", domid, e.what());
             return ECANCELED;
@@ -0,0 +1,113 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+
+#include <lixs/epoch.hh>
+
+#include <atomic>
+#include <functional>
+#include <utility>
+
+
+lixs::epoch_mgr::epoch_mgr(void)
+    : epoch(1)
+{
+}
+
+lixs::epoch_mgr::~epoch_mgr()
+{
+    for (auto& r : retired) {
+        r.second();
+    }
+}
+
+unsigned int lixs::epoch_mgr::add_reader(void)
+{
+    readers.emplace_back(0);
+
+    return readers.size() - 1;
+}
+
+void lixs::epoch_mgr::enter(unsigned int reader)
+{
+    readers[reader].store(epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+
+    /* Pairs with the fence in sync(). Either the writer sees this reader as active, or the reader
+     * sees everything the writer unlinked before advancing the epoch.
+     */
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void lixs::epoch_mgr::leave(unsigned int reader)
+{
+    readers[reader].store(0, std::memory_order_release);
+}
+
+void lixs::epoch_mgr::retire(std::function<void(void)> free)
+{
+    retired.emplace_back(epoch.load(std::memory_order_relaxed), std::move(free));
+}
+
+void lixs::epoch_mgr::sync(void)
+{
+    unsigned long int oldest;
+    unsigned long int current;
+
+    if (retired.empty()) {
+        return;
+    }
+
+    oldest = epoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    for (auto& r : readers) {
+        current = r.load(std::memory_order_acquire);
+        if (current != 0 && current < oldest) {
+            oldest = current;
+        }
+    }
+
+    /* Items are retired in epoch order. */
+    while (!retired.empty() && retired.front().first < oldest) {
+        retired.front().second();
+        retired.pop_front();
+    }
+}
+
+unsigned long int lixs::epoch_mgr::pending(void)
+{
+    return retired.size();
+}
@@ -77,3 +77,8 @@ void lixs::event_mgr::enqueue_event(std::function<void(void)> cb)
     events.push_back(cb);
 }
 
+unsigned long int lixs::event_mgr::size(void)
+{
+    return events.size();
+}
+
@@ -0,0 +1,419 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+
+#include <lixs/epoch.hh>
+#include <lixs/mstore/database.hh>
+#include <lixs/mstore/read_view.hh>
+#include <lixs/permissions.hh>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+/* Same as the store, a trailing '/' isn't part of the entry name. */
+static const std::string& trim_path(const std::string& path, std::string& buff)
+{
+    if (!path.empty() && path.back() == '/') {
+        buff.assign(path, 0, path.length() - 1);
+        return buff;
+    }
+
+    return path;
+}
+
+lixs::mstore::read_view::node::node(const std::string& path, std::size_t hash, const entry& e,
+        const child_list_ptr& children)
+    : path(path), hash(hash), value(e.value), perms(e.perms), children(children), next(nullptr)
+{
+}
+
+lixs::mstore::read_view::node::node(const node& n, const child_list_ptr& children)
+    : path(n.path), hash(n.hash), value(n.value), perms(n.perms), children(children),
+    next(nullptr)
+{
+}
+
+lixs::mstore::read_view::node::node(const node& n)
+    : path(n.path), hash(n.hash), value(n.value), perms(n.perms), children(n.children),
+    next(nullptr)
+{
+}
+
+lixs::mstore::read_view::table::table(std::size_t size)
+    : mask(size - 1), buckets(new std::atomic<node*>[size])
+{
+    for (std::size_t i = 0; i < size; i++) {
+        buckets[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+lixs::mstore::read_view::table::~table()
+{
+    node* n;
+    node* next;
+
+    for (std::size_t i = 0; i <= mask; i++) {
+        for (n = buckets[i].load(std::memory_order_relaxed); n != nullptr; n = next) {
+            next = n->next.load(std::memory_order_relaxed);
+            delete n;
+        }
+    }
+
+    delete[] buckets;
+}
+
+lixs::mstore::read_view::read_view(void)
+    : current(new table(initial_size)), entries(0)
+{
+}
+
+lixs::mstore::read_view::~read_view()
+{
+    /* Retired nodes are freed by the epoch manager, which is destroyed after this. */
+    delete current.load(std::memory_order_relaxed);
+}
+
+unsigned int lixs::mstore::read_view::add_reader(void)
+{
+    return epochs.add_reader();
+}
+
+int lixs::mstore::read_view::read(unsigned int reader, cid_t cid,
+        const std::string& path, std::string& val)
+{
+    std::string buff;
+    epoch_guard guard(epochs, reader);
+
+    const node* n = find(trim_path(path, buff));
+    if (n == nullptr) {
+        return ENOENT;
+    }
+
+    if (!has_read_access(cid, n->perms)) {
+        return EACCES;
+    }
+
+    val = n->value;
+
+    return 0;
+}
+
+int lixs::mstore::read_view::get_children(unsigned int reader, cid_t cid,
+        const std::string& path, const children_cb& cb)
+{
+    std::string buff;
+    epoch_guard guard(epochs, reader);
+
+    const node* n = find(trim_path(path, buff));
+    if (n == nullptr) {
+        return ENOENT;
+    }
+
+    if (!has_read_access(cid, n->perms)) {
+        return EACCES;
+    }
+
+    if (n->children != nullptr) {
+        for (auto& c : *(n->children)) {
+            for (auto& name : *c) {
+                cb(name);
+            }
+        }
+    }
+
+    return 0;
+}
+
+int lixs::mstore::read_view::get_perms(unsigned int reader, cid_t cid,
+        const std::string& path, permission_list& perms)
+{
+    std::string buff;
+    epoch_guard guard(epochs, reader);
+
+    const node* n = find(trim_path(path, buff));
+    if (n == nullptr) {
+        return ENOENT;
+    }
+
+    if (!has_read_access(cid, n->perms)) {
+        return EACCES;
+    }
+
+    perms = n->perms;
+
+    return 0;
+}
+
+void lixs::mstore::read_view::publish(const std::string& path, const entry& e)
+{
+    std::size_t hash = std::hash<std::string>()(path);
+    table* t = current.load(std::memory_order_relaxed);
+    std::atomic<node*>* link = find_link(t, path, hash);
+    node* old = link->load(std::memory_order_relaxed);
+
+    if (old != nullptr) {
+        /* Children are published on their own, the list only changes along with them. */
+        replace(link, old, new node(path, hash, e, old->children));
+    } else {
+        /* New entries go at the front of the chain. Their children, if any, are published
+         * after them.
+         */
+        node* n = new node(path, hash, e, nullptr);
+        std::atomic<node*>& bucket = t->buckets[hash & t->mask];
+
+        n->next.store(bucket.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        bucket.store(n, std::memory_order_release);
+
+        add_child(path);
+
+        entries++;
+        if (entries > max_load * (t->mask + 1)) {
+            grow();
+        }
+    }
+}
+
+void lixs::mstore::read_view::remove(const std::string& path)
+{
+    std::size_t hash = std::hash<std::string>()(path);
+    std::atomic<node*>* link = find_link(current.load(std::memory_order_relaxed), path, hash);
+    node* old = link->load(std::memory_order_relaxed);
+
+    if (old == nullptr) {
+        return;
+    }
+
+    link->store(old->next.load(std::memory_order_relaxed), std::memory_order_release);
+    retire(old);
+
+    remove_child(path);
+
+    entries--;
+}
+
+void lixs::mstore::read_view::sync(void)
+{
+    epochs.sync();
+}
+
+unsigned long int lixs::mstore::read_view::size(void)
+{
+    return entries;
+}
+
+const lixs::mstore::read_view::node* lixs::mstore::read_view::find(const std::string& path)
+{
+    std::size_t hash = std::hash<std::string>()(path);
+    table* t = current.load(std::memory_order_acquire);
+    node* n = t->buckets[hash & t->mask].load(std::memory_order_acquire);
+
+    for (; n != nullptr; n = n->next.load(std::memory_order_acquire)) {
+        if (n->hash == hash && n->path == path) {
+            return n;
+        }
+    }
+
+    return nullptr;
+}
+
+std::atomic<lixs::mstore::read_view::node*>* lixs::mstore::read_view::find_link(table* t,
+        const std::string& path, std::size_t hash)
+{
+    std::atomic<node*>* link = &(t->buckets[hash & t->mask]);
+    node* n;
+
+    /* Ends up pointing to the link holding the entry's node, or to the last (null) link. */
+    while ((n = link->load(std::memory_order_relaxed)) != nullptr) {
+        if (n->hash == hash && n->path == path) {
+            break;
+        }
+
+        link = &(n->next);
+    }
+
+    return link;
+}
+
+void lixs::mstore::read_view::replace(std::atomic<node*>* link, node* old, node* n)
+{
+    /* Readers at the old node still find the rest of the chain through it. */
+    n->next.store(old->next.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    link->store(n, std::memory_order_release);
+    retire(old);
+}
+
+void lixs::mstore::read_view::retire(node* n)
+{
+    epochs.retire([n] () {
+        delete n;
+    });
+}
+
+void lixs::mstore::read_view::grow(void)
+{
+    table* old = current.load(std::memory_order_relaxed);
+    table* t = new table(2 * (old->mask + 1));
+    node* n;
+
+    /* Readers might be walking the old chains, so nodes are copied rather than relinked. The old
+     * table goes away together with its nodes.
+     */
+    for (std::size_t i = 0; i <= old->mask; i++) {
+        for (n = old->buckets[i].load(std::memory_order_relaxed); n != nullptr;
+                n = n->next.load(std::memory_order_relaxed)) {
+            node* c = new node(*n);
+            std::atomic<node*>& bucket = t->buckets[c->hash & t->mask];
+
+            c->next.store(bucket.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            bucket.store(c, std::memory_order_relaxed);
+        }
+    }
+
+    current.store(t, std::memory_order_release);
+
+    epochs.retire([old] () {
+        delete old;
+    });
+}
+
+bool lixs::mstore::read_view::find_parent(const std::string& path, std::atomic<node*>*& link,
+        std::string& name)
+{
+    std::size_t pos;
+    std::string parent;
+
+    pos = path.rfind('/');
+    if (pos == std::string::npos) {
+        return false;
+    }
+
+    parent = path.substr(0, pos);
+    name = path.substr(pos + 1);
+
+    link = find_link(current.load(std::memory_order_relaxed), parent,
+            std::hash<std::string>()(parent));
+
+    /* The parent goes away before its children when a subtree is removed. */
+    return link->load(std::memory_order_relaxed) != nullptr;
+}
+
+void lixs::mstore::read_view::add_child(const std::string& path)
+{
+    std::string name;
+    std::atomic<node*>* link;
+    child_list::iterator it;
+
+    if (!find_parent(path, link, name)) {
+        return;
+    }
+
+    node* parent = link->load(std::memory_order_relaxed);
+    std::shared_ptr<child_list> children = parent->children == nullptr
+        ? std::make_shared<child_list>() : std::make_shared<child_list>(*(parent->children));
+
+    /* The chunk the name sorts into, or the last one. */
+    it = std::lower_bound(children->begin(), children->end(), name,
+            [] (const std::shared_ptr<const chunk>& c, const std::string& n) {
+        return c->back() < n;
+    });
+    if (it == children->end() && it != children->begin()) {
+        it--;
+    }
+
+    if (it == children->end()) {
+        children->push_back(std::make_shared<chunk>(1, name));
+    } else {
+        std::shared_ptr<chunk> c = std::make_shared<chunk>(**it);
+
+        c->insert(std::lower_bound(c->begin(), c->end(), name), name);
+
+        if (c->size() > chunk_max) {
+            std::shared_ptr<chunk> half = std::make_shared<chunk>(
+                    c->begin() + c->size() / 2, c->end());
+
+            c->resize(c->size() / 2);
+            it = children->insert(it + 1, half) - 1;
+        }
+
+        *it = c;
+    }
+
+    replace(link, parent, new node(*parent, children));
+}
+
+void lixs::mstore::read_view::remove_child(const std::string& path)
+{
+    std::string name;
+    std::atomic<node*>* link;
+    child_list::iterator it;
+
+    if (!find_parent(path, link, name)) {
+        return;
+    }
+
+    node* parent = link->load(std::memory_order_relaxed);
+    if (parent->children == nullptr) {
+        return;
+    }
+
+    std::shared_ptr<child_list> children = std::make_shared<child_list>(*(parent->children));
+
+    it = std::lower_bound(children->begin(), children->end(), name,
+            [] (const std::shared_ptr<const chunk>& c, const std::string& n) {
+        return c->back() < n;
+    });
+    if (it == children->end() || !std::binary_search((*it)->begin(), (*it)->end(), name)) {
+        return;
+    }
+
+    if ((*it)->size() == 1) {
+        children->erase(it);
+    } else {
+        std::shared_ptr<chunk> c = std::make_shared<chunk>(**it);
+
+        c->erase(std::lower_bound(c->begin(), c->end(), name));
+        *it = c;
+    }
+
+    replace(link, parent, new node(*parent, children->empty() ? nullptr : children));
+}
@@ -0,0 +1,779 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <lixs/mstore/sharded_store.hh>
+
+#include <cerrno>
+#include <list>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+/* Paths might come with a trailing '/', which isn't part of the entry name. A trimmed copy is
+ * only made in that case, otherwise the path is used as is.
+ */
+static const std::string& trim_path(const std::string& path, std::string& buff)
+{
+    if (!path.empty() && path.back() == '/') {
+        buff.assign(path, 0, path.length() - 1);
+        return buff;
+    }
+
+    return path;
+}
+
+static bool parse_domid(const std::string& path, size_t pos, size_t& end, unsigned int& domid)
+{
+    end = path.find('/', pos);
+    if (end == std::string::npos) {
+        end = path.length();
+    }
+
+    if (end == pos || end - pos > 9) {
+        return false;
+    }
+
+    domid = 0;
+    for (size_t i = pos; i < end; i++) {
+        if (path[i] < '0' || path[i] > '9') {
+            return false;
+        }
+        domid = domid * 10 + (path[i] - '0');
+    }
+
+    return true;
+}
+
+/* Domain subtrees are /local/domain/<domid> and /local/domain/<backend>/backend/<type>/<domid>.
+ * Find the top of the subtree path belongs to, if any, giving the length of its path and the
+ * domain.
+ */
+static bool get_root(const std::string& path, size_t& len, unsigned int& domid)
+{
+    static const std::string local = "/local/domain/";
+    static const std::string backend = "/backend/";
+
+    size_t pos;
+    size_t end;
+    unsigned int backend_domid;
+
+    if (path.compare(0, local.length(), local) != 0
+            || !parse_domid(path, local.length(), len, domid)) {
+        return false;
+    }
+
+    if (path.compare(len, backend.length(), backend) == 0) {
+        pos = path.find('/', len + backend.length());
+        if (pos != std::string::npos && pos > len + backend.length()
+                && parse_domid(path, pos + 1, end, backend_domid)) {
+            len = end;
+            domid = backend_domid;
+        }
+    }
+
+    return true;
+}
+
+
+lixs::mstore::sharded_store::shard::shard(log::logger& log)
+    : access(db, log)
+{
+}
+
+lixs::mstore::sharded_store::guard::guard(sharded_store& store)
+    : store(store)
+{
+}
+
+lixs::mstore::sharded_store::guard::~guard()
+{
+    unlock();
+}
+
+void lixs::mstore::sharded_store::guard::lock(unsigned int shard)
+{
+    store.shards[shard].lock.lock();
+    held.push_back(shard);
+}
+
+void lixs::mstore::sharded_store::guard::lock(const std::set<unsigned int>& shards)
+{
+    /* Sets are sorted, so locks are taken in the same order as lock_all. */
+    for (auto s : shards) {
+        lock(s);
+    }
+}
+
+void lixs::mstore::sharded_store::guard::lock_all(void)
+{
+    unlock();
+
+    for (unsigned int s = 0; s < store.shards.size(); s++) {
+        lock(s);
+    }
+}
+
+void lixs::mstore::sharded_store::guard::unlock(void)
+{
+    for (auto s : held) {
+        store.shards[s].lock.unlock();
+    }
+
+    held.clear();
+}
+
+
+lixs::mstore::sharded_store::sharded_store(log::logger& log, unsigned int shards)
+    : next_tid(1), log(log)
+{
+    do {
+        this->shards.emplace_back(log);
+        this->shards.back().db.shards = this;
+        this->shards.back().db.quotas = &quotas;
+        dbs.push_back(&this->shards.back().db);
+    } while (this->shards.size() < shards);
+}
+
+lixs::mstore::sharded_store::~sharded_store(void)
+{
+}
+
+void lixs::mstore::sharded_store::branch(unsigned int& tid)
+{
+    std::lock_guard<std::mutex> lock(trans_lock);
+
+    tid = next_tid++;
+    trans.insert({tid, transaction(tid, shards.front().db, log)});
+}
+
+int lixs::mstore::sharded_store::merge(unsigned int tid, bool& success)
+{
+    int ret;
+    guard g(*this);
+    transaction* t;
+    std::set<unsigned int> used;
+
+    t = get_transaction(tid);
+    if (t == NULL) {
+        return ENOENT;
+    }
+
+    /* Transactions confined to a shard are validated and committed by that shard alone. Others
+     * lock every shard they referenced, all of them committing or none.
+     */
+    for (auto& r : t->get_records()) {
+        used.insert(shard_of(r));
+    }
+
+    g.lock(used);
+    ret = t->merge(success);
+
+    std::lock_guard<std::mutex> lock(trans_lock);
+    trans.erase(tid);
+
+    return ret;
+}
+
+int lixs::mstore::sharded_store::abort(unsigned int tid)
+{
+    guard g(*this);
+    transaction* t;
+    std::set<unsigned int> used;
+
+    t = get_transaction(tid);
+    if (t == NULL) {
+        return ENOENT;
+    }
+
+    for (auto& r : t->get_records()) {
+        used.insert(shard_of(r));
+    }
+
+    g.lock(used);
+    t->abort();
+
+    std::lock_guard<std::mutex> lock(trans_lock);
+    trans.erase(tid);
+
+    return 0;
+}
+
+int lixs::mstore::sharded_store::create(cid_t cid, unsigned int tid,
+        const std::string& path, bool& created)
+{
+    guard g(*this);
+    transaction* t;
+    std::string buff;
+    const std::string& key = trim_path(path, buff);
+    shard& s = shards[shard_of(key)];
+
+    if (tid == 0) {
+        g.lock(shard_of(key));
+        if (missing_root(key, NULL)) {
+            g.lock_all();
+        }
+
+        return s.access.create(cid, key, created);
+    } else {
+        t = get_transaction(tid);
+        if (t == NULL) {
+            return EINVAL;
+        }
+
+        g.lock(shard_of(key));
+        if (missing_root(key, t)) {
+            g.lock_all();
+        }
+
+        return t->create(cid, key, created);
+    }
+}
+
+int lixs::mstore::sharded_store::read(cid_t cid, unsigned int tid,
+        const std::string& path, std::string& val)
+{
+    guard g(*this);
+    transaction* t;
+    std::string buff;
+    const std::string& key = trim_path(path, buff);
+    shard& s = shards[shard_of(key)];
+
+    if (tid == 0) {
+        g.lock(shard_of(key));
+
+        return s.access.read(cid, key, val);
+    } else {
+        t = get_transaction(tid);
+        if (t == NULL) {
+            return EINVAL;
+        }
+
+        g.lock(shard_of(key));
+
+        return t->read(cid, key, val);
+    }
+}
+
+int lixs::mstore::sharded_store::update(cid_t cid, unsigned int tid,
+        const std::string& path, std::string val)
+{
+    guard g(*this);
+    transaction* t;
+    std::string buff;
+    const std::string& key = trim_path(path, buff);
+    shard& s = shards[shard_of(key)];
+
+    if (tid == 0) {
+        g.lock(shard_of(key));
+        if (missing_root(key, NULL)) {
+            g.lock_all();
+        }
+
+        return s.access.update(cid, key, std::move(val));
+    } else {
+        t = get_transaction(tid);
+        if (t == NULL) {
+            return EINVAL;
+        }
+
+        g.lock(shard_of(key));
+        if (missing_root(key, t)) {
+            g.lock_all();
+        }
+
+        return t->update(cid, key, std::move(val));
+    }
+}
+
+int lixs::mstore::sharded_store::del(cid_t cid, unsigned int tid, const std::string& path)
+{
+    guard g(*this);
+    transaction* t;
+    std::string buff;
+    const std::string& key = trim_path(path, buff);
+    shard& s = shards[shard_of(key)];
+
+    /* Deleting the top of a domain's subtree changes its parent's children list, kept by another
+     * shard, and deleting a subtree spanning shards deletes entries from all of them.
+     */
+    if (tid == 0) {
+        if (is_root(key) || spans(key)) {
+            g.lock_all();
+        } else {
+            g.lock(shard_of(key));
+        }
+
+        return s.access.del(cid, key);
+    } else {
+        t = get_transaction(tid);
+        if (t == NULL) {
+            return EINVAL;
+        }
+
+        if (is_root(key) || spans(key)) {
+            g.lock_all();
+        } else {
+            g.lock(shard_of(key));
+        }
+
+        return t->del(cid, key);
+    }
+}
+
+int lixs::mstore::sharded_store::read(cid_t cid, unsigned int tid, const std::string& path,
+        std::string& val, unsigned long int& version)
+{
+    guard g(*this);
+    std::string buff;
+    const std::string& key = trim_path(path, buff);
+
+    if (tid != 0) {
+        return EINVAL;
+    }
+
+    g.lock(shard_of(key));
+
+    return shards[shard_of(key)].access.read(cid, key, val, version);
+}
+
+int lixs::mstore::sharded_store::update_if(cid_t cid, unsigned int tid, const std::string& path,
+        std::string val, unsigned long int& version)
+{
+    guard g(*this);
+    std::string buff;
+    const std::string& key = trim_path(path, buff);
+
+    if (tid != 0) {
+        return EINVAL;
+    }
+
+    g.lock(shard_of(key));
+    if (missing_root(key, NULL)) {
+        g.lock_all();
+    }
+
+    return shards[shard_of(key)].access.update_if(cid, key, std::move(val), version);
+}
+
+int lixs::mstore::sharded_store::update_if(cid_t cid, unsigned int tid, const std::string& path,
+        std::string val, const std::string& expected, unsigned long int& version)
+{
+    guard g(*this);
+    std::string buff;
+    const std::string& key = trim_path(path, buff);
+
+    if (tid != 0) {
+        return EINVAL;
+    }
+
+    /* Only existing entries are updated, so the tree doesn't change. */
+    g.lock(shard_of(key));
+
+    return shards[shard_of(key)].access.update_if(cid, key, std::move(val), expected, version);
+}
+
+int lixs::mstore::sharded_store::del_owned(cid_t owner, const std::string& path,
+        std::list<std::string>& removed)
+{
+    guard g(*this);
+    std::string buff;
+    const std::string& key = trim_path(path, buff);
+
+    g.lock_all();
+
+    return shards[shard_of(key)].access.del_owned(owner, key, removed);
+}
+
+int lixs::mstore::sharded_store::clone(cid_t cid, unsigned int tid, const std::string& src,
+        const std::string& dst, cid_t from, cid_t to)
+{
+    guard g(*this);
+    std::string src_buff;
+    std::string dst_buff;
+    const std::string& dst_key = trim_path(dst, dst_buff);
+
+    if (tid != 0) {
+        return EINVAL;
+    }
+
+    g.lock_all();
+
+    return shards[shard_of(dst_key)].access.clone(cid, trim_path(src, src_buff), dst_key,
+            from, to);
+}
+
+int lixs::mstore::sharded_store::get_children(cid_t cid, unsigned int tid,
+        const std::string& path, std::set<std::string>& resp)
+{
+    resp.clear();
+
+    /* Children are visited in order, so each name goes to the end of the set. */
+    return get_children(cid, tid, path, [&resp] (const std::string& name) {
+        resp.insert(resp.end(), name);
+    });
+}
+
+int lixs::mstore::sharded_store::get_children(cid_t cid, unsigned int tid,
+        const std::string& path, const children_cb& cb)
+{
+    unsigned long int gen;
+
+    return get_children_part(cid, tid, path, "", [&cb] (const std::string& name) {
+        cb(name);
+        return true;
+    }, gen);
+}
+
+int lixs::mstore::sharded_store::get_children_part(cid_t cid, unsigned int tid,
+        const std::string& path, const std::string& start, const children_part_cb& cb,
+        unsigned long int& gen)
+{
+    guard g(*this);
+    transaction* t;
+    std::string buff;
+    const std::string& key = trim_path(path, buff);
+    shard& s = shards[shard_of(key)];
+
+    if (tid == 0) {
+        g.lock(shard_of(key));
+
+        return s.access.get_children(cid, key, start, cb, gen);
+    } else {
+        t = get_transaction(tid);
+        if (t == NULL) {
+            return EINVAL;
+        }
+
+        g.lock(shard_of(key));
+
+        return t->get_children(cid, key, start, cb, gen);
+    }
+}
+
+int lixs::mstore::sharded_store::get_perms(cid_t cid, unsigned int tid,
+        const std::string& path, permission_list& perms)
+{
+    guard g(*this);
+    transaction* t;
+    std::string buff;
+    const std::string& key = trim_path(path, buff);
+    shard& s = shards[shard_of(key)];
+
+    if (tid == 0) {
+        g.lock(shard_of(key));
+
+        return s.access.get_perms(cid, key, perms);
+    } else {
+        t = get_transaction(tid);
+        if (t == NULL) {
+            return EINVAL;
+        }
+
+        g.lock(shard_of(key));
+
+        return t->get_perms(cid, key, perms);
+    }
+}
+
+int lixs::mstore::sharded_store::set_perms(cid_t cid, unsigned int tid,
+        const std::string& path, const permission_list& perms)
+{
+    guard g(*this);
+    transaction* t;
+    std::string buff;
+    const std::string& key = trim_path(path, buff);
+    shard& s = shards[shard_of(key)];
+
+    if (tid == 0) {
+        g.lock(shard_of(key));
+
+        return s.access.set_perms(cid, key, perms);
+    } else {
+        t = get_transaction(tid);
+        if (t == NULL) {
+            return EINVAL;
+        }
+
+        g.lock(shard_of(key));
+
+        return t->set_perms(cid, key, perms);
+    }
+}
+
+void lixs::mstore::sharded_store::set_quota(unsigned long int nodes, unsigned long int bytes)
+{
+    quotas.set_limits(nodes, bytes);
+}
+
+void lixs::mstore::sharded_store::get_stats(store_stats& stats)
+{
+    guard g(*this);
+
+    g.lock_all();
+
+    stats.nodes = 0;
+    stats.bytes = 0;
+    for (auto& s : shards) {
+        stats.nodes += s.db.nodes;
+        stats.bytes += s.db.bytes;
+    }
+
+    std::lock_guard<std::mutex> lock(trans_lock);
+    stats.transactions = trans.size();
+}
+
+void lixs::mstore::sharded_store::get_owner_stats(cid_t owner, owner_stats& stats)
+{
+    quotas.get(owner, stats.nodes, stats.bytes);
+}
+
+void lixs::mstore::sharded_store::get_transaction_stats(std::list<transaction_stats>& stats)
+{
+    guard g(*this);
+
+    /* Transactions record entries while holding the lock of their shards. */
+    g.lock_all();
+
+    std::lock_guard<std::mutex> lock(trans_lock);
+
+    stats.clear();
+
+    for (auto& t : trans) {
+        stats.push_back(transaction_stats());
+        stats.back().tid = t.first;
+        stats.back().records = t.second.size();
+        stats.back().age_ms = t.second.age_ms();
+    }
+}
+
+int lixs::mstore::sharded_store::get_usage(const std::string& path, const std::string& cursor,
+        unsigned long int max_entries, std::list<store_usage>& usage, std::string& next)
+{
+    guard g(*this);
+    std::string prefix;
+    std::string last;
+    database::iterator pit;
+    std::vector<database*> below;
+    std::vector<std::pair<database::iterator, database::iterator>> ranges;
+    unsigned long int entries;
+
+    /* The root entry is stored with an empty path. */
+    prefix = path;
+    if (prefix.back() == '/') {
+        prefix.pop_back();
+    }
+
+    if (spans(prefix)) {
+        g.lock_all();
+    } else {
+        g.lock(shard_of(prefix));
+    }
+
+    database& pdb = owner(prefix);
+    pit = pdb.find(prefix);
+    if (pit == pdb.end() || pit->second.e.write_seq <= pit->second.e.delete_seq) {
+        return ENOENT;
+    }
+
+    /* Same as store::get_usage, with the subtree possibly split into one range per shard. Ranges
+     * are merged as they are visited, so that entries are still accounted for in order.
+     */
+    pdb.below(prefix, below);
+    prefix += "/";
+
+    for (auto d : below) {
+        ranges.push_back({cursor.empty() ? d->lower_bound(prefix) : d->upper_bound(cursor),
+                d->end()});
+    }
+
+    usage.clear();
+    next.clear();
+
+    for (entries = 0; ; ) {
+        std::pair<database::iterator, database::iterator>* min = NULL;
+
+        for (auto& r : ranges) {
+            if (r.first != r.second && r.first->first.compare(0, prefix.length(), prefix) == 0
+                    && (min == NULL || r.first->first < min->first->first)) {
+                min = &r;
+            }
+        }
+
+        if (min == NULL) {
+            break;
+        }
+
+        database::iterator it = min->first++;
+        const std::string& key = it->first;
+        record& rec = it->second;
+
+        if (entries == max_entries) {
+            next = last;
+            break;
+        }
+        entries++;
+        last = key;
+
+        if (rec.e.write_seq <= rec.e.delete_seq) {
+            continue;
+        }
+
+        size_t end = key.find('/', prefix.length());
+        if (end == std::string::npos) {
+            end = key.length();
+        }
+
+        if (usage.empty()
+                || key.compare(prefix.length(), end - prefix.length(), usage.back().name) != 0) {
+            usage.push_back(store_usage());
+            usage.back().name = key.substr(prefix.length(), end - prefix.length());
+        }
+
+        usage.back().last = key;
+        usage.back().nodes++;
+        usage.back().bytes += key.length() + rec.e.value.length();
+    }
+
+    return 0;
+}
+
+lixs::mstore::database& lixs::mstore::sharded_store::owner(const std::string& path)
+{
+    return shards[shard_of(path)].db;
+}
+
+bool lixs::mstore::sharded_store::spans(const std::string& path)
+{
+    static const std::string backend = "/backend";
+
+    size_t len;
+    size_t pos;
+    unsigned int domid;
+
+    /* Whether path is above the top of some domain subtree. */
+    if (path.empty() || path == "/local" || path == "/local/domain") {
+        return true;
+    }
+
+    if (!get_root(path, len, domid)) {
+        return false;
+    }
+
+    if (len == path.length()) {
+        /* Either /local/domain/<domid>, above its backends, or the top of a backend. */
+        return path.find('/', sizeof("/local/domain/") - 1) == std::string::npos;
+    }
+
+    /* Only /local/domain/<domid>/backend and /local/domain/<domid>/backend/<type> are left. */
+    if (path.compare(len, backend.length(), backend) != 0) {
+        return false;
+    }
+
+    pos = len + backend.length();
+    if (pos == path.length()) {
+        return true;
+    }
+
+    return path[pos] == '/' && pos + 1 < path.length()
+        && path.find('/', pos + 1) == std::string::npos;
+}
+
+const std::vector<lixs::mstore::database*>& lixs::mstore::sharded_store::databases(void)
+{
+    return dbs;
+}
+
+unsigned int lixs::mstore::sharded_store::shard_of(const std::string& path)
+{
+    size_t len;
+    unsigned int domid;
+
+    if (get_root(path, len, domid)) {
+        return domid % shards.size();
+    } else {
+        return 0;
+    }
+}
+
+bool lixs::mstore::sharded_store::is_root(const std::string& path)
+{
+    size_t len;
+    unsigned int domid;
+
+    return get_root(path, len, domid) && len == path.length();
+}
+
+bool lixs::mstore::sharded_store::missing_root(const std::string& path, transaction* trans)
+{
+    size_t len;
+    unsigned int domid;
+    std::string root;
+    database::iterator it;
+
+    /* Writing to a domain's subtree might create the top of the subtree, in which case it is
+     * linked to its parent in another shard.
+     */
+    if (!get_root(path, len, domid)) {
+        return false;
+    }
+
+    root.assign(path, 0, len);
+
+    if (trans != NULL) {
+        return !trans->exists(root);
+    }
+
+    database& db = owner(root);
+    it = db.find(root);
+
+    return it == db.end() || it->second.e.write_seq <= it->second.e.delete_seq;
+}
+
+lixs::mstore::transaction* lixs::mstore::sharded_store::get_transaction(unsigned int tid)
+{
+    transaction_db::iterator it;
+    std::lock_guard<std::mutex> lock(trans_lock);
+
+    it = trans.find(tid);
+    if (it != trans.end()) {
+        return &it->second;
+    } else {
+        return NULL;
+    }
+}
@@ -40,8 +40,13 @@
 #include <lixs/mstore/simple_access.hh>
 #include <lixs/util.hh>
 
+#include <algorithm>
+#include <iterator>
+#include <list>
 #include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
 
 lixs::mstore::simple_access::simple_access(database& db, log::logger& log)
@@ -50,6 +55,24 @@ lixs::mstore::simple_access::simple_access(database& db, log::logger& log)
 }
 
 int lixs::mstore::simple_access::create(cid_t cid, const std::string& path, bool& created)
+{
+    int ret;
+    database::iterator it;
+
+    if (limited(cid)) {
+        it = db.find(path);
+        if (it == db.end() || it->second.e.write_seq <= it->second.e.delete_seq) {
+            ret = check_quota(path, NULL, 0);
+            if (ret != 0) {
+                return ret;
+            }
+        }
+    }
+
+    return create_entry(cid, path, created);
+}
+
+int lixs::mstore::simple_access::create_entry(cid_t cid, const std::string& path, bool& created)
 {
     /* Here we can use the array operator since the entry either exists or will be created. */
     record& rec = db[path];
@@ -70,6 +93,10 @@ int lixs::mstore::simple_access::create(cid_t cid, const std::string& path, bool
 
         /* Finally mark the entry as written and therefore as valid. */
         rec.e.write_seq = rec.next_seq++;
+        rec.e.write_gen = ++db.generation;
+
+        db.account(rec.e.perms, 1, path.length());
+        db.touch(path);
 
         created = true;
     }
@@ -104,11 +131,119 @@ int lixs::mstore::simple_access::read(cid_t cid, const std::string& path, std::s
     }
 }
 
-int lixs::mstore::simple_access::update(cid_t cid, const std::string& path, const std::string& val)
+int lixs::mstore::simple_access::update(cid_t cid, const std::string& path, std::string val)
 {
+    int ret;
+    database::iterator it;
+
+    /* Checked before the entry is looked up below, so that no record is left behind on failure. */
+    if (limited(cid)) {
+        it = db.find(path);
+        ret = check_quota(path, it == db.end() ? NULL : &it->second, val.length());
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
     /* Here we can use the array operator since the entry either exists or will be created. */
-    record& rec = db[path];
+    return update_entry(cid, path, db[path], std::move(val));
+}
+
+int lixs::mstore::simple_access::read(cid_t cid, const std::string& path,
+        std::string& val, unsigned long int& version)
+{
+    int ret;
+
+    ret = read(cid, path, val);
+    if (ret == 0) {
+        version = db.find(path)->second.e.write_gen;
+    }
+
+    return ret;
+}
 
+int lixs::mstore::simple_access::update_if(cid_t cid, const std::string& path,
+        std::string val, unsigned long int& version)
+{
+    int ret;
+    unsigned long int current;
+    database::iterator it;
+
+    /* The version of an entry that doesn't exist is 0. */
+    current = 0;
+
+    it = db.find(path);
+    if (it != db.end() && it->second.e.write_seq > it->second.e.delete_seq) {
+        /* The current version is given back on a mismatch, so it requires read access. */
+        if (!has_read_access(cid, it->second.e.perms)) {
+            return EACCES;
+        }
+
+        current = it->second.e.write_gen;
+    }
+
+    if (current != version) {
+        version = current;
+        return EAGAIN;
+    }
+
+    if (limited(cid)) {
+        ret = check_quota(path, it == db.end() ? NULL : &it->second, val.length());
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
+    /* Only create the record once we know the entry is going to be written. */
+    if (it == db.end()) {
+        it = db.emplace(path, record()).first;
+    }
+
+    ret = update_entry(cid, path, it->second, std::move(val));
+    version = it->second.e.write_gen;
+
+    return ret;
+}
+
+int lixs::mstore::simple_access::update_if(cid_t cid, const std::string& path,
+        std::string val, const std::string& expected, unsigned long int& version)
+{
+    int ret;
+    database::iterator it;
+
+    it = db.find(path);
+    if (it == db.end() || it->second.e.write_seq <= it->second.e.delete_seq) {
+        return ENOENT;
+    }
+
+    /* Get a reference for code clarity. */
+    record& rec = it->second;
+
+    if (!has_read_access(cid, rec.e.perms)) {
+        return EACCES;
+    }
+
+    if (rec.e.value != expected) {
+        version = rec.e.write_gen;
+        return EAGAIN;
+    }
+
+    if (limited(cid)) {
+        ret = check_quota(path, &rec, val.length());
+        if (ret != 0) {
+            return ret;
+        }
+    }
+
+    ret = update_entry(cid, path, rec, std::move(val));
+    version = rec.e.write_gen;
+
+    return ret;
+}
+
+int lixs::mstore::simple_access::update_entry(cid_t cid, const std::string& path,
+        record& rec, std::string val)
+{
     if (rec.e.write_seq > rec.e.delete_seq) {
         if (!has_write_access(cid, rec.e.perms)) {
             return EACCES;
@@ -122,13 +257,22 @@ int lixs::mstore::simple_access::update(cid_t cid, const std::string& path, cons
 
         /* When creating a new entry permissions are inherited from the parent node. */
         get_parent_perms(path, rec.e.perms);
+
+        /* The value is accounted for below, together with the update. */
+        rec.e.value.clear();
+
+        db.account(rec.e.perms, 1, path.length());
     }
 
     /* Set the new value. */
-    rec.e.value = val;
+    db.account(rec.e.perms, 0,
+            static_cast<long int>(val.length()) - static_cast<long int>(rec.e.value.length()));
+    rec.e.value = std::move(val);
 
     /* Finally mark the entry as written and therefore as valid. */
     rec.e.write_seq = rec.next_seq++;
+    rec.e.write_gen = ++db.generation;
+    db.touch(path);
 
     return 0;
 }
@@ -153,26 +297,168 @@ int lixs::mstore::simple_access::del(cid_t cid, const std::string& path)
         }
 
         /* Delete all children branches and unregister this entry.  */
-        delete_branch(path, rec);
+        delete_branch(path);
         unregister_from_parent(path);
+        delete_entry(it);
 
-        /* If the transaction list is empty, i.e. no transaction is currently referencing this
-         * entry, we can remove it from the database. Otherwise just mark as deleted.
+        return 0;
+    } else {
+        return ENOENT;
+    }
+}
+
+int lixs::mstore::simple_access::del_owned(cid_t owner, const std::string& path,
+        std::list<std::string>& removed)
+{
+    std::string prefix;
+    database::iterator it;
+    std::vector<database*> dbs;
+    std::vector<std::string> owned;
+
+    it = db.find(path);
+    if (it == db.end() || it->second.e.write_seq <= it->second.e.delete_seq) {
+        return ENOENT;
+    }
+
+    removed.clear();
+
+    /* Entries are sorted by path, so the subtree is the range of entries starting with "<path>/",
+     * each entry coming before its descendants. Deleting the branch of an owned entry only erases
+     * entries after the current one, so the scan can carry on from the next entry.
+     */
+    prefix = path + "/";
+
+    db.below(path, dbs);
+    if (dbs.size() > 1) {
+        /* The subtree is spread across databases. Owned entries are collected and sorted first,
+         * so that, as above, entries deleted together with an owned ancestor aren't reported.
          */
-        if (rec.te.empty()) {
-            db.erase(it);
-        } else {
-            rec.e.delete_seq = rec.next_seq++;
+        for (auto d : dbs) {
+            it = d->lower_bound(prefix);
+            while (it != d->end() && it->first.compare(0, prefix.length(), prefix) == 0) {
+                record& rec = it->second;
+
+                if (rec.e.write_seq > rec.e.delete_seq
+                        && !rec.e.perms.empty() && rec.e.perms.front().cid == owner) {
+                    owned.push_back(it->first);
+                }
+                it++;
+            }
+        }
+
+        std::sort(owned.begin(), owned.end());
+
+        for (auto& o : owned) {
+            database& d = db.owner(o);
+            simple_access access(d, log);
+
+            it = d.find(o);
+            if (it == d.end() || it->second.e.write_seq <= it->second.e.delete_seq) {
+                continue;
+            }
+
+            removed.push_back(o);
+
+            access.delete_branch(o);
+            access.unregister_from_parent(o);
+            access.delete_entry(it);
         }
 
         return 0;
-    } else {
+    }
+
+    it = db.lower_bound(prefix);
+    while (it != db.end() && it->first.compare(0, prefix.length(), prefix) == 0) {
+        record& rec = it->second;
+
+        if (rec.e.write_seq > rec.e.delete_seq
+                && !rec.e.perms.empty() && rec.e.perms.front().cid == owner) {
+            removed.push_back(it->first);
+
+            delete_branch(it->first);
+            unregister_from_parent(it->first);
+            it = delete_entry(it);
+        } else {
+            it++;
+        }
+    }
+
+    return 0;
+}
+
+int lixs::mstore::simple_access::clone(cid_t cid, const std::string& src, const std::string& dst,
+        cid_t from, cid_t to)
+{
+    std::string prefix;
+    std::string path;
+    database::iterator it;
+    database::iterator sit;
+    database::iterator hint;
+    std::vector<database*> dbs;
+    database& sdb = db.owner(src);
+
+    /* Copies can be given to any domain, only the toolstack can clone. */
+    if (cid != 0) {
+        return EACCES;
+    }
+
+    sit = sdb.find(src);
+    if (sit == sdb.end() || sit->second.e.write_seq <= sit->second.e.delete_seq) {
         return ENOENT;
     }
+
+    /* The copy can't be part of the subtree being copied. */
+    prefix = src + "/";
+    if (dst == src || dst.compare(0, prefix.length(), prefix) == 0) {
+        return EINVAL;
+    }
+
+    it = db.find(dst);
+    if (it != db.end() && it->second.e.write_seq > it->second.e.delete_seq) {
+        return EEXIST;
+    }
+
+    db.below(src, dbs);
+
+    ensure_branch(cid, dst);
+    register_with_parent(dst);
+
+    clone_entry(sit->second.e, dst, db[dst], from, to);
+
+    /* Entries are sorted by path and the copies keep the order of the originals, so each copy
+     * goes right after the previous one. Copies of the children lists are valid as they are given
+     * the whole subtree is copied. On a sharded tree copies kept by other databases are inserted
+     * there instead.
+     */
+    hint = db.upper_bound(dst);
+    for (auto d : dbs) {
+        for (it = d->lower_bound(prefix); it != d->end(); it++) {
+            if (it->first.compare(0, prefix.length(), prefix) != 0) {
+                break;
+            }
+
+            if (it->second.e.write_seq <= it->second.e.delete_seq) {
+                continue;
+            }
+
+            path = dst + it->first.substr(src.length());
+
+            database& ddb = db.owner(path);
+            if (&ddb == &db) {
+                hint = db.emplace_hint(hint, std::move(path), record());
+                clone_entry(it->second.e, hint->first, hint->second, from, to);
+                hint++;
+            } else {
+                simple_access(ddb, log).clone_entry(it->second.e, path, ddb[path], from, to);
+            }
+        }
+    }
+
+    return 0;
 }
 
-int lixs::mstore::simple_access::get_children(cid_t cid,
-        const std::string& path, std::set<std::string>& resp)
+int lixs::mstore::simple_access::get_children(cid_t cid, const std::string& path,
+        const std::string& start, const children_part_cb& cb, unsigned long int& gen)
 {
     /* On reading we can't create a new entry, so don't use the array operator. */
     database::iterator it;
@@ -191,7 +477,13 @@ int lixs::mstore::simple_access::get_children(cid_t cid,
             return EACCES;
         }
 
-        resp = rec.e.children;
+        gen = rec.e.children_gen;
+
+        for (auto c = rec.e.children.lower_bound(start); c != rec.e.children.end(); c++) {
+            if (!cb(*c)) {
+                break;
+            }
+        }
 
         return 0;
     } else {
@@ -247,10 +539,26 @@ int lixs::mstore::simple_access::set_perms(cid_t cid,
             return EACCES;
         }
 
+        /* Entries created below an entry are owned by its owner, a guest giving an entry away
+         * could then keep creating entries out of its quota.
+         */
+        if (cid != 0 && get_owner(perms) != get_owner(rec.e.perms)) {
+            return EACCES;
+        }
+
+        /* Giving the entry away moves its usage over to the new owner. */
+        if (get_owner(perms) != get_owner(rec.e.perms)) {
+            db.account(rec.e.perms, -1, -static_cast<long int>(path.length()
+                        + rec.e.value.length()));
+            db.account(perms, 1, path.length() + rec.e.value.length());
+        }
+
         rec.e.perms = perms;
 
         /* Writing sequence needs to be updated both for value and permissions. */
         rec.e.write_seq = rec.next_seq++;
+        rec.e.write_gen = ++db.generation;
+        db.touch(path);
 
         return 0;
     } else {
@@ -268,11 +576,14 @@ void lixs::mstore::simple_access::register_with_parent(const std::string& path)
         /* This method should only be called after ensuring the parent branch exists and is valid,
          * therefore we can just get the entry without checking for its validity.
          */
-        record& rec = db[parent];
+        database& pdb = db.owner(parent);
+        record& rec = pdb[parent];
 
         rec.e.children.insert(name);
 
         rec.e.write_children_seq = rec.next_seq++;
+        rec.e.children_gen = ++pdb.generation;
+        pdb.touch(parent);
     }
 }
 
@@ -286,11 +597,14 @@ void lixs::mstore::simple_access::unregister_from_parent(const std::string& path
         /* This method should only be called after ensuring the parent branch exists and is valid,
          * therefore we can just get the entry without checking for its validity.
          */
-        record& rec = db[parent];
+        database& pdb = db.owner(parent);
+        record& rec = pdb[parent];
 
         rec.e.children.erase(name);
 
         rec.e.write_children_seq = rec.next_seq++;
+        rec.e.children_gen = ++pdb.generation;
+        pdb.touch(parent);
     }
 }
 
@@ -302,24 +616,170 @@ void lixs::mstore::simple_access::ensure_branch(cid_t cid, const std::string& pa
 
     /* This method is indirectly recursing, break recursion if we get to the root node. */
     if (basename(path, parent, name)) {
-        /* Method create won't perform any action in case the node exists already, therefore we
-         * don't need to check before. It will also not recurse in that case so we don't need to
-         * check for the result of the operation.
+        /* Method create_entry won't perform any action in case the node exists already, therefore
+         * we don't need to check before. It will also not recurse in that case so we don't need
+         * to check for the result of the operation. Quotas were checked for the whole branch. The
+         * parent of an entry at the top of a shard is kept, and created, by another database.
          */
-        create(cid, parent, created);
+        database& pdb = db.owner(parent);
+        if (&pdb == &db) {
+            create_entry(cid, parent, created);
+        } else {
+            simple_access(pdb, log).create_entry(cid, parent, created);
+        }
     }
 }
 
-void lixs::mstore::simple_access::delete_branch(const std::string& path, record& rec)
+void lixs::mstore::simple_access::delete_branch(const std::string& path)
 {
-    /* Method del will eventually call unregister_from_parent which will update rec.e.children,
-     * deleting the element we're currently iterating on, therefore we don't use an iterator here.
+    std::string prefix;
+    database::iterator it;
+    database::iterator first;
+    std::vector<database*> dbs;
+
+    /* Entries are sorted by path, so all the entries below path share the "<path>/" prefix and
+     * are found in a single range, no matter how deep. Entries in the range are deleted together,
+     * which doesn't require updating each parent's children list. Runs of entries not referenced
+     * by any transaction are erased in one go, the others just marked as deleted. On a sharded
+     * tree there is one such range per database keeping part of the subtree.
      */
-    while (!rec.e.children.empty()) {
-        /* Deleting a subtree doesn't require access permissions. Only access to the root node, so
-         * we delete as 0.
-         */
-        del(0, path + "/" + *(rec.e.children.begin()));
+    prefix = path + "/";
+
+    db.below(path, dbs);
+    for (auto d : dbs) {
+        first = d->lower_bound(prefix);
+        for (it = first; it != d->end(); it++) {
+            record& rec = it->second;
+
+            if (it->first.compare(0, prefix.length(), prefix) != 0) {
+                break;
+            }
+
+            if (rec.te.empty()) {
+                if (rec.e.write_seq > rec.e.delete_seq) {
+                    d->account(rec.e.perms, -1, -static_cast<long int>(it->first.length()
+                                + rec.e.value.length()));
+                    d->touch(it->first);
+                }
+                continue;
+            }
+
+            d->erase(first, it);
+            first = std::next(it);
+
+            if (rec.e.write_seq > rec.e.delete_seq) {
+                d->account(rec.e.perms, -1, -static_cast<long int>(it->first.length()
+                            + rec.e.value.length()));
+                d->touch(it->first);
+
+                rec.e.children.clear();
+                rec.e.write_children_seq = rec.next_seq++;
+                rec.e.children_gen = ++d->generation;
+                rec.e.delete_seq = rec.next_seq++;
+            }
+        }
+
+        d->erase(first, it);
+    }
+}
+
+lixs::mstore::database::iterator lixs::mstore::simple_access::delete_entry(database::iterator it)
+{
+    record& rec = it->second;
+
+    db.account(rec.e.perms, -1, -static_cast<long int>(it->first.length()
+                + rec.e.value.length()));
+    db.touch(it->first);
+
+    /* If the transaction list is empty, i.e. no transaction is currently referencing this entry,
+     * we can remove it from the database. Otherwise just mark as deleted. Its children are gone
+     * already.
+     */
+    if (rec.te.empty()) {
+        return db.erase(it);
+    } else {
+        rec.e.children.clear();
+        rec.e.write_children_seq = rec.next_seq++;
+        rec.e.children_gen = ++db.generation;
+        rec.e.delete_seq = rec.next_seq++;
+
+        return std::next(it);
+    }
+}
+
+void lixs::mstore::simple_access::clone_entry(const entry& src, const std::string& path,
+        record& rec, cid_t from, cid_t to)
+{
+    /* The copy might reuse an entry still referenced by transactions, overwrite everything. */
+    rec.e.value = src.value;
+    rec.e.perms = src.perms;
+    rec.e.children = src.children;
+
+    for (auto& p : rec.e.perms) {
+        if (p.cid == from) {
+            p.cid = to;
+        }
+    }
+
+    rec.e.write_children_seq = rec.next_seq++;
+    rec.e.children_gen = ++db.generation;
+    rec.e.write_seq = rec.next_seq++;
+    rec.e.write_gen = ++db.generation;
+
+    db.account(rec.e.perms, 1, path.length() + rec.e.value.length());
+    db.touch(path);
+}
+
+bool lixs::mstore::simple_access::limited(cid_t cid)
+{
+    return cid != 0 && db.quotas != NULL && db.quotas->enabled();
+}
+
+int lixs::mstore::simple_access::check_quota(const std::string& path, const record* rec,
+        size_t len)
+{
+    cid_t owner;
+    long int nodes;
+    long int bytes;
+
+    if (rec != NULL && rec->e.write_seq > rec->e.delete_seq) {
+        owner = get_owner(rec->e.perms);
+        nodes = 0;
+        bytes = static_cast<long int>(len) - static_cast<long int>(rec->e.value.length());
+    } else {
+        new_branch(path, owner, nodes, bytes);
+        bytes += len;
+    }
+
+    return db.quotas->check(owner, nodes, bytes) ? 0 : ENOSPC;
+}
+
+void lixs::mstore::simple_access::new_branch(const std::string& path,
+        cid_t& owner, long int& nodes, long int& bytes)
+{
+    std::string name;
+    std::string parent;
+    std::string child;
+    database::iterator it;
+
+    /* Missing parents are created together with the entry, and they all inherit the permissions
+     * of the closest existing parent.
+     */
+    owner = 0;
+    nodes = 1;
+    bytes = path.length();
+
+    for (child = path; basename(child, parent, name); child = parent) {
+        database& pdb = db.owner(parent);
+
+        it = pdb.find(parent);
+        if (it != pdb.end() && it->second.e.write_seq > it->second.e.delete_seq) {
+            owner = get_owner(it->second.e.perms);
+            break;
+        }
+
+        nodes++;
+        bytes += parent.length();
     }
 }
 
@@ -332,7 +792,7 @@ void lixs::mstore::simple_access::get_parent_perms(const std::string& path, perm
         /* This method should only be called after ensuring the parent branch exists and is valid,
          * therefore we can just get the entry without checking for its validity.
          */
-        perms = db[parent].e.perms;
+        perms = db.owner(parent)[parent].e.perms;
     } else {
         /* Getting permissions for the root node yield the default of n0 */
         perms.clear();
@@ -35,11 +35,32 @@
  */
 
 #include <lixs/mstore/store.hh>
+#include <lixs/util.hh>
 
+#include <algorithm>
+#include <cstring>
+#include <list>
+#include <string>
+#include <utility>
+
+
+/* Paths might come with a trailing '/', which isn't part of the entry name. A trimmed copy is
+ * only made in that case, otherwise the path is used as is.
+ */
+static const std::string& trim_path(const std::string& path, std::string& buff)
+{
+    if (!path.empty() && path.back() == '/') {
+        buff.assign(path, 0, path.length() - 1);
+        return buff;
+    }
+
+    return path;
+}
 
 lixs::mstore::store::store(log::logger& log)
-    : access(db, log), next_tid(1), log(log)
+    : access(db, log), next_tid(1), view(NULL), journal(NULL), log(log)
 {
+    db.quotas = &quotas;
 }
 
 lixs::mstore::store::~store(void)
@@ -54,14 +75,15 @@ void lixs::mstore::store::branch(unsigned int& tid)
 
 int lixs::mstore::store::merge(unsigned int tid, bool& success)
 {
+    int ret;
     transaction_db::iterator it;
 
     it = trans.find(tid);
     if (it != trans.end()) {
-        it->second.merge(success);
+        ret = it->second.merge(success);
         trans.erase(it);
 
-        return 0;
+        return publish(ret);
     } else {
         return ENOENT;
     }
@@ -82,101 +104,180 @@ int lixs::mstore::store::abort(unsigned int tid)
     }
 }
 
-int lixs::mstore::store::create(cid_t cid, unsigned int tid, std::string path, bool& created)
+int lixs::mstore::store::create(cid_t cid, unsigned int tid,
+        const std::string& path, bool& created)
 {
-    if (path.back() == '/') {
-        path.pop_back();
-    }
+    std::string buff;
+    const std::string& key = trim_path(path, buff);
 
     if (tid == 0) {
-        return access.create(cid, path, created);
+        return publish(access.create(cid, key, created));
     } else {
         transaction_db::iterator it;
 
         it = trans.find(tid);
         if (it != trans.end()) {
-            return it->second.create(cid, path, created);
+            return it->second.create(cid, key, created);
         } else {
             return EINVAL;
         }
     }
 }
 
-int lixs::mstore::store::read(cid_t cid, unsigned int tid, std::string path, std::string& val)
+int lixs::mstore::store::read(cid_t cid, unsigned int tid,
+        const std::string& path, std::string& val)
 {
-    if (path.back() == '/') {
-        path.pop_back();
-    }
+    std::string buff;
+    const std::string& key = trim_path(path, buff);
 
     if (tid == 0) {
-        return access.read(cid, path, val);
+        return access.read(cid, key, val);
     } else {
         transaction_db::iterator it;
 
         it = trans.find(tid);
         if (it != trans.end()) {
-            return it->second.read(cid, path, val);
+            return it->second.read(cid, key, val);
         } else {
             return EINVAL;
         }
     }
 }
 
-int lixs::mstore::store::update(cid_t cid, unsigned int tid, std::string path, std::string val)
+int lixs::mstore::store::update(cid_t cid, unsigned int tid,
+        const std::string& path, std::string val)
 {
-    if (path.back() == '/') {
-        path.pop_back();
-    }
+    std::string buff;
+    const std::string& key = trim_path(path, buff);
 
     if (tid == 0) {
-        return access.update(cid, path, val);
+        return publish(access.update(cid, key, std::move(val)));
     } else {
         transaction_db::iterator it;
 
         it = trans.find(tid);
         if (it != trans.end()) {
-            return it->second.update(cid, path, val);
+            return it->second.update(cid, key, std::move(val));
         } else {
             return EINVAL;
         }
     }
 }
 
-int lixs::mstore::store::del(cid_t cid, unsigned int tid, std::string path)
+int lixs::mstore::store::del(cid_t cid, unsigned int tid, const std::string& path)
 {
-    if (path.back() == '/') {
-        path.pop_back();
-    }
+    std::string buff;
+    const std::string& key = trim_path(path, buff);
 
     if (tid == 0) {
-        return access.del(cid, path);
+        return publish(access.del(cid, key));
     } else {
         transaction_db::iterator it;
 
         it = trans.find(tid);
         if (it != trans.end()) {
-            return it->second.del(cid, path);
+            return it->second.del(cid, key);
         } else {
             return EINVAL;
         }
     }
 }
 
-int lixs::mstore::store::get_children(cid_t cid, unsigned int tid, std::string path,
-        std::set<std::string>& resp)
+int lixs::mstore::store::read(cid_t cid, unsigned int tid, const std::string& path,
+        std::string& val, unsigned long int& version)
+{
+    std::string buff;
+
+    if (tid != 0) {
+        return EINVAL;
+    }
+
+    return access.read(cid, trim_path(path, buff), val, version);
+}
+
+int lixs::mstore::store::update_if(cid_t cid, unsigned int tid, const std::string& path,
+        std::string val, unsigned long int& version)
+{
+    std::string buff;
+
+    if (tid != 0) {
+        return EINVAL;
+    }
+
+    return publish(access.update_if(cid, trim_path(path, buff), std::move(val), version));
+}
+
+int lixs::mstore::store::update_if(cid_t cid, unsigned int tid, const std::string& path,
+        std::string val, const std::string& expected, unsigned long int& version)
+{
+    std::string buff;
+
+    if (tid != 0) {
+        return EINVAL;
+    }
+
+    return publish(access.update_if(cid, trim_path(path, buff), std::move(val), expected,
+                version));
+}
+
+int lixs::mstore::store::del_owned(cid_t owner, const std::string& path,
+        std::list<std::string>& removed)
+{
+    std::string buff;
+
+    return publish(access.del_owned(owner, trim_path(path, buff), removed));
+}
+
+int lixs::mstore::store::clone(cid_t cid, unsigned int tid, const std::string& src,
+        const std::string& dst, cid_t from, cid_t to)
 {
-    if (path.back() == '/') {
-        path.pop_back();
+    std::string src_buff;
+    std::string dst_buff;
+
+    if (tid != 0) {
+        return EINVAL;
     }
 
+    return publish(access.clone(cid, trim_path(src, src_buff), trim_path(dst, dst_buff),
+                from, to));
+}
+
+int lixs::mstore::store::get_children(cid_t cid, unsigned int tid,
+        const std::string& path, std::set<std::string>& resp)
+{
+    resp.clear();
+
+    /* Children are visited in order, so each name goes to the end of the set. */
+    return get_children(cid, tid, path, [&resp] (const std::string& name) {
+        resp.insert(resp.end(), name);
+    });
+}
+
+int lixs::mstore::store::get_children(cid_t cid, unsigned int tid,
+        const std::string& path, const children_cb& cb)
+{
+    unsigned long int gen;
+
+    return get_children_part(cid, tid, path, "", [&cb] (const std::string& name) {
+        cb(name);
+        return true;
+    }, gen);
+}
+
+int lixs::mstore::store::get_children_part(cid_t cid, unsigned int tid, const std::string& path,
+        const std::string& start, const children_part_cb& cb, unsigned long int& gen)
+{
+    std::string buff;
+    const std::string& key = trim_path(path, buff);
+
     if (tid == 0) {
-        return access.get_children(cid, path, resp);
+        return access.get_children(cid, key, start, cb, gen);
     } else {
         transaction_db::iterator it;
 
         it = trans.find(tid);
         if (it != trans.end()) {
-            return it->second.get_children(cid, path, resp);
+            return it->second.get_children(cid, key, start, cb, gen);
         } else {
             return EINVAL;
         }
@@ -184,20 +285,19 @@ int lixs::mstore::store::get_children(cid_t cid, unsigned int tid, std::string p
 }
 
 int lixs::mstore::store::get_perms(cid_t cid, unsigned int tid,
-        std::string path, permission_list& perms)
+        const std::string& path, permission_list& perms)
 {
-    if (path.back() == '/') {
-        path.pop_back();
-    }
+    std::string buff;
+    const std::string& key = trim_path(path, buff);
 
     if (tid == 0) {
-        return access.get_perms(cid, path, perms);
+        return access.get_perms(cid, key, perms);
     } else {
         transaction_db::iterator it;
 
         it = trans.find(tid);
         if (it != trans.end()) {
-            return it->second.get_perms(cid, path, perms);
+            return it->second.get_perms(cid, key, perms);
         } else {
             return EINVAL;
         }
@@ -205,23 +305,236 @@ int lixs::mstore::store::get_perms(cid_t cid, unsigned int tid,
 }
 
 int lixs::mstore::store::set_perms(cid_t cid, unsigned int tid,
-        std::string path, const permission_list& perms)
+        const std::string& path, const permission_list& perms)
 {
-    if (path.back() == '/') {
-        path.pop_back();
-    }
+    std::string buff;
+    const std::string& key = trim_path(path, buff);
 
     if (tid == 0) {
-        return access.set_perms(cid, path, perms);
+        return publish(access.set_perms(cid, key, perms));
     } else {
         transaction_db::iterator it;
 
         it = trans.find(tid);
         if (it != trans.end()) {
-            return it->second.set_perms(cid, path, perms);
+            return it->second.set_perms(cid, key, perms);
         } else {
             return EINVAL;
         }
     }
 }
 
+void lixs::mstore::store::set_quota(unsigned long int nodes, unsigned long int bytes)
+{
+    quotas.set_limits(nodes, bytes);
+}
+
+void lixs::mstore::store::get_stats(store_stats& stats)
+{
+    stats.nodes = db.nodes;
+    stats.bytes = db.bytes;
+    stats.transactions = trans.size();
+}
+
+void lixs::mstore::store::get_owner_stats(cid_t owner, owner_stats& stats)
+{
+    quotas.get(owner, stats.nodes, stats.bytes);
+}
+
+void lixs::mstore::store::get_transaction_stats(std::list<transaction_stats>& stats)
+{
+    stats.clear();
+
+    for (auto& t : trans) {
+        stats.push_back(transaction_stats());
+        stats.back().tid = t.first;
+        stats.back().records = t.second.size();
+        stats.back().age_ms = t.second.age_ms();
+    }
+}
+
+int lixs::mstore::store::get_usage(const std::string& path, const std::string& cursor,
+        unsigned long int max_entries, std::list<store_usage>& usage, std::string& next)
+{
+    std::string prefix;
+    database::iterator it;
+    database::iterator pit;
+    database::iterator last;
+    unsigned long int entries;
+
+    /* The root entry is stored with an empty path. */
+    prefix = path;
+    if (prefix.back() == '/') {
+        prefix.pop_back();
+    }
+
+    pit = db.find(prefix);
+    if (pit == db.end() || pit->second.e.write_seq <= pit->second.e.delete_seq) {
+        return ENOENT;
+    }
+
+    /* Entries are sorted by path, therefore all the entries of the subtree are found after
+     * "<path>/" and before the first entry not sharing that prefix. Entries in the subtree are
+     * accounted for in runs of consecutive entries belonging to the same child. The same child
+     * might show up in more than one run (e.g. "a", "a-b", "a/c").
+     */
+    prefix += "/";
+
+    /* Position before clearing the output, the cursor might refer to it. */
+    it = cursor.empty() ? db.lower_bound(prefix) : db.upper_bound(cursor);
+
+    usage.clear();
+    next.clear();
+
+    for (entries = 0; it != db.end(); it++) {
+        const std::string& key = it->first;
+        record& rec = it->second;
+
+        if (key.compare(0, prefix.length(), prefix) != 0) {
+            break;
+        }
+
+        if (entries == max_entries) {
+            next = last->first;
+            break;
+        }
+        entries++;
+        last = it;
+
+        if (rec.e.write_seq <= rec.e.delete_seq) {
+            continue;
+        }
+
+        size_t end = key.find('/', prefix.length());
+        if (end == std::string::npos) {
+            end = key.length();
+        }
+
+        if (usage.empty()
+                || key.compare(prefix.length(), end - prefix.length(), usage.back().name) != 0) {
+            usage.push_back(store_usage());
+            usage.back().name = key.substr(prefix.length(), end - prefix.length());
+        }
+
+        usage.back().last = key;
+        usage.back().nodes++;
+        usage.back().bytes += key.length() + rec.e.value.length();
+    }
+
+    return 0;
+}
+
+void lixs::mstore::store::enable_view(read_view& v)
+{
+    view = &v;
+
+    db.track_changes = true;
+    db.changed.clear();
+
+    for (auto& r : db) {
+        if (r.second.e.write_seq > r.second.e.delete_seq) {
+            view->publish(r.first, r.second.e);
+        }
+    }
+}
+
+int lixs::mstore::store::enable_wal(wal& w)
+{
+    int ret;
+    wal_state state;
+    std::string name;
+    std::string parent;
+    database::iterator it;
+
+    ret = w.recover(state);
+    if (ret) {
+        return ret;
+    }
+
+    /* Entries are sorted by path, so parents are restored before their children. An entry
+     * without a parent could only come from a damaged log and is left out, along with its
+     * children.
+     */
+    for (auto& s : state) {
+        if (basename(s.first, parent, name)) {
+            it = db.find(parent);
+            if (it == db.end()) {
+                continue;
+            }
+
+            record& prec = it->second;
+            prec.e.children.insert(name);
+            prec.e.write_children_seq = prec.next_seq++;
+            prec.e.children_gen = ++db.generation;
+        }
+
+        record& rec = db[s.first];
+        rec.e.value = s.second.value;
+        rec.e.perms = s.second.perms;
+        rec.e.write_seq = rec.next_seq++;
+        rec.e.write_gen = ++db.generation;
+
+        db.account(rec.e.perms, 1, s.first.length() + rec.e.value.length());
+    }
+
+    ret = w.compact(db);
+    if (ret) {
+        return ret;
+    }
+
+    journal = &w;
+
+    db.track_changes = true;
+    db.changed.clear();
+
+    return 0;
+}
+
+int lixs::mstore::store::publish(int ret)
+{
+    database::iterator it;
+    std::vector<std::string>& changed = db.changed;
+
+    if ((view == NULL && journal == NULL) || changed.empty()) {
+        return ret;
+    }
+
+    /* An operation might change the same entry more than once, e.g. a parent gaining children. */
+    std::sort(changed.begin(), changed.end());
+    changed.erase(std::unique(changed.begin(), changed.end()), changed.end());
+
+    for (auto& path : changed) {
+        it = db.find(path);
+        if (it != db.end() && it->second.e.write_seq > it->second.e.delete_seq) {
+            if (view != NULL) {
+                view->publish(path, it->second.e);
+            }
+            if (journal != NULL) {
+                journal->write(path, it->second.e);
+            }
+        } else {
+            if (view != NULL) {
+                view->remove(path);
+            }
+            if (journal != NULL) {
+                journal->remove(path);
+            }
+        }
+    }
+
+    changed.clear();
+
+    if (view != NULL) {
+        view->sync();
+    }
+
+    if (journal != NULL) {
+        journal->commit();
+    }
+
+    if (journal != NULL && journal->compact_due()) {
+        journal->compact_later(db);
+    }
+
+    return ret;
+}
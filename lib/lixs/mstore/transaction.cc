@@ -39,18 +39,24 @@
 #include <lixs/mstore/transaction.hh>
 #include <lixs/util.hh>
 
+#include <chrono>
+#include <map>
 #include <set>
 #include <string>
+#include <utility>
+#include <vector>
 
 
 lixs::mstore::transaction::transaction(unsigned int id, database& db, log::logger& log)
-    : db_access(db, log), id(id)
+    : db_access(db, log), id(id), limited(false), start(std::chrono::steady_clock::now())
 {
 }
 
 int lixs::mstore::transaction::create(cid_t cid, const std::string& path, bool& created)
 {
-    record& rec = db[path];
+    limited |= (cid != 0);
+
+    record& rec = db.owner(path)[path];
     tentry& te = get_tentry(path, rec);
 
     if (te.write_seq > te.delete_seq) {
@@ -78,7 +84,7 @@ int lixs::mstore::transaction::create(cid_t cid, const std::string& path, bool&
 
 int lixs::mstore::transaction::read(cid_t cid, const std::string& path, std::string& val)
 {
-    record& rec = db[path];
+    record& rec = db.owner(path)[path];
     tentry& te = get_tentry(path, rec);
 
     if (te.write_seq > te.delete_seq) {
@@ -97,9 +103,11 @@ int lixs::mstore::transaction::read(cid_t cid, const std::string& path, std::str
     }
 }
 
-int lixs::mstore::transaction::update(cid_t cid, const std::string& path, const std::string& val)
+int lixs::mstore::transaction::update(cid_t cid, const std::string& path, std::string val)
 {
-    record& rec = db[path];
+    limited |= (cid != 0);
+
+    record& rec = db.owner(path)[path];
     tentry& te = get_tentry(path, rec);
 
     if (te.write_seq > te.delete_seq) {
@@ -124,7 +132,7 @@ int lixs::mstore::transaction::update(cid_t cid, const std::string& path, const
     }
 
     /* Set the new value. */
-    te.value = val;
+    te.value = std::move(val);
 
     /* Finally mark the entry as written and therefore as valid. */
     te.write_seq = rec.next_seq++;
@@ -134,7 +142,9 @@ int lixs::mstore::transaction::update(cid_t cid, const std::string& path, const
 
 int lixs::mstore::transaction::del(cid_t cid, const std::string& path)
 {
-    record& rec = db[path];
+    limited |= (cid != 0);
+
+    record& rec = db.owner(path)[path];
     tentry& te = get_tentry(path, rec);
 
     if (te.write_seq > te.delete_seq) {
@@ -152,7 +162,8 @@ int lixs::mstore::transaction::del(cid_t cid, const std::string& path)
     fetch_tentry_children(te, rec);
 
     /* Delete all children branches and unregister this entry.  */
-    delete_branch(path, te);
+    delete_branch(path);
+    clear_children(db.owner(path), te);
     unregister_from_parent(path);
 
     /* We don't need to reset value or permissions. If the entry is re-used we reset the data
@@ -165,9 +176,15 @@ int lixs::mstore::transaction::del(cid_t cid, const std::string& path)
     return 0;
 }
 
-int lixs::mstore::transaction::get_children(cid_t cid, const std::string& path, std::set<std::string>& resp)
+int lixs::mstore::transaction::get_children(cid_t cid, const std::string& path,
+        const std::string& start, const children_part_cb& cb, unsigned long int& gen)
 {
-    record& rec = db[path];
+    const std::string* name;
+    std::set<std::string>::const_iterator c;
+    std::set<std::string>::const_iterator a;
+    std::set<std::string>::const_iterator r;
+
+    record& rec = db.owner(path)[path];
     tentry& te = get_tentry(path, rec);
 
     if (te.write_seq > te.delete_seq) {
@@ -184,13 +201,37 @@ int lixs::mstore::transaction::get_children(cid_t cid, const std::string& path,
     /* If we have a valid entry and can read from it we then need to fetch the children list. */
     fetch_tentry_children(te, rec);
 
-    /* Build the current children list as: `te.children + te.children_add - te.children_rem`. */
-    resp = te.children;
-    for (auto& c : te.children_add) {
-        resp.insert(c);
-    }
-    for (auto& c : te.children_rem) {
-        resp.erase(c);
+    /* The current children list is `te.children + te.children_add - te.children_rem`. All three
+     * sets are sorted, so walk them together instead of building the list. A name can be in both
+     * te.children and te.children_add (e.g. deleted and created again), but children_add and
+     * children_rem never share names.
+     */
+    gen = te.children_gen;
+
+    c = te.children.lower_bound(start);
+    a = te.children_add.lower_bound(start);
+    r = te.children_rem.lower_bound(start);
+
+    while (c != te.children.end() || a != te.children_add.end()) {
+        if (a == te.children_add.end() || (c != te.children.end() && *c < *a)) {
+            name = &*c++;
+        } else if (c == te.children.end() || *a < *c) {
+            name = &*a++;
+        } else {
+            name = &*c++;
+            a++;
+        }
+
+        while (r != te.children_rem.end() && *r < *name) {
+            r++;
+        }
+        if (r != te.children_rem.end() && *r == *name) {
+            continue;
+        }
+
+        if (!cb(*name)) {
+            break;
+        }
     }
 
     return 0;
@@ -199,7 +240,7 @@ int lixs::mstore::transaction::get_children(cid_t cid, const std::string& path,
 int lixs::mstore::transaction::get_perms(cid_t cid,
         const std::string& path, permission_list& perms)
 {
-    record& rec = db[path];
+    record& rec = db.owner(path)[path];
     tentry& te = get_tentry(path, rec);
 
     if (te.write_seq > te.delete_seq) {
@@ -221,7 +262,9 @@ int lixs::mstore::transaction::get_perms(cid_t cid,
 int lixs::mstore::transaction::set_perms(cid_t cid,
         const std::string& path, const permission_list& perms)
 {
-    record& rec = db[path];
+    limited |= (cid != 0);
+
+    record& rec = db.owner(path)[path];
     tentry& te = get_tentry(path, rec);
 
     if (te.write_seq > te.delete_seq) {
@@ -233,6 +276,11 @@ int lixs::mstore::transaction::set_perms(cid_t cid,
         if (!has_write_access(cid, te.perms)) {
             return EACCES;
         }
+
+        /* Only dom0 can give entries away, see simple_access::set_perms. */
+        if (cid != 0 && get_owner(perms) != get_owner(te.perms)) {
+            return EACCES;
+        }
     } else {
         return ENOENT;
     }
@@ -248,14 +296,15 @@ int lixs::mstore::transaction::set_perms(cid_t cid,
 void lixs::mstore::transaction::abort()
 {
     for (auto& r : records) {
-        record& rec = db[r];
+        database& d = db.owner(r);
+        record& rec = d[r];
 
         /* Remove transaction information from the entry. */
         rec.te.erase(id);
 
         /* If the entry is invalid and has no more active transactions we clean it from the DB. */
         if ((rec.e.delete_seq > rec.e.write_seq) && rec.te.empty()) {
-            db.erase(r);
+            d.erase(r);
         }
     }
 
@@ -263,15 +312,59 @@ void lixs::mstore::transaction::abort()
     records.clear();
 }
 
-void lixs::mstore::transaction::merge(bool& success)
+int lixs::mstore::transaction::merge(bool& success)
 {
     success = can_merge();
 
+    if (success && limited && !check_quota()) {
+        success = false;
+        abort();
+
+        return ENOSPC;
+    }
+
     if (success) {
         do_merge();
     } else {
         abort();
     }
+
+    return 0;
+}
+
+unsigned long int lixs::mstore::transaction::size(void)
+{
+    return records.size();
+}
+
+unsigned long int lixs::mstore::transaction::age_ms(void)
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+}
+
+const std::set<std::string>& lixs::mstore::transaction::get_records(void)
+{
+    return records;
+}
+
+bool lixs::mstore::transaction::exists(const std::string& path)
+{
+    database::iterator it;
+    tentry_map::iterator tit;
+    database& d = db.owner(path);
+
+    it = d.find(path);
+    if (it == d.end()) {
+        return false;
+    }
+
+    tit = it->second.te.find(id);
+    if (tit != it->second.te.end()) {
+        return tit->second.write_seq > tit->second.delete_seq;
+    } else {
+        return it->second.e.write_seq > it->second.e.delete_seq;
+    }
 }
 
 bool lixs::mstore::transaction::can_merge()
@@ -283,7 +376,7 @@ bool lixs::mstore::transaction::can_merge()
      */
     log::LOG<log::level::TRACE>::logf(log, "  RECORDS");
     for (auto& r : records) {
-        record& rec = db[r];
+        record& rec = db.owner(r)[r];
         tentry& te = rec.te[id];
 
         /* 1. A valid entry at initialization time was deleted or an invalid entry at
@@ -329,10 +422,56 @@ bool lixs::mstore::transaction::can_merge()
     return true;
 }
 
+bool lixs::mstore::transaction::check_quota()
+{
+    cid_t owner;
+    std::map<cid_t, std::pair<long int, long int> > needed;
+
+    if (db.quotas == NULL || !db.quotas->enabled()) {
+        return true;
+    }
+
+    /* Usage changes as do_merge is going to apply them, committed entries being replaced by the
+     * transaction's.
+     */
+    for (auto& r : records) {
+        record& rec = db.owner(r)[r];
+        tentry& te = rec.te[id];
+
+        bool replaced = (te.write_seq > te.delete_seq) ? (te.write_seq > te.init_seq)
+            : (te.delete_seq > te.init_seq);
+
+        if (!replaced) {
+            continue;
+        }
+
+        if (rec.e.write_seq > rec.e.delete_seq) {
+            owner = get_owner(rec.e.perms);
+            needed[owner].first--;
+            needed[owner].second -= r.length() + rec.e.value.length();
+        }
+
+        if (te.write_seq > te.delete_seq) {
+            owner = get_owner(te.perms);
+            needed[owner].first++;
+            needed[owner].second += r.length() + te.value.length();
+        }
+    }
+
+    for (auto& n : needed) {
+        if (!db.quotas->check(n.first, n.second.first, n.second.second)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 void lixs::mstore::transaction::do_merge()
 {
     for (auto& r : records) {
-        record& rec = db[r];
+        database& d = db.owner(r);
+        record& rec = d[r];
         tentry& te = rec.te[id];
 
         if (te.write_seq > te.delete_seq) {
@@ -340,14 +479,26 @@ void lixs::mstore::transaction::do_merge()
              * after initialization.
              */
             if (te.write_seq > te.init_seq) {
-                rec.e.value = te.value;
-                rec.e.perms = te.perms;
+                /* Keep the database statistics up to date, the entry might have been created
+                 * during the transaction.
+                 */
+                if (rec.e.write_seq > rec.e.delete_seq) {
+                    d.account(rec.e.perms, -1, -static_cast<long int>(r.length()
+                                + rec.e.value.length()));
+                }
+                d.account(te.perms, 1, r.length() + te.value.length());
+
+                /* The transaction entry is dropped below, so its data can be moved. */
+                rec.e.value = std::move(te.value);
+                rec.e.perms = std::move(te.perms);
 
                 /* If a second transaction started after this entry was written here, that
                  * transaction would be able to commit even though this transaction is modifying
                  * the entry now. Therefore we need to update the sequence numbers with new ones.
                  */
                 rec.e.write_seq = rec.next_seq++;
+                rec.e.write_gen = ++d.generation;
+                d.touch(r);
             }
 
             /* If there were changes to the children list during transaction we apply those now and
@@ -362,6 +513,8 @@ void lixs::mstore::transaction::do_merge()
                 }
 
                 rec.e.write_children_seq = rec.next_seq++;
+                rec.e.children_gen = ++d.generation;
+                d.touch(r);
             }
 
             /* It is possible to get here without applying any action on the node, for instance,
@@ -369,8 +522,22 @@ void lixs::mstore::transaction::do_merge()
              */
         } else {
             if (te.delete_seq > te.init_seq) {
+                /* The entry might have been created and deleted during the transaction, in which
+                 * case there's nothing to account for.
+                 */
+                if (rec.e.write_seq > rec.e.delete_seq) {
+                    d.account(rec.e.perms, -1, -static_cast<long int>(r.length()
+                                + rec.e.value.length()));
+                    d.touch(r);
+
+                    /* All the children are deleted by this transaction as well. */
+                    rec.e.children.clear();
+                    rec.e.write_children_seq = rec.next_seq++;
+                    rec.e.children_gen = ++d.generation;
+                }
+
                 /* See above for why we need to update the sequence number. */
-                te.delete_seq = rec.next_seq++;
+                rec.e.delete_seq = rec.next_seq++;
             }
         }
 
@@ -387,7 +554,7 @@ void lixs::mstore::transaction::do_merge()
                 rec.e.write_children_seq = 0;
             } else {
                 /* If the entry is invalid we should remove it from the database. */
-                db.erase(r);
+                d.erase(r);
             }
         }
     }
@@ -403,11 +570,13 @@ void lixs::mstore::transaction::register_with_parent(const std::string& path)
 
     /* The root node can't be registered. */
     if (basename(path, parent, name)) {
-        record& rec = db[parent];
+        database& pdb = db.owner(parent);
+        record& rec = pdb[parent];
         tentry& te = get_tentry(parent, rec);
 
         te.children_add.insert(name);
         te.children_rem.erase(name);
+        te.children_gen = ++pdb.generation;
     }
 }
 
@@ -418,11 +587,13 @@ void lixs::mstore::transaction::unregister_from_parent(const std::string& path)
 
     /* Check whether we're registering the root node, that is not registered anywhere. */
     if (basename(path, parent, name)) {
-        record& rec = db[parent];
+        database& pdb = db.owner(parent);
+        record& rec = pdb[parent];
         tentry& te = get_tentry(parent, rec);
 
         te.children_rem.insert(name);
         te.children_add.erase(name);
+        te.children_gen = ++pdb.generation;
     }
 }
 
@@ -442,33 +613,59 @@ void lixs::mstore::transaction::ensure_branch(cid_t cid, const std::string& path
     }
 }
 
-void lixs::mstore::transaction::delete_branch(const std::string& path, tentry& te)
+void lixs::mstore::transaction::delete_branch(const std::string& path)
 {
-    /* With due precaution we could operate on te.children directly. However it's safer to generate
-     * the current children list on a separate set without touching te.children. Later we can
-     * optimize this if necessary.
+    std::string prefix;
+    database::iterator it;
+    tentry_map::iterator tit;
+    std::vector<database*> dbs;
+
+    /* Entries are sorted by path, so all the entries below path share the "<path>/" prefix and
+     * are found in a single range, no matter how deep, one per database on a sharded tree. This
+     * includes entries not valid from the transaction point of view (e.g. created by other
+     * transactions), which are skipped without being referenced here.
      */
-    std::set<std::string> children;
+    prefix = path + "/";
 
-    /* Build the current children list as: `te.children + te.children_add - te.children_rem`. */
-    children = te.children;
-    for (auto& c : te.children_add) {
-        children.insert(c);
-    }
-    for (auto& c : te.children_rem) {
-        children.erase(c);
-    }
+    db.below(path, dbs);
+    for (auto d : dbs) {
+        for (it = d->lower_bound(prefix); it != d->end(); it++) {
+            record& rec = it->second;
+
+            if (it->first.compare(0, prefix.length(), prefix) != 0) {
+                break;
+            }
+
+            tit = rec.te.find(id);
+            if (tit != rec.te.end()) {
+                if (tit->second.write_seq <= tit->second.delete_seq) {
+                    continue;
+                }
+            } else if (rec.e.write_seq <= rec.e.delete_seq) {
+                continue;
+            }
+
+            /* As on del, the entry is read so that the transaction aborts if it's modified
+             * outside of the transaction. All the entries below it are deleted too, so its
+             * children list can simply be cleared instead of unregistering each of them.
+             */
+            tentry& te = get_tentry(it->first, rec);
+            fetch_tentry_data(te, rec);
+            fetch_tentry_children(te, rec);
+            clear_children(*d, te);
 
-    /* Delete all children. This will recursively delete the full branches. */
-    for (auto& c : children) {
-        /* Deleting a subtree only requires write access to the root node, so delete as 0. */
-        del(0, path + "/" + c);
+            te.delete_seq = rec.next_seq++;
+        }
     }
+}
 
-    /* During the deletion process children_rem will be updated with all the deleted children so
-     * that `te.children + te.children_add - te.children_rem` results in an empty set. Therefore we
-     * don't need to clear the sets. Again this can be optimized later if necessary.
-     */
+void lixs::mstore::transaction::clear_children(database& d, tentry& te)
+{
+    /* Make `te.children + te.children_add - te.children_rem` an empty set. */
+    te.children_rem.insert(te.children.begin(), te.children.end());
+    te.children_rem.insert(te.children_add.begin(), te.children_add.end());
+    te.children_add.clear();
+    te.children_gen = ++d.generation;
 }
 
 void lixs::mstore::transaction::get_parent_perms(const std::string& path, permission_list& perms)
@@ -481,7 +678,7 @@ void lixs::mstore::transaction::get_parent_perms(const std::string& path, permis
          * therefore we can just get the entry without checking for its validity. However we need
          * to make sure to fetch entry data so that we can read its permission list.
          */
-        record& rec = db[parent];
+        record& rec = db.owner(parent)[parent];
         tentry& te = get_tentry(parent, rec);
         fetch_tentry_data(te, rec);
 
@@ -589,6 +786,13 @@ void lixs::mstore::transaction::fetch_tentry_children(tentry& te, record& rec)
             te.children.insert(rec.e.children.begin(), rec.e.children.end());
         }
 
+        /* Local changes already got a new generation, any change to the base list from now on
+         * only happens within the transaction.
+         */
+        if (te.children_add.empty() && te.children_rem.empty()) {
+            te.children_gen = rec.e.children_gen;
+        }
+
         /* Finally mark the children list as fetched. */
         te.read_children_seq = rec.next_seq++;
     }
@@ -0,0 +1,627 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+
+#include <lixs/log/logger.hh>
+#include <lixs/mstore/wal.hh>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <string>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+
+static uint32_t checksum(const char* data, size_t len)
+{
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < len; i++) {
+        hash ^= static_cast<uint8_t>(data[i]);
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static void put_u32(std::string& buff, uint32_t val)
+{
+    buff.append(reinterpret_cast<const char*>(&val), sizeof(val));
+}
+
+static void put_str(std::string& buff, const std::string& str)
+{
+    put_u32(buff, str.length());
+    buff.append(str);
+}
+
+static void encode(std::string& buff, uint8_t type, const std::string& path,
+        const lixs::mstore::entry* e)
+{
+    buff.push_back(type);
+    put_str(buff, path);
+
+    if (e != NULL) {
+        put_str(buff, e->value);
+        put_u32(buff, e->perms.size());
+
+        for (auto& p : e->perms) {
+            put_u32(buff, p.cid);
+            buff.push_back((p.read ? 1 : 0) | (p.write ? 2 : 0));
+        }
+    }
+}
+
+/* Append the changes encoded in group to buff as a single record. */
+static void frame(std::string& buff, const std::string& group)
+{
+    lixs::mstore::wal_record rec;
+
+    rec.len = group.length();
+    rec.sum = checksum(group.data(), group.length());
+
+    buff.append(reinterpret_cast<const char*>(&rec), sizeof(rec));
+    buff.append(group);
+}
+
+static bool get_u32(const char*& pos, const char* end, uint32_t& val)
+{
+    if (static_cast<size_t>(end - pos) < sizeof(val)) {
+        return false;
+    }
+
+    std::memcpy(&val, pos, sizeof(val));
+    pos += sizeof(val);
+
+    return true;
+}
+
+static bool get_str(const char*& pos, const char* end, std::string& str)
+{
+    uint32_t len;
+
+    if (!get_u32(pos, end, len) || static_cast<size_t>(end - pos) < len) {
+        return false;
+    }
+
+    str.assign(pos, len);
+    pos += len;
+
+    return true;
+}
+
+/* A change read back from a record, kept aside until the whole record is read. */
+struct change {
+    std::string path;
+    bool remove;
+    lixs::mstore::wal_entry e;
+};
+
+/* Parse the change at pos, returns false if it can't be parsed. */
+static bool parse(const char*& pos, const char* end, change& c)
+{
+    uint8_t type;
+    uint32_t nperms;
+    uint32_t cid;
+
+    if (pos == end) {
+        return false;
+    }
+
+    type = *pos++;
+
+    if (!get_str(pos, end, c.path)) {
+        return false;
+    }
+
+    c.remove = type == lixs::mstore::wal_remove;
+    if (c.remove) {
+        return true;
+    }
+
+    if (type != lixs::mstore::wal_write || !get_str(pos, end, c.e.value)
+            || !get_u32(pos, end, nperms)) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < nperms; i++) {
+        if (!get_u32(pos, end, cid) || pos == end) {
+            return false;
+        }
+
+        c.e.perms.push_back(lixs::permission(cid, *pos & 1, *pos & 2));
+        pos++;
+    }
+
+    return true;
+}
+
+/* Apply the changes in the record body to state, returns false if it can't be parsed. Nothing is
+ * applied unless the whole record is, so a commit is either restored or not at all.
+ */
+static bool replay(const char* pos, const char* end, lixs::mstore::wal_state& state)
+{
+    std::vector<change> changes;
+
+    if (pos == end) {
+        return false;
+    }
+
+    while (pos != end) {
+        changes.push_back(change());
+
+        if (!parse(pos, end, changes.back())) {
+            return false;
+        }
+    }
+
+    for (auto& c : changes) {
+        if (c.remove) {
+            state.erase(c.path);
+        } else {
+            state[c.path] = std::move(c.e);
+        }
+    }
+
+    return true;
+}
+
+static int write_all(int fd, const std::string& data)
+{
+    ssize_t ret;
+
+    for (size_t off = 0; off < data.length(); off += ret) {
+        ret = write(fd, data.data() + off, data.length() - off);
+        if (ret == -1 && errno == EINTR) {
+            ret = 0;
+        } else if (ret == -1) {
+            return errno;
+        }
+    }
+
+    return 0;
+}
+
+static std::string dirname(const std::string& path)
+{
+    size_t pos;
+
+    pos = path.rfind('/');
+    if (pos == std::string::npos) {
+        return ".";
+    } else if (pos == 0) {
+        return "/";
+    } else {
+        return path.substr(0, pos);
+    }
+}
+
+/* Encode the valid entries in db as a new log holding a single record. */
+static void snapshot(std::string& data, lixs::mstore::database& db)
+{
+    std::string entries;
+
+    for (auto& r : db) {
+        if (r.second.e.write_seq > r.second.e.delete_seq) {
+            encode(entries, lixs::mstore::wal_write, r.first, &r.second.e);
+        }
+    }
+
+    data.assign(lixs::mstore::wal_magic, sizeof(lixs::mstore::wal_magic));
+
+    if (!entries.empty()) {
+        frame(data, entries);
+    }
+}
+
+
+const off_t lixs::mstore::wal::compact_min;
+const off_t lixs::mstore::wal::compact_ratio;
+const unsigned int lixs::mstore::wal::retry_interval;
+
+lixs::mstore::wal::wal(const std::string& path, unsigned int sync_interval,
+        event_mgr& emgr, timer& t, log::logger& log)
+    : path(path), sync_interval(sync_interval), emgr(emgr), t(t), fd(-1), length(0),
+    compact_at(compact_min), flush_queued(false), sync_pending(false), compacting(false),
+    compact_done(false), compact_fd(-1), compact_err(0), log(log)
+{
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if (fd == -1) {
+        throw wal_error("Failed to open log file: " + std::string(std::strerror(errno)));
+    }
+}
+
+lixs::mstore::wal::~wal()
+{
+    finish_compaction(true);
+    sync();
+
+    if (sync_pending) {
+        t.clear();
+    }
+
+    close(fd);
+}
+
+int lixs::mstore::wal::recover(wal_state& state)
+{
+    int err;
+    ssize_t ret;
+    struct stat st;
+    wal_record rec;
+    std::string data;
+    const char* pos;
+    const char* end;
+
+    state.clear();
+
+    if (fstat(fd, &st) == -1) {
+        return errno;
+    }
+
+    /* A new log, start it. */
+    if (st.st_size == 0) {
+        data.assign(wal_magic, sizeof(wal_magic));
+
+        if ((err = write_all(fd, data)) != 0) {
+            return err;
+        }
+
+        length = data.length();
+        return 0;
+    }
+
+    data.resize(st.st_size);
+    for (off_t off = 0; off < st.st_size; off += ret) {
+        ret = pread(fd, &data[off], st.st_size - off, off);
+        if (ret == -1 && errno == EINTR) {
+            ret = 0;
+        } else if (ret == -1) {
+            return errno;
+        } else if (ret == 0) {
+            data.resize(off);
+            break;
+        }
+    }
+
+    /* Don't take over some other file. */
+    if (data.length() < sizeof(wal_magic)
+            || std::memcmp(data.data(), wal_magic, sizeof(wal_magic)) != 0) {
+        return EINVAL;
+    }
+
+    pos = data.data() + sizeof(wal_magic);
+    end = data.data() + data.length();
+
+    while (static_cast<size_t>(end - pos) >= sizeof(rec)) {
+        std::memcpy(&rec, pos, sizeof(rec));
+
+        if (rec.len > static_cast<size_t>(end - pos) - sizeof(rec)
+                || checksum(pos + sizeof(rec), rec.len) != rec.sum
+                || !replay(pos + sizeof(rec), pos + sizeof(rec) + rec.len, state)) {
+            break;
+        }
+
+        pos += sizeof(rec) + rec.len;
+    }
+
+    length = pos - data.data();
+
+    if (pos != end) {
+        log::LOG<log::level::WARN>::logf(log,
+                "Dropping %ld bytes of damaged records at the end of the log",
+                static_cast<long int>(end - pos));
+
+        if (ftruncate(fd, length) == -1) {
+            return errno;
+        }
+    }
+
+    return 0;
+}
+
+int lixs::mstore::wal::compact(database& db)
+{
+    int ret;
+    int nfd;
+    std::string data;
+
+    snapshot(data, db);
+
+    /* Don't try again before the log grows some more if this fails. */
+    compact_at = std::max(compact_min, compact_ratio * length);
+
+    nfd = open(tmp_path().c_str(), O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+    if (nfd == -1) {
+        return errno;
+    }
+
+    ret = write_all(nfd, data);
+    if (ret == 0 && fdatasync(nfd) == -1) {
+        ret = errno;
+    }
+
+    if (ret == 0) {
+        ret = install(nfd, data.length());
+    }
+
+    if (ret != 0) {
+        close(nfd);
+        unlink(tmp_path().c_str());
+        return ret;
+    }
+
+    /* Buffered records are about changes db already has. */
+    buffer.clear();
+    group.clear();
+
+    return 0;
+}
+
+void lixs::mstore::wal::compact_later(database& db)
+{
+    if (compacting) {
+        return;
+    }
+
+    compacting = true;
+    emgr.enqueue_event(std::bind(&wal::start_compaction, this, std::ref(db)));
+}
+
+bool lixs::mstore::wal::compact_due(void)
+{
+    return !compacting && length + static_cast<off_t>(buffer.length()) >= compact_at;
+}
+
+void lixs::mstore::wal::commit(void)
+{
+    if (group.empty()) {
+        return;
+    }
+
+    frame(buffer, group);
+    group.clear();
+
+    /* Group commit: records of every change made during this iteration of the event loop are
+     * written together once the events already queued, e.g. the other ready connections, ran.
+     */
+    if (!flush_queued) {
+        flush_queued = true;
+        emgr.enqueue_event(std::bind(&wal::flush, this));
+    }
+}
+
+void lixs::mstore::wal::write(const std::string& path, const entry& e)
+{
+    encode(group, wal_write, path, &e);
+}
+
+void lixs::mstore::wal::remove(const std::string& path)
+{
+    encode(group, wal_remove, path, NULL);
+}
+
+void lixs::mstore::wal::sync(void)
+{
+    commit();
+    flush();
+
+    if (fdatasync(fd) == -1) {
+        log::LOG<log::level::ERROR>::logf(log,
+                "Failed to sync log: %s", std::strerror(errno));
+    }
+}
+
+void lixs::mstore::wal::flush(void)
+{
+    int ret;
+
+    flush_queued = false;
+
+    /* Records that fail to be written are kept and written again later, after dropping whatever
+     * part of them made it to the file. Until then waiters stay held.
+     */
+    if (!buffer.empty() && (ret = write_all(fd, buffer)) != 0) {
+        log::LOG<log::level::ERROR>::logf(log,
+                "Failed to write log: %s", std::strerror(ret));
+
+        if (ftruncate(fd, length) == -1) {
+            log::LOG<log::level::ERROR>::logf(log,
+                    "Failed to truncate log: %s", std::strerror(errno));
+        }
+
+        if (!sync_pending) {
+            sync_pending = true;
+            t.set(std::chrono::steady_clock::now() + std::chrono::milliseconds(retry_interval),
+                    std::bind(&wal::expired, this));
+        }
+
+        return;
+    }
+
+    length += buffer.length();
+
+    /* Written after the snapshot being compacted was taken, so the compacted log needs them. */
+    if (compactor.joinable()) {
+        compact_tail.append(buffer);
+    }
+
+    buffer.clear();
+
+    finish_compaction(false);
+
+    if (sync_interval.count() == 0) {
+        if (fdatasync(fd) == -1) {
+            log::LOG<log::level::ERROR>::logf(log,
+                    "Failed to sync log: %s", std::strerror(errno));
+        }
+    } else if (!sync_pending) {
+        sync_pending = true;
+        t.set(std::chrono::steady_clock::now() + sync_interval, std::bind(&wal::expired, this));
+    }
+
+    release();
+}
+
+void lixs::mstore::wal::expired(void)
+{
+    sync_pending = false;
+
+    finish_compaction(false);
+
+    /* Retrying a failed write. */
+    if (!buffer.empty()) {
+        flush();
+        return;
+    }
+
+    if (fdatasync(fd) == -1) {
+        log::LOG<log::level::ERROR>::logf(log,
+                "Failed to sync log: %s", std::strerror(errno));
+    }
+}
+
+bool lixs::mstore::wal::pending(void)
+{
+    return !group.empty() || !buffer.empty();
+}
+
+std::string lixs::mstore::wal::tmp_path(void)
+{
+    return path + ".tmp";
+}
+
+int lixs::mstore::wal::install(int nfd, off_t len)
+{
+    int dfd;
+
+    /* The new log is written next to the old one and renamed over it once synced, so a crash
+     * leaves either of them in place.
+     */
+    if (rename(tmp_path().c_str(), path.c_str()) == -1) {
+        return errno;
+    }
+
+    dfd = open(dirname(path).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dfd != -1) {
+        fsync(dfd);
+        close(dfd);
+    }
+
+    close(fd);
+    fd = nfd;
+    length = len;
+    compact_at = std::max(compact_min, compact_ratio * length);
+
+    return 0;
+}
+
+void lixs::mstore::wal::start_compaction(database& db)
+{
+    snapshot(compact_data, db);
+
+    compact_at = std::max(compact_min, compact_ratio * length);
+
+    compact_fd = open(tmp_path().c_str(),
+            O_RDWR | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0600);
+    if (compact_fd == -1) {
+        log::LOG<log::level::ERROR>::logf(log,
+                "Failed to compact log: %s", std::strerror(errno));
+
+        compact_data.clear();
+        compacting = false;
+        return;
+    }
+
+    compact_done.store(false, std::memory_order_relaxed);
+    compactor = std::thread(&wal::write_snapshot, this);
+}
+
+void lixs::mstore::wal::write_snapshot(void)
+{
+    compact_err = write_all(compact_fd, compact_data);
+    if (compact_err == 0 && fdatasync(compact_fd) == -1) {
+        compact_err = errno;
+    }
+
+    compact_done.store(true, std::memory_order_release);
+}
+
+void lixs::mstore::wal::finish_compaction(bool wait)
+{
+    int ret;
+
+    if (!compactor.joinable() || (!wait && !compact_done.load(std::memory_order_acquire))) {
+        return;
+    }
+
+    compactor.join();
+
+    /* Records written to the old log meanwhile are copied over before replacing it. */
+    ret = compact_err;
+    if (ret == 0 && !compact_tail.empty()) {
+        ret = write_all(compact_fd, compact_tail);
+        if (ret == 0 && fdatasync(compact_fd) == -1) {
+            ret = errno;
+        }
+    }
+
+    if (ret == 0) {
+        ret = install(compact_fd, compact_data.length() + compact_tail.length());
+    }
+
+    if (ret != 0) {
+        log::LOG<log::level::ERROR>::logf(log,
+                "Failed to compact log: %s", std::strerror(ret));
+
+        close(compact_fd);
+        unlink(tmp_path().c_str());
+    }
+
+    compact_fd = -1;
+    compact_data.clear();
+    compact_tail.clear();
+    compacting = false;
+}
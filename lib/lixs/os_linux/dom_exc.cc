@@ -36,37 +36,38 @@
 
 #include <lixs/domain.hh>
 #include <lixs/domain_mgr.hh>
+#include <lixs/event_mgr.hh>
+#include <lixs/hypervisor.hh>
 #include <lixs/iomux.hh>
 #include <lixs/os_linux/dom_exc.hh>
 #include <lixs/xenstore.hh>
 
-#include <list>
+#include <cerrno>
+#include <cstring>
 #include <functional>
+#include <list>
+#include <string>
+#include <vector>
 
 
-lixs::os_linux::dom_exc::dom_exc(xenstore& xs, domain_mgr& dmgr, iomux& io)
-    : xs(xs), dmgr(dmgr), io(io), alive(true)
+lixs::os_linux::dom_exc::dom_exc(xenstore& xs, domain_mgr& dmgr, event_mgr& emgr, iomux& io,
+        hypervisor& hv)
+    : xs(xs), dmgr(dmgr), emgr(emgr), io(io), hv(hv), alive(true), scan_pending(false)
 {
-    xc_handle = xc_interface_open(NULL, NULL, 0);
-    if (xc_handle == NULL) {
-        throw dom_exc_error("Failed to open xc handle: " +
-                std::string(std::strerror(errno)));
-    }
-
-    xce_handle = xc_evtchn_open(NULL, 0);
-    if (xce_handle == NULL) {
+    evtchn = hv.evtchn_open();
+    if (evtchn == NULL) {
         throw dom_exc_error("Failed to open evtchn handle: " +
                 std::string(std::strerror(errno)));
     }
 
-    virq_port = xc_evtchn_bind_virq(xce_handle, VIRQ_DOM_EXC);
+    virq_port = evtchn->bind_virq(VIRQ_DOM_EXC);
     if (virq_port == (evtchn_port_t)(-1)) {
-        xc_evtchn_close(xce_handle);
+        delete evtchn;
         throw dom_exc_error("Failed to bind virq: " +
                 std::string(std::strerror(errno)));
     }
 
-    fd = xc_evtchn_fd(xce_handle);
+    fd = evtchn->fd();
     io.add(fd, true, false, std::bind(&dom_exc::callback, this,
                 std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
 }
@@ -77,19 +78,15 @@ lixs::os_linux::dom_exc::~dom_exc()
         io.rem(fd);
     }
 
-    xc_evtchn_close(xce_handle);
-    xc_interface_close(xc_handle);
+    delete evtchn;
 }
 
+
 void lixs::os_linux::dom_exc::callback(bool read, bool write, bool error)
 {
     int ret;
     evtchn_port_t port;
 
-    xc_dominfo_t dominfo;
-    std::list<domid_t> dead_list;
-    std::list<domid_t> dying_list;
-
     if (!alive) {
         return;
     }
@@ -98,32 +95,95 @@ void lixs::os_linux::dom_exc::callback(bool read, bool write, bool error)
         goto out_err;
     }
 
-    ret = 0;
-    for (auto& d : dmgr) {
-        domain* dom = d.second;
-        domid_t domid = dom->get_domid();
-
-        ret = xc_domain_getinfo(xc_handle, domid, 1, &dominfo);
-        if (ret == -1) {
-            break;
-        } else if (ret != 1 || domid != dominfo.domid) {
-            /* Domain doesn't exist already but is still in our list: remove */
-            dead_list.push_back(domid);
-        } else if (dominfo.dying) {
-            /* Domain is dying: remove */
-            dead_list.push_back(domid);
-        } else if (dom->is_active() && (dominfo.shutdown || dominfo.crashed)) {
-            dom->set_inactive();
-            dying_list.push_back(domid);
-        }
+    /* A burst of VIRQs arriving before the scan runs is handled by that single scan. */
+    if (!scan_pending) {
+        scan_pending = true;
+        emgr.enqueue_event(std::bind(&dom_exc::scan, this));
     }
 
+    port = evtchn->pending();
+    if (port == (evtchn_port_t)(-1)) {
+        goto out_err;
+    }
+
+    ret = evtchn->unmask(port);
     if (ret == -1) {
         goto out_err;
     }
 
+    return;
+
+out_err:
+    alive = false;
+    io.rem(fd);
+}
+
+void lixs::os_linux::dom_exc::scan(void)
+{
+    int ret;
+    unsigned int i;
+    domain_mgr::iterator it;
+
+    std::list<domid_t> dead_list;
+    std::list<domid_t> dying_list;
+
+    scan_pending = false;
+
+    if (!alive) {
+        return;
+    }
+
+    /* Both our list and the hypervisor's are sorted by domain id, so they are diffed in a single
+     * pass. Domain info is fetched in batches starting at the first domain not yet checked, so
+     * domains we don't know about don't need to be fetched.
+     */
+    it = dmgr.begin();
+    while (it != dmgr.end()) {
+        ret = hv.list_domains(it->first, scan_batch, infos);
+        if (ret != 0) {
+            goto out_err;
+        }
+
+        for (i = 0; it != dmgr.end(); ) {
+            domain* dom = it->second;
+            domid_t domid = it->first;
+
+            if (i == infos.size()) {
+                if (infos.size() < scan_batch) {
+                    /* No more domains: everything left in our list is gone. */
+                    dead_list.push_back(domid);
+                    it++;
+                    continue;
+                } else {
+                    /* Fetch the next batch. */
+                    break;
+                }
+            }
+
+            if (infos[i].domid < domid) {
+                i++;
+            } else if (infos[i].domid > domid) {
+                /* Domain doesn't exist already but is still in our list: remove */
+                dead_list.push_back(domid);
+                it++;
+            } else {
+                if (infos[i].dying) {
+                    /* Domain is dying: remove */
+                    dead_list.push_back(domid);
+                } else if (dom->is_active() && (infos[i].shutdown || infos[i].crashed)) {
+                    dom->set_inactive();
+                    dying_list.push_back(domid);
+                }
+
+                i++;
+                it++;
+            }
+        }
+    }
+
     for (auto& d : dead_list) {
         if (dmgr.destroy(d) == 0) {
+            xs.domain_teardown(d);
             xs.domain_release(d);
         }
     }
@@ -132,16 +192,6 @@ void lixs::os_linux::dom_exc::callback(bool read, bool write, bool error)
         xs.domain_release(d);
     }
 
-    port = xc_evtchn_pending(xce_handle);
-    if (port == (evtchn_port_t)(-1)) {
-        goto out_err;
-    }
-
-    ret = xc_evtchn_unmask(xce_handle, port);
-    if (ret == -1) {
-        goto out_err;
-    }
-
     return;
 
 out_err:
@@ -40,8 +40,14 @@
 #include <sys/epoll.h>
 
 
-lixs::os_linux::epoll::epoll(event_mgr& emgr)
-    : iomux(emgr), epfd(epoll_create(0x7E57))
+lixs::os_linux::epoll::handler::handler(void)
+    : used(false), read(false), write(false), events(0), ready_read(false), ready_write(false),
+    error(false)
+{
+}
+
+lixs::os_linux::epoll::epoll(event_mgr& emgr, bool edge)
+    : iomux(emgr), edge(edge), epfd(epoll_create(0x7E57))
 {
     emgr.enqueue_event(std::bind(&epoll::handle, this));
 }
@@ -52,44 +58,75 @@ lixs::os_linux::epoll::~epoll()
 
 void lixs::os_linux::epoll::add(int fd, bool read, bool write, io_cb cb)
 {
-    std::pair<cb_map::iterator, bool> res = callbacks.insert({fd, cb});
+    if (fd < 0) {
+        return;
+    }
+
+    if (static_cast<unsigned int>(fd) >= handlers.size()) {
+        handlers.resize(fd + 1);
+    }
 
-    if (!res.second) {
+    handler& h = handlers[fd];
+
+    if (h.used) {
         return;
     }
 
-    struct epoll_event event = {
-        get_events(read, write),
-        { static_cast<void*>(&(res.first->second)) }
-    };
+    h = handler();
+    h.used = true;
+    h.cb = cb;
+    h.read = read;
+    h.write = write;
+    h.events = edge ? (get_events(true, write) | EPOLLET) : get_events(read, write);
+
+    struct epoll_event event;
+    event.events = h.events;
+    event.data.fd = fd;
 
     epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &event);
 }
 
 void lixs::os_linux::epoll::set(int fd, bool read, bool write)
 {
-    cb_map::iterator it = callbacks.find(fd);
+    handler* h = get(fd);
 
-    if (it == callbacks.end()) {
+    if (h == NULL || (h->read == read && h->write == write)) {
         return;
     }
 
-    struct epoll_event event = {
-        get_events(read, write),
-        { static_cast<void*>(&(it->second)) }
-    };
+    h->read = read;
+    h->write = write;
+
+    if (edge) {
+        if (!write || (h->events & EPOLLOUT)) {
+            dispatch(*h);
+            return;
+        }
+
+        /* Readiness is reported right away if there is space already. */
+        h->events |= EPOLLOUT;
+    } else {
+        h->events = get_events(read, write);
+    }
+
+    struct epoll_event event;
+    event.events = h->events;
+    event.data.fd = fd;
 
     epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &event);
 }
 
 void lixs::os_linux::epoll::rem(int fd)
 {
-    cb_map::size_type res = callbacks.erase(fd);
+    handler* h = get(fd);
 
-    if (res == 0) {
+    if (h == NULL) {
         return;
     }
 
+    h->used = false;
+    h->cb = nullptr;
+
     /* Passing event == NULL requires linux > 2.6.9, see BUGS */
     epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
 }
@@ -98,16 +135,54 @@ void lixs::os_linux::epoll::handle(void)
 {
     int n_events;
 
-    n_events = epoll_wait(epfd, epev, epoll_max_events, timeout);
+    /* Don't block if there are other events to run, this one is still counted. */
+    n_events = epoll_wait(epfd, epev, epoll_max_events, emgr.size() > 1 ? 0 : timeout);
 
     for (int i = 0; i < n_events; i++) {
-        emgr.enqueue_event(std::bind(*static_cast<io_cb*>(epev[i].data.ptr),
-                is_read(epev[i].events), is_write(epev[i].events), is_error(epev[i].events)));
+        handler& h = handlers[epev[i].data.fd];
+
+        if (edge) {
+            h.ready_read |= is_read(epev[i].events);
+            h.ready_write |= is_write(epev[i].events);
+            h.error |= is_error(epev[i].events);
+
+            dispatch(h);
+        } else {
+            emgr.enqueue_event(std::bind(h.cb, is_read(epev[i].events),
+                        is_write(epev[i].events), is_error(epev[i].events)));
+        }
     }
 
     emgr.enqueue_event(std::bind(&epoll::handle, this));
 }
 
+void lixs::os_linux::epoll::dispatch(handler& h)
+{
+    bool read = h.read && h.ready_read;
+    bool write = h.write && h.ready_write;
+    bool error = h.error;
+
+    if (!(read || write || error)) {
+        return;
+    }
+
+    /* Reported once, the callback is expected to drain it. */
+    h.ready_read = h.ready_read && !read;
+    h.ready_write = h.ready_write && !write;
+    h.error = false;
+
+    emgr.enqueue_event(std::bind(h.cb, read, write, error));
+}
+
+lixs::os_linux::epoll::handler* lixs::os_linux::epoll::get(int fd)
+{
+    if (fd < 0 || static_cast<unsigned int>(fd) >= handlers.size() || !handlers[fd].used) {
+        return NULL;
+    }
+
+    return &handlers[fd];
+}
+
 uint32_t inline lixs::os_linux::epoll::get_events(bool read, bool write)
 {
     return (read ? EPOLLIN : 0) | (write ? EPOLLOUT : 0);
@@ -0,0 +1,487 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <lixs/hypervisor.hh>
+#include <lixs/os_linux/fake_hypervisor.hh>
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <vector>
+
+extern "C" {
+#include <xenctrl.h>
+#include <xen/io/xs_wire.h>
+}
+
+
+lixs::os_linux::fake_event_channel::fake_event_channel(fake_hypervisor& hv, int efd)
+    : hv(hv), efd(efd), port((evtchn_port_t)(-1)), domid(0), virq(false)
+{
+}
+
+lixs::os_linux::fake_event_channel::~fake_event_channel()
+{
+    fake_hypervisor::fake_domain* dom;
+
+    if (virq) {
+        hv.virqs.erase(this);
+    } else if (port != (evtchn_port_t)(-1)) {
+        /* The domain might be gone already, or its id reused. */
+        dom = hv.find_domain(domid);
+        if (dom != NULL && dom->channel == this) {
+            dom->channel = NULL;
+        }
+    }
+
+    close(efd);
+}
+
+int lixs::os_linux::fake_event_channel::fd(void)
+{
+    return efd;
+}
+
+evtchn_port_t lixs::os_linux::fake_event_channel::bind_interdomain(domid_t domid,
+        evtchn_port_t remote_port)
+{
+    fake_hypervisor::fake_domain* dom;
+
+    if (port != (evtchn_port_t)(-1)) {
+        errno = EBUSY;
+        return (evtchn_port_t)(-1);
+    }
+
+    dom = hv.find_domain(domid);
+    if (dom == NULL || dom->destroyed) {
+        errno = ESRCH;
+        return (evtchn_port_t)(-1);
+    }
+
+    if (dom->remote_port != remote_port || dom->channel != NULL) {
+        errno = EINVAL;
+        return (evtchn_port_t)(-1);
+    }
+
+    dom->channel = this;
+
+    this->domid = domid;
+    port = hv.next_port++;
+
+    return port;
+}
+
+evtchn_port_t lixs::os_linux::fake_event_channel::bind_virq(unsigned int virq)
+{
+    if (port != (evtchn_port_t)(-1)) {
+        errno = EBUSY;
+        return (evtchn_port_t)(-1);
+    }
+
+    hv.virqs.insert({this, virq});
+
+    this->virq = true;
+    port = hv.next_port++;
+
+    return port;
+}
+
+int lixs::os_linux::fake_event_channel::notify(evtchn_port_t port)
+{
+    fake_hypervisor::fake_domain* dom;
+
+    if (port != this->port || port == (evtchn_port_t)(-1)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (virq) {
+        return 0;
+    }
+
+    /* Once the domain is destroyed the other end of the channel is closed. */
+    dom = hv.find_domain(domid);
+    if (dom == NULL || dom->destroyed || dom->channel != this) {
+        errno = ENOTCONN;
+        return -1;
+    }
+
+    dom->notifications++;
+
+    return 0;
+}
+
+evtchn_port_t lixs::os_linux::fake_event_channel::pending(void)
+{
+    uint64_t val;
+
+    if (port == (evtchn_port_t)(-1)) {
+        errno = EINVAL;
+        return (evtchn_port_t)(-1);
+    }
+
+    /* Having a single port there's no need to track which ports are pending, just consume the
+     * notifications.
+     */
+    if (::read(efd, &val, sizeof(val)) == -1 && errno != EAGAIN) {
+        return (evtchn_port_t)(-1);
+    }
+
+    return port;
+}
+
+int lixs::os_linux::fake_event_channel::unmask(evtchn_port_t port)
+{
+    if (port != this->port || port == (evtchn_port_t)(-1)) {
+        errno = EINVAL;
+        return -1;
+    }
+
+    return 0;
+}
+
+void lixs::os_linux::fake_event_channel::signal(void)
+{
+    uint64_t val = 1;
+
+    /* Can only fail if the counter overflows, in which case the channel is pending anyway. */
+    if (::write(efd, &val, sizeof(val)) == -1) {
+        return;
+    }
+}
+
+
+lixs::os_linux::fake_hypervisor::fake_hypervisor(void)
+    : ring_size(getpagesize()), next_port(1), queries(0)
+{
+}
+
+lixs::os_linux::fake_hypervisor::~fake_hypervisor()
+{
+    for (auto& r : rings) {
+        munmap(r.first, ring_size);
+    }
+
+    for (auto& d : domains) {
+        if (d.second.guest_ring != NULL) {
+            munmap(d.second.guest_ring, ring_size);
+        }
+    }
+}
+
+lixs::event_channel* lixs::os_linux::fake_hypervisor::evtchn_open(void)
+{
+    int efd;
+
+    efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (efd == -1) {
+        return NULL;
+    }
+
+    return new fake_event_channel(*this, efd);
+}
+
+xenstore_domain_interface* lixs::os_linux::fake_hypervisor::map_ring(domid_t domid,
+        unsigned int mfn)
+{
+    fake_domain* dom;
+
+    dom = find_domain(domid);
+    if (dom == NULL || dom->destroyed) {
+        errno = ESRCH;
+        return NULL;
+    }
+
+    if (dom->mapped) {
+        errno = EBUSY;
+        return NULL;
+    }
+
+    dom->mapped = true;
+
+    return dom->host_ring;
+}
+
+void lixs::os_linux::fake_hypervisor::unmap_ring(xenstore_domain_interface* interface)
+{
+    ring_map::iterator rit;
+    domain_map::iterator dit;
+
+    rit = rings.find(interface);
+    if (rit == rings.end()) {
+        return;
+    }
+
+    dit = domains.find(rit->second);
+    dit->second.mapped = false;
+
+    /* Destroyed domains are kept around until the store lets go of their ring. */
+    if (dit->second.destroyed) {
+        release_domain(dit);
+    }
+}
+
+int lixs::os_linux::fake_hypervisor::get_domain_info(domid_t domid, domain_info& info)
+{
+    fake_domain* dom;
+
+    queries++;
+
+    dom = find_domain(domid);
+    if (dom == NULL || dom->destroyed) {
+        return ENOENT;
+    }
+
+    info = dom->info;
+
+    return 0;
+}
+
+int lixs::os_linux::fake_hypervisor::list_domains(domid_t first, unsigned int max,
+        std::vector<domain_info>& infos)
+{
+    domain_map::iterator it;
+
+    queries++;
+
+    infos.clear();
+    for (it = domains.lower_bound(first); it != domains.end() && infos.size() < max; it++) {
+        if (!it->second.destroyed) {
+            infos.push_back(it->second.info);
+        }
+    }
+
+    return 0;
+}
+
+int lixs::os_linux::fake_hypervisor::create_domain(domid_t domid,
+        evtchn_port_t& port, unsigned int& mfn)
+{
+    int fd;
+    int ret;
+    void* guest;
+    void* host;
+
+    if (domains.find(domid) != domains.end()) {
+        return EEXIST;
+    }
+
+    fd = memfd_create("lixs-ring", MFD_CLOEXEC);
+    if (fd == -1) {
+        return errno;
+    }
+
+    if (ftruncate(fd, ring_size) == -1) {
+        goto out_close;
+    }
+
+    guest = mmap(NULL, ring_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (guest == MAP_FAILED) {
+        goto out_close;
+    }
+
+    host = mmap(NULL, ring_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+    if (host == MAP_FAILED) {
+        munmap(guest, ring_size);
+        goto out_close;
+    }
+
+    /* Both mappings keep the memory alive. */
+    close(fd);
+
+    {
+        fake_domain& dom = domains[domid];
+
+        dom.info.domid = domid;
+        dom.remote_port = next_port++;
+        dom.guest_ring = static_cast<xenstore_domain_interface*>(guest);
+        dom.host_ring = static_cast<xenstore_domain_interface*>(host);
+
+        rings.insert({dom.host_ring, domid});
+
+        port = dom.remote_port;
+    }
+
+    /* There are no real frames, any value will do. */
+    mfn = domid;
+
+    return 0;
+
+out_close:
+    ret = errno;
+    close(fd);
+    return ret;
+}
+
+int lixs::os_linux::fake_hypervisor::shutdown_domain(domid_t domid, bool crashed)
+{
+    fake_domain* dom;
+
+    dom = find_domain(domid);
+    if (dom == NULL || dom->destroyed) {
+        return ENOENT;
+    }
+
+    dom->info.shutdown = true;
+    dom->info.crashed = crashed;
+
+    raise_virq(VIRQ_DOM_EXC);
+
+    return 0;
+}
+
+int lixs::os_linux::fake_hypervisor::kill_domain(domid_t domid)
+{
+    fake_domain* dom;
+
+    dom = find_domain(domid);
+    if (dom == NULL || dom->destroyed) {
+        return ENOENT;
+    }
+
+    dom->info.dying = true;
+
+    raise_virq(VIRQ_DOM_EXC);
+
+    return 0;
+}
+
+int lixs::os_linux::fake_hypervisor::destroy_domain(domid_t domid)
+{
+    domain_map::iterator it;
+
+    it = domains.find(domid);
+    if (it == domains.end() || it->second.destroyed) {
+        return ENOENT;
+    }
+
+    release_domain(it);
+
+    raise_virq(VIRQ_DOM_EXC);
+
+    return 0;
+}
+
+xenstore_domain_interface* lixs::os_linux::fake_hypervisor::guest_ring(domid_t domid)
+{
+    fake_domain* dom;
+
+    dom = find_domain(domid);
+    if (dom == NULL || dom->destroyed) {
+        return NULL;
+    }
+
+    return dom->guest_ring;
+}
+
+int lixs::os_linux::fake_hypervisor::guest_notify(domid_t domid)
+{
+    fake_domain* dom;
+
+    dom = find_domain(domid);
+    if (dom == NULL || dom->destroyed) {
+        return ENOENT;
+    }
+
+    if (dom->channel == NULL) {
+        return ENOTCONN;
+    }
+
+    dom->channel->signal();
+
+    return 0;
+}
+
+unsigned long int lixs::os_linux::fake_hypervisor::guest_notifications(domid_t domid)
+{
+    fake_domain* dom;
+
+    dom = find_domain(domid);
+    if (dom == NULL) {
+        return 0;
+    }
+
+    return dom->notifications;
+}
+
+unsigned long int lixs::os_linux::fake_hypervisor::domain_queries(void)
+{
+    return queries;
+}
+
+lixs::os_linux::fake_hypervisor::fake_domain*
+lixs::os_linux::fake_hypervisor::find_domain(domid_t domid)
+{
+    domain_map::iterator it;
+
+    it = domains.find(domid);
+    if (it == domains.end()) {
+        return NULL;
+    }
+
+    return &(it->second);
+}
+
+void lixs::os_linux::fake_hypervisor::release_domain(domain_map::iterator it)
+{
+    fake_domain& dom = it->second;
+
+    if (dom.guest_ring != NULL) {
+        munmap(dom.guest_ring, ring_size);
+        dom.guest_ring = NULL;
+    }
+
+    if (dom.mapped) {
+        dom.destroyed = true;
+    } else {
+        rings.erase(dom.host_ring);
+        munmap(dom.host_ring, ring_size);
+        domains.erase(it);
+    }
+}
+
+void lixs::os_linux::fake_hypervisor::raise_virq(unsigned int virq)
+{
+    for (auto& v : virqs) {
+        if (v.second == virq) {
+            v.first->signal();
+        }
+    }
+}
+
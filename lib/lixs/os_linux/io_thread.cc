@@ -0,0 +1,113 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+
+#include <lixs/os_linux/epoll.hh>
+#include <lixs/os_linux/io_thread.hh>
+#include <lixs/os_linux/io_uring.hh>
+
+#include <csignal>
+#include <functional>
+#include <future>
+#include <pthread.h>
+#include <thread>
+
+
+lixs::iomux* lixs::os_linux::new_iomux(iomux_type type, event_mgr& emgr)
+{
+    switch (type) {
+        case iomux_type::epoll_et:
+            return new epoll(emgr, true);
+
+        case iomux_type::io_uring:
+            return new io_uring(emgr);
+
+        case iomux_type::epoll:
+        default:
+            return new epoll(emgr);
+    }
+}
+
+lixs::os_linux::io_thread::io_thread(iomux_type type)
+    : io(new_iomux(type, emgr)), mbox(*io), thread(std::bind(&io_thread::run, this))
+{
+}
+
+lixs::os_linux::io_thread::~io_thread()
+{
+    mbox.post(std::bind(&event_mgr::disable, &emgr));
+    thread.join();
+}
+
+void lixs::os_linux::io_thread::post(ev_cb cb)
+{
+    mbox.post(std::move(cb));
+}
+
+lixs::iomux& lixs::os_linux::io_thread::get_iomux(void)
+{
+    return *io;
+}
+
+void lixs::os_linux::io_thread::run_sync(ev_cb cb)
+{
+    std::promise<void> done;
+    std::future<void> res = done.get_future();
+
+    if (std::this_thread::get_id() == thread.get_id()) {
+        cb();
+        return;
+    }
+
+    mbox.post([&cb, &done] () {
+        cb();
+        done.set_value();
+    });
+
+    res.wait();
+}
+
+void lixs::os_linux::io_thread::run(void)
+{
+    sigset_t set;
+
+    /* Signals are handled by the main thread. */
+    sigfillset(&set);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+
+    emgr.enable();
+    emgr.run();
+}
@@ -0,0 +1,677 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <lixs/os_linux/io_uring.hh>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <linux/io_uring.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+lixs::os_linux::io_uring::entry::entry(void)
+    : used(false), stream(false), queued(false), tag(0),
+    read(false), write(false), poll_armed(false), poll_mask(0),
+    recv_on(false), recv_armed(false), recv_cancel(false),
+    send_armed(false), sent(0)
+{
+}
+
+lixs::os_linux::io_uring::io_uring(event_mgr& emgr)
+    : iomux(emgr), ring_fd(-1), multishot(true), next_tag(0),
+    sq_ring(MAP_FAILED), sq_ring_size(0), cq_ring(MAP_FAILED), cq_ring_size(0),
+    sqes(static_cast<struct io_uring_sqe*>(MAP_FAILED)), sqes_size(0),
+    buff_ring(static_cast<struct io_uring_buf_ring*>(MAP_FAILED)), buff_ring_size(0),
+    buffs(static_cast<char*>(MAP_FAILED)), buff_tail(0)
+{
+    struct io_uring_params p;
+    struct io_uring_buf_reg reg;
+    char* sq;
+    char* cq;
+
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CLAMP | IORING_SETUP_CQSIZE | IORING_SETUP_SUBMIT_ALL |
+        IORING_SETUP_COOP_TASKRUN;
+    p.cq_entries = cq_size;
+
+    ring_fd = syscall(__NR_io_uring_setup, sq_size, &p);
+    if (ring_fd == -1) {
+        throw io_uring_error("Failed to create io_uring: " + std::string(std::strerror(errno)));
+    }
+
+    if (!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_NODROP)) {
+        destroy();
+        throw io_uring_error("Kernel's io_uring is missing required features");
+    }
+
+    sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    cq_ring_size = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        sq_ring_size = std::max(sq_ring_size, cq_ring_size);
+        cq_ring_size = sq_ring_size;
+    }
+
+    sq_ring = mmap(NULL, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+            ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring != MAP_FAILED && (p.features & IORING_FEAT_SINGLE_MMAP)) {
+        cq_ring = sq_ring;
+    } else if (sq_ring != MAP_FAILED) {
+        cq_ring = mmap(NULL, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                ring_fd, IORING_OFF_CQ_RING);
+    }
+
+    sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = static_cast<struct io_uring_sqe*>(mmap(NULL, sqes_size, PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES));
+
+    if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED || sqes == MAP_FAILED) {
+        std::string err(std::strerror(errno));
+        destroy();
+        throw io_uring_error("Failed to map io_uring: " + err);
+    }
+
+    sq = static_cast<char*>(sq_ring);
+    sq_head = reinterpret_cast<unsigned int*>(sq + p.sq_off.head);
+    sq_tail = reinterpret_cast<unsigned int*>(sq + p.sq_off.tail);
+    sq_mask = *reinterpret_cast<unsigned int*>(sq + p.sq_off.ring_mask);
+    sq_entries = *reinterpret_cast<unsigned int*>(sq + p.sq_off.ring_entries);
+    sq_local_tail = *sq_tail;
+
+    /* Slots are always used in order, so the indirection array is fixed. */
+    for (unsigned int i = 0; i < sq_entries; i++) {
+        reinterpret_cast<unsigned int*>(sq + p.sq_off.array)[i] = i;
+    }
+
+    cq = static_cast<char*>(cq_ring);
+    cq_head = reinterpret_cast<unsigned int*>(cq + p.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned int*>(cq + p.cq_off.tail);
+    cq_mask = *reinterpret_cast<unsigned int*>(cq + p.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe*>(cq + p.cq_off.cqes);
+
+    buff_ring_size = buff_count * sizeof(struct io_uring_buf);
+    buff_ring = static_cast<struct io_uring_buf_ring*>(mmap(NULL, buff_ring_size,
+                PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+    buffs = static_cast<char*>(mmap(NULL, buff_count * buff_size, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+
+    if (buff_ring == MAP_FAILED || buffs == MAP_FAILED) {
+        std::string err(std::strerror(errno));
+        destroy();
+        throw io_uring_error("Failed to allocate receive buffers: " + err);
+    }
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(buff_ring);
+    reg.ring_entries = buff_count;
+    reg.bgid = buff_group;
+
+    if (syscall(__NR_io_uring_register, ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1) {
+        std::string err(std::strerror(errno));
+        destroy();
+        throw io_uring_error("Failed to register receive buffers: " + err);
+    }
+
+    for (unsigned int i = 0; i < buff_count; i++) {
+        give_buffer(i);
+    }
+
+    emgr.enqueue_event(std::bind(&io_uring::handle, this));
+}
+
+lixs::os_linux::io_uring::~io_uring()
+{
+    destroy();
+}
+
+void lixs::os_linux::io_uring::add(int fd, bool read, bool write, io_cb cb)
+{
+    if (fd < 0) {
+        return;
+    }
+
+    if (static_cast<unsigned int>(fd) >= fds.size()) {
+        fds.resize(fd + 1);
+    }
+
+    entry& e = fds[fd];
+
+    if (e.used) {
+        return;
+    }
+
+    reset(e);
+    e.stream = false;
+    e.cb = cb;
+    e.read = read;
+    e.write = write;
+
+    queue(fd);
+}
+
+void lixs::os_linux::io_uring::set(int fd, bool read, bool write)
+{
+    entry* e = get(fd);
+
+    if (e == NULL || e->stream) {
+        return;
+    }
+
+    e->read = read;
+    e->write = write;
+
+    queue(fd);
+}
+
+void lixs::os_linux::io_uring::rem(int fd)
+{
+    entry* e = get(fd);
+
+    if (e == NULL) {
+        return;
+    }
+
+    /* Cancel by user data rather than by fd, which the caller is about to close and might be
+     * reused before the cancellation is submitted.
+     */
+    if (e->poll_armed) {
+        cancels.push_back(user_data(op::poll, fd, e->tag));
+    }
+
+    if (e->recv_armed) {
+        cancels.push_back(user_data(op::recv, fd, e->tag));
+    }
+
+    if (e->send_armed) {
+        cancels.push_back(user_data(op::send, fd, e->tag));
+        orphans[user_data(op::send, fd, e->tag)] = std::move(e->sending);
+    }
+
+    e->used = false;
+    e->out.clear();
+    e->sending.clear();
+
+    /* The callbacks might be running, release them only at the end of the pass. */
+    released.push_back(fd);
+}
+
+lixs::stream_io* lixs::os_linux::io_uring::get_stream_io(void)
+{
+    return this;
+}
+
+void lixs::os_linux::io_uring::attach(int fd, recv_cb rx, send_cb tx)
+{
+    if (fd < 0) {
+        return;
+    }
+
+    if (static_cast<unsigned int>(fd) >= fds.size()) {
+        fds.resize(fd + 1);
+    }
+
+    entry& e = fds[fd];
+
+    if (e.used) {
+        return;
+    }
+
+    reset(e);
+    e.stream = true;
+    e.rx = rx;
+    e.tx = tx;
+    e.recv_on = true;
+
+    queue(fd);
+}
+
+void lixs::os_linux::io_uring::set_recv(int fd, bool on)
+{
+    entry* e = get(fd);
+
+    if (e == NULL || !e->stream || e->recv_on == on) {
+        return;
+    }
+
+    e->recv_on = on;
+
+    queue(fd);
+}
+
+void lixs::os_linux::io_uring::send(int fd, const char* buff, int bytes)
+{
+    entry* e = get(fd);
+
+    if (e == NULL || !e->stream || bytes <= 0) {
+        return;
+    }
+
+    e->out.append(buff, bytes);
+
+    if (!e->send_armed) {
+        queue(fd);
+    }
+}
+
+void lixs::os_linux::io_uring::handle(void)
+{
+    unsigned int to_submit;
+    bool backlog;
+
+    backlog = prepare();
+
+    to_submit = sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE);
+    __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+
+    /* Only wait if everything was submitted and there are no other events to run, this one is
+     * still counted.
+     */
+    enter(to_submit, (backlog || emgr.size() > 1) ? 0 : 1, IORING_ENTER_GETEVENTS);
+
+    reap();
+
+    for (int fd : released) {
+        if (!fds[fd].used) {
+            fds[fd].cb = nullptr;
+            fds[fd].rx = nullptr;
+            fds[fd].tx = nullptr;
+        }
+    }
+    released.clear();
+
+    emgr.enqueue_event(std::bind(&io_uring::handle, this));
+}
+
+bool lixs::os_linux::io_uring::prepare(void)
+{
+    std::vector<int>::size_type i;
+
+    while (!cancels.empty() && sq_space() > 0) {
+        struct io_uring_sqe* sqe = get_sqe();
+
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = cancels.back();
+        sqe->user_data = user_data(op::cancel, 0, 0);
+
+        cancels.pop_back();
+    }
+
+    /* Each fd needs at most two requests. */
+    for (i = 0; i < pending.size() && sq_space() >= 2; i++) {
+        entry& e = fds[pending[i]];
+
+        e.queued = false;
+
+        if (e.used) {
+            prepare(pending[i], e);
+        }
+    }
+
+    pending.erase(pending.begin(), pending.begin() + i);
+
+    return !pending.empty() || !cancels.empty();
+}
+
+void lixs::os_linux::io_uring::prepare(int fd, entry& e)
+{
+    struct io_uring_sqe* sqe;
+
+    if (!e.stream) {
+        uint32_t mask = get_events(e.read, e.write);
+
+        if (e.poll_armed && e.poll_mask != mask) {
+            /* Re-armed with the new mask once the cancellation completes. Recording the mask
+             * now avoids cancelling it again meanwhile.
+             */
+            sqe = get_sqe();
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = user_data(op::poll, fd, e.tag);
+            sqe->user_data = user_data(op::cancel, 0, 0);
+
+            e.poll_mask = mask;
+        } else if (!e.poll_armed && mask != 0) {
+            sqe = get_sqe();
+            sqe->opcode = IORING_OP_POLL_ADD;
+            sqe->fd = fd;
+            sqe->poll32_events = mask;
+            sqe->user_data = user_data(op::poll, fd, e.tag);
+
+            e.poll_armed = true;
+            e.poll_mask = mask;
+        }
+
+        return;
+    }
+
+    if (e.recv_on && !e.recv_armed) {
+        sqe = get_sqe();
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = fd;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = buff_group;
+        sqe->ioprio = multishot ? IORING_RECV_MULTISHOT : 0;
+        sqe->user_data = user_data(op::recv, fd, e.tag);
+
+        e.recv_armed = true;
+    } else if (!e.recv_on && e.recv_armed && !e.recv_cancel) {
+        sqe = get_sqe();
+        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+        sqe->fd = -1;
+        sqe->addr = user_data(op::recv, fd, e.tag);
+        sqe->user_data = user_data(op::cancel, 0, 0);
+
+        e.recv_cancel = true;
+    }
+
+    if (!e.send_armed) {
+        if (e.sent == e.sending.size() && !e.out.empty()) {
+            e.sending.swap(e.out);
+            e.out.clear();
+            e.sent = 0;
+        }
+
+        if (e.sent < e.sending.size()) {
+            sqe = get_sqe();
+            sqe->opcode = IORING_OP_SEND;
+            sqe->fd = fd;
+            sqe->addr = reinterpret_cast<uint64_t>(e.sending.data() + e.sent);
+            sqe->len = e.sending.size() - e.sent;
+            sqe->msg_flags = MSG_NOSIGNAL;
+            sqe->user_data = user_data(op::send, fd, e.tag);
+
+            e.send_armed = true;
+        }
+    }
+}
+
+void lixs::os_linux::io_uring::reap(void)
+{
+    unsigned int head = *cq_head;
+    unsigned int tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+
+    while (head != tail) {
+        struct io_uring_cqe* cqe = &cqes[head & cq_mask];
+        uint64_t data = cqe->user_data;
+        int res = cqe->res;
+        uint32_t flags = cqe->flags;
+
+        /* Release the slot first, the completion might take a while to process. */
+        head++;
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+
+        int fd = (data >> 32) & 0xFFFFFF;
+        uint32_t tag = data & 0xFFFFFFFF;
+
+        switch (static_cast<op>(data >> 56)) {
+            case op::poll:
+                complete_poll(fd, tag, res);
+                break;
+
+            case op::recv:
+                complete_recv(fd, tag, res, flags);
+                break;
+
+            case op::send:
+                complete_send(data, fd, tag, res);
+                break;
+
+            case op::cancel:
+                break;
+        }
+    }
+}
+
+void lixs::os_linux::io_uring::complete_poll(int fd, uint32_t tag, int res)
+{
+    entry* e = get(fd, tag);
+
+    if (e == NULL) {
+        return;
+    }
+
+    e->poll_armed = false;
+    queue(fd);
+
+    if (res < 0) {
+        /* Cancelled to change the mask */
+        return;
+    }
+
+    bool read = e->read && (res & POLLIN);
+    bool write = e->write && (res & POLLOUT);
+    bool error = (res & (POLLERR | POLLHUP)) != 0;
+
+    if (read || write || error) {
+        emgr.enqueue_event(std::bind(e->cb, read, write, error));
+    }
+}
+
+void lixs::os_linux::io_uring::complete_recv(int fd, uint32_t tag, int res, uint32_t flags)
+{
+    const char* data = NULL;
+    uint16_t bid = 0;
+    bool more = (flags & IORING_CQE_F_MORE) != 0;
+    bool rearm = false;
+
+    if (flags & IORING_CQE_F_BUFFER) {
+        bid = flags >> IORING_CQE_BUFFER_SHIFT;
+        data = buffs + bid * buff_size;
+    }
+
+    entry* e = get(fd, tag);
+
+    if (e != NULL) {
+        if (!more) {
+            e->recv_armed = false;
+            e->recv_cancel = false;
+
+            if (res == -EINVAL && multishot) {
+                /* Multishot receive needs Linux 6.0, fall back to a request per receive. */
+                multishot = false;
+                rearm = true;
+            } else {
+                /* Also when provided buffers ran out or the receive was paused. */
+                rearm = res > 0 || res == -ENOBUFS || res == -ECANCELED;
+            }
+
+            if (rearm) {
+                queue(fd);
+            }
+        }
+
+        if (res > 0) {
+            e->rx(data, res);
+        } else if (!rearm) {
+            e->rx(NULL, res);
+        }
+    }
+
+    if (flags & IORING_CQE_F_BUFFER) {
+        give_buffer(bid);
+    }
+}
+
+void lixs::os_linux::io_uring::complete_send(uint64_t data, int fd, uint32_t tag, int res)
+{
+    entry* e = get(fd, tag);
+
+    if (e == NULL) {
+        orphans.erase(data);
+        return;
+    }
+
+    e->send_armed = false;
+
+    if (res < 0) {
+        e->tx(res);
+        return;
+    }
+
+    e->sent += res;
+
+    if (e->sent < e->sending.size() || !e->out.empty()) {
+        queue(fd);
+    }
+
+    e->tx((e->sending.size() - e->sent) + e->out.size());
+}
+
+lixs::os_linux::io_uring::entry* lixs::os_linux::io_uring::get(int fd)
+{
+    if (fd < 0 || static_cast<unsigned int>(fd) >= fds.size() || !fds[fd].used) {
+        return NULL;
+    }
+
+    return &fds[fd];
+}
+
+lixs::os_linux::io_uring::entry* lixs::os_linux::io_uring::get(int fd, uint32_t tag)
+{
+    entry* e = get(fd);
+
+    return (e != NULL && e->tag == tag) ? e : NULL;
+}
+
+void lixs::os_linux::io_uring::reset(entry& e)
+{
+    bool queued = e.queued;
+
+    e = entry();
+    e.used = true;
+    e.queued = queued;
+    e.tag = ++next_tag;
+}
+
+void lixs::os_linux::io_uring::queue(int fd)
+{
+    if (!fds[fd].queued) {
+        fds[fd].queued = true;
+        pending.push_back(fd);
+    }
+}
+
+unsigned int lixs::os_linux::io_uring::sq_space(void)
+{
+    return sq_entries - (sq_local_tail - __atomic_load_n(sq_head, __ATOMIC_ACQUIRE));
+}
+
+struct io_uring_sqe* lixs::os_linux::io_uring::get_sqe(void)
+{
+    struct io_uring_sqe* sqe = &sqes[sq_local_tail & sq_mask];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sq_local_tail++;
+
+    return sqe;
+}
+
+int lixs::os_linux::io_uring::enter(unsigned int to_submit, unsigned int min_complete,
+        unsigned int flags)
+{
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+
+    ts.tv_sec = timeout / 1000;
+    ts.tv_nsec = (timeout % 1000) * 1000000;
+
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = reinterpret_cast<uint64_t>(&ts);
+
+    return syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete,
+            flags | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+}
+
+void lixs::os_linux::io_uring::give_buffer(uint16_t bid)
+{
+    /* Not through buff_ring->bufs, which C++ places after an empty struct instead of at 0. */
+    struct io_uring_buf* buf = reinterpret_cast<struct io_uring_buf*>(buff_ring) +
+        (buff_tail & (buff_count - 1));
+
+    buf->addr = reinterpret_cast<uint64_t>(buffs + bid * buff_size);
+    buf->len = buff_size;
+    buf->bid = bid;
+
+    buff_tail++;
+    __atomic_store_n(&buff_ring->tail, buff_tail, __ATOMIC_RELEASE);
+}
+
+void lixs::os_linux::io_uring::destroy(void)
+{
+    if (ring_fd != -1) {
+        close(ring_fd);
+        ring_fd = -1;
+    }
+
+    if (buffs != MAP_FAILED) {
+        munmap(buffs, buff_count * buff_size);
+    }
+
+    if (buff_ring != MAP_FAILED) {
+        munmap(buff_ring, buff_ring_size);
+    }
+
+    if (sqes != MAP_FAILED) {
+        munmap(sqes, sqes_size);
+    }
+
+    if (cq_ring != MAP_FAILED && cq_ring != sq_ring) {
+        munmap(cq_ring, cq_ring_size);
+    }
+
+    if (sq_ring != MAP_FAILED) {
+        munmap(sq_ring, sq_ring_size);
+    }
+}
+
+inline uint64_t lixs::os_linux::io_uring::user_data(op type, int fd, uint32_t tag)
+{
+    return (static_cast<uint64_t>(type) << 56) |
+        (static_cast<uint64_t>(fd & 0xFFFFFF) << 32) | tag;
+}
+
+inline uint32_t lixs::os_linux::io_uring::get_events(bool read, bool write)
+{
+    return (read ? POLLIN : 0) | (write ? POLLOUT : 0);
+}
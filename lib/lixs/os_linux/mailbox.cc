@@ -0,0 +1,103 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+
+#include <lixs/os_linux/mailbox.hh>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+
+lixs::os_linux::mailbox::mailbox(iomux& io)
+    : io(io), signaled(false)
+{
+    fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (fd == -1) {
+        throw mailbox_error("Failed to create eventfd: " + std::string(std::strerror(errno)));
+    }
+
+    io.add(fd, true, false, std::bind(&mailbox::callback, this,
+                std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+lixs::os_linux::mailbox::~mailbox()
+{
+    io.rem(fd);
+    close(fd);
+}
+
+void lixs::os_linux::mailbox::post(ev_cb cb)
+{
+    uint64_t val = 1;
+
+    queue.push(std::move(cb));
+
+    /* The flag is only checked after the callback is queued. If it is still set the owning thread
+     * has yet to clear it, which it does before draining the queue.
+     */
+    if (!signaled.exchange(true, std::memory_order_acq_rel)) {
+        if (write(fd, &val, sizeof(val)) == -1) {
+            /* EAGAIN means the counter is already non zero and the thread will wake up anyway. */
+        }
+    }
+}
+
+void lixs::os_linux::mailbox::callback(bool read, bool write, bool error)
+{
+    ev_cb cb;
+    uint64_t val;
+
+    if (::read(fd, &val, sizeof(val)) == -1) {
+        /* Spurious wake up, the counter was already drained. */
+    }
+
+    /* Clearing the flag with a read-modify-write acquires from the producers that found it set,
+     * making their callbacks visible below.
+     */
+    signaled.exchange(false, std::memory_order_acq_rel);
+
+    /* A callback might be pushed but not yet linked when popping. Its producer sees the flag
+     * cleared and signals again, so it's picked up on the next wake up.
+     */
+    while (queue.pop(cb)) {
+        cb();
+    }
+}
@@ -0,0 +1,117 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <lixs/os_linux/timer.hh>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <utility>
+
+
+lixs::os_linux::timer::timer(iomux& io)
+    : io(io)
+{
+    fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (fd == -1) {
+        throw timer_error("Failed to create timerfd: " + std::string(std::strerror(errno)));
+    }
+
+    io.add(fd, true, false, std::bind(&timer::callback, this,
+                std::placeholders::_1, std::placeholders::_2, std::placeholders::_3));
+}
+
+lixs::os_linux::timer::~timer()
+{
+    io.rem(fd);
+    close(fd);
+}
+
+void lixs::os_linux::timer::set(std::chrono::steady_clock::time_point expiry, ev_cb cb)
+{
+    struct itimerspec spec;
+    long long int ns;
+
+    ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            expiry.time_since_epoch()).count();
+
+    /* A zero expiry time would disarm the timer instead. */
+    if (ns <= 0) {
+        ns = 1;
+    }
+
+    std::memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = ns / 1000000000;
+    spec.it_value.tv_nsec = ns % 1000000000;
+
+    this->cb = std::move(cb);
+
+    timerfd_settime(fd, TFD_TIMER_ABSTIME, &spec, NULL);
+}
+
+void lixs::os_linux::timer::clear(void)
+{
+    struct itimerspec spec;
+
+    std::memset(&spec, 0, sizeof(spec));
+    timerfd_settime(fd, 0, &spec, NULL);
+
+    cb = nullptr;
+}
+
+void lixs::os_linux::timer::callback(bool read, bool write, bool error)
+{
+    ev_cb expired;
+    uint64_t val;
+
+    /* Nothing to read means the timer was set again or cleared after it expired. */
+    if (::read(fd, &val, sizeof(val)) == -1) {
+        return;
+    }
+
+    /* The callback might set the timer again. */
+    expired = std::move(cb);
+    cb = nullptr;
+
+    if (expired) {
+        expired();
+    }
+}
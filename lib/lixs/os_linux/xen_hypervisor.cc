@@ -0,0 +1,217 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <lixs/hypervisor.hh>
+#include <lixs/os_linux/xen_hypervisor.hh>
+
+#include <cerrno>
+#include <cstddef>
+#include <sys/mman.h>
+#include <vector>
+
+extern "C" {
+#include <xenctrl.h>
+#include <xen/grant_table.h>
+#include <xen/io/xs_wire.h>
+}
+
+
+lixs::os_linux::xen_event_channel::xen_event_channel(xc_evtchn* xce_handle)
+    : xce_handle(xce_handle)
+{
+}
+
+lixs::os_linux::xen_event_channel::~xen_event_channel()
+{
+    xc_evtchn_close(xce_handle);
+}
+
+int lixs::os_linux::xen_event_channel::fd(void)
+{
+    return xc_evtchn_fd(xce_handle);
+}
+
+evtchn_port_t lixs::os_linux::xen_event_channel::bind_interdomain(domid_t domid,
+        evtchn_port_t remote_port)
+{
+    return xc_evtchn_bind_interdomain(xce_handle, domid, remote_port);
+}
+
+evtchn_port_t lixs::os_linux::xen_event_channel::bind_virq(unsigned int virq)
+{
+    return xc_evtchn_bind_virq(xce_handle, virq);
+}
+
+int lixs::os_linux::xen_event_channel::notify(evtchn_port_t port)
+{
+    return xc_evtchn_notify(xce_handle, port);
+}
+
+evtchn_port_t lixs::os_linux::xen_event_channel::pending(void)
+{
+    return xc_evtchn_pending(xce_handle);
+}
+
+int lixs::os_linux::xen_event_channel::unmask(evtchn_port_t port)
+{
+    return xc_evtchn_unmask(xce_handle, port);
+}
+
+
+lixs::os_linux::xen_hypervisor::xen_hypervisor(void)
+    : xc_handle(NULL), xcg_handle(NULL)
+{
+}
+
+lixs::os_linux::xen_hypervisor::~xen_hypervisor()
+{
+    if (xcg_handle != NULL) {
+        xc_gnttab_close(xcg_handle);
+    }
+
+    if (xc_handle != NULL) {
+        xc_interface_close(xc_handle);
+    }
+}
+
+lixs::event_channel* lixs::os_linux::xen_hypervisor::evtchn_open(void)
+{
+    xc_evtchn* xce_handle;
+
+    xce_handle = xc_evtchn_open(NULL, 0);
+    if (xce_handle == NULL) {
+        return NULL;
+    }
+
+    return new xen_event_channel(xce_handle);
+}
+
+xenstore_domain_interface* lixs::os_linux::xen_hypervisor::map_ring(domid_t domid,
+        unsigned int mfn)
+{
+    if (xcg_handle == NULL) {
+        xcg_handle = xc_gnttab_open(NULL, 0);
+        if (xcg_handle == NULL) {
+            return NULL;
+        }
+    }
+
+    return (xenstore_domain_interface*) xc_gnttab_map_grant_ref(xcg_handle, domid,
+            GNTTAB_RESERVED_XENSTORE, PROT_READ|PROT_WRITE);
+}
+
+void lixs::os_linux::xen_hypervisor::unmap_ring(xenstore_domain_interface* interface)
+{
+    xc_gnttab_munmap(xcg_handle, interface, 1);
+}
+
+int lixs::os_linux::xen_hypervisor::get_domain_info(domid_t domid, domain_info& info)
+{
+    int ret;
+    xc_dominfo_t dominfo;
+
+    ret = open_xc();
+    if (ret != 0) {
+        return ret;
+    }
+
+    ret = xc_domain_getinfo(xc_handle, domid, 1, &dominfo);
+    if (ret == -1) {
+        return errno;
+    }
+
+    /* The call returns the first domain with an id equal or higher than the one requested. */
+    if (ret != 1 || dominfo.domid != domid) {
+        return ENOENT;
+    }
+
+    info.domid = dominfo.domid;
+    info.dying = dominfo.dying;
+    info.shutdown = dominfo.shutdown;
+    info.crashed = dominfo.crashed;
+
+    return 0;
+}
+
+int lixs::os_linux::xen_hypervisor::list_domains(domid_t first, unsigned int max,
+        std::vector<domain_info>& infos)
+{
+    int ret;
+    unsigned int flags;
+
+    ret = open_xc();
+    if (ret != 0) {
+        return ret;
+    }
+
+    if (list_buff.size() < max) {
+        list_buff.resize(max);
+    }
+
+    /* Unlike xc_domain_getinfo, which issues one hypercall per domain, this is a single
+     * hypercall for the whole batch.
+     */
+    ret = xc_domain_getinfolist(xc_handle, first, max, list_buff.data());
+    if (ret == -1) {
+        return errno;
+    }
+
+    infos.resize(ret);
+    for (int i = 0; i < ret; i++) {
+        flags = list_buff[i].flags;
+
+        infos[i].domid = list_buff[i].domain;
+        infos[i].dying = (flags & XEN_DOMINF_dying);
+        infos[i].shutdown = (flags & XEN_DOMINF_shutdown);
+        infos[i].crashed = infos[i].shutdown &&
+            ((flags >> XEN_DOMINF_shutdownshift) & XEN_DOMINF_shutdownmask) == SHUTDOWN_crash;
+    }
+
+    return 0;
+}
+
+int lixs::os_linux::xen_hypervisor::open_xc(void)
+{
+    if (xc_handle == NULL) {
+        xc_handle = xc_interface_open(NULL, NULL, 0);
+        if (xc_handle == NULL) {
+            return errno;
+        }
+    }
+
+    return 0;
+}
+
@@ -34,10 +34,14 @@
  * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
  */
 
-#include <lixs/mstore/database.hh>
 #include <lixs/permissions.hh>
 
-bool lixs::mstore::has_read_access(cid_t cid, const permission_list& perms)
+lixs::cid_t lixs::get_owner(const permission_list& perms)
+{
+    return perms.empty() ? 0 : perms.front().cid;
+}
+
+bool lixs::has_read_access(cid_t cid, const permission_list& perms)
 {
     if (cid == 0
             || perms.empty()
@@ -55,7 +59,7 @@ bool lixs::mstore::has_read_access(cid_t cid, const permission_list& perms)
     return false;
 }
 
-bool lixs::mstore::has_write_access(cid_t cid, const permission_list& perms)
+bool lixs::has_write_access(cid_t cid, const permission_list& perms)
 {
     if (cid == 0
             || perms.empty()
@@ -0,0 +1,147 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <lixs/rate_limiter.hh>
+#include <lixs/timer.hh>
+
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <utility>
+
+
+lixs::token_bucket::token_bucket(ev_cb resume)
+    : resume(std::move(resume)), tokens(0), waiting(false), throttled(0)
+{
+    /* The last refill is left at the clock's epoch, so the first refill fills the bucket. */
+}
+
+unsigned long int lixs::token_bucket::get_throttled(void)
+{
+    return throttled;
+}
+
+lixs::rate_limiter::rate_limiter(timer& t, unsigned int rate, unsigned int burst)
+    : t(t), rate(rate), burst(std::max(burst, 1u))
+{
+}
+
+lixs::rate_limiter::~rate_limiter()
+{
+    t.clear();
+}
+
+bool lixs::rate_limiter::take(token_bucket& b)
+{
+    time_point now;
+    std::chrono::nanoseconds wait;
+
+    if (b.waiting) {
+        return false;
+    }
+
+    now = std::chrono::steady_clock::now();
+    refill(b, now);
+
+    if (b.tokens >= 1) {
+        b.tokens -= 1;
+        return true;
+    }
+
+    /* Wait for the missing fraction of a token, rounding up so that it's there on wake up. */
+    wait = std::chrono::nanoseconds(static_cast<long long int>((1 - b.tokens) * 1e9 / rate) + 1);
+
+    b.throttled++;
+    b.waiting = true;
+    b.it = waiting.insert({now + wait, &b});
+
+    if (b.it == waiting.begin()) {
+        arm();
+    }
+
+    return false;
+}
+
+void lixs::rate_limiter::cancel(token_bucket& b)
+{
+    if (!b.waiting) {
+        return;
+    }
+
+    waiting.erase(b.it);
+    b.waiting = false;
+}
+
+void lixs::rate_limiter::refill(token_bucket& b, time_point now)
+{
+    double elapsed;
+
+    elapsed = std::chrono::duration<double>(now - b.last).count();
+
+    b.tokens = std::min(burst, b.tokens + elapsed * rate);
+    b.last = now;
+}
+
+void lixs::rate_limiter::arm(void)
+{
+    /* Buckets cancelled after the timer was set only cause a spurious wake up. */
+    if (waiting.empty()) {
+        return;
+    }
+
+    t.set(waiting.begin()->first, std::bind(&rate_limiter::expired, this));
+}
+
+void lixs::rate_limiter::expired(void)
+{
+    time_point now;
+    token_bucket* b;
+
+    now = std::chrono::steady_clock::now();
+
+    /* Buckets are dequeued before resuming, a connection running out of tokens again waits for
+     * a later time and is left for the next expiry.
+     */
+    while (!waiting.empty() && waiting.begin()->first <= now) {
+        b = waiting.begin()->second;
+
+        waiting.erase(waiting.begin());
+        b->waiting = false;
+        b->resume();
+    }
+
+    arm();
+}
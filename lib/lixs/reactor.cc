@@ -0,0 +1,81 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+
+#include <lixs/reactor.hh>
+
+#include <vector>
+
+
+lixs::reactor_pool::reactor_pool(executor& store, store_view* view)
+    : store(store), view(view), next_reactor(0)
+{
+}
+
+lixs::reactor_pool::~reactor_pool()
+{
+}
+
+void lixs::reactor_pool::add(reactor& r)
+{
+    reactors.push_back(&r);
+    readers.push_back(view != NULL ? view->add_reader() : 0);
+}
+
+bool lixs::reactor_pool::empty(void)
+{
+    return reactors.empty();
+}
+
+lixs::reactor& lixs::reactor_pool::next(unsigned int& reader)
+{
+    reactor& r = *reactors[next_reactor];
+    reader = readers[next_reactor];
+
+    next_reactor = (next_reactor + 1) % reactors.size();
+
+    return r;
+}
+
+lixs::executor& lixs::reactor_pool::get_store(void)
+{
+    return store;
+}
+
+lixs::store_view* lixs::reactor_pool::get_view(void)
+{
+    return view;
+}
@@ -34,6 +34,7 @@
  * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
  */
 
+#include <lixs/hypervisor.hh>
 #include <lixs/ring_conn.hh>
 
 #include <cerrno>
@@ -48,41 +49,41 @@ extern "C" {
 }
 
 
-lixs::ring_conn_base::ring_conn_base(iomux& io, domid_t domid,
+lixs::ring_conn_base::ring_conn_base(iomux& io, hypervisor& hv, domid_t domid,
         evtchn_port_t port, xenstore_domain_interface* interface)
     : io(io), ev_read(false), ev_write(false), alive(true),
     domid(domid), remote_port(port), interface(interface)
 {
     int ret;
 
-    xce_handle = xc_evtchn_open(NULL, 0);
-    if (xce_handle == NULL) {
+    evtchn = hv.evtchn_open();
+    if (evtchn == NULL) {
         throw ring_conn_error("Failed to open evtchn handle: " +
                 std::string(std::strerror(errno)));
     }
 
-    local_port = xc_evtchn_bind_interdomain(xce_handle, domid, remote_port);
+    local_port = evtchn->bind_interdomain(domid, remote_port);
     if (local_port == (evtchn_port_t)(-1)) {
-        xc_evtchn_close(xce_handle);
+        delete evtchn;
         throw ring_conn_error("Failed to bind evtchn: " +
                 std::string(std::strerror(errno)));
     }
 
-    ret = xc_evtchn_unmask(xce_handle, local_port);
+    ret = evtchn->unmask(local_port);
     if (ret == -1) {
-        xc_evtchn_close(xce_handle);
+        delete evtchn;
         throw ring_conn_error("Failed to unmask evtchn: " +
                 std::string(std::strerror(errno)));
     }
 
-    ret = xc_evtchn_notify(xce_handle, local_port);
+    ret = evtchn->notify(local_port);
     if (ret == -1) {
-        xc_evtchn_close(xce_handle);
+        delete evtchn;
         throw ring_conn_error("Failed to notify evtchn: " +
                 std::string(std::strerror(errno)));
     }
 
-    fd = xc_evtchn_fd(xce_handle);
+    fd = evtchn->fd();
 
     cb = std::shared_ptr<ring_conn_cb>(new ring_conn_cb(*this));
 
@@ -96,7 +97,7 @@ lixs::ring_conn_base::~ring_conn_base()
     if (alive) {
         io.rem(fd);
     }
-    xc_evtchn_close(xce_handle);
+    delete evtchn;
 }
 
 bool lixs::ring_conn_base::read(char*& buff, int& bytes)
@@ -128,7 +129,7 @@ bool lixs::ring_conn_base::read(char*& buff, int& bytes)
     }
 
     if (notify) {
-        ret = xc_evtchn_notify(xce_handle, local_port);
+        ret = evtchn->notify(local_port);
         if (ret == -1) {
             alive = false;
             io.rem(fd);
@@ -168,7 +169,7 @@ bool lixs::ring_conn_base::write(char*& buff, int& bytes)
     }
 
     if (notify) {
-        ret = xc_evtchn_notify(xce_handle, local_port);
+        ret = evtchn->notify(local_port);
         if (ret == -1) {
             alive = false;
             io.rem(fd);
@@ -240,12 +241,12 @@ void lixs::ring_conn_cb::callback(bool read, bool write, bool error,
         return;
     }
 
-    port = xc_evtchn_pending(cb->conn.xce_handle);
+    port = cb->conn.evtchn->pending();
     if (port == (evtchn_port_t)(-1)) {
         goto out_err;
     }
 
-    ret = xc_evtchn_unmask(cb->conn.xce_handle, port);
+    ret = cb->conn.evtchn->unmask(port);
     if (ret == -1) {
         goto out_err;
     }
@@ -0,0 +1,126 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <lixs/event_mgr.hh>
+#include <lixs/scheduler.hh>
+
+#include <functional>
+#include <list>
+
+
+lixs::sched_task::sched_task(void)
+    : queued(false), cls(sched_class::guest)
+{
+}
+
+lixs::sched_task::~sched_task()
+{
+}
+
+lixs::scheduler::scheduler(event_mgr& emgr, unsigned int budget)
+    : emgr(emgr), base(budget), scheduled(false)
+{
+    for (unsigned int& w : weights) {
+        w = 1;
+    }
+}
+
+void lixs::scheduler::set_weight(sched_class c, unsigned int weight)
+{
+    weights[static_cast<int>(c)] = weight;
+}
+
+unsigned int lixs::scheduler::budget(sched_class c)
+{
+    return base * weights[static_cast<int>(c)];
+}
+
+void lixs::scheduler::yield(sched_task& t, sched_class c)
+{
+    std::list<sched_task*>& q = queues[static_cast<int>(c)];
+
+    if (t.queued) {
+        return;
+    }
+
+    t.queued = true;
+    t.cls = c;
+    t.it = q.insert(q.end(), &t);
+
+    if (!scheduled) {
+        scheduled = true;
+        emgr.enqueue_event(std::bind(&scheduler::run, this));
+    }
+}
+
+void lixs::scheduler::cancel(sched_task& t)
+{
+    if (!t.queued) {
+        return;
+    }
+
+    queues[static_cast<int>(t.cls)].erase(t.it);
+    t.queued = false;
+}
+
+void lixs::scheduler::run(void)
+{
+    bool pending = false;
+
+    scheduled = false;
+
+    for (std::list<sched_task*>& q : queues) {
+        /* Tasks yielding again go to the back, for the next pass. */
+        std::list<sched_task*>::size_type n = q.size();
+
+        while (n-- > 0 && !q.empty()) {
+            sched_task* t = q.front();
+
+            q.pop_front();
+            t->queued = false;
+            t->resume();
+        }
+    }
+
+    for (std::list<sched_task*>& q : queues) {
+        pending |= !q.empty();
+    }
+
+    if (pending && !scheduled) {
+        scheduled = true;
+        emgr.enqueue_event(std::bind(&scheduler::run, this));
+    }
+}
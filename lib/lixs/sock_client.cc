@@ -52,8 +52,9 @@
 
 /* FIXME: What is the correct domid when running in a stub domain? */
 lixs::sock_client::sock_client(long unsigned int id, std::function<void(void)> dead_cb,
-        xenstore& xs, domain_mgr& dmgr, event_mgr& emgr, iomux& io, log::logger& log, int fd)
-    : client(get_id(id), log, 0, xs, dmgr, log, io, fd), id(id), emgr(emgr), dead_cb(dead_cb)
+        xenstore& xs, domain_mgr& dmgr, event_mgr& emgr, iomux& io,
+        xs_proto_v1::trace_writer& trace, log::logger& log, int fd)
+    : client(get_id(id), log, 0, xs, dmgr, trace, log, io, fd), id(id), emgr(emgr), dead_cb(dead_cb)
 {
 }
 
@@ -63,7 +64,11 @@ lixs::sock_client::~sock_client()
 
 void lixs::sock_client::conn_dead(void)
 {
-    emgr.enqueue_event(dead_cb);
+    if (store_exec != NULL) {
+        store_exec->post(dead_cb);
+    } else {
+        emgr.enqueue_event(dead_cb);
+    }
 }
 
 std::string lixs::sock_client::get_id(long unsigned int id)
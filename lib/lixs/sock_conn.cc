@@ -37,6 +37,7 @@
 #include <lixs/iomux.hh>
 #include <lixs/sock_conn.hh>
 
+#include <algorithm>
 #include <cerrno>
 #include <cstring>
 #include <fcntl.h>
@@ -49,8 +50,23 @@
 
 
 lixs::sock_conn::sock_conn(iomux& io, int fd)
-    : io(io), fd(fd), ev_read(false), ev_write(false), alive(true)
+    : io(io), sio(io.get_stream_io()), fd(fd), ev_read(false), ev_write(false), alive(true),
+    rx_off(0), rx_paused(false), rx_closed(false), tx_queued(0), tx_blocked(false)
 {
+    if (sio != NULL) {
+        /* Some kernels fail requests on non-blocking sockets instead of waiting for them. */
+        if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) & ~O_NONBLOCK) == -1) {
+            throw sock_conn_error("Unable to clear O_NONBLOCK: " +
+                    std::string(std::strerror(errno)));
+        }
+
+        sio->attach(fd,
+                std::bind(&sock_conn::stream_recv, this, std::placeholders::_1,
+                    std::placeholders::_2),
+                std::bind(&sock_conn::stream_sent, this, std::placeholders::_1));
+        return;
+    }
+
     if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK) == -1) {
         throw sock_conn_error("Unable to set O_NONBLOCK: " +
                 std::string(std::strerror(errno)));
@@ -76,6 +92,10 @@ bool lixs::sock_conn::read(char*& buff, int& bytes)
     bool done;
     ssize_t len;
 
+    if (sio != NULL) {
+        return stream_read(buff, bytes);
+    }
+
     if (!alive) {
         return false;
     }
@@ -136,6 +156,10 @@ bool lixs::sock_conn::write(char*& buff, int& bytes)
     bool done;
     ssize_t len;
 
+    if (sio != NULL) {
+        return stream_write(buff, bytes);
+    }
+
     if (!alive) {
         return false;
     }
@@ -193,7 +217,7 @@ bool lixs::sock_conn::write(char*& buff, int& bytes)
 
 void lixs::sock_conn::need_rx(void)
 {
-    if (!alive) {
+    if (!alive || sio != NULL) {
         return;
     }
 
@@ -205,7 +229,7 @@ void lixs::sock_conn::need_rx(void)
 
 void lixs::sock_conn::need_tx(void)
 {
-    if (!alive) {
+    if (!alive || sio != NULL) {
         return;
     }
 
@@ -215,6 +239,124 @@ void lixs::sock_conn::need_tx(void)
     }
 }
 
+bool lixs::sock_conn::stream_read(char*& buff, int& bytes)
+{
+    std::string::size_type len;
+
+    if (!alive) {
+        return false;
+    }
+
+    if (bytes == 0) {
+        return true;
+    }
+
+    len = std::min(rx_data.size() - rx_off, static_cast<std::string::size_type>(bytes));
+
+    memcpy(buff, rx_data.data() + rx_off, len);
+    rx_off += len;
+    buff += len;
+    bytes -= len;
+
+    if (rx_off == rx_data.size()) {
+        rx_data.clear();
+        rx_off = 0;
+
+        if (rx_paused) {
+            rx_paused = false;
+            sio->set_recv(fd, true);
+        }
+    }
+
+    if (bytes > 0 && rx_closed) {
+        /* Backlog consumed, nothing else is coming */
+        kill();
+    }
+
+    return bytes == 0;
+}
+
+bool lixs::sock_conn::stream_write(char*& buff, int& bytes)
+{
+    if (!alive) {
+        return false;
+    }
+
+    if (bytes == 0) {
+        return true;
+    }
+
+    if (tx_queued >= tx_max) {
+        /* Resumed by stream_sent */
+        tx_blocked = true;
+        return false;
+    }
+
+    sio->send(fd, buff, bytes);
+
+    tx_queued += bytes;
+    buff += bytes;
+    bytes = 0;
+
+    return true;
+}
+
+void lixs::sock_conn::stream_recv(const char* data, int len)
+{
+    if (!alive) {
+        return;
+    }
+
+    if (len > 0) {
+        if (rx_off > 0 && rx_off >= rx_data.size() / 2) {
+            rx_data.erase(0, rx_off);
+            rx_off = 0;
+        }
+
+        rx_data.append(data, len);
+
+        if (!rx_paused && rx_data.size() - rx_off >= rx_max) {
+            rx_paused = true;
+            sio->set_recv(fd, false);
+        }
+    } else {
+        /* Closed or failed, reported once the backlog is consumed */
+        rx_closed = true;
+    }
+
+    process_rx();
+}
+
+void lixs::sock_conn::stream_sent(int queued)
+{
+    if (!alive) {
+        return;
+    }
+
+    if (queued < 0) {
+        kill();
+        return;
+    }
+
+    tx_queued = queued;
+
+    if (tx_blocked && tx_queued < tx_max) {
+        tx_blocked = false;
+        process_tx();
+    }
+}
+
+void lixs::sock_conn::kill(void)
+{
+    if (!alive) {
+        return;
+    }
+
+    alive = false;
+    io.rem(fd);
+    conn_dead();
+}
+
 lixs::sock_conn_cb::sock_conn_cb(sock_conn& conn)
     : conn(conn)
 {
@@ -38,13 +38,16 @@
 #include <lixs/event_mgr.hh>
 #include <lixs/iomux.hh>
 #include <lixs/log/logger.hh>
+#include <lixs/reactor.hh>
 #include <lixs/sock_client.hh>
 #include <lixs/unix_sock_server.hh>
 #include <lixs/xenstore.hh>
 
+#include <cerrno>
 #include <cstddef>
 #include <functional>
 #include <string>
+#include <utility>
 #include <sys/socket.h>
 #include <sys/types.h>
 #include <sys/un.h>
@@ -52,8 +55,10 @@
 
 
 lixs::unix_sock_server::unix_sock_server(xenstore& xs, domain_mgr& dmgr, event_mgr& emgr,
-        iomux& io, log::logger& log, const std::string& rw_path, const std::string& ro_path)
-    : xs(xs), dmgr(dmgr), emgr(emgr), io(io), log(log), rw_path(rw_path), ro_path(ro_path),
+        iomux& io, reactor_pool& reactors, xs_proto_v1::trace_writer& trace, log::logger& log,
+        const std::string& rw_path, const std::string& ro_path)
+    : xs(xs), dmgr(dmgr), emgr(emgr), io(io), reactors(reactors), trace(trace), log(log),
+    rw_path(rw_path), ro_path(ro_path),
     next_id(0)
 {
     std::string err_msg;
@@ -95,7 +100,7 @@ out_err:
 lixs::unix_sock_server::~unix_sock_server(void)
 {
     for (auto& c : clients) {
-        delete c.second;
+        client_delete(c.second.first, c.second.second);
     }
     clients.clear();
 
@@ -116,7 +121,8 @@ int lixs::unix_sock_server::bind_socket(const std::string& path, std::string& er
     struct sockaddr_un sock_addr = { 0 };
     sock_addr.sun_family = AF_UNIX;
 
-    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    /* Non-blocking so callback can accept until the backlog is empty. */
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
     if (fd == -1) {
         error_msg = "Failed to create socket: " + std::string(std::strerror(errno));
         return -1;
@@ -136,7 +142,7 @@ int lixs::unix_sock_server::bind_socket(const std::string& path, std::string& er
         return -1;
     }
 
-    ret = listen(fd, 1);
+    ret = listen(fd, SOMAXCONN);
     if (ret == -1) {
         error_msg = "Failed to listen on socket: " + std::string(std::strerror(errno));
         return -1;
@@ -151,11 +157,26 @@ void lixs::unix_sock_server::client_dead(long unsigned int id)
 
     it = clients.find(id);
     if (it != clients.end()) {
-        delete it->second;
+        client_delete(it->second.first, it->second.second);
         clients.erase(it);
     }
 }
 
+void lixs::unix_sock_server::client_delete(sock_client* client, reactor* r)
+{
+    if (r == NULL) {
+        delete client;
+        return;
+    }
+
+    /* The connection is torn down on its reactor. Anything the reactor posted for it before
+     * dying was already handled here, and anything posted to it runs before this.
+     */
+    r->run_sync([client] () {
+        delete client;
+    });
+}
+
 void lixs::unix_sock_server::callback(bool read, bool write, bool error, int fd)
 {
     int client_fd;
@@ -169,21 +190,56 @@ void lixs::unix_sock_server::callback(bool read, bool write, bool error, int fd)
         return;
     }
 
-    client_fd = accept(fd, NULL, NULL);
-    if (client_fd == -1) {
-        log::LOG<log::level::ERROR>::logf(log,
-                "[unix_socket_server] Calling accept on socket failed: %s", std::strerror(errno));
-        log::LOG<log::level::WARN>::logf(log,
-                "[unix_socket_server] Disabling socket (fd = %d)", fd);
-        io.rem(fd);
-        return;
+    /* Edge triggered multiplexers only report new connections once. */
+    while (true) {
+        client_fd = accept(fd, NULL, NULL);
+        if (client_fd == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+
+            log::LOG<log::level::ERROR>::logf(log,
+                    "[unix_socket_server] Calling accept on socket failed: %s",
+                    std::strerror(errno));
+            log::LOG<log::level::WARN>::logf(log,
+                    "[unix_socket_server] Disabling socket (fd = %d)", fd);
+            io.rem(fd);
+            return;
+        }
+
+        new_client(client_fd);
     }
+}
 
+void lixs::unix_sock_server::new_client(int client_fd)
+{
     long unsigned int id = next_id++;
     std::function<void(void)> cb = std::bind(&unix_sock_server::client_dead, this, id);
 
-    sock_client* client = new sock_client(id, cb, xs, dmgr, emgr, io, log, client_fd);
+    sock_client* client;
+
+    if (reactors.empty()) {
+        client = new sock_client(id, cb, xs, dmgr, emgr, io, trace, log, client_fd);
+
+        clients.insert({id, {client, NULL}});
+        return;
+    }
+
+    /* The client is built on its reactor, so its socket is only ever touched from there. This
+     * thread waits meanwhile, which makes it safe for the constructor to use the store.
+     */
+    unsigned int reader;
+    reactor& r = reactors.next(reader);
+
+    r.run_sync([&] () {
+        client = new sock_client(id, cb, xs, dmgr, emgr, r.get_iomux(), trace, log, client_fd);
+        client->offload(reactors.get_store(), r, reactors.get_view(), reader);
+    });
 
-    clients.insert({id, client});
+    clients.insert({id, {client, &r}});
 }
 
@@ -38,11 +38,18 @@
 #include <lixs/watch.hh>
 #include <lixs/watch_mgr.hh>
 
+#include <algorithm>
+#include <cerrno>
+#include <iterator>
+#include <list>
+#include <map>
 #include <memory>
+#include <string>
+#include <vector>
 
 
 lixs::watch_mgr::watch_mgr(event_mgr& emgr)
-    : emgr(emgr)
+    : emgr(emgr), n_watches(0), n_value_watches(0), owner_max(0)
 {
 }
 
@@ -50,50 +57,132 @@ lixs::watch_mgr::~watch_mgr()
 {
 }
 
-void lixs::watch_mgr::add(watch_cb& cb)
+int lixs::watch_mgr::add(watch_cb& cb)
 {
-    db[cb.path].path.insert(&cb);
+    unsigned long int& owned = owners[cb.owner];
+
+    if (cb.owner != 0 && owner_max != 0 && owned >= owner_max) {
+        if (owned == 0) {
+            owners.erase(cb.owner);
+        }
+
+        return ENOSPC;
+    }
+
+    owned++;
+
+    add_path(db.insert(std::make_pair(cb.path, record())).first, &cb);
 
     register_with_parents(cb.path, cb);
 
-    emgr.enqueue_event(std::bind(&watch_mgr::callback, this, cb.path, &cb, cb.path));
+    n_watches++;
+    if (cb.with_value) {
+        n_value_watches++;
+    }
+
+    emgr.enqueue_event(std::bind(&watch_mgr::callback, this, cb.path, &cb, cb.path,
+                watch_value_ptr()));
+
+    return 0;
 }
 
 void lixs::watch_mgr::del(watch_cb& cb)
 {
-    record& rec = db[cb.path];
-    rec.path.erase(&cb);
-    if (rec.path.empty() && rec.children.empty()) {
-        db.erase(cb.path);
+    database::iterator it;
+
+    it = db.find(cb.path);
+    if (it != db.end()) {
+        del_path(it, &cb);
+        if (it->second.path.empty() && it->second.children.empty()) {
+            db.erase(it);
+        }
     }
 
     unregister_from_parents(cb.path, cb);
+
+    release(cb.owner);
+
+    n_watches--;
+    if (cb.with_value) {
+        n_value_watches--;
+    }
 }
 
-void lixs::watch_mgr::fire(unsigned int tid, const std::string& path)
+void lixs::watch_mgr::del(const std::list<watch_cb*>& cbs)
+{
+    size_t pos;
+    std::string parent;
+    database::iterator it;
+    std::map<std::string, std::vector<watch_cb*> > parents;
+
+    /* The watches of a connection usually share most of their parents, so first group the
+     * removals by parent and then visit each affected record only once.
+     */
+    for (auto& cb : cbs) {
+        it = db.find(cb->path);
+        if (it != db.end()) {
+            del_path(it, cb);
+            if (it->second.path.empty() && it->second.children.empty()) {
+                db.erase(it);
+            }
+        }
+
+        for (pos = cb->path.rfind('/'); pos != std::string::npos; pos = parent.rfind('/')) {
+            parent.assign(cb->path, 0, pos);
+            parents[parent].push_back(cb);
+        }
+
+        release(cb->owner);
+
+        n_watches--;
+        if (cb->with_value) {
+            n_value_watches--;
+        }
+    }
+
+    for (auto& p : parents) {
+        it = db.find(p.first);
+        if (it == db.end()) {
+            continue;
+        }
+
+        for (auto& cb : p.second) {
+            it->second.children.erase(cb);
+        }
+
+        if (it->second.path.empty() && it->second.children.empty()) {
+            db.erase(it);
+        }
+    }
+}
+
+void lixs::watch_mgr::fire(unsigned int tid, const std::string& path,
+        const watch_value_ptr& value)
 {
     if (tid == 0) {
-        _fire(path, path);
+        _fire(path, path, 0, value);
     } else {
-        _tfire(tid, path, path);
+        _tfire(tid, path, path, 0, value);
     }
 }
 
-void lixs::watch_mgr::fire_parents(unsigned int tid, const std::string& path)
+void lixs::watch_mgr::fire_parents(unsigned int tid, const std::string& path,
+        const watch_value_ptr& value)
 {
     if (tid == 0) {
-        _fire_parents(path, path);
+        _fire_parents(path, path, 1, value);
     } else {
-        _tfire_parents(tid, path, path);
+        _tfire_parents(tid, path, path, 1, value);
     }
 }
 
-void lixs::watch_mgr::fire_children(unsigned int tid, const std::string& path)
+void lixs::watch_mgr::fire_children(unsigned int tid, const std::string& path,
+        const watch_value_ptr& value)
 {
     if (tid == 0) {
-        _fire_children(path);
+        _fire_children(path, value);
     } else {
-        _tfire_children(tid, path);
+        _tfire_children(tid, path, value);
     }
 }
 
@@ -111,73 +200,190 @@ void lixs::watch_mgr::abort_transaction(unsigned int tid)
     tdb.erase(tid);
 }
 
-void lixs::watch_mgr::callback(const std::string& key, watch_cb* cb, const std::string& path)
+void lixs::watch_mgr::set_quota(unsigned long int watches)
+{
+    owner_max = watches;
+}
+
+unsigned long int lixs::watch_mgr::size(void)
+{
+    return n_watches;
+}
+
+unsigned long int lixs::watch_mgr::owner_size(cid_t owner)
+{
+    owner_map::iterator it;
+
+    it = owners.find(owner);
+
+    return it == owners.end() ? 0 : it->second;
+}
+
+bool lixs::watch_mgr::has_value_watches(void)
+{
+    return n_value_watches > 0;
+}
+
+void lixs::watch_mgr::get_fanout(unsigned long int offset, unsigned long int count,
+        std::list<watch_fanout>& fanout)
+{
+    ranking::iterator it;
+
+    fanout.clear();
+
+    if (offset >= ranked.size()) {
+        return;
+    }
+
+    for (it = std::next(ranked.begin(), offset); it != ranked.end() && count > 0; it++, count--) {
+        fanout.push_back(watch_fanout());
+        fanout.back().path = (*it)->first;
+        fanout.back().path_watches = (*it)->second.n_path;
+        fanout.back().children_watches = (*it)->second.children.size();
+    }
+}
+
+void lixs::watch_mgr::callback(const std::string& key, watch_cb* cb, const std::string& path,
+        const watch_value_ptr& value)
 {
     database::iterator it;
 
     it = db.find(key);
     if (it != db.end()) {
         record& rec = it->second;
-
-        if (rec.path.find(cb) != rec.path.end() || rec.children.find(cb) != rec.children.end()) {
-            cb->operator()(path);
+        depth_map::iterator dit = rec.path.find(cb->depth);
+
+        if ((dit != rec.path.end() && dit->second.find(cb) != dit->second.end())
+                || rec.children.find(cb) != rec.children.end()) {
+            if (cb->with_value && value) {
+                cb->operator()(path, *value);
+            } else {
+                cb->operator()(path);
+            }
         }
     }
 }
 
-void lixs::watch_mgr::_fire(const std::string& path, const std::string& fire_path)
+/* The ranking is ordered by the watch count, so paths are taken out of it while that changes. */
+void lixs::watch_mgr::add_path(database::iterator it, watch_cb* cb)
+{
+    record& rec = it->second;
+
+    if (!rec.path[cb->depth].insert(cb).second) {
+        return;
+    }
+
+    if (rec.n_path > 0) {
+        ranked.erase(it);
+    }
+
+    rec.n_path++;
+    ranked.insert(it);
+}
+
+void lixs::watch_mgr::del_path(database::iterator it, watch_cb* cb)
+{
+    record& rec = it->second;
+    depth_map::iterator dit;
+
+    dit = rec.path.find(cb->depth);
+    if (dit == rec.path.end() || dit->second.find(cb) == dit->second.end()) {
+        return;
+    }
+
+    ranked.erase(it);
+
+    dit->second.erase(cb);
+    rec.n_path--;
+
+    if (rec.n_path > 0) {
+        ranked.insert(it);
+    }
+
+    if (dit->second.empty()) {
+        rec.path.erase(dit);
+    }
+}
+
+/* Depth is how many levels fire_path is below path. Watches limited to a lower depth are skipped
+ * without being visited.
+ */
+void lixs::watch_mgr::_fire(const std::string& path, const std::string& fire_path,
+        unsigned int depth, const watch_value_ptr& value)
 {
-    for (auto& r : db[path].path) {
-        emgr.enqueue_event(std::bind(&watch_mgr::callback, this, path, r, fire_path));
+    database::iterator it;
+    depth_map::iterator dit;
+
+    it = db.find(path);
+    if (it == db.end()) {
+        return;
+    }
+
+    for (dit = it->second.path.lower_bound(depth); dit != it->second.path.end(); dit++) {
+        for (auto& r : dit->second) {
+            emgr.enqueue_event(std::bind(&watch_mgr::callback, this, path, r, fire_path, value));
+        }
     }
 }
 
 void lixs::watch_mgr::_tfire(unsigned int tid, const std::string& path,
-        const std::string& fire_path)
+        const std::string& fire_path, unsigned int depth, const watch_value_ptr& value)
 {
+    database::iterator it;
+    depth_map::iterator dit;
+
+    it = db.find(path);
+    if (it == db.end()) {
+        return;
+    }
+
     fire_list& l = tdb[tid];
 
-    for (auto& p : db[path].path) {
-        l.push_back(std::bind(&watch_mgr::callback, this, path, p, fire_path));
+    for (dit = it->second.path.lower_bound(depth); dit != it->second.path.end(); dit++) {
+        for (auto& p : dit->second) {
+            l.push_back(std::bind(&watch_mgr::callback, this, path, p, fire_path, value));
+        }
     }
 }
 
-void lixs::watch_mgr::_fire_parents(const std::string& path, const std::string& fire_path)
+void lixs::watch_mgr::_fire_parents(const std::string& path, const std::string& fire_path,
+        unsigned int depth, const watch_value_ptr& value)
 {
     std::string name;
     std::string parent;
 
     if (basename(path, parent, name)) {
-        _fire(parent, fire_path);
-        _fire_parents(parent, fire_path);
+        _fire(parent, fire_path, depth, value);
+        _fire_parents(parent, fire_path, depth + 1, value);
     }
 }
 
 void lixs::watch_mgr::_tfire_parents(unsigned int tid, const std::string& path,
-        const std::string& fire_path)
+        const std::string& fire_path, unsigned int depth, const watch_value_ptr& value)
 {
     std::string name;
     std::string parent;
 
     if (basename(path, parent, name)) {
-        _tfire(tid, parent, fire_path);
-        _tfire_parents(tid, parent, fire_path);
+        _tfire(tid, parent, fire_path, depth, value);
+        _tfire_parents(tid, parent, fire_path, depth + 1, value);
     }
 }
 
-void lixs::watch_mgr::_fire_children(const std::string& path)
+void lixs::watch_mgr::_fire_children(const std::string& path, const watch_value_ptr& value)
 {
     for (auto& c : db[path].children) {
-        emgr.enqueue_event(std::bind(&watch_mgr::callback, this, path, c, c->path));
+        emgr.enqueue_event(std::bind(&watch_mgr::callback, this, path, c, c->path, value));
     }
 }
 
-void lixs::watch_mgr::_tfire_children(unsigned int tid, const std::string& path)
+void lixs::watch_mgr::_tfire_children(unsigned int tid, const std::string& path,
+        const watch_value_ptr& value)
 {
     fire_list& l = tdb[tid];
 
     for (auto& c : db[path].children) {
-        l.push_back(std::bind(&watch_mgr::callback, this, path, c, c->path));
+        l.push_back(std::bind(&watch_mgr::callback, this, path, c, c->path, value));
     }
 }
 
@@ -210,3 +416,13 @@ void lixs::watch_mgr::unregister_from_parents(const std::string& path, watch_cb&
     }
 }
 
+
+void lixs::watch_mgr::release(cid_t owner)
+{
+    owner_map::iterator it;
+
+    it = owners.find(owner);
+    if (it != owners.end() && --it->second == 0) {
+        owners.erase(it);
+    }
+}
@@ -36,6 +36,7 @@
 
 #include <lixs/domain_mgr.hh>
 #include <lixs/event_mgr.hh>
+#include <lixs/hypervisor.hh>
 #include <lixs/log/logger.hh>
 #include <lixs/xenbus.hh>
 #include <lixs/xenstore.hh>
@@ -57,7 +58,8 @@ extern "C" {
 
 const std::string lixs::xenbus_mapper::xsd_kva_path = "/proc/xen/xsd_kva";
 
-lixs::xenbus_mapper::xenbus_mapper(domid_t domid)
+/* The local ring is set up by the kernel, there's nothing to map through the hypervisor. */
+lixs::xenbus_mapper::xenbus_mapper(hypervisor& hv, domid_t domid)
 {
     int fd;
     void* ptr;
@@ -90,8 +92,9 @@ lixs::xenbus_mapper::~xenbus_mapper(void)
 const std::string lixs::xenbus::xsd_port_path = "/proc/xen/xsd_port";
 
 /* FIXME: What is the correct domid when running in a stub domain? */
-lixs::xenbus::xenbus(xenstore& xs, domain_mgr& dmgr, event_mgr& emgr, iomux& io, log::logger& log)
-    : client("XB", log, 0, xs, dmgr, log, io, 0, xenbus_evtchn())
+lixs::xenbus::xenbus(xenstore& xs, domain_mgr& dmgr, event_mgr& emgr, iomux& io, hypervisor& hv,
+        xs_proto_v1::trace_writer& trace, log::logger& log)
+    : client("XB", log, 0, xs, dmgr, trace, log, io, hv, 0, xenbus_evtchn())
 {
 }
 
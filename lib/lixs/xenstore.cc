@@ -37,12 +37,34 @@
 #include <lixs/xenstore.hh>
 
 #include <cerrno>
+#include <chrono>
+#include <list>
+#include <map>
+#include <memory>
 #include <set>
 #include <string>
-
+#include <utility>
+#include <vector>
+
+
+const char* lixs::xenstore::op_names[op_max] = {
+    "read",
+    "write",
+    "write_if",
+    "mkdir",
+    "rm",
+    "directory",
+    "directory_part",
+    "get_perms",
+    "set_perms",
+    "batch",
+    "clone",
+    "transaction_start",
+    "transaction_end",
+};
 
 lixs::xenstore::xenstore(store& st, event_mgr& emgr, iomux& io)
-    : st(st), wmgr(emgr)
+    : st(st), emgr(emgr), sched(NULL), clog(NULL), limiter(NULL), wmgr(emgr)
 {
     bool created;
 
@@ -56,74 +78,205 @@ lixs::xenstore::~xenstore()
 int lixs::xenstore::store_read(cid_t cid, unsigned int tid,
         const std::string& path, std::string& val)
 {
+    op_timer timer(ops[op_read]);
+
     return st.read(cid, tid, path, val);
 }
 
 int lixs::xenstore::store_write(cid_t cid, unsigned int tid,
-        const std::string& path, const std::string& val)
+        const std::string& path, std::string val)
+{
+    op_timer timer(ops[op_write]);
+
+    return apply_write(cid, tid, path, std::move(val));
+}
+
+int lixs::xenstore::store_read(cid_t cid, unsigned int tid, const std::string& path,
+        std::string& val, unsigned long int& version)
+{
+    op_timer timer(ops[op_read]);
+
+    return st.read(cid, tid, path, val, version);
+}
+
+int lixs::xenstore::store_write_if(cid_t cid, unsigned int tid, const std::string& path,
+        std::string val, unsigned long int& version)
 {
     int ret;
+    watch_value_ptr value;
+    op_timer timer(ops[op_write_if]);
 
-    ret = st.update(cid, tid, path, val);
+    ret = st.update_if(cid, tid, path, std::move(val), version);
     if (ret == 0) {
-        wmgr.fire(tid, path);
-        wmgr.fire_parents(tid, path);
+        value = current_value(tid, path);
+        wmgr.fire(tid, path, value);
+        wmgr.fire_parents(tid, path, value);
     }
 
     return ret;
 }
 
-int lixs::xenstore::store_mkdir(cid_t cid, unsigned int tid,
-        const std::string& path)
+int lixs::xenstore::store_write_if(cid_t cid, unsigned int tid, const std::string& path,
+        std::string val, const std::string& expected, unsigned long int& version)
 {
     int ret;
-    bool created;
+    watch_value_ptr value;
+    op_timer timer(ops[op_write_if]);
 
-    ret = st.create(cid, tid, path, created);
-    if (ret == 0 && created) {
-        wmgr.fire(tid, path);
-        wmgr.fire_parents(tid, path);
+    ret = st.update_if(cid, tid, path, std::move(val), expected, version);
+    if (ret == 0) {
+        value = current_value(tid, path);
+        wmgr.fire(tid, path, value);
+        wmgr.fire_parents(tid, path, value);
     }
 
     return ret;
 }
 
-int lixs::xenstore::store_rm(cid_t cid, unsigned int tid,
+int lixs::xenstore::store_mkdir(cid_t cid, unsigned int tid,
         const std::string& path)
 {
-    int ret;
+    op_timer timer(ops[op_mkdir]);
 
-    ret = st.del(cid, tid, path);
-    if (ret == 0) {
-        wmgr.fire(tid, path);
-        wmgr.fire_parents(tid, path);
-        wmgr.fire_children(tid, path);
-    }
+    return apply_mkdir(cid, tid, path);
+}
 
-    return ret;
+int lixs::xenstore::store_rm(cid_t cid, unsigned int tid,
+        const std::string& path)
+{
+    op_timer timer(ops[op_rm]);
+
+    return apply_rm(cid, tid, path);
 }
 
 int lixs::xenstore::store_dir(cid_t cid, unsigned int tid,
-        const std::string& path, std::set<std::string>& res)
+        const std::string& path, const children_cb& cb)
 {
-    return st.get_children(cid, tid, path, res);
+    op_timer timer(ops[op_dir]);
+
+    return st.get_children(cid, tid, path, cb);
+}
+
+int lixs::xenstore::store_dir_part(cid_t cid, unsigned int tid, const std::string& path,
+        const std::string& start, const children_part_cb& cb, unsigned long int& gen)
+{
+    op_timer timer(ops[op_dir_part]);
+
+    return st.get_children_part(cid, tid, path, start, cb, gen);
 }
 
 int lixs::xenstore::store_get_perms(cid_t cid, unsigned int tid,
         const std::string& path, permission_list& perms)
 {
+    op_timer timer(ops[op_get_perms]);
+
     return st.get_perms(cid, tid, path, perms);
 }
 
 int lixs::xenstore::store_set_perms(cid_t cid, unsigned int tid,
         const std::string& path, const permission_list& perms)
+{
+    op_timer timer(ops[op_set_perms]);
+
+    return apply_set_perms(cid, tid, path, perms);
+}
+
+int lixs::xenstore::store_batch(cid_t cid, unsigned int tid,
+        std::vector<batch_op>& batch, std::vector<int>& results)
 {
     int ret;
+    bool success;
+    unsigned int btid;
+    op_timer timer(ops[op_batch]);
+
+    /* Outside of a transaction the batch runs in one of its own. Watches fired by the operations
+     * are then held until the end and fire in a single pass.
+     */
+    if (tid == 0) {
+        st.branch(btid);
+    } else {
+        btid = tid;
+    }
 
-    ret = st.set_perms(cid, tid, path, perms);
+    ret = 0;
+    results.clear();
+
+    /* Only accounted for as a batch, not as each of its operations. */
+    for (auto& op : batch) {
+        switch (op.type) {
+            case batch_type::write:
+                ret = apply_write(cid, btid, op.path, std::move(op.value));
+            break;
+
+            case batch_type::mkdir:
+                ret = apply_mkdir(cid, btid, op.path);
+            break;
+
+            case batch_type::rm:
+                ret = apply_rm(cid, btid, op.path);
+            break;
+
+            case batch_type::set_perms:
+                ret = apply_set_perms(cid, btid, op.path, op.perms);
+            break;
+        }
+
+        results.push_back(ret);
+
+        if (ret != 0) {
+            break;
+        }
+    }
+
+    /* The operations applied before the failure can't be taken back from the transaction, which
+     * is doomed instead.
+     */
+    if (tid != 0) {
+        if (ret != 0) {
+            doomed[tid] = ret;
+        }
+
+        return ret;
+    }
+
+    if (ret != 0) {
+        st.abort(btid);
+        wmgr.abort_transaction(btid);
+
+        return 0;
+    }
+
+    /* Nothing else runs while the batch is applied, so it can't conflict, but it might take the
+     * entries' owners over quota as a whole.
+     */
+    ret = st.merge(btid, success);
+    if (ret == 0 && success) {
+        wmgr.fire_transaction(btid);
+    } else {
+        wmgr.abort_transaction(btid);
+    }
+
+    if (ret != 0) {
+        return ret;
+    }
+
+    return success ? 0 : EAGAIN;
+}
+
+int lixs::xenstore::store_clone(cid_t cid, unsigned int tid, const std::string& src,
+        const std::string& dst, cid_t from, cid_t to)
+{
+    int ret;
+    watch_value_ptr value;
+    op_timer timer(ops[op_clone]);
+
+    ret = st.clone(cid, tid, src, dst, from, to);
     if (ret == 0) {
-        wmgr.fire(tid, path);
-        wmgr.fire_parents(tid, path);
+        value = current_value(tid, dst);
+        wmgr.fire(tid, dst, value);
+        wmgr.fire_parents(tid, dst, value);
+        /* Watches below dst get created entries, not worth looking each of them up. */
+        wmgr.fire_children(tid, dst, watch_value_ptr());
     }
 
     return ret;
@@ -131,6 +284,8 @@ int lixs::xenstore::store_set_perms(cid_t cid, unsigned int tid,
 
 int lixs::xenstore::transaction_start(cid_t cid, unsigned int* tid)
 {
+    op_timer timer(ops[op_transaction_start]);
+
     st.branch(*tid);
 
     return 0;
@@ -140,6 +295,22 @@ int lixs::xenstore::transaction_end(cid_t cid, unsigned int tid, bool commit)
 {
     int ret;
     bool success;
+    std::map<unsigned int, int>::iterator d;
+    op_timer timer(ops[op_transaction_end]);
+
+    /* Doomed transactions are aborted even if asked to commit. */
+    d = doomed.find(tid);
+    if (d != doomed.end()) {
+        ret = st.abort(tid);
+        if (ret == 0) {
+            wmgr.abort_transaction(tid);
+            ret = commit ? d->second : 0;
+        }
+
+        doomed.erase(d);
+
+        return ret;
+    }
 
     if (commit) {
         ret = st.merge(tid, success);
@@ -153,6 +324,11 @@ int lixs::xenstore::transaction_end(cid_t cid, unsigned int tid, bool commit)
 
             return success ? 0 : EAGAIN;
         } else {
+            /* Transactions over quota are aborted by the store. */
+            if (ret == ENOSPC) {
+                wmgr.abort_transaction(tid);
+            }
+
             return ret;
         }
     } else {
@@ -168,9 +344,9 @@ int lixs::xenstore::transaction_end(cid_t cid, unsigned int tid, bool commit)
     }
 }
 
-void lixs::xenstore::watch_add(watch_cb& cb)
+int lixs::xenstore::watch_add(watch_cb& cb)
 {
-    wmgr.add(cb);
+    return wmgr.add(cb);
 }
 
 void lixs::xenstore::watch_del(watch_cb& cb)
@@ -178,6 +354,11 @@ void lixs::xenstore::watch_del(watch_cb& cb)
     wmgr.del(cb);
 }
 
+void lixs::xenstore::watch_del(const std::list<watch_cb*>& cbs)
+{
+    wmgr.del(cbs);
+}
+
 void lixs::xenstore::domain_path(domid_t domid, std::string& path)
 {
     char numstr[35];
@@ -188,11 +369,222 @@ void lixs::xenstore::domain_path(domid_t domid, std::string& path)
 
 void lixs::xenstore::domain_introduce(domid_t domid)
 {
-    wmgr.fire(0, "@introduceDomain");
+    wmgr.fire(0, "@introduceDomain", watch_value_ptr());
 }
 
 void lixs::xenstore::domain_release(domid_t domid)
 {
-    wmgr.fire(0, "@releaseDomain");
+    wmgr.fire(0, "@releaseDomain", watch_value_ptr());
+}
+
+/* Once a domain is gone nobody else will clean up the entries it owns below its home path, remove
+ * them in one go. The home path itself and entries owned by others are left to the toolstack.
+ */
+void lixs::xenstore::domain_teardown(domid_t domid)
+{
+    std::string path;
+    std::list<std::string> removed;
+    watch_value_ptr value;
+
+    domain_path(domid, path);
+
+    if (st.del_owned(domid, path, removed) == 0) {
+        value = deleted_value();
+
+        for (auto& r : removed) {
+            wmgr.fire(0, r, value);
+            wmgr.fire_parents(0, r, value);
+            wmgr.fire_children(0, r, value);
+        }
+    }
+}
+
+int lixs::xenstore::apply_write(cid_t cid, unsigned int tid,
+        const std::string& path, std::string val)
+{
+    int ret;
+    watch_value_ptr value;
+
+    ret = st.update(cid, tid, path, std::move(val));
+    if (ret == 0) {
+        value = current_value(tid, path);
+        wmgr.fire(tid, path, value);
+        wmgr.fire_parents(tid, path, value);
+    }
+
+    return ret;
+}
+
+int lixs::xenstore::apply_mkdir(cid_t cid, unsigned int tid,
+        const std::string& path)
+{
+    int ret;
+    watch_value_ptr value;
+    bool created;
+
+    ret = st.create(cid, tid, path, created);
+    if (ret == 0 && created) {
+        value = current_value(tid, path);
+        wmgr.fire(tid, path, value);
+        wmgr.fire_parents(tid, path, value);
+    }
+
+    return ret;
+}
+
+int lixs::xenstore::apply_rm(cid_t cid, unsigned int tid,
+        const std::string& path)
+{
+    int ret;
+    watch_value_ptr value;
+
+    ret = st.del(cid, tid, path);
+    if (ret == 0) {
+        value = deleted_value();
+        wmgr.fire(tid, path, value);
+        wmgr.fire_parents(tid, path, value);
+        wmgr.fire_children(tid, path, value);
+    }
+
+    return ret;
+}
+
+int lixs::xenstore::apply_set_perms(cid_t cid, unsigned int tid,
+        const std::string& path, const permission_list& perms)
+{
+    int ret;
+    watch_value_ptr value;
+
+    ret = st.set_perms(cid, tid, path, perms);
+    if (ret == 0) {
+        value = current_value(tid, path);
+        wmgr.fire(tid, path, value);
+        wmgr.fire_parents(tid, path, value);
+    }
+
+    return ret;
+}
+
+/* The state of a path is only worth building if some watch is going to get it. It is read once
+ * for all the watches and shared among them.
+ */
+lixs::watch_value_ptr lixs::xenstore::current_value(unsigned int tid, const std::string& path)
+{
+    std::shared_ptr<watch_value> value;
+
+    if (!wmgr.has_value_watches()) {
+        return watch_value_ptr();
+    }
+
+    value = std::make_shared<watch_value>(false);
+
+    if (st.read(0, tid, path, value->value) != 0
+            || st.get_perms(0, tid, path, value->perms) != 0) {
+        return watch_value_ptr();
+    }
+
+    return value;
+}
+
+lixs::watch_value_ptr lixs::xenstore::deleted_value(void)
+{
+    if (!wmgr.has_value_watches()) {
+        return watch_value_ptr();
+    }
+
+    return std::make_shared<watch_value>(true);
+}
+
+void lixs::xenstore::set_scheduler(scheduler* sched)
+{
+    this->sched = sched;
+}
+
+lixs::scheduler* lixs::xenstore::get_scheduler(void)
+{
+    return sched;
+}
+
+void lixs::xenstore::set_commit_log(commit_log* clog)
+{
+    this->clog = clog;
+}
+
+lixs::commit_log* lixs::xenstore::get_commit_log(void)
+{
+    return clog;
+}
+
+void lixs::xenstore::set_rate_limiter(rate_limiter* limiter)
+{
+    this->limiter = limiter;
+}
+
+lixs::rate_limiter* lixs::xenstore::get_rate_limiter(void)
+{
+    return limiter;
+}
+
+void lixs::xenstore::set_quota(unsigned long int nodes, unsigned long int bytes,
+        unsigned long int watches)
+{
+    st.set_quota(nodes, bytes);
+    wmgr.set_quota(watches);
+}
+
+void lixs::xenstore::get_stats(xenstore_stats& stats)
+{
+    st.get_stats(stats.store);
+
+    stats.watches = wmgr.size();
+    stats.events = emgr.size();
+
+    stats.ops.clear();
+    for (int i = 0; i < op_max; i++) {
+        stats.ops[op_names[i]] = ops[i];
+    }
+}
+
+void lixs::xenstore::get_domain_stats(domid_t domid, domain_stats& stats)
+{
+    st.get_owner_stats(domid, stats.store);
+
+    stats.watches = wmgr.owner_size(domid);
+}
+
+void lixs::xenstore::get_transaction_stats(std::list<transaction_stats>& stats)
+{
+    st.get_transaction_stats(stats);
+}
+
+void lixs::xenstore::get_watch_fanout(unsigned long int offset, unsigned long int count,
+        std::list<watch_fanout>& fanout)
+{
+    wmgr.get_fanout(offset, count, fanout);
+}
+
+int lixs::xenstore::get_usage(const std::string& path, const std::string& cursor,
+        unsigned long int max_entries, std::list<store_usage>& usage, std::string& next)
+{
+    return st.get_usage(path, cursor, max_entries, usage, next);
+}
+
+lixs::xenstore::op_timer::op_timer(op_stats& stats)
+    : stats(stats), start(std::chrono::steady_clock::now())
+{
+}
+
+lixs::xenstore::op_timer::~op_timer()
+{
+    unsigned long long int ns;
+
+    ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+
+    stats.count++;
+    stats.total_ns += ns;
+    if (ns > stats.max_ns) {
+        stats.max_ns = ns;
+    }
 }
 
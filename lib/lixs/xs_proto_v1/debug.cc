@@ -0,0 +1,379 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <lixs/log/logger.hh>
+#include <lixs/store.hh>
+#include <lixs/watch_mgr.hh>
+#include <lixs/xenstore.hh>
+#include <lixs/xs_proto_v1/xs_proto.hh>
+
+#include <cerrno>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+
+namespace lixs {
+namespace xs_proto_v1 {
+
+/*
+ * XS_DEBUG takes a sub-command as first argument followed by the sub-command arguments. The
+ * response is text, one entry per line, with space separated fields:
+ *
+ *   print <msg>                       logs <msg>, replies "OK"
+ *   mem [<path> [<cursor>]]           <child> <nodes> <bytes>
+ *   watches [<offset>]                <path> <path watches> <children watches>
+ *   transactions [<offset>]           <tid> <records> <age ms>
+ *   connections [<offset>]            <conn> <domid> <queued responses> <rx state>
+ *                                     <rx missing bytes> <watches>
+ *   alloc                             <counter> <bytes>
+ *
+ * Responses never exceed XENSTORE_PAYLOAD_MAX. When there is more data available the last line
+ * reads "more <arguments>", where <arguments> are the ones to use for the next request.
+ *
+ * The connections sub-command lists every connection, unix socket clients included, in the
+ * order they were made. <conn> is an id unique to the connection, <rx state> is one of idle,
+ * header, body or wait (throttled, yielded or waiting for the store thread), and <rx missing
+ * bytes> is what is left to read of the header or body being read.
+ *
+ * The mem sub-command inspects a bounded number of entries per request, therefore it might
+ * return a "more" line with few or no entries. Entries are reported as runs of consecutive
+ * store entries and the same child might be reported more than once, consumers need to sum up
+ * the counters. The cursor is relative to <path>.
+ *
+ * Only dom0 is allowed to issue debug requests.
+ */
+
+/* Maximum number of entries a page of the offset based sub-commands is built from */
+static const unsigned long int debug_page_max = 256;
+
+static bool debug_append(std::string& out, const std::string& line, const std::string& more)
+{
+    /* Leave space for the string terminator. */
+    if (out.length() + line.length() + more.length() >= XENSTORE_PAYLOAD_MAX) {
+        return false;
+    }
+
+    out += line;
+
+    return true;
+}
+
+static int debug_offset(const char* arg, unsigned long int& offset)
+{
+    size_t pos;
+
+    offset = 0;
+
+    if (arg == NULL) {
+        return 0;
+    }
+
+    try {
+        offset = std::stoul(arg, &pos);
+    } catch(std::invalid_argument& e) {
+        return EINVAL;
+    } catch(std::out_of_range& e) {
+        return EINVAL;
+    }
+
+    return arg[pos] == '\0' ? 0 : EINVAL;
+}
+
+static int debug_page(const std::string& cmd, unsigned long int offset,
+        const std::list<std::string>& lines, bool more, std::string& out)
+{
+    std::string trailer;
+
+    for (auto& l : lines) {
+        trailer = "more " + cmd + " " + std::to_string(offset + 1) + "\n";
+
+        if (!debug_append(out, l, trailer)) {
+            if (out.empty()) {
+                return E2BIG;
+            }
+
+            more = true;
+            break;
+        }
+
+        offset++;
+    }
+
+    if (more) {
+        out += "more " + cmd + " " + std::to_string(offset) + "\n";
+    }
+
+    return 0;
+}
+
+void xs_proto_base::op_debug(void)
+{
+    int ret;
+    char* cmd;
+    char* arg;
+    std::string out;
+
+    if (domid != 0) {
+        tx_queue.push_back({XS_ERROR, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
+                {err2str(EACCES)}, false});
+        return;
+    }
+
+    cmd = get_arg1();
+    arg = get_next_arg(cmd);
+
+    if (strcmp(cmd, "print") == 0) {
+        log::LOG<log::level::INFO>::logf(log, "[%4s] %s", cid().c_str(), arg ? arg : "");
+        out = "OK";
+        ret = 0;
+    } else if (strcmp(cmd, "mem") == 0) {
+        ret = debug_mem(arg, out);
+    } else if (strcmp(cmd, "watches") == 0) {
+        ret = debug_watches(arg, out);
+    } else if (strcmp(cmd, "transactions") == 0) {
+        ret = debug_transactions(arg, out);
+    } else if (strcmp(cmd, "connections") == 0) {
+        ret = debug_connections(arg, out);
+    } else if (strcmp(cmd, "alloc") == 0) {
+        ret = debug_alloc(arg, out);
+    } else {
+        ret = EINVAL;
+    }
+
+    if (ret == 0) {
+        tx_queue.push_back({XS_DEBUG, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
+                {out}, true});
+    } else {
+        tx_queue.push_back({XS_ERROR, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
+                {err2str(ret)}, false});
+    }
+}
+
+int xs_proto_base::debug_mem(char* arg, std::string& out)
+{
+    int ret;
+    char* rel;
+    std::string path;
+    std::string prefix;
+    std::string next;
+    std::string cursor;
+    std::string line;
+    std::string trailer;
+    std::list<store_usage> usage;
+
+    path = arg ? arg : "/";
+    if (path[0] != '/') {
+        return EINVAL;
+    }
+
+    prefix = path;
+    if (prefix.back() != '/') {
+        prefix += "/";
+    }
+
+    rel = arg ? get_next_arg(arg) : NULL;
+    if (rel != NULL && rel[0] != '\0') {
+        cursor = prefix + rel;
+    }
+
+    ret = xs.get_usage(path, cursor, debug_mem_scan_max, usage, next);
+    if (ret != 0) {
+        return ret;
+    }
+
+    for (auto& u : usage) {
+        line = u.name + " " + std::to_string(u.nodes) + " " + std::to_string(u.bytes) + "\n";
+        trailer = "more mem " + path + " " + u.last.substr(prefix.length()) + "\n";
+
+        if (!debug_append(out, line, trailer)) {
+            if (out.empty()) {
+                return E2BIG;
+            }
+
+            /* Resume after the last reported run. */
+            next = cursor;
+            break;
+        }
+
+        cursor = u.last;
+    }
+
+    if (!next.empty()) {
+        trailer = "more mem " + path + " " + next.substr(prefix.length()) + "\n";
+
+        /* Entries skipped at the end of the scan can always be inspected again. */
+        if (!debug_append(out, trailer, "")) {
+            out += "more mem " + path + " " + cursor.substr(prefix.length()) + "\n";
+        }
+    }
+
+    return 0;
+}
+
+int xs_proto_base::debug_watches(char* arg, std::string& out)
+{
+    int ret;
+    bool more;
+    unsigned long int offset;
+    std::list<watch_fanout> fanout;
+    std::list<std::string> lines;
+
+    ret = debug_offset(arg, offset);
+    if (ret != 0) {
+        return ret;
+    }
+
+    /* One more than a page tells whether there is a next one. */
+    xs.get_watch_fanout(offset, debug_page_max + 1, fanout);
+
+    more = fanout.size() > debug_page_max;
+    if (more) {
+        fanout.pop_back();
+    }
+
+    for (auto& f : fanout) {
+        lines.push_back(f.path + " " + std::to_string(f.path_watches) + " "
+                + std::to_string(f.children_watches) + "\n");
+    }
+
+    return debug_page("watches", offset, lines, more, out);
+}
+
+int xs_proto_base::debug_transactions(char* arg, std::string& out)
+{
+    int ret;
+    unsigned long int i;
+    unsigned long int offset;
+    std::list<transaction_stats> stats;
+    std::list<std::string> lines;
+
+    ret = debug_offset(arg, offset);
+    if (ret != 0) {
+        return ret;
+    }
+
+    xs.get_transaction_stats(stats);
+
+    i = 0;
+    for (auto& t : stats) {
+        if (i++ < offset) {
+            continue;
+        }
+
+        if (lines.size() == debug_page_max) {
+            break;
+        }
+
+        lines.push_back(std::to_string(t.tid) + " " + std::to_string(t.records) + " "
+                + std::to_string(t.age_ms) + "\n");
+    }
+
+    return debug_page("transactions", offset, lines, offset + lines.size() < stats.size(), out);
+}
+
+int xs_proto_base::debug_connections(char* arg, std::string& out)
+{
+    int ret;
+    bool more;
+    unsigned long int i;
+    unsigned long int offset;
+    std::list<std::string> lines;
+    static const char* const rx_names[] = { "idle", "header", "body", "wait" };
+
+    ret = debug_offset(arg, offset);
+    if (ret != 0) {
+        return ret;
+    }
+
+    std::lock_guard<std::mutex> lock(registry_lock);
+
+    i = 0;
+    more = false;
+    for (auto c : registry) {
+        if (i++ < offset) {
+            continue;
+        }
+
+        if (lines.size() == debug_page_max) {
+            more = true;
+            break;
+        }
+
+        lines.push_back(std::to_string(c->trace_conn) + " " + std::to_string(c->domid) + " "
+                + std::to_string(c->queue_length()) + " "
+                + rx_names[static_cast<int>(c->rx_stage.load(std::memory_order_relaxed))] + " "
+                + std::to_string(c->rx_missing.load(std::memory_order_relaxed)) + " "
+                + std::to_string(c->watch_count()) + "\n");
+    }
+
+    return debug_page("connections", offset, lines, more, out);
+}
+
+int xs_proto_base::debug_alloc(char* arg, std::string& out)
+{
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+    struct mallinfo2 mi = mallinfo2();
+#elif defined(__GLIBC__)
+    struct mallinfo mi = mallinfo();
+#endif
+
+    if (arg != NULL) {
+        return EINVAL;
+    }
+
+#if defined(__GLIBC__)
+    out = "arena " + std::to_string(mi.arena) + "\n"
+        + "mmap " + std::to_string(mi.hblkhd) + "\n"
+        + "inuse " + std::to_string(mi.uordblks) + "\n"
+        + "free " + std::to_string(mi.fordblks) + "\n"
+        + "releasable " + std::to_string(mi.keepcost) + "\n";
+
+    return 0;
+#else
+    return ENOSYS;
+#endif
+}
+
+} /* namespace xs_proto_v1 */
+} /* namespace lixs */
+
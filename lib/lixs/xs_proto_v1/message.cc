@@ -36,10 +36,14 @@
 
 #include <lixs/xs_proto_v1/xs_proto.hh>
 
+#include <list>
+#include <string>
+#include <utility>
+
 
 lixs::xs_proto_v1::message::message(uint32_t type, uint32_t req_id, uint32_t tx_id,
         std::list<std::string> body, bool terminator)
-    : type(type), req_id(req_id), tx_id(tx_id), body(body), terminator(terminator)
+    : type(type), req_id(req_id), tx_id(tx_id), body(std::move(body)), terminator(terminator)
 {
 }
 
@@ -0,0 +1,223 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <lixs/domain.hh>
+#include <lixs/domain_mgr.hh>
+#include <lixs/xenstore.hh>
+#include <lixs/xs_proto_v1/xs_proto.hh>
+
+#include <cerrno>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+
+namespace lixs {
+namespace xs_proto_v1 {
+
+/*
+ * The statistics subtree is generated on every access from the in-memory counters kept by the
+ * different components, nothing is ever written to the store. The layout is the following:
+ *
+ *   @stats/store/{nodes,bytes,transactions}
+ *   @stats/watches
+ *   @stats/events
+ *   @stats/domains/<domid>/{queue,nodes,bytes,watches,throttled}
+ *   @stats/ops/<op>/{count,total_ns,max_ns}
+ *
+ * A domain's nodes and bytes are those of the entries it owns, and throttled is the number of
+ * times its connection ran out of rate limiting tokens. Intermediate nodes have an empty value,
+ * like regular directories in the store. Statistics show what every domain is doing, so only dom0
+ * can read them, others get EACCES.
+ */
+
+bool xs_proto_base::is_stats_path(const std::string& path)
+{
+    if (path.compare(0, stats_path.length(), stats_path) != 0) {
+        return false;
+    }
+
+    return path.length() == stats_path.length() || path[stats_path.length()] == '/';
+}
+
+int xs_proto_base::stats_read(const std::string& path, std::string& val)
+{
+    std::set<std::string> children;
+
+    return stats_node(path, val, children);
+}
+
+int xs_proto_base::stats_dir(const std::string& path, std::set<std::string>& res)
+{
+    std::string val;
+
+    return stats_node(path, val, res);
+}
+
+int xs_proto_base::stats_node(const std::string& path,
+        std::string& val, std::set<std::string>& children)
+{
+    size_t pos;
+    size_t next;
+    xenstore_stats stats;
+    std::vector<std::string> elems;
+
+    if (domid != 0) {
+        return EACCES;
+    }
+
+    /* Split the path relative to the subtree root, ignoring empty elements. */
+    for (pos = stats_path.length(); pos < path.length(); pos = next + 1) {
+        next = path.find('/', pos);
+        if (next == std::string::npos) {
+            next = path.length();
+        }
+
+        if (next > pos) {
+            elems.push_back(path.substr(pos, next - pos));
+        }
+    }
+
+    xs.get_stats(stats);
+
+    val = "";
+    children.clear();
+
+    if (elems.size() == 0) {
+        children = { "store", "watches", "events", "domains", "ops" };
+        return 0;
+    }
+
+    if (elems[0] == "store") {
+        if (elems.size() == 1) {
+            children = { "nodes", "bytes", "transactions" };
+        } else if (elems.size() == 2 && elems[1] == "nodes") {
+            val = std::to_string(stats.store.nodes);
+        } else if (elems.size() == 2 && elems[1] == "bytes") {
+            val = std::to_string(stats.store.bytes);
+        } else if (elems.size() == 2 && elems[1] == "transactions") {
+            val = std::to_string(stats.store.transactions);
+        } else {
+            return ENOENT;
+        }
+
+        return 0;
+    }
+
+    if (elems[0] == "watches" && elems.size() == 1) {
+        val = std::to_string(stats.watches);
+        return 0;
+    }
+
+    if (elems[0] == "events" && elems.size() == 1) {
+        val = std::to_string(stats.events);
+        return 0;
+    }
+
+    if (elems[0] == "domains") {
+        if (elems.size() == 1) {
+            for (auto& d : dmgr) {
+                children.insert(std::to_string(d.first));
+            }
+            return 0;
+        }
+
+        for (auto& d : dmgr) {
+            domain_stats dstats;
+
+            if (std::to_string(d.first) != elems[1]) {
+                continue;
+            }
+
+            xs.get_domain_stats(d.first, dstats);
+
+            if (elems.size() == 2) {
+                children = { "queue", "nodes", "bytes", "watches", "throttled" };
+            } else if (elems.size() == 3 && elems[2] == "queue") {
+                val = std::to_string(d.second->queue_length());
+            } else if (elems.size() == 3 && elems[2] == "nodes") {
+                val = std::to_string(dstats.store.nodes);
+            } else if (elems.size() == 3 && elems[2] == "bytes") {
+                val = std::to_string(dstats.store.bytes);
+            } else if (elems.size() == 3 && elems[2] == "watches") {
+                val = std::to_string(dstats.watches);
+            } else if (elems.size() == 3 && elems[2] == "throttled") {
+                val = std::to_string(d.second->throttle_count());
+            } else {
+                return ENOENT;
+            }
+
+            return 0;
+        }
+
+        return ENOENT;
+    }
+
+    if (elems[0] == "ops") {
+        if (elems.size() == 1) {
+            for (auto& o : stats.ops) {
+                children.insert(o.first);
+            }
+            return 0;
+        }
+
+        std::map<std::string, op_stats>::iterator it = stats.ops.find(elems[1]);
+        if (it == stats.ops.end()) {
+            return ENOENT;
+        }
+
+        if (elems.size() == 2) {
+            children = { "count", "total_ns", "max_ns" };
+        } else if (elems.size() == 3 && elems[2] == "count") {
+            val = std::to_string(it->second.count);
+        } else if (elems.size() == 3 && elems[2] == "total_ns") {
+            val = std::to_string(it->second.total_ns);
+        } else if (elems.size() == 3 && elems[2] == "max_ns") {
+            val = std::to_string(it->second.max_ns);
+        } else {
+            return ENOENT;
+        }
+
+        return 0;
+    }
+
+    return ENOENT;
+}
+
+} /* namespace xs_proto_v1 */
+} /* namespace lixs */
+
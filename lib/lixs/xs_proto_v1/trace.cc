@@ -0,0 +1,202 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <lixs/xs_proto_v1/trace.hh>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <string>
+#include <unistd.h>
+
+
+/* Records are small, buffer them to keep the cost of tracing down to a memory copy. */
+static const size_t trace_buffer_size = 1 << 20;
+
+
+lixs::xs_proto_v1::trace_writer::trace_writer(void)
+    : fd(-1), emgr(NULL), buff(NULL), used(0), flush_queued(false), next_conn(0),
+    start(std::chrono::steady_clock::now())
+{
+}
+
+lixs::xs_proto_v1::trace_writer::trace_writer(const std::string& path, event_mgr& emgr)
+    : fd(-1), emgr(&emgr), buff(NULL), used(0), flush_queued(false), next_conn(0),
+    start(std::chrono::steady_clock::now())
+{
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        throw trace_error("Failed to open trace file: " + std::string(std::strerror(errno)));
+    }
+
+    buff = new char[trace_buffer_size];
+
+    append(trace_magic, sizeof(trace_magic));
+    flush();
+
+    if (fd == -1) {
+        delete[] buff;
+        throw trace_error("Failed to write trace file");
+    }
+}
+
+lixs::xs_proto_v1::trace_writer::~trace_writer()
+{
+    if (fd != -1) {
+        flush();
+    }
+
+    if (fd != -1) {
+        close(fd);
+    }
+
+    delete[] buff;
+}
+
+uint32_t lixs::xs_proto_v1::trace_writer::conn_open(void)
+{
+    return next_conn++;
+}
+
+void lixs::xs_proto_v1::trace_writer::conn_closed(uint32_t conn, domid_t domid)
+{
+    struct xsd_sockmsg hdr = { 0 };
+
+    hdr.type = trace_conn_closed;
+
+    record(conn, domid, hdr, "");
+}
+
+void lixs::xs_proto_v1::trace_writer::record(uint32_t conn, domid_t domid,
+        const struct xsd_sockmsg& hdr, const char* body)
+{
+    trace_record rec;
+
+    rec.time_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    rec.conn = conn;
+    rec.domid = domid;
+    rec.hdr = hdr;
+
+    append(&rec, sizeof(rec));
+    append(body, hdr.len);
+
+    if (!flush_queued && fd != -1) {
+        flush_queued = true;
+        emgr->enqueue_event(std::bind(&trace_writer::flush_event, this));
+    }
+}
+
+void lixs::xs_proto_v1::trace_writer::flush(void)
+{
+    ssize_t ret;
+
+    for (size_t off = 0; off < used && fd != -1; off += ret) {
+        ret = write(fd, buff + off, used - off);
+        if (ret == -1 && errno == EINTR) {
+            ret = 0;
+        } else if (ret == -1) {
+            /* Failing to write the trace shouldn't affect the service, stop tracing instead. */
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    used = 0;
+}
+
+void lixs::xs_proto_v1::trace_writer::append(const void* data, std::size_t len)
+{
+    /* A body is at most XENSTORE_PAYLOAD_MAX bytes, always fitting in an empty buffer. */
+    if (used + len > trace_buffer_size) {
+        flush();
+    }
+
+    std::memcpy(buff + used, data, len);
+    used += len;
+}
+
+void lixs::xs_proto_v1::trace_writer::flush_event(void)
+{
+    flush_queued = false;
+    flush();
+}
+
+
+lixs::xs_proto_v1::trace_reader::trace_reader(const std::string& path)
+    : fp(NULL)
+{
+    char magic[sizeof(trace_magic)];
+
+    fp = std::fopen(path.c_str(), "r");
+    if (fp == NULL) {
+        throw trace_error("Failed to open trace file: " + std::string(std::strerror(errno)));
+    }
+
+    if (std::fread(magic, sizeof(magic), 1, fp) != 1
+            || std::memcmp(magic, trace_magic, sizeof(magic)) != 0) {
+        std::fclose(fp);
+        throw trace_error("Invalid trace file");
+    }
+}
+
+lixs::xs_proto_v1::trace_reader::~trace_reader()
+{
+    std::fclose(fp);
+}
+
+bool lixs::xs_proto_v1::trace_reader::next(trace_record& rec, std::string& body)
+{
+    if (std::fread(&rec, sizeof(rec), 1, fp) != 1) {
+        return false;
+    }
+
+    if (rec.hdr.len > XENSTORE_PAYLOAD_MAX) {
+        throw trace_error("Invalid trace record");
+    }
+
+    body.resize(rec.hdr.len);
+    if (rec.hdr.len > 0 && std::fread(&body[0], rec.hdr.len, 1, fp) != 1) {
+        throw trace_error("Truncated trace record");
+    }
+
+    return true;
+}
+
@@ -37,24 +37,51 @@
 #include <lixs/xs_proto_v1/xs_proto.hh>
 
 
-lixs::xs_proto_v1::watch_cb::watch_cb(xs_proto_base& proto,
-        const std::string& path, const std::string& token, bool relative)
-    : lixs::watch_cb(path, token), proto(proto), relative(relative)
+lixs::xs_proto_v1::watch_cb::watch_cb(xs_proto_base& proto, const std::string& path,
+        const std::string& token, bool relative, bool with_value, unsigned int depth)
+    : lixs::watch_cb(path, token, with_value, depth, proto.domid), proto(proto),
+    relative(relative)
 {
 }
 
 void lixs::xs_proto_v1::watch_cb::operator()(const std::string& fire_path)
 {
-    std::string path;
+    if (with_value) {
+        send(fire_path, { watch_state_unknown }, true);
+    } else {
+        send(fire_path, { }, true);
+    }
+}
+
+void lixs::xs_proto_v1::watch_cb::operator()(const std::string& fire_path,
+        const watch_value& value)
+{
+    if (value.deleted) {
+        send(fire_path, { watch_state_deleted }, true);
+    } else if (has_read_access(proto.domid, value.perms)) {
+        /* Like in XS_READ replies the value isn't null terminated. */
+        send(fire_path, { watch_state_value, value.value }, false);
+    } else {
+        send(fire_path, { watch_state_unknown }, true);
+    }
+}
+
+void lixs::xs_proto_v1::watch_cb::send(const std::string& fire_path,
+        std::list<std::string> state, bool terminator)
+{
+    std::list<std::string> body;
 
     if (relative) {
         /* NOTE: Remove dom_path plus '/' */
-        path = fire_path.substr(proto.dom_path.length() + 1);
+        body.push_back(fire_path.substr(proto.dom_path.length() + 1));
     } else {
-        path = fire_path;
+        body.push_back(fire_path);
     }
 
-    proto.tx_queue.push_back({XS_WATCH_EVENT, 0, 0, { path, token }, true});
-    proto.process_tx();
+    body.push_back(token);
+    body.splice(body.end(), state);
+
+    proto.tx_queue.emplace_back(XS_WATCH_EVENT, 0, 0, std::move(body), terminator);
+    proto.flush_tx();
 }
 
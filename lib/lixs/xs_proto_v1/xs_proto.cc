@@ -36,33 +36,107 @@
 
 #include <lixs/xs_proto_v1/xs_proto.hh>
 
+#include <atomic>
 #include <cstdio>
 #include <cstring>
 #include <limits>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <utility>
+#include <vector>
 
 
 namespace lixs {
 namespace xs_proto_v1 {
 
-xs_proto_base::xs_proto_base(domid_t domid, xenstore& xs, domain_mgr& dmgr, log::logger& log)
+std::mutex xs_proto_base::registry_lock;
+std::list<xs_proto_base*> xs_proto_base::registry;
+
+xs_proto_base::xs_proto_base(domid_t domid, xenstore& xs, domain_mgr& dmgr, trace_writer& trace,
+        log::logger& log)
     : domid(domid), dom_path(get_dom_path(domid, xs)),
-    rx_msg(dom_path), tx_msg(dom_path), xs(xs), dmgr(dmgr), log(log)
+    rx_msg(dom_path), tx_msg(dom_path), tx_pending(0), clog(xs.get_commit_log()),
+    holding(false), rx_held(false), xs(xs), dmgr(dmgr),
+    trace(trace), trace_conn(trace.conn_open()), log(log),
+    store_exec(NULL), io_exec(NULL), view(NULL), view_reader(0),
+    sched(xs.get_scheduler()), sched_cls(domid == 0 ? sched_class::dom0 : sched_class::guest),
+    limiter(domid == 0 ? NULL : xs.get_rate_limiter()), bucket([this] { resume(); }),
+    watching(false), rx_stage(io_state::p), rx_missing(0)
 {
+    std::lock_guard<std::mutex> lock(registry_lock);
+
+    registry_it = registry.insert(registry.end(), this);
 }
 
 xs_proto_base::~xs_proto_base()
 {
+    {
+        std::lock_guard<std::mutex> lock(registry_lock);
+
+        registry.erase(registry_it);
+    }
+
+    if (clog != NULL) {
+        clog->cancel(*this);
+    }
+
+    if (sched != NULL) {
+        sched->cancel(*this);
+    }
+
+    if (limiter != NULL) {
+        limiter->cancel(bucket);
+    }
+
+    if (trace.enabled()) {
+        trace.conn_closed(trace_conn, domid);
+    }
+}
+
+unsigned long int xs_proto_base::queue_length(void)
+{
+    return tx_queue.size() + tx_held.size() + tx_pending.load(std::memory_order_relaxed);
+}
+
+unsigned long int xs_proto_base::watch_count(void)
+{
+    return watches.size();
+}
+
+unsigned long int xs_proto_base::throttle_count(void)
+{
+    return bucket.get_throttled();
+}
+
+void xs_proto_base::offload(executor& store, executor& io, store_view* view, unsigned int reader)
+{
+    store_exec = &store;
+    io_exec = &io;
+    sched = NULL;
+    limiter = NULL;
+
+    this->view = view;
+    view_reader = reader;
 }
 
 void xs_proto_base::handle_rx(void)
 {
+    if (trace.enabled()) {
+        trace.record(trace_conn, domid, rx_msg.hdr, rx_msg.body);
+    }
+
     switch (rx_msg.hdr.type) {
         case XS_DIRECTORY:
             op_directory();
         break;
 
+        case xs_directory_part:
+            op_directory_part();
+        break;
+
         case XS_READ:
             op_read();
         break;
@@ -87,8 +161,28 @@ void xs_proto_base::handle_rx(void)
             op_set_perms();
         break;
 
+        case xs_batch:
+            op_batch();
+        break;
+
+        case xs_clone:
+            op_clone();
+        break;
+
+        case xs_read_version:
+            op_read_version();
+        break;
+
+        case xs_write_version:
+            op_write_version();
+        break;
+
+        case xs_write_match:
+            op_write_match();
+        break;
+
         case XS_DEBUG:
-            op_unimplemented();
+            op_debug();
         break;
 
         case XS_WATCH:
@@ -144,39 +238,284 @@ void xs_proto_base::handle_rx(void)
         break;
     }
 
+    watching.store(!watches.empty(), std::memory_order_relaxed);
+
     /* As result of the message processing a response might have been
      * generated. Trigger tx here.
      */
-    process_tx();
+    flush_tx();
+}
+
+bool xs_proto_base::handle_rx_view(void)
+{
+    int ret;
+    char* path;
+    bool terminator;
+    permission_list perms;
+    std::string perm_str;
+    std::list<std::string> result;
+
+    /* Only plain reads of committed data qualify. Connections with watches are left to the store
+     * thread, so that a read never returns data ahead of the watch event announcing it. Traced
+     * requests are recorded by the store thread as well.
+     */
+    if (rx_msg.hdr.tx_id != 0 || watching.load(std::memory_order_relaxed) || trace.enabled()) {
+        return false;
+    }
+
+    if (rx_msg.hdr.type != XS_READ && rx_msg.hdr.type != XS_DIRECTORY
+            && rx_msg.hdr.type != XS_GET_PERMS) {
+        return false;
+    }
+
+    /* Statistics are generated by the store thread, which also refuses them to guests. */
+    path = get_path();
+    if (is_stats_path(path)) {
+        return false;
+    }
+
+    terminator = false;
+
+    switch (rx_msg.hdr.type) {
+        case XS_READ:
+            result.resize(1);
+            ret = view->read(view_reader, domid, path, result.front());
+        break;
+
+        case XS_DIRECTORY:
+            result.resize(1);
+            ret = view->get_children(view_reader, domid, path,
+                    [&result] (const std::string& name) {
+                result.front().append(name.c_str(), name.length() + 1);
+            });
+        break;
+
+        default:
+            ret = view->get_perms(view_reader, domid, path, perms);
+            for (auto& p : perms) {
+                perm2str(p, perm_str);
+                result.push_back(perm_str);
+            }
+            terminator = true;
+        break;
+    }
+
+    if (ret == 0) {
+        tx_out.emplace_back(rx_msg.hdr.type, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
+                std::move(result), terminator);
+    } else {
+        tx_out.push_back({XS_ERROR, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
+                {err2str(ret)}, false});
+    }
+    tx_pending.fetch_add(1, std::memory_order_relaxed);
+
+    return true;
+}
+
+void xs_proto_base::flush_tx(void)
+{
+    /* Group commit: replies wait for the changes committed up to now, their own included, to be
+     * durable and are then released together with those of the other connections.
+     */
+    if (clog != NULL && (holding || clog->pending())) {
+        tx_held.splice(tx_held.end(), tx_queue);
+
+        if (!holding) {
+            holding = true;
+            clog->wait(*this);
+        }
+
+        return;
+    }
+
+    tx_pending.fetch_add(tx_queue.size(), std::memory_order_relaxed);
+
+    if (io_exec == NULL) {
+        tx_out.splice(tx_out.end(), tx_queue);
+        process_tx();
+        return;
+    }
+
+    if (tx_queue.empty()) {
+        return;
+    }
+
+    std::shared_ptr<std::list<message> > batch(new std::list<message>());
+    batch->splice(batch->end(), tx_queue);
+
+    io_exec->post([this, batch] () {
+        tx_out.splice(tx_out.end(), *batch);
+        process_tx();
+    });
+}
+
+void xs_proto_base::durable(void)
+{
+    holding = false;
+
+    tx_queue.splice(tx_queue.begin(), tx_held);
+    flush_tx();
+
+    if (rx_held && !holding) {
+        rx_held = false;
+        io_exec->post(std::bind(&xs_proto_base::resume, this));
+    }
 }
 
 
 void xs_proto_base::op_directory(void)
 {
     int ret;
-    std::set<std::string> result;
+    char* path;
+    std::set<std::string> stats;
+    /* Child names are serialized straight into a single body element, each one followed by its
+     * null separator, rather than collected first.
+     */
+    std::list<std::string> result(1);
+    std::string& body = result.front();
 
-    ret = xs.store_dir(domid, rx_msg.hdr.tx_id, get_path(), result);
+    path = get_path();
+
+    if (is_stats_path(path)) {
+        ret = stats_dir(path, stats);
+        for (auto& s : stats) {
+            body.append(s.c_str(), s.length() + 1);
+        }
+    } else {
+        ret = xs.store_dir(domid, rx_msg.hdr.tx_id, path, [&body] (const std::string& name) {
+            body.append(name.c_str(), name.length() + 1);
+        });
+    }
 
     if (ret == 0) {
-        tx_queue.push_back({XS_DIRECTORY, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
-                {result.begin(), result.end()}, !result.empty()});
+        tx_queue.emplace_back(XS_DIRECTORY, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
+                std::move(result), false);
+    } else {
+        tx_queue.push_back({XS_ERROR, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
+                {err2str(ret)}, false});
+    }
+}
+
+void xs_proto_base::op_directory_part(void)
+{
+    int ret;
+    char* path;
+    bool done;
+    unsigned int pos;
+    unsigned int offset;
+    unsigned long int gen;
+    std::string start;
+    std::string names;
+    std::set<std::string> stats;
+    children_part_cb cb;
+    std::list<std::string> result(1);
+    std::string& body = result.front();
+
+    path = get_path();
+
+    ret = get_int(get_arg2(), offset);
+    if (ret != 0) {
+        tx_queue.push_back({XS_ERROR, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
+                {err2str(EINVAL)}, false});
+        return;
+    }
+
+    /* The offset is in bytes into the full list of null terminated child names. Unless resuming
+     * from where the previous page stopped, children before the offset have to be skipped.
+     */
+    if (offset != 0 && offset == dir_part.offset
+            && rx_msg.hdr.tx_id == dir_part.tx_id && dir_part.path == path) {
+        start = dir_part.next;
+        pos = offset;
+    } else {
+        pos = 0;
+    }
+
+    done = true;
+    cb = [&] (const std::string& name) {
+        unsigned int skip = 0;
+        unsigned int len = name.length() + 1;
+
+        if (pos < offset) {
+            if (pos + len <= offset) {
+                pos += len;
+                return true;
+            }
+
+            /* An offset might point inside a name, just like it would on the full list. */
+            skip = offset - pos;
+        }
+
+        if (names.length() + len - skip > dir_part_names_max) {
+            dir_part.next = name;
+            done = false;
+            return false;
+        }
+
+        names.append(name.c_str() + skip, len - skip);
+        pos += len;
+
+        return true;
+    };
+
+    if (is_stats_path(path)) {
+        gen = 0;
+        ret = stats_dir(path, stats);
+        if (ret == 0) {
+            for (auto it = stats.lower_bound(start); it != stats.end(); it++) {
+                if (!cb(*it)) {
+                    break;
+                }
+            }
+        }
     } else {
+        ret = xs.store_dir_part(domid, rx_msg.hdr.tx_id, path, start, cb, gen);
+    }
+
+    if (ret != 0) {
         tx_queue.push_back({XS_ERROR, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
                 {err2str(ret)}, false});
+        return;
+    }
+
+    if (done) {
+        dir_part.offset = 0;
+    } else {
+        dir_part.path = path;
+        dir_part.tx_id = rx_msg.hdr.tx_id;
+        dir_part.offset = offset + names.length();
+    }
+
+    /* Reply with the generation, the names and, on the last page, an empty name. */
+    body = std::to_string(gen);
+    body.push_back('\0');
+    body.append(names);
+    if (done) {
+        body.push_back('\0');
     }
+
+    tx_queue.emplace_back(xs_directory_part, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
+            std::move(result), false);
 }
 
 void xs_proto_base::op_read(void)
 {
     int ret;
-    std::string result;
+    char* path;
+    /* Read straight into the reply body, the value is then moved into the queued message. */
+    std::list<std::string> result(1);
+
+    path = get_path();
 
-    ret = xs.store_read(domid, rx_msg.hdr.tx_id, get_path(), result);
+    if (is_stats_path(path)) {
+        ret = stats_read(path, result.front());
+    } else {
+        ret = xs.store_read(domid, rx_msg.hdr.tx_id, path, result.front());
+    }
 
     if (ret == 0) {
-        tx_queue.push_back({XS_READ, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
-                {result}, false});
+        tx_queue.emplace_back(XS_READ, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
+                std::move(result), false);
     } else {
         tx_queue.push_back({XS_ERROR, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
                 {err2str(ret)}, false});
@@ -186,8 +525,15 @@ void xs_proto_base::op_read(void)
 void xs_proto_base::op_write(void)
 {
     int ret;
+    char* path;
+
+    path = get_path();
 
-    ret = xs.store_write(domid, rx_msg.hdr.tx_id, get_path(), get_arg2());
+    if (is_stats_path(path)) {
+        ret = EACCES;
+    } else {
+        ret = xs.store_write(domid, rx_msg.hdr.tx_id, path, get_arg2());
+    }
 
     if (ret == 0) {
         tx_queue.push_back({XS_WRITE, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
@@ -201,8 +547,15 @@ void xs_proto_base::op_write(void)
 void xs_proto_base::op_mkdir(void)
 {
     int ret;
+    char* path;
+
+    path = get_path();
 
-    ret = xs.store_mkdir(domid, rx_msg.hdr.tx_id, get_path());
+    if (is_stats_path(path)) {
+        ret = EACCES;
+    } else {
+        ret = xs.store_mkdir(domid, rx_msg.hdr.tx_id, path);
+    }
 
     if (ret == 0) {
         tx_queue.push_back({XS_MKDIR, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
@@ -216,8 +569,15 @@ void xs_proto_base::op_mkdir(void)
 void xs_proto_base::op_rm(void)
 {
     int ret;
+    char* path;
+
+    path = get_path();
 
-    ret = xs.store_rm(domid, rx_msg.hdr.tx_id, get_path());
+    if (is_stats_path(path)) {
+        ret = EACCES;
+    } else {
+        ret = xs.store_rm(domid, rx_msg.hdr.tx_id, path);
+    }
 
     if (ret == 0) {
         tx_queue.push_back({XS_RM, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
@@ -276,7 +636,11 @@ void xs_proto_base::op_set_perms(void)
         return;
     }
 
-    ret = xs.store_set_perms(domid, rx_msg.hdr.tx_id, path, perms);
+    if (is_stats_path(path)) {
+        ret = EACCES;
+    } else {
+        ret = xs.store_set_perms(domid, rx_msg.hdr.tx_id, path, perms);
+    }
 
     if (ret == 0) {
         tx_queue.push_back({XS_SET_PERMS, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
@@ -287,22 +651,197 @@ void xs_proto_base::op_set_perms(void)
     }
 }
 
+void xs_proto_base::op_batch(void)
+{
+    int ret;
+    std::vector<int> results;
+    std::vector<batch_op> batch;
+    std::list<std::string> result_str;
+
+    if (!parse_batch(batch)) {
+        tx_queue.push_back({XS_ERROR, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
+                {err2str(EINVAL)}, false});
+        return;
+    }
+
+    ret = xs.store_batch(domid, rx_msg.hdr.tx_id, batch, results);
+
+    if (ret == 0) {
+        for (auto& r : results) {
+            result_str.push_back(err2str(r));
+        }
+
+        tx_queue.emplace_back(xs_batch, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
+                std::move(result_str), true);
+    } else {
+        tx_queue.push_back({XS_ERROR, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
+                {err2str(ret)}, false});
+    }
+}
+
+void xs_proto_base::op_clone(void)
+{
+    int ret;
+    char* src;
+    char* dst;
+    char* arg_from;
+    char* arg_to;
+    domid_t from;
+    domid_t to;
+
+    if (domid != 0) {
+        tx_queue.push_back({XS_ERROR, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
+                {err2str(EACCES)}, false});
+        return;
+    }
+
+    src = get_path();
+    dst = get_next_arg(rx_msg.body);
+    arg_from = dst ? get_next_arg(dst) : NULL;
+    arg_to = arg_from ? get_next_arg(arg_from) : NULL;
+
+    if (arg_to == NULL || get_int(arg_from, from) != 0 || get_int(arg_to, to) != 0) {
+        tx_queue.push_back({XS_ERROR, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
+                {err2str(EINVAL)}, false});
+        return;
+    }
+
+    if (is_stats_path(src) || is_stats_path(dst)) {
+        ret = EACCES;
+    } else {
+        ret = xs.store_clone(domid, rx_msg.hdr.tx_id, src, rel2abs(dst), from, to);
+    }
+
+    if (ret == 0) {
+        tx_queue.push_back({xs_clone, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
+                {err2str(ret)}, false});
+    } else {
+        tx_queue.push_back({XS_ERROR, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
+                {err2str(ret)}, false});
+    }
+}
+
+void xs_proto_base::op_read_version(void)
+{
+    int ret;
+    char* path;
+    unsigned long int version;
+    /* Read straight into the reply body, the value is then moved into the queued message. */
+    std::list<std::string> result(2);
+
+    path = get_path();
+
+    if (is_stats_path(path)) {
+        ret = EACCES;
+    } else {
+        ret = xs.store_read(domid, rx_msg.hdr.tx_id, path, result.back(), version);
+    }
+
+    if (ret == 0) {
+        result.front() = std::to_string(version);
+        tx_queue.emplace_back(xs_read_version, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
+                std::move(result), false);
+    } else {
+        tx_queue.push_back({XS_ERROR, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
+                {err2str(ret)}, false});
+    }
+}
+
+void xs_proto_base::op_write_version(void)
+{
+    int ret;
+    char* path;
+    char* value;
+    long int expected;
+    unsigned long int version;
+
+    path = get_path();
+    value = get_next_arg(get_arg2());
+    version = 0;
+
+    if (get_int(get_arg2(), expected) != 0 || expected < 0) {
+        ret = EINVAL;
+    } else if (is_stats_path(path)) {
+        ret = EACCES;
+    } else {
+        version = expected;
+        ret = xs.store_write_if(domid, rx_msg.hdr.tx_id, path, value ? value : "", version);
+    }
+
+    write_if_reply(ret, version);
+}
+
+void xs_proto_base::op_write_match(void)
+{
+    int ret;
+    char* path;
+    char* value;
+    unsigned long int version;
+
+    path = get_path();
+    value = get_next_arg(get_arg2());
+    version = 0;
+
+    if (is_stats_path(path)) {
+        ret = EACCES;
+    } else {
+        ret = xs.store_write_if(domid, rx_msg.hdr.tx_id, path, value ? value : "",
+                get_arg2(), version);
+    }
+
+    write_if_reply(ret, version);
+}
+
+void xs_proto_base::write_if_reply(int ret, unsigned long int version)
+{
+    if (ret == 0) {
+        tx_queue.push_back({rx_msg.hdr.type, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
+                {std::to_string(version)}, true});
+    } else if (ret == EAGAIN) {
+        /* Standard clients only look at the error name, the version follows it. */
+        tx_queue.push_back({XS_ERROR, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
+                {err2str(ret), std::to_string(version)}, true});
+    } else {
+        tx_queue.push_back({XS_ERROR, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
+                {err2str(ret)}, false});
+    }
+}
+
 void xs_proto_base::op_watch(void)
 {
+    int ret;
     char* path;
     char* token;
+    char* flags;
     bool relative;
+    bool with_value;
+    unsigned int depth;
     watch_map::iterator it;
 
     path = get_path();
     token = get_arg2();
+    flags = get_next_arg(token);
     relative = (path != rx_msg.body);
 
+    if (!parse_watch_flags(flags ? flags : "", with_value, depth)) {
+        tx_queue.push_back({XS_ERROR, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
+                {err2str(EINVAL)}, false});
+        return;
+    }
+
     it = watches.find({path, token});
     if (it == watches.end()) {
-        it = watches.insert({{path, token}, {*this, path, token, relative}}).first;
+        it = watches.insert({{path, token},
+                {*this, path, token, relative, with_value, depth}}).first;
+
+        ret = xs.watch_add(it->second);
+        if (ret != 0) {
+            watches.erase(it);
 
-        xs.watch_add(it->second);
+            tx_queue.push_back({XS_ERROR, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
+                    {err2str(ret)}, false});
+            return;
+        }
 
         tx_queue.push_back({XS_WATCH, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
                 {err2str(0)}, false});
@@ -430,6 +969,7 @@ void xs_proto_base::op_release(void)
     ret = dmgr.destroy(domid);
 
     if (ret == 0) {
+        xs.domain_teardown(domid);
         xs.domain_release(domid);
 
         tx_queue.push_back({XS_RELEASE, rx_msg.hdr.req_id, rx_msg.hdr.tx_id,
@@ -489,12 +1029,11 @@ void xs_proto_base::op_unimplemented(void)
 
 bool xs_proto_base::prepare_tx(void)
 {
-    if (tx_queue.empty()) {
+    if (tx_out.empty()) {
         return false;
     }
 
-    message msg = tx_queue.front();
-    tx_queue.pop_front();
+    const message& msg = tx_out.front();
 
     build_hdr(msg.type, msg.req_id, msg.tx_id);
     if (!build_body(msg.body, msg.terminator)) {
@@ -502,6 +1041,76 @@ bool xs_proto_base::prepare_tx(void)
         build_body(err2str(E2BIG), false);
     }
 
+    tx_out.pop_front();
+    tx_pending.fetch_sub(1, std::memory_order_relaxed);
+
+    return true;
+}
+
+bool xs_proto_base::parse_batch(std::vector<batch_op>& batch)
+{
+    char* op;
+    char* arg;
+    char* end;
+    uint32_t len;
+    batch_hdr hdr;
+    permission perm;
+    std::string path;
+
+    batch.clear();
+
+    for (op = rx_msg.body, end = rx_msg.body + rx_msg.hdr.len; op < end; op += len) {
+        if ((uint32_t) (end - op) < sizeof(hdr)) {
+            return false;
+        }
+
+        memcpy(&hdr, op, sizeof(hdr));
+        op += sizeof(hdr);
+        len = hdr.len;
+
+        /* Every sub-request starts with a null terminated path. */
+        if ((uint32_t) (end - op) < len || len == 0 || !memchr(op, '\0', len)) {
+            return false;
+        }
+
+        path = rel2abs(op);
+
+        /* The statistics tree is read-only, batches touching it are rejected. */
+        if (is_stats_path(path)) {
+            return false;
+        }
+
+        arg = op + strlen(op) + 1;
+
+        switch (hdr.type) {
+            case XS_WRITE:
+                batch.emplace_back(batch_type::write, std::move(path));
+                batch.back().value.assign(arg, op + len - arg);
+            break;
+
+            case XS_MKDIR:
+                batch.emplace_back(batch_type::mkdir, std::move(path));
+            break;
+
+            case XS_RM:
+                batch.emplace_back(batch_type::rm, std::move(path));
+            break;
+
+            case XS_SET_PERMS:
+                batch.emplace_back(batch_type::set_perms, std::move(path));
+                for (; arg < op + len; arg += strlen(arg) + 1) {
+                    if (!memchr(arg, '\0', op + len - arg) || !str2perm(arg, perm)) {
+                        return false;
+                    }
+                    batch.back().perms.push_back(perm);
+                }
+            break;
+
+            default:
+                return false;
+        }
+    }
+
     return true;
 }
 
@@ -592,6 +1201,50 @@ std::string xs_proto_base::path2rel(std::string path)
     return path.substr(dom_path.length());
 }
 
+bool xs_proto_base::parse_watch_flags(const char* flags, bool& with_value, unsigned int& depth)
+{
+    size_t end;
+    size_t start;
+    std::string flag;
+    std::string list(flags);
+
+    with_value = false;
+    depth = watch_depth_any;
+
+    for (start = 0; start < list.length(); start = end + 1) {
+        end = list.find(',', start);
+        if (end == std::string::npos) {
+            end = list.length();
+        }
+
+        flag.assign(list, start, end - start);
+
+        if (flag == watch_flag_value) {
+            with_value = true;
+        } else if (flag == watch_flag_exact) {
+            depth = 0;
+        } else if (flag.compare(0, watch_flag_depth.length(), watch_flag_depth) == 0) {
+            if (get_int(flag.c_str() + watch_flag_depth.length(), depth) != 0
+                    || depth == watch_depth_any) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+std::string xs_proto_base::rel2abs(const char* path)
+{
+    if (path[0] == '/' || path[0] == '@') {
+        return path;
+    } else {
+        return dom_path + "/" + path;
+    }
+}
+
 char* xs_proto_base::get_arg1(void)
 {
     return rx_msg.body;
@@ -655,7 +1308,7 @@ void xs_proto_base::build_hdr(uint32_t type, uint32_t req_id, uint32_t tx_id)
     tx_msg.hdr.len = 0;
 }
 
-bool xs_proto_base::build_body(std::string elem, bool terminator)
+bool xs_proto_base::build_body(const std::string& elem, bool terminator)
 {
     if (elem.length() == 0) {
         tx_msg.body[0] = '\0';
@@ -679,7 +1332,7 @@ bool xs_proto_base::build_body(std::string elem, bool terminator)
     return true;
 }
 
-bool xs_proto_base::build_body(std::list<std::string> elems, bool terminator)
+bool xs_proto_base::build_body(const std::list<std::string>& elems, bool terminator)
 {
     char* body;
     uint32_t length;
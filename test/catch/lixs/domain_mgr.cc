@@ -0,0 +1,496 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <catch.hpp>
+
+#include <lixs/domain_mgr.hh>
+#include <lixs/event_mgr.hh>
+#include <lixs/iomux.hh>
+#include <lixs/log/logger.hh>
+#include <lixs/mstore/store.hh>
+#include <lixs/os_linux/dom_exc.hh>
+#include <lixs/os_linux/fake_hypervisor.hh>
+#include <lixs/watch.hh>
+#include <lixs/xenstore.hh>
+#include <lixs/xs_proto_v1/trace.hh>
+
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <poll.h>
+#include <sstream>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include <xen/io/xs_wire.h>
+}
+
+
+/* Minimal poll based iomux, dispatching ready file descriptors on request. */
+class poll_iomux : public lixs::iomux {
+public:
+    poll_iomux(lixs::event_mgr& emgr)
+        : iomux(emgr)
+    { }
+
+public:
+    void add(int fd, bool read, bool write, lixs::io_cb cb)
+    {
+        fds[fd] = { read, write, cb };
+    }
+
+    void set(int fd, bool read, bool write)
+    {
+        fds[fd].read = read;
+        fds[fd].write = write;
+    }
+
+    void rem(int fd)
+    {
+        fds.erase(fd);
+    }
+
+    void dispatch(void)
+    {
+        std::vector<struct pollfd> pfds;
+
+        for (auto& f : fds) {
+            pfds.push_back({ f.first, (short) ((f.second.read ? POLLIN : 0) |
+                        (f.second.write ? POLLOUT : 0)), 0 });
+        }
+
+        REQUIRE( poll(pfds.data(), pfds.size(), 0) >= 0 );
+
+        for (auto& p : pfds) {
+            if (p.revents != 0 && fds.find(p.fd) != fds.end()) {
+                fds[p.fd].cb(p.revents & POLLIN, p.revents & POLLOUT,
+                        p.revents & (POLLERR | POLLHUP));
+            }
+        }
+
+        emgr.run();
+    }
+
+private:
+    struct fd_state {
+        bool read;
+        bool write;
+        lixs::io_cb cb;
+    };
+
+    std::map<int, fd_state> fds;
+};
+
+static void guest_send(xenstore_domain_interface* ring,
+        uint32_t type, uint32_t req_id, const std::string& body)
+{
+    struct xsd_sockmsg hdr = { type, req_id, 0, (uint32_t) body.length() };
+    std::string msg = std::string((char*) &hdr, sizeof(hdr)) + body;
+
+    for (char c : msg) {
+        ring->req[MASK_XENSTORE_IDX(ring->req_prod)] = c;
+        ring->req_prod++;
+    }
+}
+
+static std::string guest_recv(xenstore_domain_interface* ring, struct xsd_sockmsg& hdr)
+{
+    std::string msg;
+
+    while (ring->rsp_cons != ring->rsp_prod) {
+        msg.push_back(ring->rsp[MASK_XENSTORE_IDX(ring->rsp_cons)]);
+        ring->rsp_cons++;
+    }
+
+    REQUIRE( msg.length() >= sizeof(hdr) );
+    memcpy(&hdr, msg.data(), sizeof(hdr));
+
+    return msg.substr(sizeof(hdr));
+}
+
+/* Responses larger than the ring are collected over as many notifications as needed. */
+static std::string guest_request(lixs::os_linux::fake_hypervisor& hv, poll_iomux& io,
+        domid_t domid, uint32_t type, const std::string& body, struct xsd_sockmsg& hdr)
+{
+    std::string msg;
+    xenstore_domain_interface* ring = hv.guest_ring(domid);
+
+    guest_send(ring, type, 1, body);
+
+    for (int i = 0; i < 16; i++) {
+        REQUIRE( hv.guest_notify(domid) == 0 );
+        io.dispatch();
+
+        while (ring->rsp_cons != ring->rsp_prod) {
+            msg.push_back(ring->rsp[MASK_XENSTORE_IDX(ring->rsp_cons)]);
+            ring->rsp_cons++;
+        }
+
+        if (msg.length() >= sizeof(hdr)) {
+            memcpy(&hdr, msg.data(), sizeof(hdr));
+
+            if (msg.length() >= sizeof(hdr) + hdr.len) {
+                break;
+            }
+        }
+    }
+
+    REQUIRE( msg.length() >= sizeof(hdr) );
+    REQUIRE( msg.length() == sizeof(hdr) + hdr.len );
+
+    /* Drop the string terminator. */
+    msg.resize(msg.find_last_not_of('\0') + 1);
+
+    return msg.substr(sizeof(hdr));
+}
+
+static std::vector<std::vector<std::string> > debug_lines(const std::string& body)
+{
+    std::string line;
+    std::string field;
+    std::istringstream lines(body);
+    std::vector<std::vector<std::string> > out;
+
+    while (std::getline(lines, line)) {
+        std::istringstream fields(line);
+
+        out.push_back(std::vector<std::string>());
+        while (fields >> field) {
+            out.back().push_back(field);
+        }
+    }
+
+    return out;
+}
+
+class silent_watch : public lixs::watch_cb {
+public:
+    silent_watch(const std::string& path)
+        : watch_cb(path, "token", false, lixs::watch_depth_any)
+    { }
+
+public:
+    void operator()(const std::string& path) { }
+    void operator()(const std::string& path, const lixs::watch_value& value) { }
+};
+
+
+TEST_CASE( "Domain lifecycle on the fake hypervisor", "[domain_mgr]" ) {
+    bool exists;
+    evtchn_port_t port;
+    unsigned int mfn;
+
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::event_mgr emgr;
+    poll_iomux io(emgr);
+    lixs::os_linux::fake_hypervisor hv;
+    lixs::mstore::store store(log);
+    lixs::xenstore xs(store, emgr, io);
+    lixs::xs_proto_v1::trace_writer trace;
+    lixs::domain_mgr dmgr(xs, emgr, io, hv, trace, log);
+    lixs::os_linux::dom_exc dom_exc(xs, dmgr, emgr, io, hv);
+
+    emgr.enable();
+
+    REQUIRE( hv.create_domain(1, port, mfn) == 0 );
+    REQUIRE( dmgr.create(1, port, mfn) == 0 );
+
+    {
+        INFO( "The store notifies the guest once the ring is connected" );
+        REQUIRE( hv.guest_notifications(1) == 1 );
+    }
+
+    SECTION( "Request over the ring" ) {
+        struct xsd_sockmsg hdr;
+        xenstore_domain_interface* ring = hv.guest_ring(1);
+
+        guest_send(ring, XS_GET_DOMAIN_PATH, 7, std::string("1\0", 2));
+        REQUIRE( hv.guest_notify(1) == 0 );
+
+        io.dispatch();
+
+        std::string body = guest_recv(ring, hdr);
+        REQUIRE( hdr.type == XS_GET_DOMAIN_PATH );
+        REQUIRE( hdr.req_id == 7 );
+        REQUIRE( body == "/local/domain/1" );
+        REQUIRE( hv.guest_notifications(1) > 1 );
+    }
+
+    SECTION( "Guests can't read statistics" ) {
+        struct xsd_sockmsg hdr;
+        xenstore_domain_interface* ring = hv.guest_ring(1);
+
+        guest_send(ring, XS_READ, 1, std::string("@stats/domains/0/queue\0", 23));
+        REQUIRE( hv.guest_notify(1) == 0 );
+        io.dispatch();
+
+        REQUIRE( guest_recv(ring, hdr) == "EACCES" );
+        REQUIRE( hdr.type == XS_ERROR );
+
+        guest_send(ring, XS_DIRECTORY, 2, std::string("@stats\0", 7));
+        REQUIRE( hv.guest_notify(1) == 0 );
+        io.dispatch();
+
+        REQUIRE( guest_recv(ring, hdr) == "EACCES" );
+        REQUIRE( hdr.type == XS_ERROR );
+    }
+
+    SECTION( "Shutdown keeps the domain until it's destroyed" ) {
+        REQUIRE( hv.shutdown_domain(1, false) == 0 );
+        io.dispatch();
+
+        dmgr.exists(1, exists);
+        REQUIRE( exists == true );
+
+        REQUIRE( hv.destroy_domain(1) == 0 );
+        io.dispatch();
+
+        dmgr.exists(1, exists);
+        REQUIRE( exists == false );
+
+        {
+            INFO( "The domain id can be reused once the store released the ring" );
+            REQUIRE( hv.create_domain(1, port, mfn) == 0 );
+        }
+    }
+
+    SECTION( "Destroyed domains lose their watches and entries" ) {
+        std::string val;
+        lixs::xenstore_stats stats;
+        xenstore_domain_interface* ring = hv.guest_ring(1);
+
+        REQUIRE( store.update(0, 0, "/local/domain/1/name", "guest") == 0 );
+        REQUIRE( store.update(0, 0, "/local/domain/1/data/key", "value") == 0 );
+        REQUIRE( store.set_perms(0, 0, "/local/domain/1/data",
+                    { lixs::permission(1, false, false) }) == 0 );
+
+        guest_send(ring, XS_WATCH, 1, std::string("/local/domain/1/data\0a\0", 23));
+        guest_send(ring, XS_WATCH, 2, std::string("/local/domain/1/data/key\0b\0", 27));
+        REQUIRE( hv.guest_notify(1) == 0 );
+        io.dispatch();
+
+        xs.get_stats(stats);
+        REQUIRE( stats.watches == 2 );
+
+        REQUIRE( hv.destroy_domain(1) == 0 );
+        io.dispatch();
+
+        xs.get_stats(stats);
+        REQUIRE( stats.watches == 0 );
+
+        REQUIRE( store.read(0, 0, "/local/domain/1/data/key", val) == ENOENT );
+        REQUIRE( store.read(0, 0, "/local/domain/1/name", val) == 0 );
+    }
+
+    SECTION( "Dying domains are released" ) {
+        REQUIRE( hv.kill_domain(1) == 0 );
+        io.dispatch();
+
+        dmgr.exists(1, exists);
+        REQUIRE( exists == false );
+    }
+
+    SECTION( "Bursts of domain exceptions are handled by a single scan" ) {
+        unsigned long int queries;
+
+        for (domid_t d = 2; d <= 600; d++) {
+            REQUIRE( hv.create_domain(d, port, mfn) == 0 );
+            REQUIRE( dmgr.create(d, port, mfn) == 0 );
+        }
+
+        /* Domains unknown to the store are skipped over. */
+        REQUIRE( hv.create_domain(1000, port, mfn) == 0 );
+
+        queries = hv.domain_queries();
+
+        REQUIRE( hv.destroy_domain(1) == 0 );
+        dom_exc.callback(true, false, false);
+        REQUIRE( hv.kill_domain(300) == 0 );
+        dom_exc.callback(true, false, false);
+        REQUIRE( hv.destroy_domain(600) == 0 );
+        dom_exc.callback(true, false, false);
+
+        emgr.run();
+
+        {
+            INFO( "Domain info is fetched in batches, not per domain or per VIRQ" );
+            REQUIRE( hv.domain_queries() - queries <= 3 );
+        }
+
+        dmgr.exists(1, exists);
+        REQUIRE( exists == false );
+        dmgr.exists(300, exists);
+        REQUIRE( exists == false );
+        dmgr.exists(600, exists);
+        REQUIRE( exists == false );
+        dmgr.exists(599, exists);
+        REQUIRE( exists == true );
+    }
+
+    SECTION( "Introducing an unknown domain fails" ) {
+        REQUIRE( dmgr.create(2, port, mfn) == ECANCELED );
+
+        dmgr.exists(2, exists);
+        REQUIRE( exists == false );
+    }
+}
+
+
+TEST_CASE( "Debug requests over the ring", "[domain_mgr][debug]" ) {
+    struct xsd_sockmsg hdr;
+    evtchn_port_t port;
+    unsigned int mfn;
+    std::string body;
+    std::vector<std::vector<std::string> > lines;
+    std::vector<std::unique_ptr<silent_watch> > watches;
+
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::event_mgr emgr;
+    poll_iomux io(emgr);
+    lixs::os_linux::fake_hypervisor hv;
+    lixs::mstore::store store(log);
+    lixs::xenstore xs(store, emgr, io);
+    lixs::xs_proto_v1::trace_writer trace;
+    lixs::domain_mgr dmgr(xs, emgr, io, hv, trace, log);
+
+    emgr.enable();
+
+    REQUIRE( hv.create_domain(0, port, mfn) == 0 );
+    REQUIRE( dmgr.create(0, port, mfn) == 0 );
+    REQUIRE( hv.create_domain(1, port, mfn) == 0 );
+    REQUIRE( dmgr.create(1, port, mfn) == 0 );
+
+    SECTION( "Only dom0 can debug" ) {
+        body = guest_request(hv, io, 1, XS_DEBUG, std::string("connections\0", 12), hdr);
+        REQUIRE( hdr.type == XS_ERROR );
+        REQUIRE( body == "EACCES" );
+    }
+
+    SECTION( "Unknown sub-commands are rejected" ) {
+        body = guest_request(hv, io, 0, XS_DEBUG, std::string("bogus\0", 6), hdr);
+        REQUIRE( hdr.type == XS_ERROR );
+        REQUIRE( body == "EINVAL" );
+
+        body = guest_request(hv, io, 0, XS_DEBUG, std::string("watches\0x\0", 10), hdr);
+        REQUIRE( hdr.type == XS_ERROR );
+        REQUIRE( body == "EINVAL" );
+    }
+
+    SECTION( "Connections list every connection" ) {
+        body = guest_request(hv, io, 0, XS_DEBUG, std::string("connections\0", 12), hdr);
+        REQUIRE( hdr.type == XS_DEBUG );
+
+        lines = debug_lines(body);
+        REQUIRE( lines.size() == 2 );
+
+        for (unsigned int i = 0; i < lines.size(); i++) {
+            REQUIRE( lines[i].size() == 6 );
+            REQUIRE( lines[i][1] == std::to_string(i) );
+            REQUIRE( lines[i][2] == "0" );
+            REQUIRE( lines[i][5] == "0" );
+        }
+
+        {
+            INFO( "The requesting connection is done reading" );
+            REQUIRE( lines[0][3] == "idle" );
+            REQUIRE( lines[0][4] == "0" );
+        }
+
+        body = guest_request(hv, io, 0, XS_DEBUG, std::string("connections\0" "1\0", 14), hdr);
+        lines = debug_lines(body);
+        REQUIRE( lines.size() == 1 );
+        REQUIRE( lines[0][1] == "1" );
+    }
+
+    SECTION( "Watches are ranked and paged" ) {
+        char path[16];
+
+        for (int i = 0; i < 256; i++) {
+            snprintf(path, sizeof(path), "/w/%03d", i);
+            watches.emplace_back(new silent_watch(path));
+        }
+        watches.emplace_back(new silent_watch("/w/100"));
+
+        for (auto& w : watches) {
+            xs.watch_add(*w);
+        }
+
+        body = guest_request(hv, io, 0, XS_DEBUG, std::string("watches\0", 8), hdr);
+        REQUIRE( hdr.type == XS_DEBUG );
+
+        lines = debug_lines(body);
+        REQUIRE( lines.front() == std::vector<std::string>({ "/w/100", "2", "0" }) );
+        REQUIRE( lines[1] == std::vector<std::string>({ "/w/000", "1", "0" }) );
+
+        {
+            INFO( "An exactly full last page has no next page" );
+            REQUIRE( lines.size() == 256 );
+            REQUIRE( lines.back() == std::vector<std::string>({ "/w/255", "1", "0" }) );
+        }
+
+        watches.emplace_back(new silent_watch("/w/256"));
+        xs.watch_add(*watches.back());
+
+        body = guest_request(hv, io, 0, XS_DEBUG, std::string("watches\0", 8), hdr);
+        lines = debug_lines(body);
+        REQUIRE( lines.size() == 257 );
+        REQUIRE( lines.back() == std::vector<std::string>({ "more", "watches", "256" }) );
+
+        body = guest_request(hv, io, 0, XS_DEBUG, std::string("watches\0" "256\0", 12), hdr);
+        lines = debug_lines(body);
+        REQUIRE( lines.size() == 1 );
+        REQUIRE( lines[0] == std::vector<std::string>({ "/w/256", "1", "0" }) );
+
+        {
+            INFO( "Watches that go away leave the ranking" );
+            xs.watch_del(*watches[256]);
+            xs.watch_del(*watches[257]);
+
+            body = guest_request(hv, io, 0, XS_DEBUG, std::string("watches\0", 8), hdr);
+            lines = debug_lines(body);
+            REQUIRE( lines.size() == 256 );
+            REQUIRE( lines[100] == std::vector<std::string>({ "/w/100", "1", "0" }) );
+            REQUIRE( lines.back() == std::vector<std::string>({ "/w/255", "1", "0" }) );
+        }
+
+        watches.resize(256);
+        for (auto& w : watches) {
+            xs.watch_del(*w);
+        }
+    }
+}
@@ -0,0 +1,261 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <catch.hpp>
+
+#include <lixs/event_mgr.hh>
+#include <lixs/iomux.hh>
+#include <lixs/os_linux/epoll.hh>
+#include <lixs/os_linux/io_uring.hh>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+
+
+static void run_passes(lixs::event_mgr& emgr, int passes)
+{
+    std::function<void(void)> tick;
+
+    tick = [&] () {
+        if (--passes == 0) {
+            emgr.disable();
+        } else {
+            emgr.enqueue_event(tick);
+        }
+    };
+
+    emgr.enqueue_event(tick);
+    emgr.enable();
+    emgr.run();
+}
+
+TEST_CASE( "Edge triggered epoll", "[iomux]" ) {
+    lixs::event_mgr emgr;
+    lixs::os_linux::epoll io(emgr, true);
+    int pfd[2];
+    int reads = 0;
+
+    REQUIRE( pipe(pfd) == 0 );
+
+    io.add(pfd[0], false, false, [&] (bool read, bool write, bool error) {
+        REQUIRE( read );
+        REQUIRE( !write );
+        REQUIRE( !error );
+        reads++;
+    });
+
+    REQUIRE( write(pfd[1], "x", 1) == 1 );
+    run_passes(emgr, 3);
+
+    /* Readiness is kept until there is interest in it */
+    REQUIRE( reads == 0 );
+
+    io.set(pfd[0], true, false);
+    run_passes(emgr, 3);
+
+    /* And reported once, even if not drained */
+    REQUIRE( reads == 1 );
+
+    io.set(pfd[0], false, false);
+    io.set(pfd[0], true, false);
+    run_passes(emgr, 3);
+
+    REQUIRE( reads == 1 );
+
+    REQUIRE( write(pfd[1], "x", 1) == 1 );
+    run_passes(emgr, 3);
+
+    REQUIRE( reads == 2 );
+
+    io.rem(pfd[0]);
+    close(pfd[0]);
+    close(pfd[1]);
+}
+
+TEST_CASE( "Stream sockets on io_uring", "[iomux]" ) {
+    lixs::event_mgr emgr;
+    std::unique_ptr<lixs::os_linux::io_uring> io;
+    int sv[2];
+
+    try {
+        io.reset(new lixs::os_linux::io_uring(emgr));
+    } catch (lixs::os_linux::io_uring_error& e) {
+        WARN( "io_uring unavailable: " << e.what() );
+        return;
+    }
+
+    lixs::stream_io* sio = io->get_stream_io();
+    REQUIRE( sio != NULL );
+    REQUIRE( socketpair(AF_UNIX, SOCK_STREAM, 0, sv) == 0 );
+
+    std::string data;
+    for (int i = 0; i < 100000; i++) {
+        data.push_back('a' + i % 26);
+    }
+
+    std::string received;
+    int closed = 1;
+    int queued = -1;
+
+    sio->attach(sv[0],
+            [&] (const char* buff, int len) {
+                if (len > 0) {
+                    received.append(buff, len);
+                } else {
+                    closed = len;
+                    emgr.disable();
+                }
+
+                if (received.size() == data.size()) {
+                    emgr.disable();
+                }
+            },
+            [&] (int n) {
+                queued = n;
+                if (n <= 0) {
+                    emgr.disable();
+                }
+            });
+
+    SECTION( "Receive" ) {
+        ssize_t written;
+        std::thread peer([&] () {
+            written = write(sv[1], data.data(), data.size());
+        });
+
+        emgr.enable();
+        emgr.run();
+        peer.join();
+
+        REQUIRE( written == ssize_t(data.size()) );
+        REQUIRE( received == data );
+        REQUIRE( closed == 1 );
+
+        close(sv[1]);
+        emgr.enable();
+        emgr.run();
+
+        REQUIRE( closed == 0 );
+    }
+
+    SECTION( "Send" ) {
+        std::string peer_received;
+        std::thread peer([&] () {
+            char buff[4096];
+            ssize_t len;
+
+            while (peer_received.size() < data.size()
+                    && (len = read(sv[1], buff, sizeof(buff))) > 0) {
+                peer_received.append(buff, len);
+            }
+        });
+
+        for (std::string::size_type i = 0; i < data.size(); i += 1000) {
+            sio->send(sv[0], data.data() + i, 1000);
+        }
+
+        emgr.enable();
+        emgr.run();
+        peer.join();
+
+        REQUIRE( queued == 0 );
+        REQUIRE( peer_received == data );
+
+        close(sv[1]);
+    }
+
+    SECTION( "No callbacks after removal" ) {
+        io->rem(sv[0]);
+
+        REQUIRE( write(sv[1], data.data(), 1000) == 1000 );
+        close(sv[1]);
+
+        emgr.enqueue_event(std::bind(&lixs::event_mgr::disable, &emgr));
+        emgr.enable();
+        emgr.run();
+
+        REQUIRE( received.empty() );
+        REQUIRE( closed == 1 );
+    }
+
+    close(sv[0]);
+}
+
+TEST_CASE( "Generic fds on io_uring", "[iomux]" ) {
+    lixs::event_mgr emgr;
+    std::unique_ptr<lixs::os_linux::io_uring> io;
+    int pfd[2];
+    int reads = 0;
+
+    try {
+        io.reset(new lixs::os_linux::io_uring(emgr));
+    } catch (lixs::os_linux::io_uring_error& e) {
+        WARN( "io_uring unavailable: " << e.what() );
+        return;
+    }
+
+    REQUIRE( pipe(pfd) == 0 );
+
+    io->add(pfd[0], true, false, [&] (bool read, bool write, bool error) {
+        char c;
+
+        REQUIRE( read );
+        REQUIRE( !write );
+        REQUIRE( !error );
+
+        /* Level triggered: reported until drained */
+        if (++reads == 3) {
+            REQUIRE( ::read(pfd[0], &c, 1) == 1 );
+            io->set(pfd[0], false, false);
+            emgr.disable();
+        }
+    });
+
+    REQUIRE( write(pfd[1], "x", 1) == 1 );
+
+    emgr.enable();
+    emgr.run();
+
+    REQUIRE( reads == 3 );
+
+    io->rem(pfd[0]);
+    close(pfd[0]);
+    close(pfd[1]);
+}
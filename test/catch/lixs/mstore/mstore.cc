@@ -37,8 +37,12 @@
 #include <catch.hpp>
 
 #include <lixs/log/logger.hh>
+#include <lixs/mstore/read_view.hh>
 #include <lixs/mstore/store.hh>
 
+#include <atomic>
+#include <thread>
+
 
 TEST_CASE( "Basic CRUD operations", "[mstore]" ) {
     lixs::log::logger log(lixs::log::level::OFF);
@@ -275,3 +279,762 @@ TEST_CASE( "Conflicting transactions", "[mstore][transactions]" ) {
         REQUIRE( success == false );
     }
 }
+
+TEST_CASE( "Store statistics", "[mstore][stats]" ) {
+    bool created;
+    bool success;
+    unsigned int tid;
+    lixs::store_stats stats;
+
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::mstore::store store(log);
+
+
+    /* The root entry is stored with an empty path and value. */
+    REQUIRE( store.create(0, 0, "/", created) == 0 );
+    REQUIRE( store.update(0, 0, "/test", "v1") == 0 );
+    REQUIRE( store.update(0, 0, "/test/1", "value") == 0 );
+
+    store.get_stats(stats);
+    REQUIRE( stats.nodes == 3 );
+    REQUIRE( stats.bytes == std::string("/test" "v1" "/test/1" "value").length() );
+
+    REQUIRE( store.update(0, 0, "/test/1", "v") == 0 );
+
+    store.get_stats(stats);
+    REQUIRE( stats.bytes == std::string("/test" "v1" "/test/1" "v").length() );
+
+    store.branch(tid);
+    REQUIRE( store.create(0, tid, "/test/2", created) == 0 );
+
+    store.get_stats(stats);
+    INFO( "Entries created inside a transaction only count after merging" );
+    REQUIRE( stats.nodes == 3 );
+    REQUIRE( stats.transactions == 1 );
+
+    REQUIRE( store.merge(tid, success) == 0 );
+    REQUIRE( success == true );
+
+    store.get_stats(stats);
+    REQUIRE( stats.nodes == 4 );
+    REQUIRE( stats.transactions == 0 );
+
+    REQUIRE( store.del(0, 0, "/test") == 0 );
+
+    store.get_stats(stats);
+    REQUIRE( stats.nodes == 1 );
+    REQUIRE( stats.bytes == 0 );
+}
+
+TEST_CASE( "Store usage inspection", "[mstore][stats]" ) {
+    std::string next;
+    std::list<lixs::store_usage> usage;
+    std::list<lixs::store_usage>::iterator it;
+
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::mstore::store store(log);
+
+
+    REQUIRE( store.update(0, 0, "/a/1", "value") == 0 );
+    REQUIRE( store.update(0, 0, "/a/2", "v") == 0 );
+    REQUIRE( store.update(0, 0, "/a-b", "") == 0 );
+    REQUIRE( store.update(0, 0, "/b", "") == 0 );
+
+    REQUIRE( store.get_usage("/c", "", 10, usage, next) == ENOENT );
+
+    REQUIRE( store.get_usage("/", "", 10, usage, next) == 0 );
+    REQUIRE( next == "" );
+
+    INFO( "Children are reported in runs of consecutive entries" );
+    REQUIRE( usage.size() == 4 );
+    it = usage.begin();
+    REQUIRE( it->name == "a" );
+    REQUIRE( it->nodes == 1 );
+    it++;
+    REQUIRE( it->name == "a-b" );
+    it++;
+    REQUIRE( it->name == "a" );
+    REQUIRE( it->nodes == 2 );
+    REQUIRE( it->bytes == std::string("/a/1" "value" "/a/2" "v").length() );
+    it++;
+    REQUIRE( it->name == "b" );
+
+    INFO( "Inspection is bounded and can be resumed" );
+    REQUIRE( store.get_usage("/", "", 2, usage, next) == 0 );
+    REQUIRE( usage.size() == 2 );
+    REQUIRE( next == "/a-b" );
+
+    REQUIRE( store.get_usage("/", next, 2, usage, next) == 0 );
+    REQUIRE( usage.size() == 1 );
+    REQUIRE( usage.front().nodes == 2 );
+    REQUIRE( next == "/a/2" );
+
+    REQUIRE( store.get_usage("/", next, 2, usage, next) == 0 );
+    REQUIRE( usage.size() == 1 );
+    REQUIRE( usage.front().name == "b" );
+    REQUIRE( next == "" );
+}
+
+TEST_CASE( "Domain quotas", "[mstore][quota]" ) {
+    bool created;
+    bool success;
+    unsigned int tid;
+    std::string val;
+    lixs::owner_stats stats;
+    lixs::permission_list dom1 = { {1, false, false} };
+    lixs::permission_list dom2 = { {2, false, false} };
+
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::mstore::store store(log);
+
+
+    REQUIRE( store.update(0, 0, "/local/domain/1", "") == 0 );
+    REQUIRE( store.set_perms(0, 0, "/local/domain/1", dom1) == 0 );
+
+    store.get_owner_stats(1, stats);
+    REQUIRE( stats.nodes == 1 );
+    REQUIRE( stats.bytes == std::string("/local/domain/1").length() );
+
+    store.set_quota(4, 128);
+
+    SECTION( "Usage follows every change" ) {
+        REQUIRE( store.update(1, 0, "/local/domain/1/a", "value") == 0 );
+
+        store.get_owner_stats(1, stats);
+        REQUIRE( stats.nodes == 2 );
+        REQUIRE( stats.bytes == std::string("/local/domain/1"
+                    "/local/domain/1/a" "value").length() );
+
+        REQUIRE( store.del(1, 0, "/local/domain/1/a") == 0 );
+
+        store.get_owner_stats(1, stats);
+        REQUIRE( stats.nodes == 1 );
+        REQUIRE( stats.bytes == std::string("/local/domain/1").length() );
+
+        INFO( "Changing the owner moves the usage" );
+        REQUIRE( store.set_perms(0, 0, "/local/domain/1", dom2) == 0 );
+
+        store.get_owner_stats(1, stats);
+        REQUIRE( stats.nodes == 0 );
+        REQUIRE( stats.bytes == 0 );
+
+        store.get_owner_stats(2, stats);
+        REQUIRE( stats.nodes == 1 );
+    }
+
+    SECTION( "Guests can't go over quota" ) {
+        REQUIRE( store.update(1, 0, "/local/domain/1/a", "") == 0 );
+
+        INFO( "Missing parents count towards the quota" );
+        REQUIRE( store.update(1, 0, "/local/domain/1/b/c/d", "") == ENOSPC );
+        REQUIRE( store.read(1, 0, "/local/domain/1/b", val) == ENOENT );
+
+        REQUIRE( store.create(1, 0, "/local/domain/1/b", created) == 0 );
+        REQUIRE( store.create(1, 0, "/local/domain/1/c", created) == 0 );
+        REQUIRE( store.create(1, 0, "/local/domain/1/d", created) == ENOSPC );
+
+        REQUIRE( store.update(1, 0, "/local/domain/1/a", std::string(100, 'x')) == ENOSPC );
+        REQUIRE( store.read(1, 0, "/local/domain/1/a", val) == 0 );
+        REQUIRE( val == "" );
+
+        INFO( "Shrinking and deleting entries is always allowed" );
+        REQUIRE( store.update(1, 0, "/local/domain/1/a", "") == 0 );
+        REQUIRE( store.del(1, 0, "/local/domain/1/c") == 0 );
+        REQUIRE( store.create(1, 0, "/local/domain/1/d", created) == 0 );
+
+        INFO( "Dom0 is not limited" );
+        REQUIRE( store.create(0, 0, "/local/domain/1/e", created) == 0 );
+
+        store.get_owner_stats(1, stats);
+        REQUIRE( stats.nodes == 5 );
+    }
+
+    SECTION( "Guests can't give entries away" ) {
+        lixs::permission_list escape = { {0, false, false}, {1, true, true} };
+        lixs::permission_list shared = { {1, false, false}, {2, true, false} };
+
+        REQUIRE( store.update(1, 0, "/local/domain/1/a", "") == 0 );
+        REQUIRE( store.set_perms(1, 0, "/local/domain/1/a", escape) == EACCES );
+        REQUIRE( store.set_perms(1, 0, "/local/domain/1/a", shared) == 0 );
+
+        store.branch(tid);
+        REQUIRE( store.set_perms(1, tid, "/local/domain/1/a", escape) == EACCES );
+        REQUIRE( store.abort(tid) == 0 );
+
+        INFO( "Entries created below still count towards the guest's quota" );
+        REQUIRE( store.create(1, 0, "/local/domain/1/a/b", created) == 0 );
+        REQUIRE( store.create(1, 0, "/local/domain/1/a/c", created) == 0 );
+        REQUIRE( store.create(1, 0, "/local/domain/1/a/d", created) == ENOSPC );
+    }
+
+    SECTION( "Transactions are checked when merged" ) {
+        store.branch(tid);
+        REQUIRE( store.create(1, tid, "/local/domain/1/a", created) == 0 );
+        REQUIRE( store.create(1, tid, "/local/domain/1/b", created) == 0 );
+        REQUIRE( store.create(1, tid, "/local/domain/1/c", created) == 0 );
+        REQUIRE( store.create(1, tid, "/local/domain/1/d", created) == 0 );
+
+        REQUIRE( store.merge(tid, success) == ENOSPC );
+        REQUIRE( success == false );
+        REQUIRE( store.read(1, 0, "/local/domain/1/a", val) == ENOENT );
+
+        store.get_owner_stats(1, stats);
+        REQUIRE( stats.nodes == 1 );
+
+        store.branch(tid);
+        REQUIRE( store.create(1, tid, "/local/domain/1/a", created) == 0 );
+        REQUIRE( store.merge(tid, success) == 0 );
+        REQUIRE( success == true );
+
+        store.get_owner_stats(1, stats);
+        REQUIRE( stats.nodes == 2 );
+    }
+}
+
+TEST_CASE( "Delete entries owned by a domain", "[mstore]" ) {
+    std::string val;
+    std::set<std::string> children;
+    std::list<std::string> removed;
+    lixs::store_stats stats;
+
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::mstore::store store(log);
+
+    lixs::permission_list dom1 = { lixs::permission(1, false, false) };
+    lixs::permission_list dom0 = { lixs::permission(0, false, false) };
+
+    REQUIRE( store.update(0, 0, "/local/domain/1/name", "guest") == 0 );
+    REQUIRE( store.update(0, 0, "/local/domain/1/device/vif/0/state", "4") == 0 );
+    REQUIRE( store.set_perms(0, 0, "/local/domain/1/device", dom1) == 0 );
+    REQUIRE( store.set_perms(0, 0, "/local/domain/1/device/vif", dom1) == 0 );
+    REQUIRE( store.set_perms(0, 0, "/local/domain/1/device/vif/0", dom1) == 0 );
+    REQUIRE( store.update(0, 0, "/local/domain/1/device-misc", "") == 0 );
+    REQUIRE( store.set_perms(0, 0, "/local/domain/1/device-misc", dom1) == 0 );
+    REQUIRE( store.update(0, 0, "/local/domain/1/control/shutdown", "") == 0 );
+    REQUIRE( store.set_perms(0, 0, "/local/domain/1/control/shutdown", dom1) == 0 );
+    REQUIRE( store.update(0, 0, "/local/domain/10/name", "other") == 0 );
+    REQUIRE( store.set_perms(0, 0, "/local/domain/10/name", dom1) == 0 );
+
+    REQUIRE( store.del_owned(1, "/local/domain/2", removed) == ENOENT );
+
+    REQUIRE( store.del_owned(1, "/local/domain/1", removed) == 0 );
+
+    INFO( "Only the roots of the removed subtrees are reported" );
+    REQUIRE( removed == std::list<std::string>({ "/local/domain/1/control/shutdown",
+                "/local/domain/1/device", "/local/domain/1/device-misc" }) );
+
+    INFO( "Subtrees interleaving with siblings are removed entirely" );
+    REQUIRE( store.read(0, 0, "/local/domain/1/device/vif/0/state", val) == ENOENT );
+    REQUIRE( store.read(0, 0, "/local/domain/1/device", val) == ENOENT );
+    REQUIRE( store.read(0, 0, "/local/domain/1/device-misc", val) == ENOENT );
+
+    INFO( "Entries owned by others are kept, as well as other domains' paths" );
+    REQUIRE( store.read(0, 0, "/local/domain/1/name", val) == 0 );
+    REQUIRE( store.read(0, 0, "/local/domain/1/control", val) == 0 );
+    REQUIRE( store.read(0, 0, "/local/domain/10/name", val) == 0 );
+
+    REQUIRE( store.get_children(0, 0, "/local/domain/1", children) == 0 );
+    REQUIRE( children == std::set<std::string>({ "control", "name" }) );
+    REQUIRE( store.get_children(0, 0, "/local/domain/1/control", children) == 0 );
+    REQUIRE( children.empty() );
+
+    store.get_stats(stats);
+    /* "", local, domain, 1, 1/name, 1/control, 10, 10/name */
+    REQUIRE( stats.nodes == 8 );
+}
+
+TEST_CASE( "Delete subtrees", "[mstore]" ) {
+    bool created;
+    bool success;
+    unsigned int tid;
+    std::string val;
+    std::set<std::string> children;
+    lixs::store_stats stats;
+
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::mstore::store store(log);
+
+
+    REQUIRE( store.create(0, 0, "/", created) == 0 );
+    REQUIRE( store.update(0, 0, "/a/b/c/d", "v") == 0 );
+    REQUIRE( store.update(0, 0, "/a/b/e", "v") == 0 );
+    REQUIRE( store.update(0, 0, "/a/b-x", "v") == 0 );
+
+    SECTION( "Delete outside transaction" ) {
+        REQUIRE( store.del(0, 0, "/a/b") == 0 );
+
+        REQUIRE( store.read(0, 0, "/a/b", val) == ENOENT );
+        REQUIRE( store.read(0, 0, "/a/b/c/d", val) == ENOENT );
+        REQUIRE( store.read(0, 0, "/a/b/e", val) == ENOENT );
+        REQUIRE( store.read(0, 0, "/a/b-x", val) == 0 );
+
+        REQUIRE( store.get_children(0, 0, "/a", children) == 0 );
+        REQUIRE( children == std::set<std::string>({ "b-x" }) );
+
+        store.get_stats(stats);
+        REQUIRE( stats.nodes == 3 );
+        REQUIRE( stats.bytes == std::string("/a" "/a/b-x" "v").length() );
+    }
+
+    SECTION( "Delete outside transaction entries referenced by a transaction" ) {
+        REQUIRE( store.get_children(0, 0, "/a/b/c", children) == 0 );
+
+        store.branch(tid);
+        REQUIRE( store.read(0, tid, "/a/b/c/d", val) == 0 );
+
+        REQUIRE( store.del(0, 0, "/a/b") == 0 );
+
+        REQUIRE( store.read(0, 0, "/a/b/c/d", val) == ENOENT );
+        REQUIRE( store.read(0, 0, "/a/b/c", val) == ENOENT );
+
+        INFO( "Recreating a deleted entry doesn't bring its children back" );
+        REQUIRE( store.create(0, 0, "/a/b/c", created) == 0 );
+        REQUIRE( store.get_children(0, 0, "/a/b/c", children) == 0 );
+        REQUIRE( children.empty() );
+
+        REQUIRE( store.merge(tid, success) == 0 );
+        REQUIRE( success == false );
+
+        store.get_stats(stats);
+        REQUIRE( stats.nodes == 5 );
+    }
+
+    SECTION( "Delete inside transaction" ) {
+        store.branch(tid);
+
+        REQUIRE( store.del(0, tid, "/a/b") == 0 );
+
+        REQUIRE( store.read(0, tid, "/a/b/c/d", val) == ENOENT );
+        REQUIRE( store.read(0, 0, "/a/b/c/d", val) == 0 );
+
+        REQUIRE( store.get_children(0, tid, "/a", children) == 0 );
+        REQUIRE( children == std::set<std::string>({ "b-x" }) );
+
+        INFO( "Recreating a deleted entry doesn't bring its children back" );
+        REQUIRE( store.create(0, tid, "/a/b", created) == 0 );
+        REQUIRE( store.get_children(0, tid, "/a/b", children) == 0 );
+        REQUIRE( children.empty() );
+        REQUIRE( store.del(0, tid, "/a/b") == 0 );
+
+        REQUIRE( store.merge(tid, success) == 0 );
+        REQUIRE( success == true );
+
+        REQUIRE( store.read(0, 0, "/a/b", val) == ENOENT );
+        REQUIRE( store.read(0, 0, "/a/b/c/d", val) == ENOENT );
+        REQUIRE( store.read(0, 0, "/a/b/e", val) == ENOENT );
+
+        REQUIRE( store.get_children(0, 0, "/a", children) == 0 );
+        REQUIRE( children == std::set<std::string>({ "b-x" }) );
+
+        store.get_stats(stats);
+        REQUIRE( stats.nodes == 3 );
+        REQUIRE( stats.bytes == std::string("/a" "/a/b-x" "v").length() );
+    }
+}
+
+TEST_CASE( "Clone subtrees", "[mstore]" ) {
+    bool created;
+    std::string val;
+    std::set<std::string> children;
+    lixs::permission_list perms;
+    lixs::store_stats before;
+    lixs::store_stats after;
+
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::mstore::store store(log);
+
+    lixs::permission_list tmpl = { lixs::permission(5, false, false),
+        lixs::permission(0, true, false) };
+    lixs::permission_list dom1 = { lixs::permission(1, false, false),
+        lixs::permission(0, true, false) };
+
+
+    REQUIRE( store.create(0, 0, "/", created) == 0 );
+    REQUIRE( store.update(0, 0, "/tmpl/name", "guest") == 0 );
+    REQUIRE( store.update(0, 0, "/tmpl/device/vif/0/state", "1") == 0 );
+    REQUIRE( store.update(0, 0, "/tmpl-other", "x") == 0 );
+    REQUIRE( store.set_perms(0, 0, "/tmpl/device", tmpl) == 0 );
+
+    SECTION( "Clone a subtree" ) {
+        store.get_stats(before);
+
+        REQUIRE( store.clone(0, 0, "/tmpl", "/local/domain/1", 5, 1) == 0 );
+
+        REQUIRE( store.read(0, 0, "/local/domain/1/name", val) == 0 );
+        REQUIRE( val == "guest" );
+        REQUIRE( store.read(0, 0, "/local/domain/1/device/vif/0/state", val) == 0 );
+        REQUIRE( val == "1" );
+
+        INFO( "Only the subtree is cloned, not siblings sharing the prefix" );
+        REQUIRE( store.get_children(0, 0, "/local/domain", children) == 0 );
+        REQUIRE( children == std::set<std::string>({ "1" }) );
+        REQUIRE( store.get_children(0, 0, "/local/domain/1", children) == 0 );
+        REQUIRE( children == std::set<std::string>({ "device", "name" }) );
+
+        INFO( "Permissions of the template owner are given to the new owner" );
+        REQUIRE( store.get_perms(0, 0, "/local/domain/1/device", perms) == 0 );
+        REQUIRE( perms == dom1 );
+        REQUIRE( store.get_perms(0, 0, "/tmpl/device", perms) == 0 );
+        REQUIRE( perms == tmpl );
+
+        INFO( "The source is left unchanged" );
+        REQUIRE( store.update(0, 0, "/local/domain/1/name", "other") == 0 );
+        REQUIRE( store.read(0, 0, "/tmpl/name", val) == 0 );
+        REQUIRE( val == "guest" );
+
+        store.get_stats(after);
+        /* local, domain, and a copy of the 6 template entries */
+        REQUIRE( after.nodes == before.nodes + 8 );
+    }
+
+    SECTION( "Invalid clones" ) {
+        REQUIRE( store.clone(0, 0, "/none", "/local/domain/1", 5, 1) == ENOENT );
+        REQUIRE( store.clone(0, 0, "/tmpl", "/tmpl/device/copy", 5, 1) == EINVAL );
+        REQUIRE( store.clone(0, 0, "/tmpl", "/tmpl", 5, 1) == EINVAL );
+        REQUIRE( store.clone(0, 0, "/tmpl", "/tmpl-other", 5, 1) == EEXIST );
+
+        INFO( "Only dom0 can clone, guests could give copies to any domain" );
+        REQUIRE( store.clone(5, 0, "/tmpl", "/copy", 5, 1) == EACCES );
+        REQUIRE( store.clone(5, 0, "/tmpl", "/copy", 5, 0) == EACCES );
+        REQUIRE( store.clone(5, 0, "/tmpl", "/copy", 5, 5) == EACCES );
+        REQUIRE( store.read(0, 0, "/copy", val) == ENOENT );
+    }
+}
+
+TEST_CASE( "Conditional updates", "[mstore]" ) {
+    bool success;
+    unsigned int tid;
+    std::string val;
+    unsigned long int version;
+    unsigned long int first;
+
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::mstore::store store(log);
+
+    lixs::permission_list dom1 = { lixs::permission(1, false, false) };
+
+
+    SECTION( "Compare versions" ) {
+        version = 5;
+        REQUIRE( store.update_if(0, 0, "/a", "1", version) == EAGAIN );
+        INFO( "Entries that don't exist have version 0" );
+        REQUIRE( version == 0 );
+        REQUIRE( store.read(0, 0, "/a", val) == ENOENT );
+
+        REQUIRE( store.update_if(0, 0, "/a", "1", version) == 0 );
+        REQUIRE( version != 0 );
+        first = version;
+
+        REQUIRE( store.read(0, 0, "/a", val, version) == 0 );
+        REQUIRE( val == "1" );
+        REQUIRE( version == first );
+
+        REQUIRE( store.update(0, 0, "/a", "2") == 0 );
+        version = first;
+        REQUIRE( store.update_if(0, 0, "/a", "3", version) == EAGAIN );
+        REQUIRE( version != first );
+        REQUIRE( store.update_if(0, 0, "/a", "3", version) == 0 );
+        REQUIRE( store.read(0, 0, "/a", val) == 0 );
+        REQUIRE( val == "3" );
+    }
+
+    SECTION( "Compare values" ) {
+        REQUIRE( store.update_if(0, 0, "/a", "1", "0", version) == ENOENT );
+
+        REQUIRE( store.update(0, 0, "/a", "1") == 0 );
+        REQUIRE( store.update_if(0, 0, "/a", "3", "2", version) == EAGAIN );
+        REQUIRE( store.read(0, 0, "/a", val, first) == 0 );
+        REQUIRE( version == first );
+
+        REQUIRE( store.update_if(0, 0, "/a", "2", "1", version) == 0 );
+        REQUIRE( version != first );
+        REQUIRE( store.read(0, 0, "/a", val) == 0 );
+        REQUIRE( val == "2" );
+    }
+
+    SECTION( "Versions change on every write" ) {
+        REQUIRE( store.update(0, 0, "/a", "1") == 0 );
+        REQUIRE( store.read(0, 0, "/a", val, first) == 0 );
+
+        INFO( "Deleting and creating the entry again gives it a new version" );
+        REQUIRE( store.del(0, 0, "/a") == 0 );
+        REQUIRE( store.update(0, 0, "/a", "1") == 0 );
+        REQUIRE( store.read(0, 0, "/a", val, version) == 0 );
+        REQUIRE( version != first );
+        first = version;
+
+        INFO( "Writes merged from transactions change the version" );
+        store.branch(tid);
+        REQUIRE( store.update(0, tid, "/a", "2") == 0 );
+        REQUIRE( store.merge(tid, success) == 0 );
+        REQUIRE( success == true );
+        REQUIRE( store.read(0, 0, "/a", val, version) == 0 );
+        REQUIRE( version != first );
+    }
+
+    SECTION( "Permissions" ) {
+        REQUIRE( store.update(0, 0, "/a", "1") == 0 );
+        REQUIRE( store.read(0, 0, "/a", val, first) == 0 );
+
+        version = 0;
+        REQUIRE( store.update_if(1, 0, "/a", "2", version) == EACCES );
+        REQUIRE( version == 0 );
+
+        REQUIRE( store.set_perms(0, 0, "/a", { lixs::permission(0, true, false) }) == 0 );
+        REQUIRE( store.update_if(1, 0, "/a", "2", "1", version) == EACCES );
+
+        REQUIRE( store.set_perms(0, 0, "/a", dom1) == 0 );
+        REQUIRE( store.read(0, 0, "/a", val, version) == 0 );
+        REQUIRE( store.update_if(1, 0, "/a", "2", version) == 0 );
+    }
+
+    SECTION( "Not available in transactions" ) {
+        store.branch(tid);
+        REQUIRE( store.read(0, tid, "/a", val, version) == EINVAL );
+        REQUIRE( store.update_if(0, tid, "/a", "1", version) == EINVAL );
+        REQUIRE( store.abort(tid) == 0 );
+    }
+}
+
+TEST_CASE( "Children list inside transaction", "[mstore][transactions]" ) {
+    bool created;
+    unsigned int tid;
+    std::list<std::string> visited;
+
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::mstore::store store(log);
+
+
+    REQUIRE( store.create(0, 0, "/test/b", created) == 0 );
+    REQUIRE( store.create(0, 0, "/test/d", created) == 0 );
+    REQUIRE( store.create(0, 0, "/test/f", created) == 0 );
+
+    store.branch(tid);
+
+    REQUIRE( store.create(0, tid, "/test/a", created) == 0 );
+    REQUIRE( store.create(0, tid, "/test/e", created) == 0 );
+    REQUIRE( store.del(0, tid, "/test/d") == 0 );
+    REQUIRE( store.del(0, tid, "/test/f") == 0 );
+    REQUIRE( store.create(0, tid, "/test/f", created) == 0 );
+
+    /* The children list is only fetched by the transaction when first listed. */
+    REQUIRE( store.create(0, 0, "/test/c", created) == 0 );
+
+    INFO( "Children are visited once each, in order, as seen by the transaction" );
+    REQUIRE( store.get_children(0, tid, "/test", [&visited] (const std::string& name) {
+        visited.push_back(name);
+    }) == 0 );
+    REQUIRE( visited == std::list<std::string>({ "a", "b", "c", "e", "f" }) );
+
+    visited.clear();
+    REQUIRE( store.get_children(0, 0, "/test", [&visited] (const std::string& name) {
+        visited.push_back(name);
+    }) == 0 );
+    REQUIRE( visited == std::list<std::string>({ "b", "c", "d", "f" }) );
+}
+
+TEST_CASE( "Partial children lists", "[mstore]" ) {
+    bool created;
+    bool success;
+    unsigned int tid;
+    unsigned long int gen;
+    unsigned long int gen2;
+    std::list<std::string> visited;
+
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::mstore::store store(log);
+
+    lixs::children_part_cb first2 = [&visited] (const std::string& name) {
+        visited.push_back(name);
+        return visited.size() < 2;
+    };
+
+
+    for (auto& c : { "a", "b", "c", "d" }) {
+        REQUIRE( store.create(0, 0, std::string("/test/") + c, created) == 0 );
+    }
+
+    REQUIRE( store.get_children_part(0, 0, "/test", "", first2, gen) == 0 );
+    REQUIRE( visited == std::list<std::string>({ "a", "b" }) );
+
+    INFO( "Listing resumes from the first child not sorting before start" );
+    visited.clear();
+    REQUIRE( store.get_children_part(0, 0, "/test", "bb", first2, gen2) == 0 );
+    REQUIRE( visited == std::list<std::string>({ "c", "d" }) );
+    REQUIRE( gen2 == gen );
+
+    SECTION( "Changing the children list changes the generation" ) {
+        REQUIRE( store.update(0, 0, "/test/a", "v") == 0 );
+        REQUIRE( store.get_children_part(0, 0, "/test", "", first2, gen2) == 0 );
+        REQUIRE( gen2 == gen );
+
+        REQUIRE( store.del(0, 0, "/test/a") == 0 );
+        REQUIRE( store.get_children_part(0, 0, "/test", "", first2, gen2) == 0 );
+        REQUIRE( gen2 != gen );
+
+        gen = gen2;
+        REQUIRE( store.create(0, 0, "/test/a", created) == 0 );
+        REQUIRE( store.get_children_part(0, 0, "/test", "", first2, gen2) == 0 );
+        REQUIRE( gen2 != gen );
+    }
+
+    SECTION( "Generations inside transactions" ) {
+        store.branch(tid);
+
+        REQUIRE( store.get_children_part(0, tid, "/test", "", first2, gen2) == 0 );
+        REQUIRE( gen2 == gen );
+
+        REQUIRE( store.create(0, tid, "/test/e", created) == 0 );
+        REQUIRE( store.get_children_part(0, tid, "/test", "", first2, gen2) == 0 );
+        REQUIRE( gen2 != gen );
+
+        gen = gen2;
+        REQUIRE( store.merge(tid, success) == 0 );
+        REQUIRE( success == true );
+
+        REQUIRE( store.get_children_part(0, 0, "/test", "", first2, gen2) == 0 );
+        REQUIRE( gen2 != gen );
+    }
+}
+
+/* Everything readable from the store outside of a transaction must read the same from the view. */
+static void check_view(lixs::mstore::store& store, lixs::mstore::read_view& view,
+        unsigned int reader, const std::string& path, lixs::cid_t cid)
+{
+    std::string val;
+    std::string view_val;
+    std::set<std::string> children;
+    std::set<std::string> view_children;
+    lixs::permission_list perms;
+    lixs::permission_list view_perms;
+
+    INFO( "Checking " << path << " as " << cid );
+
+    REQUIRE( view.read(reader, cid, path, view_val) == store.read(cid, 0, path, val) );
+    REQUIRE( view_val == val );
+
+    REQUIRE( view.get_children(reader, cid, path, [&view_children] (const std::string& name) {
+        view_children.insert(name);
+    }) == store.get_children(cid, 0, path, children) );
+    REQUIRE( view_children == children );
+
+    REQUIRE( view.get_perms(reader, cid, path, view_perms)
+            == store.get_perms(cid, 0, path, perms) );
+    REQUIRE( view_perms == perms );
+}
+
+TEST_CASE( "Read view", "[mstore]" ) {
+    bool created;
+    bool success;
+    unsigned int tid;
+    std::list<std::string> removed;
+
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::mstore::read_view view;
+    lixs::mstore::store store(log);
+
+    lixs::permission_list dom1 = { lixs::permission(1, false, false),
+        lixs::permission(0, true, false) };
+
+    unsigned int reader = view.add_reader();
+
+    std::vector<std::string> paths = { "/", "/a", "/a/b", "/a/b/c", "/a/d", "/a/", "/t",
+        "/t/x", "/copy", "/copy/b/c", "/local/domain/1", "/local/domain/1/data", "/none" };
+
+    REQUIRE( store.create(0, 0, "/", created) == 0 );
+    REQUIRE( store.update(0, 0, "/a/b/c", "1") == 0 );
+
+    INFO( "Entries present when enabling the view are published" );
+    store.enable_view(view);
+
+    REQUIRE( store.update(0, 0, "/a/d", "2") == 0 );
+    REQUIRE( store.update(0, 0, "/local/domain/1/data", "x") == 0 );
+    REQUIRE( store.set_perms(0, 0, "/local/domain/1", dom1) == 0 );
+    REQUIRE( store.set_perms(0, 0, "/local/domain/1/data", dom1) == 0 );
+    REQUIRE( store.clone(0, 0, "/a", "/copy", 5, 1) == 0 );
+
+    SECTION( "Plain operations" ) {
+        REQUIRE( store.del(0, 0, "/a/b") == 0 );
+        REQUIRE( store.del_owned(1, "/local/domain", removed) == 0 );
+
+        for (auto& p : paths) {
+            check_view(store, view, reader, p, 0);
+            check_view(store, view, reader, p, 1);
+        }
+    }
+
+    SECTION( "Merged transactions" ) {
+        store.branch(tid);
+        REQUIRE( store.update(0, tid, "/t/x", "3") == 0 );
+        REQUIRE( store.del(0, tid, "/a/b") == 0 );
+
+        INFO( "Changes aren't visible until merged" );
+        check_view(store, view, reader, "/t/x", 0);
+        check_view(store, view, reader, "/a/b/c", 0);
+
+        REQUIRE( store.merge(tid, success) == 0 );
+        REQUIRE( success );
+
+        for (auto& p : paths) {
+            check_view(store, view, reader, p, 0);
+        }
+    }
+
+    SECTION( "Many entries" ) {
+        for (int i = 0; i < 5000; i++) {
+            REQUIRE( store.update(0, 0, "/many/" + std::to_string(i), std::to_string(i)) == 0 );
+        }
+        REQUIRE( view.size() > 5000 );
+
+        for (int i = 0; i < 5000; i += 499) {
+            check_view(store, view, reader, "/many/" + std::to_string(i), 0);
+        }
+        check_view(store, view, reader, "/many", 0);
+
+        for (int i = 0; i < 5000; i += 3) {
+            REQUIRE( store.del(0, 0, "/many/" + std::to_string(i)) == 0 );
+        }
+        check_view(store, view, reader, "/many", 0);
+
+        REQUIRE( store.del(0, 0, "/many") == 0 );
+        check_view(store, view, reader, "/many", 0);
+        check_view(store, view, reader, "/many/10", 0);
+    }
+}
+
+TEST_CASE( "Read view with concurrent updates", "[mstore]" ) {
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::mstore::read_view view;
+    lixs::mstore::store store(log);
+
+    std::atomic<bool> done(false);
+    std::atomic<unsigned long int> errors(0);
+    unsigned int reader = view.add_reader();
+
+    store.enable_view(view);
+    REQUIRE( store.update(0, 0, "/c/0", "0") == 0 );
+
+    std::thread t([&] () {
+        std::string val;
+        unsigned long int last = 0;
+
+        /* Values are only ever increasing and the entry always exists. */
+        while (!done.load()) {
+            if (view.read(reader, 0, "/c/0", val) != 0 || std::stoul(val) < last) {
+                errors++;
+            } else {
+                last = std::stoul(val);
+            }
+        }
+    });
+
+    for (int i = 1; i <= 20000; i++) {
+        REQUIRE( store.update(0, 0, "/c/0", std::to_string(i)) == 0 );
+        REQUIRE( store.update(0, 0, "/c/" + std::to_string(i), "") == 0 );
+    }
+
+    done = true;
+    t.join();
+
+    REQUIRE( errors == 0 );
+}
@@ -0,0 +1,352 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <catch.hpp>
+
+#include <lixs/log/logger.hh>
+#include <lixs/mstore/sharded_store.hh>
+#include <lixs/mstore/store.hh>
+
+#include <algorithm>
+#include <map>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+typedef std::map<std::string, std::pair<std::string, lixs::permission_list>> tree_dump;
+
+static void dump(lixs::store& store, const std::string& path, tree_dump& tree)
+{
+    std::string val;
+    lixs::permission_list perms;
+    std::set<std::string> children;
+
+    REQUIRE( store.read(0, 0, path, val) == 0 );
+    REQUIRE( store.get_perms(0, 0, path, perms) == 0 );
+    tree[path] = { val, perms };
+
+    REQUIRE( store.get_children(0, 0, path, children) == 0 );
+    for (auto& c : children) {
+        dump(store, path + "/" + c, tree);
+    }
+}
+
+static void check_same(lixs::store& a, lixs::store& b)
+{
+    tree_dump ta;
+    tree_dump tb;
+    lixs::store_stats sa;
+    lixs::store_stats sb;
+
+    dump(a, "", ta);
+    dump(b, "", tb);
+    REQUIRE( ta == tb );
+
+    a.get_stats(sa);
+    b.get_stats(sb);
+    REQUIRE( sa.nodes == ta.size() );
+    REQUIRE( sb.nodes == sa.nodes );
+    REQUIRE( sb.bytes == sa.bytes );
+    REQUIRE( sb.transactions == sa.transactions );
+}
+
+TEST_CASE( "Sharded store behaves as the store", "[mstore][sharded]" ) {
+    bool created;
+    bool success;
+    std::string val;
+    std::list<std::string> removed;
+
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::mstore::store store(log);
+    lixs::mstore::sharded_store sharded(log, 4);
+
+    std::vector<lixs::store*> stores = { &store, &sharded };
+
+    lixs::permission_list dom5 = { lixs::permission(5, false, false) };
+
+    for (auto s : stores) {
+        REQUIRE( s->create(0, 0, "/", created) == 0 );
+        REQUIRE( s->update(0, 0, "/tool/xenstored", "") == 0 );
+        REQUIRE( s->update(0, 0, "/local/domain/5/name", "guest") == 0 );
+        REQUIRE( s->set_perms(0, 0, "/local/domain/5", dom5) == 0 );
+        REQUIRE( s->update(0, 0, "/local/domain/5/device/vif/0/state", "1") == 0 );
+        REQUIRE( s->update(0, 0, "/local/domain/0/backend/vif/5/0/state", "1") == 0 );
+        REQUIRE( s->update(0, 0, "/local/domain/0/backend/vif/6/0/state", "1") == 0 );
+        REQUIRE( s->update(0, 0, "/local/domain/0/backend/vbd/5/768/state", "1") == 0 );
+    }
+    check_same(store, sharded);
+
+    SECTION( "Domain subtrees are linked to their parents" ) {
+        std::set<std::string> children;
+
+        REQUIRE( sharded.get_children(0, 0, "/local/domain", children) == 0 );
+        REQUIRE( children == std::set<std::string>({ "0", "5" }) );
+        REQUIRE( sharded.get_children(0, 0, "/local/domain/0/backend/vif", children) == 0 );
+        REQUIRE( children == std::set<std::string>({ "5", "6" }) );
+
+        INFO( "Permissions are inherited across shards" );
+        REQUIRE( sharded.create(0, 0, "/local/domain/5/data", created) == 0 );
+        REQUIRE( sharded.read(5, 0, "/local/domain/5/data", val) == 0 );
+        REQUIRE( sharded.read(6, 0, "/local/domain/5/data", val) == EACCES );
+    }
+
+    SECTION( "Deleting subtrees spanning shards" ) {
+        for (auto s : stores) {
+            REQUIRE( s->del(0, 0, "/local/domain/0/backend/vif") == 0 );
+            REQUIRE( s->read(0, 0, "/local/domain/0/backend/vif/6/0/state", val) == ENOENT );
+        }
+        check_same(store, sharded);
+
+        for (auto s : stores) {
+            REQUIRE( s->del(0, 0, "/local/domain/5") == 0 );
+            REQUIRE( s->del(0, 0, "/local") == 0 );
+        }
+        check_same(store, sharded);
+    }
+
+    SECTION( "Deleting entries owned by a domain across shards" ) {
+        for (auto s : stores) {
+            REQUIRE( s->set_perms(0, 0, "/local/domain/0/backend/vif/5", dom5) == 0 );
+            REQUIRE( s->set_perms(0, 0, "/local/domain/0/backend/vif/5/0", dom5) == 0 );
+            REQUIRE( s->set_perms(0, 0, "/local/domain/0/backend/vbd/5/768", dom5) == 0 );
+            REQUIRE( s->del_owned(5, "/local/domain", removed) == 0 );
+            REQUIRE( removed == std::list<std::string>({ "/local/domain/0/backend/vbd/5/768",
+                        "/local/domain/0/backend/vif/5", "/local/domain/5" }) );
+        }
+        check_same(store, sharded);
+    }
+
+    SECTION( "Cloning across shards" ) {
+        for (auto s : stores) {
+            REQUIRE( s->clone(0, 0, "/local/domain/5", "/local/domain/7", 5, 7) == 0 );
+            REQUIRE( s->clone(0, 0, "/local/domain/0", "/local/domain/3", 0, 3) == 0 );
+            REQUIRE( s->clone(0, 0, "/local/domain/0/backend/vif/5", "/tool/vif", 0, 0) == 0 );
+        }
+        check_same(store, sharded);
+    }
+
+    SECTION( "Transactions across shards" ) {
+        unsigned int tid;
+
+        for (auto s : stores) {
+            s->branch(tid);
+            REQUIRE( s->update(0, tid, "/local/domain/9/name", "new") == 0 );
+            REQUIRE( s->update(0, tid, "/local/domain/0/backend/vif/9/0/state", "1") == 0 );
+            REQUIRE( s->del(0, tid, "/local/domain/0/backend/vif/5") == 0 );
+            REQUIRE( s->update(0, tid, "/local/domain/5/device/vif/0/state", "6") == 0 );
+            REQUIRE( s->merge(tid, success) == 0 );
+            REQUIRE( success );
+        }
+        check_same(store, sharded);
+
+        for (auto s : stores) {
+            s->branch(tid);
+            REQUIRE( s->read(0, tid, "/local/domain/5/name", val) == 0 );
+            REQUIRE( s->update(0, tid, "/local/domain/6/name", "other") == 0 );
+            REQUIRE( s->update(0, 0, "/local/domain/5/name", "changed") == 0 );
+            REQUIRE( s->merge(tid, success) == 0 );
+            REQUIRE( !success );
+        }
+        check_same(store, sharded);
+    }
+
+    SECTION( "Usage inspection across shards" ) {
+        std::string next[2];
+        std::list<lixs::store_usage> usage[2];
+
+        for (int i = 0; i < 2; i++) {
+            do {
+                REQUIRE( stores[i]->get_usage("/local/domain/0", next[i], 3, usage[i],
+                            next[i]) == 0 );
+            } while (!next[i].empty() && usage[i].size() > 0);
+        }
+
+        REQUIRE( usage[0].size() == usage[1].size() );
+        REQUIRE( usage[0].back().name == usage[1].back().name );
+        REQUIRE( usage[0].back().nodes == usage[1].back().nodes );
+    }
+}
+
+TEST_CASE( "Sharded store with random operations", "[mstore][sharded]" ) {
+    std::mt19937 rnd(1);
+    std::vector<unsigned int> tids;
+    std::list<std::string> removed[2];
+
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::mstore::store store(log);
+    lixs::mstore::sharded_store sharded(log, 3);
+
+    std::vector<lixs::store*> stores = { &store, &sharded };
+
+    auto random_path = [&rnd] () {
+        std::string d = std::to_string(rnd() % 6);
+        std::string i = std::to_string(rnd() % 3);
+
+        switch (rnd() % 6) {
+            case 0: return "/local/domain/" + d;
+            case 1: return "/local/domain/" + d + "/data/" + i;
+            case 2: return "/local/domain/" + i + "/backend/vif/" + d + "/" + i;
+            case 3: return "/local/domain/" + i + "/backend/vif/" + d;
+            case 4: return "/local/domain/" + i + "/backend";
+            default: return "/tool/" + i;
+        }
+    };
+
+    for (int n = 0; n < 3000; n++) {
+        int op = rnd() % 10;
+        unsigned int tid = (!tids.empty() && rnd() % 2) ? tids[rnd() % tids.size()] : 0;
+        std::string path = random_path();
+        std::string other = random_path();
+        lixs::cid_t cid = rnd() % 3;
+        int ret[2];
+
+        for (int i = 0; i < 2; i++) {
+            bool created;
+            bool success;
+            std::string val;
+            lixs::permission_list perms = { lixs::permission(cid, false, false) };
+
+            switch (op) {
+                case 0:
+                case 1:
+                    ret[i] = stores[i]->update(cid, tid, path, std::to_string(n));
+                    break;
+                case 2:
+                    ret[i] = stores[i]->create(cid, tid, path, created);
+                    break;
+                case 3:
+                    ret[i] = stores[i]->del(cid, tid, path);
+                    break;
+                case 4:
+                    ret[i] = stores[i]->set_perms(0, tid, path, perms);
+                    break;
+                case 5:
+                    ret[i] = stores[i]->read(cid, tid, path, val);
+                    break;
+                case 6:
+                    ret[i] = stores[i]->clone(0, 0, path, other, 0, cid);
+                    break;
+                case 7:
+                    ret[i] = stores[i]->del_owned(cid, path, removed[i]);
+                    break;
+                case 8:
+                    if (i == 0) {
+                        stores[i]->branch(tid);
+                    } else {
+                        unsigned int t;
+                        stores[i]->branch(t);
+                        REQUIRE( t == tid );
+                        tids.push_back(tid);
+                    }
+                    ret[i] = 0;
+                    break;
+                default:
+                    if (tid == 0) {
+                        ret[i] = 0;
+                        break;
+                    }
+                    ret[i] = stores[i]->merge(tid, success) == 0 ? success : -1;
+                    if (i == 1) {
+                        tids.erase(std::find(tids.begin(), tids.end(), tid));
+                    }
+                    break;
+            }
+        }
+
+        INFO( "Operation " << n << " (" << op << ") on " << path );
+        REQUIRE( ret[0] == ret[1] );
+        if (op == 7 && ret[0] == 0) {
+            REQUIRE( removed[0] == removed[1] );
+        }
+    }
+
+    check_same(store, sharded);
+}
+
+TEST_CASE( "Sharded store with concurrent writers", "[mstore][sharded]" ) {
+    const int writers = 4;
+
+    bool created;
+    tree_dump tree;
+    lixs::store_stats stats;
+    std::vector<std::thread> threads;
+
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::mstore::sharded_store sharded(log, 4);
+
+    REQUIRE( sharded.create(0, 0, "/", created) == 0 );
+
+    for (int w = 0; w < writers; w++) {
+        threads.emplace_back([&sharded, w] () {
+            bool success;
+            unsigned int tid;
+
+            /* Each writer keeps creating and destroying its own domains, also writing to them
+             * and to their backends from transactions.
+             */
+            for (int i = 0; i < 300; i++) {
+                std::string d = std::to_string(w + writers * (i % 3));
+                std::string dom = "/local/domain/" + d;
+                std::string be = "/local/domain/0/backend/vif/" + d + "/0";
+
+                sharded.update(0, 0, dom + "/name", std::to_string(i));
+
+                sharded.branch(tid);
+                sharded.update(0, tid, dom + "/device/vif/0/state", "1");
+                sharded.update(0, tid, be + "/state", "1");
+                sharded.merge(tid, success);
+
+                if (i % 5 == 4) {
+                    sharded.del(0, 0, dom);
+                    sharded.del(0, 0, be);
+                }
+            }
+        });
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    dump(sharded, "", tree);
+    sharded.get_stats(stats);
+
+    INFO( "Every entry is reachable from the root and accounted for" );
+    REQUIRE( stats.nodes == tree.size() );
+    REQUIRE( stats.transactions == 0 );
+}
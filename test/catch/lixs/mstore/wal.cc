@@ -0,0 +1,344 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+
+#include <catch.hpp>
+
+#include <lixs/event_mgr.hh>
+#include <lixs/log/logger.hh>
+#include <lixs/mstore/store.hh>
+#include <lixs/mstore/wal.hh>
+#include <lixs/timer.hh>
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <set>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+class null_timer : public lixs::timer {
+public:
+    void set(std::chrono::steady_clock::time_point expiry, lixs::ev_cb cb) { }
+    void clear(void) { }
+};
+
+class record_waiter : public lixs::commit_waiter {
+public:
+    record_waiter(const std::string& path)
+        : path(path), released(0), size(0)
+    { }
+
+    void durable(void)
+    {
+        struct stat st;
+
+        released++;
+        size = stat(path.c_str(), &st) == 0 ? st.st_size : -1;
+    }
+
+    const std::string path;
+    int released;
+    off_t size;
+};
+
+static std::string temp_file(void)
+{
+    int fd;
+    char path[] = "/tmp/lixs-wal-XXXXXX";
+
+    fd = mkstemp(path);
+    REQUIRE( fd != -1 );
+    close(fd);
+
+    return path;
+}
+
+static off_t file_size(const std::string& path)
+{
+    struct stat st;
+
+    REQUIRE( stat(path.c_str(), &st) == 0 );
+
+    return st.st_size;
+}
+
+TEST_CASE( "Write-ahead log", "[mstore][wal]" ) {
+    bool created;
+    bool success;
+    unsigned int tid;
+    std::string val;
+    std::set<std::string> children;
+    lixs::permission_list perms;
+    lixs::permission_list dom1 = { {1, false, false}, {0, true, false} };
+    lixs::store_stats stats;
+
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::event_mgr emgr;
+    null_timer t;
+    std::string path = temp_file();
+
+    emgr.enable();
+
+    {
+        lixs::mstore::store store(log);
+        lixs::mstore::wal wal(path, 0, emgr, t, log);
+
+        REQUIRE( store.enable_wal(wal) == 0 );
+
+        REQUIRE( store.create(0, 0, "/", created) == 0 );
+        REQUIRE( store.update(0, 0, "/a/b", "v1") == 0 );
+        REQUIRE( store.update(0, 0, "/a/b", "v2") == 0 );
+        REQUIRE( store.update(0, 0, "/c/d/e", "x") == 0 );
+        REQUIRE( store.set_perms(0, 0, "/a", dom1) == 0 );
+        REQUIRE( store.del(0, 0, "/c/d") == 0 );
+
+        store.branch(tid);
+        REQUIRE( store.update(0, tid, "/t", "merged") == 0 );
+        REQUIRE( store.merge(tid, success) == 0 );
+        REQUIRE( success == true );
+
+        store.branch(tid);
+        REQUIRE( store.update(0, tid, "/u", "aborted") == 0 );
+        REQUIRE( store.abort(tid) == 0 );
+
+        /* Records are written once the event loop runs. */
+        emgr.run();
+    }
+
+    SECTION( "The store is restored on start up" ) {
+        lixs::mstore::store store(log);
+        lixs::mstore::wal wal(path, 0, emgr, t, log);
+
+        REQUIRE( store.enable_wal(wal) == 0 );
+
+        store.get_stats(stats);
+        REQUIRE( stats.nodes == 5 );
+
+        REQUIRE( store.read(0, 0, "/a/b", val) == 0 );
+        REQUIRE( val == "v2" );
+        REQUIRE( store.read(0, 0, "/t", val) == 0 );
+        REQUIRE( val == "merged" );
+        REQUIRE( store.read(0, 0, "/u", val) == ENOENT );
+        REQUIRE( store.read(0, 0, "/c/d/e", val) == ENOENT );
+
+        REQUIRE( store.get_perms(0, 0, "/a", perms) == 0 );
+        REQUIRE( perms == dom1 );
+
+        REQUIRE( store.get_children(0, 0, "/", children) == 0 );
+        REQUIRE( children == std::set<std::string>({ "a", "c", "t" }) );
+        REQUIRE( store.get_children(0, 0, "/c", children) == 0 );
+        REQUIRE( children.empty() );
+
+        INFO( "Changes after restoring are logged as well" );
+        REQUIRE( store.del(0, 0, "/t") == 0 );
+        emgr.run();
+    }
+
+    SECTION( "Restoring drops stale records" ) {
+        off_t size = file_size(path);
+
+        {
+            lixs::mstore::store store(log);
+            lixs::mstore::wal wal(path, 0, emgr, t, log);
+
+            REQUIRE( store.enable_wal(wal) == 0 );
+        }
+
+        REQUIRE( file_size(path) < size );
+    }
+
+    SECTION( "Damaged records at the end are dropped" ) {
+        off_t size = file_size(path);
+        std::FILE* fp;
+
+        fp = std::fopen(path.c_str(), "a");
+        REQUIRE( fp != NULL );
+        REQUIRE( std::fwrite("\x10\0\0\0garbage", 11, 1, fp) == 1 );
+        std::fclose(fp);
+
+        lixs::mstore::store store(log);
+        lixs::mstore::wal wal(path, 0, emgr, t, log);
+
+        REQUIRE( store.enable_wal(wal) == 0 );
+
+        store.get_stats(stats);
+        REQUIRE( stats.nodes == 5 );
+        REQUIRE( file_size(path) < size );
+    }
+
+    SECTION( "Torn commits are dropped as a whole" ) {
+        off_t size;
+
+        {
+            lixs::mstore::store store(log);
+            lixs::mstore::wal wal(path, 0, emgr, t, log);
+
+            REQUIRE( store.enable_wal(wal) == 0 );
+
+            store.branch(tid);
+            REQUIRE( store.update(0, tid, "/m/1", "x") == 0 );
+            REQUIRE( store.update(0, tid, "/m/2", "y") == 0 );
+            REQUIRE( store.update(0, tid, "/m/3", "z") == 0 );
+            REQUIRE( store.merge(tid, success) == 0 );
+            REQUIRE( success == true );
+
+            emgr.run();
+        }
+
+        /* A crash in the middle of writing the merge, only its first changes made it to disk. */
+        size = file_size(path);
+        REQUIRE( truncate(path.c_str(), size - 8) == 0 );
+
+        lixs::mstore::store store(log);
+        lixs::mstore::wal wal(path, 0, emgr, t, log);
+
+        REQUIRE( store.enable_wal(wal) == 0 );
+
+        store.get_stats(stats);
+        REQUIRE( stats.nodes == 5 );
+
+        REQUIRE( store.read(0, 0, "/m", val) == ENOENT );
+        REQUIRE( store.read(0, 0, "/m/1", val) == ENOENT );
+        REQUIRE( store.read(0, 0, "/a/b", val) == 0 );
+        REQUIRE( val == "v2" );
+    }
+
+    SECTION( "Other files are left alone" ) {
+        std::FILE* fp;
+
+        fp = std::fopen(path.c_str(), "w");
+        REQUIRE( fp != NULL );
+        REQUIRE( std::fwrite("not a log", 9, 1, fp) == 1 );
+        std::fclose(fp);
+
+        lixs::mstore::store store(log);
+        lixs::mstore::wal wal(path, 0, emgr, t, log);
+
+        REQUIRE( store.enable_wal(wal) == EINVAL );
+        REQUIRE( file_size(path) == 9 );
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE( "Write-ahead log waiters", "[mstore][wal]" ) {
+    off_t size;
+
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::event_mgr emgr;
+    null_timer t;
+    std::string path = temp_file();
+
+    emgr.enable();
+
+    {
+        lixs::mstore::store store(log);
+        lixs::mstore::wal wal(path, 0, emgr, t, log);
+        record_waiter w1(path);
+        record_waiter w2(path);
+
+        REQUIRE( store.enable_wal(wal) == 0 );
+        REQUIRE( wal.pending() == false );
+
+        size = file_size(path);
+        REQUIRE( store.update(0, 0, "/a", "x") == 0 );
+        REQUIRE( wal.pending() == true );
+
+        wal.wait(w1);
+        wal.wait(w2);
+        wal.cancel(w2);
+        REQUIRE( w1.released == 0 );
+
+        INFO( "Waiters are released once the records are written" );
+        emgr.run();
+        REQUIRE( wal.pending() == false );
+        REQUIRE( w1.released == 1 );
+        REQUIRE( w1.size > size );
+        REQUIRE( w2.released == 0 );
+    }
+
+    std::remove(path.c_str());
+}
+
+TEST_CASE( "Write-ahead log compaction", "[mstore][wal]" ) {
+    int failed = 0;
+    std::string val;
+
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::event_mgr emgr;
+    null_timer t;
+    std::string path = temp_file();
+
+    emgr.enable();
+
+    {
+        lixs::mstore::store store(log);
+        lixs::mstore::wal wal(path, 1000, emgr, t, log);
+
+        REQUIRE( store.enable_wal(wal) == 0 );
+        REQUIRE( store.update(0, 0, "/keep", "k") == 0 );
+
+        /* Each write leaves a stale record behind, about 5MB of them. */
+        for (int i = 0; i < 40000; i++) {
+            if (store.update(0, 0, "/a", std::string(100, 'a' + i % 26)) != 0) {
+                failed++;
+            }
+            emgr.run();
+        }
+
+        REQUIRE( failed == 0 );
+        REQUIRE( file_size(path) < 2 << 20 );
+    }
+
+    REQUIRE( access((path + ".tmp").c_str(), F_OK) == -1 );
+
+    INFO( "Records written while compacting made it to the compacted log" );
+    lixs::mstore::store store(log);
+    lixs::mstore::wal wal(path, 1000, emgr, t, log);
+
+    REQUIRE( store.enable_wal(wal) == 0 );
+
+    REQUIRE( store.read(0, 0, "/keep", val) == 0 );
+    REQUIRE( val == "k" );
+    REQUIRE( store.read(0, 0, "/a", val) == 0 );
+    REQUIRE( val == std::string(100, 'a' + 39999 % 26) );
+
+    std::remove(path.c_str());
+}
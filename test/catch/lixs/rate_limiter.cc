@@ -0,0 +1,125 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+
+#include <catch.hpp>
+
+#include <lixs/rate_limiter.hh>
+#include <lixs/timer.hh>
+
+#include <chrono>
+#include <thread>
+
+
+class manual_timer : public lixs::timer {
+public:
+    manual_timer(void)
+        : armed(false)
+    { }
+
+public:
+    void set(std::chrono::steady_clock::time_point expiry, lixs::ev_cb cb)
+    {
+        this->armed = true;
+        this->expiry = expiry;
+        this->cb = cb;
+    }
+
+    void clear(void)
+    {
+        armed = false;
+    }
+
+    /* Waits for the expiry time and runs the callback. */
+    void fire(void)
+    {
+        lixs::ev_cb cb;
+
+        std::this_thread::sleep_until(expiry);
+
+        armed = false;
+        std::swap(cb, this->cb);
+        cb();
+    }
+
+public:
+    bool armed;
+    std::chrono::steady_clock::time_point expiry;
+    lixs::ev_cb cb;
+};
+
+TEST_CASE( "Rate limiting connections", "[rate_limiter]" ) {
+    int resumed_a = 0;
+    int resumed_b = 0;
+
+    manual_timer t;
+    lixs::rate_limiter limiter(t, 1000, 2);
+    lixs::token_bucket a([&resumed_a] { resumed_a++; });
+    lixs::token_bucket b([&resumed_b] { resumed_b++; });
+
+    INFO( "Buckets start full" );
+    REQUIRE( limiter.take(a) );
+    REQUIRE( limiter.take(a) );
+    REQUIRE( limiter.take(b) );
+    REQUIRE( t.armed == false );
+
+    REQUIRE( limiter.take(a) == false );
+    REQUIRE( a.get_throttled() == 1 );
+    REQUIRE( t.armed == true );
+
+    SECTION( "Throttled connections are resumed once refilled" ) {
+        t.fire();
+
+        REQUIRE( resumed_a == 1 );
+        REQUIRE( resumed_b == 0 );
+        REQUIRE( t.armed == false );
+
+        REQUIRE( limiter.take(a) );
+    }
+
+    SECTION( "Cancelled connections are not resumed" ) {
+        limiter.cancel(a);
+
+        REQUIRE( limiter.take(b) );
+        REQUIRE( limiter.take(b) == false );
+        REQUIRE( t.armed == true );
+
+        t.fire();
+
+        REQUIRE( resumed_a == 0 );
+        REQUIRE( resumed_b == 1 );
+    }
+}
@@ -0,0 +1,127 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+
+#include <catch.hpp>
+
+#include <lixs/mpsc_queue.hh>
+#include <lixs/os_linux/io_thread.hh>
+#include <lixs/reactor.hh>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+
+TEST_CASE( "Queue with many producers", "[reactor]" ) {
+    const unsigned int producers = 4;
+    const unsigned int items = 100000;
+
+    lixs::mpsc_queue<unsigned long int> queue;
+    std::vector<std::thread> threads;
+    std::vector<unsigned long int> last(producers, 0);
+    unsigned long int value;
+    unsigned long int popped = 0;
+    bool ordered = true;
+
+    REQUIRE( queue.pop(value) == false );
+
+    for (unsigned int p = 0; p < producers; p++) {
+        threads.emplace_back([&queue, p, items] () {
+            for (unsigned long int i = 1; i <= items; i++) {
+                queue.push(i * producers + p);
+            }
+        });
+    }
+
+    /* Values from each producer must come out in the order they were pushed. */
+    while (popped < producers * items) {
+        if (!queue.pop(value)) {
+            continue;
+        }
+
+        if (value / producers <= last[value % producers]) {
+            ordered = false;
+        }
+        last[value % producers] = value / producers;
+        popped++;
+    }
+
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    REQUIRE( ordered );
+    REQUIRE( queue.pop(value) == false );
+    for (auto& l : last) {
+        REQUIRE( l == items );
+    }
+}
+
+TEST_CASE( "Posting to an I/O thread", "[reactor]" ) {
+    lixs::os_linux::io_thread r;
+    std::vector<int> order;
+    std::thread::id id;
+
+    SECTION( "Callbacks run in order on the reactor thread" ) {
+        for (int i = 0; i < 1000; i++) {
+            r.post([&order, i] () {
+                order.push_back(i);
+            });
+        }
+
+        r.run_sync([&id] () {
+            id = std::this_thread::get_id();
+        });
+
+        REQUIRE( id != std::this_thread::get_id() );
+        REQUIRE( order.size() == 1000 );
+        for (int i = 0; i < 1000; i++) {
+            REQUIRE( order[i] == i );
+        }
+    }
+
+    SECTION( "Nested run_sync runs in place" ) {
+        r.run_sync([&r, &order] () {
+            r.run_sync([&order] () {
+                order.push_back(1);
+            });
+            order.push_back(2);
+        });
+
+        REQUIRE( order == std::vector<int>({ 1, 2 }) );
+    }
+}
@@ -0,0 +1,125 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+
+#include <catch.hpp>
+
+#include <lixs/event_mgr.hh>
+#include <lixs/scheduler.hh>
+
+#include <string>
+#include <vector>
+
+
+class record_task : public lixs::sched_task {
+public:
+    record_task(lixs::scheduler& sched, lixs::sched_class cls, std::string name,
+            std::vector<std::string>& order, int turns)
+        : sched(sched), cls(cls), name(name), order(order), turns(turns)
+    { }
+
+protected:
+    void resume(void)
+    {
+        order.push_back(name);
+
+        if (--turns > 0) {
+            sched.yield(*this, cls);
+        }
+    }
+
+private:
+    lixs::scheduler& sched;
+    lixs::sched_class cls;
+    std::string name;
+    std::vector<std::string>& order;
+    int turns;
+};
+
+TEST_CASE( "Scheduling connections", "[scheduler]" ) {
+    lixs::event_mgr emgr;
+    lixs::scheduler sched(emgr, 2);
+    std::vector<std::string> order;
+
+    sched.set_weight(lixs::sched_class::dom0, 3);
+
+    REQUIRE( sched.budget(lixs::sched_class::dom0) == 6 );
+    REQUIRE( sched.budget(lixs::sched_class::guest) == 2 );
+
+    emgr.enable();
+
+    SECTION( "dom0 goes first, then round robin" ) {
+        record_task g1(sched, lixs::sched_class::guest, "g1", order, 3);
+        record_task g2(sched, lixs::sched_class::guest, "g2", order, 1);
+        record_task d(sched, lixs::sched_class::dom0, "d", order, 2);
+
+        sched.yield(g1, lixs::sched_class::guest);
+        sched.yield(g2, lixs::sched_class::guest);
+        sched.yield(d, lixs::sched_class::dom0);
+        sched.yield(d, lixs::sched_class::dom0);
+
+        emgr.run();
+
+        REQUIRE( order == std::vector<std::string>({ "d", "g1", "g2", "d", "g1", "g1" }) );
+    }
+
+    SECTION( "Passes run behind queued events" ) {
+        record_task g(sched, lixs::sched_class::guest, "g", order, 2);
+
+        sched.yield(g, lixs::sched_class::guest);
+        emgr.enqueue_event([&order] () {
+            order.push_back("io");
+        });
+
+        emgr.run();
+
+        REQUIRE( order == std::vector<std::string>({ "g", "io", "g" }) );
+    }
+
+    SECTION( "Cancelled tasks are not resumed" ) {
+        record_task g1(sched, lixs::sched_class::guest, "g1", order, 1);
+        record_task g2(sched, lixs::sched_class::guest, "g2", order, 1);
+
+        sched.yield(g1, lixs::sched_class::guest);
+        sched.yield(g2, lixs::sched_class::guest);
+        sched.cancel(g1);
+        sched.cancel(g1);
+
+        emgr.run();
+
+        REQUIRE( order == std::vector<std::string>({ "g2" }) );
+    }
+}
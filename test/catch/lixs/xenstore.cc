@@ -0,0 +1,410 @@
+/*
+ * LiXS: Lightweight XenStore
+ *
+ * Authors: Filipe Manco <filipe.manco@neclab.eu>
+ *
+ *
+ * Copyright (c) 2016, NEC Europe Ltd., NEC Corporation All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ * 2. Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in the
+ *    documentation and/or other materials provided with the distribution.
+ * 3. Neither the name of the copyright holder nor the names of its
+ *    contributors may be used to endorse or promote products derived from
+ *    this software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS"
+ * AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE
+ * IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE
+ * ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT HOLDER OR CONTRIBUTORS BE
+ * LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR
+ * CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF
+ * SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR PROFITS; OR BUSINESS
+ * INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF LIABILITY, WHETHER IN
+ * CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE)
+ * ARISING IN ANY WAY OUT OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE
+ * POSSIBILITY OF SUCH DAMAGE.
+ *
+ * THIS HEADER MAY NOT BE EXTRACTED OR MODIFIED IN ANY WAY.
+ */
+
+#include <catch.hpp>
+
+#include <lixs/event_mgr.hh>
+#include <lixs/iomux.hh>
+#include <lixs/log/logger.hh>
+#include <lixs/mstore/store.hh>
+#include <lixs/watch.hh>
+#include <lixs/xenstore.hh>
+
+#include <cerrno>
+#include <list>
+#include <string>
+#include <vector>
+
+
+class null_iomux : public lixs::iomux {
+public:
+    null_iomux(lixs::event_mgr& emgr)
+        : iomux(emgr)
+    { }
+
+public:
+    void add(int fd, bool read, bool write, lixs::io_cb cb) { }
+    void set(int fd, bool read, bool write) { }
+    void rem(int fd) { }
+};
+
+class record_watch : public lixs::watch_cb {
+public:
+    record_watch(const std::string& path)
+        : watch_cb(path, "token", false, lixs::watch_depth_any)
+    { }
+
+    record_watch(const std::string& path, bool with_value)
+        : watch_cb(path, "token", with_value, lixs::watch_depth_any)
+    { }
+
+    record_watch(const std::string& path, unsigned int depth)
+        : watch_cb(path, "token", false, depth)
+    { }
+
+public:
+    void operator()(const std::string& path)
+    {
+        fired.push_back(path);
+        values.push_back("?");
+    }
+
+    void operator()(const std::string& path, const lixs::watch_value& value)
+    {
+        fired.push_back(path);
+        values.push_back(value.deleted ? "-" : "=" + value.value);
+    }
+
+public:
+    std::list<std::string> fired;
+    /* "=<value>", "-" if deleted or "?" if unknown, for each event. */
+    std::list<std::string> values;
+};
+
+
+class owned_watch : public lixs::watch_cb {
+public:
+    owned_watch(const std::string& path, lixs::cid_t owner)
+        : watch_cb(path, "token", false, lixs::watch_depth_any, owner)
+    { }
+
+public:
+    void operator()(const std::string& path) { }
+    void operator()(const std::string& path, const lixs::watch_value& value) { }
+};
+
+
+TEST_CASE( "Batched operations", "[xenstore]" ) {
+    std::string val;
+    std::vector<int> results;
+    std::vector<lixs::batch_op> batch;
+
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::mstore::store st(log);
+    lixs::event_mgr emgr;
+    null_iomux io(emgr);
+    lixs::xenstore xs(st, emgr, io);
+    record_watch watch("/batch");
+
+    emgr.enable();
+
+    xs.watch_add(watch);
+    emgr.run();
+    watch.fired.clear();
+
+    SECTION( "Operations are applied in order and watches fire at the end" ) {
+        batch.emplace_back(lixs::batch_type::mkdir, "/batch/a");
+        batch.emplace_back(lixs::batch_type::write, "/batch/a/b");
+        batch.back().value = "v";
+        batch.emplace_back(lixs::batch_type::set_perms, "/batch/a/b");
+        batch.back().perms = { lixs::permission(1, true, false) };
+        batch.emplace_back(lixs::batch_type::rm, "/batch/a");
+
+        REQUIRE( xs.store_batch(0, 0, batch, results) == 0 );
+        REQUIRE( results == std::vector<int>({ 0, 0, 0, 0 }) );
+
+        REQUIRE( xs.store_read(0, 0, "/batch/a", val) == ENOENT );
+
+        INFO( "Watches only fire once the batch is merged" );
+        REQUIRE( watch.fired.empty() );
+        emgr.run();
+        REQUIRE( !watch.fired.empty() );
+    }
+
+    SECTION( "A failing operation stops the batch and nothing is applied" ) {
+        batch.emplace_back(lixs::batch_type::write, "/batch/a");
+        batch.back().value = "v";
+        batch.emplace_back(lixs::batch_type::rm, "/batch/missing");
+        batch.emplace_back(lixs::batch_type::write, "/batch/b");
+
+        REQUIRE( xs.store_batch(0, 0, batch, results) == 0 );
+        REQUIRE( results == std::vector<int>({ 0, ENOENT }) );
+
+        REQUIRE( xs.store_read(0, 0, "/batch/a", val) == ENOENT );
+        REQUIRE( xs.store_read(0, 0, "/batch/b", val) == ENOENT );
+
+        emgr.run();
+        REQUIRE( watch.fired.empty() );
+    }
+
+    SECTION( "Inside a transaction operations are applied to it" ) {
+        unsigned int tid;
+
+        REQUIRE( xs.transaction_start(0, &tid) == 0 );
+
+        batch.emplace_back(lixs::batch_type::write, "/batch/a");
+        batch.back().value = "v";
+
+        REQUIRE( xs.store_batch(0, tid, batch, results) == 0 );
+        REQUIRE( results == std::vector<int>({ 0 }) );
+
+        REQUIRE( xs.store_read(0, 0, "/batch/a", val) == ENOENT );
+        REQUIRE( xs.store_read(0, tid, "/batch/a", val) == 0 );
+        REQUIRE( val == "v" );
+
+        REQUIRE( xs.transaction_end(0, tid, true) == 0 );
+        REQUIRE( xs.store_read(0, 0, "/batch/a", val) == 0 );
+    }
+
+    SECTION( "A failing operation inside a transaction dooms it" ) {
+        unsigned int tid;
+        lixs::xenstore_stats stats;
+
+        REQUIRE( xs.transaction_start(0, &tid) == 0 );
+
+        batch.emplace_back(lixs::batch_type::write, "/batch/a");
+        batch.back().value = "v";
+        batch.emplace_back(lixs::batch_type::rm, "/batch/missing");
+
+        REQUIRE( xs.store_batch(0, tid, batch, results) == ENOENT );
+        REQUIRE( results == std::vector<int>({ 0, ENOENT }) );
+
+        INFO( "The transaction can't be committed with half of the batch" );
+        REQUIRE( xs.transaction_end(0, tid, true) == ENOENT );
+        REQUIRE( xs.store_read(0, 0, "/batch/a", val) == ENOENT );
+
+        emgr.run();
+        REQUIRE( watch.fired.empty() );
+
+        INFO( "Operations are only accounted for as a batch" );
+        xs.get_stats(stats);
+        REQUIRE( stats.ops["batch"].count == 1 );
+        REQUIRE( stats.ops["write"].count == 0 );
+        REQUIRE( stats.ops["rm"].count == 0 );
+    }
+
+    xs.watch_del(watch);
+}
+
+TEST_CASE( "Watches with values", "[xenstore][watches]" ) {
+    unsigned int tid;
+
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::mstore::store st(log);
+    lixs::event_mgr emgr;
+    null_iomux io(emgr);
+    lixs::xenstore xs(st, emgr, io);
+    record_watch plain("/w");
+    record_watch watch("/w", true);
+
+    emgr.enable();
+
+    xs.watch_add(plain);
+    xs.watch_add(watch);
+    emgr.run();
+
+    INFO( "The initial event doesn't carry a value" );
+    REQUIRE( watch.values == std::list<std::string>({ "?" }) );
+    watch.fired.clear();
+    watch.values.clear();
+    plain.values.clear();
+
+    SECTION( "Writes and removals" ) {
+        REQUIRE( xs.store_write(0, 0, "/w/a", "1") == 0 );
+        REQUIRE( xs.store_rm(0, 0, "/w/a") == 0 );
+        emgr.run();
+
+        REQUIRE( watch.fired == std::list<std::string>({ "/w/a", "/w/a" }) );
+        REQUIRE( watch.values == std::list<std::string>({ "=1", "-" }) );
+
+        INFO( "Watches that didn't ask for values don't get them" );
+        REQUIRE( plain.values == std::list<std::string>({ "?", "?" }) );
+    }
+
+    SECTION( "Watches below a removed path" ) {
+        record_watch child("/w/a/b", true);
+
+        REQUIRE( xs.store_write(0, 0, "/w/a/b", "1") == 0 );
+        xs.watch_add(child);
+        emgr.run();
+        child.values.clear();
+
+        REQUIRE( xs.store_rm(0, 0, "/w/a") == 0 );
+        emgr.run();
+        REQUIRE( child.values == std::list<std::string>({ "-" }) );
+
+        xs.watch_del(child);
+    }
+
+    SECTION( "Values written in a transaction are those of the write" ) {
+        REQUIRE( xs.transaction_start(0, &tid) == 0 );
+        REQUIRE( xs.store_write(0, tid, "/w/a", "1") == 0 );
+        REQUIRE( xs.store_write(0, tid, "/w/a", "2") == 0 );
+        REQUIRE( xs.transaction_end(0, tid, true) == 0 );
+        emgr.run();
+
+        REQUIRE( watch.values == std::list<std::string>({ "=1", "=2" }) );
+    }
+
+    xs.watch_del(watch);
+    xs.watch_del(plain);
+}
+
+TEST_CASE( "Depth limited watches", "[xenstore][watches]" ) {
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::mstore::store st(log);
+    lixs::event_mgr emgr;
+    null_iomux io(emgr);
+    lixs::xenstore xs(st, emgr, io);
+    record_watch any("/w");
+    record_watch exact("/w", 0u);
+    record_watch depth("/w", 1u);
+    record_watch child("/w/a/b", 0u);
+
+    emgr.enable();
+
+    REQUIRE( xs.store_write(0, 0, "/w/a/b", "") == 0 );
+
+    xs.watch_add(any);
+    xs.watch_add(exact);
+    xs.watch_add(depth);
+    xs.watch_add(child);
+    emgr.run();
+    any.fired.clear();
+    exact.fired.clear();
+    depth.fired.clear();
+    child.fired.clear();
+
+    REQUIRE( xs.store_write(0, 0, "/w", "") == 0 );
+    REQUIRE( xs.store_write(0, 0, "/w/a", "") == 0 );
+    REQUIRE( xs.store_write(0, 0, "/w/a/b", "") == 0 );
+    emgr.run();
+
+    REQUIRE( any.fired == std::list<std::string>({ "/w", "/w/a", "/w/a/b" }) );
+    REQUIRE( exact.fired == std::list<std::string>({ "/w" }) );
+    REQUIRE( depth.fired == std::list<std::string>({ "/w", "/w/a" }) );
+    REQUIRE( child.fired == std::list<std::string>({ "/w/a/b" }) );
+
+    any.fired.clear();
+    exact.fired.clear();
+    child.fired.clear();
+
+    INFO( "Removing a parent fires watches of any depth" );
+    REQUIRE( xs.store_rm(0, 0, "/w/a") == 0 );
+    emgr.run();
+
+    REQUIRE( any.fired == std::list<std::string>({ "/w/a" }) );
+    REQUIRE( exact.fired.empty() );
+    REQUIRE( child.fired == std::list<std::string>({ "/w/a/b" }) );
+
+    xs.watch_del(any);
+    xs.watch_del(exact);
+    xs.watch_del(depth);
+    xs.watch_del(child);
+}
+
+
+TEST_CASE( "Watch quotas", "[xenstore][watches][quota]" ) {
+    lixs::domain_stats stats;
+
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::mstore::store st(log);
+    lixs::event_mgr emgr;
+    null_iomux io(emgr);
+    lixs::xenstore xs(st, emgr, io);
+    owned_watch w1("/a", 1);
+    owned_watch w2("/b", 1);
+    owned_watch w3("/c", 2);
+    owned_watch w4("/d", 0);
+    owned_watch w5("/e", 0);
+
+    xs.set_quota(0, 0, 1);
+
+    REQUIRE( xs.watch_add(w1) == 0 );
+    REQUIRE( xs.watch_add(w2) == ENOSPC );
+    REQUIRE( xs.watch_add(w3) == 0 );
+
+    INFO( "Dom0 is not limited" );
+    REQUIRE( xs.watch_add(w4) == 0 );
+    REQUIRE( xs.watch_add(w5) == 0 );
+
+    xs.get_domain_stats(1, stats);
+    REQUIRE( stats.watches == 1 );
+
+    xs.watch_del(w1);
+
+    xs.get_domain_stats(1, stats);
+    REQUIRE( stats.watches == 0 );
+
+    REQUIRE( xs.watch_add(w2) == 0 );
+
+    xs.watch_del(w2);
+    xs.watch_del(w3);
+    xs.watch_del(w4);
+    xs.watch_del(w5);
+}
+
+TEST_CASE( "Watch fan-out pages", "[xenstore][watches]" ) {
+    std::list<std::string> paths;
+    std::list<lixs::watch_fanout> fanout;
+
+    lixs::log::logger log(lixs::log::level::OFF);
+    lixs::mstore::store st(log);
+    lixs::event_mgr emgr;
+    null_iomux io(emgr);
+    lixs::xenstore xs(st, emgr, io);
+    record_watch d("/f/d");
+    record_watch c("/f/c");
+    record_watch b("/f/b");
+    record_watch a("/f/a");
+    record_watch z1("/f/z");
+    record_watch z2("/f/z");
+
+    xs.watch_add(d);
+    xs.watch_add(c);
+    xs.watch_add(b);
+    xs.watch_add(a);
+    xs.watch_add(z1);
+    xs.watch_add(z2);
+
+    INFO( "Paths with as many watches are ranked by path" );
+    for (unsigned long int offset = 0; offset < 6; offset += 2) {
+        xs.get_watch_fanout(offset, 2, fanout);
+
+        for (auto& f : fanout) {
+            paths.push_back(f.path);
+        }
+    }
+
+    REQUIRE( paths == std::list<std::string>({ "/f/z", "/f/a", "/f/b", "/f/c", "/f/d" }) );
+
+    xs.watch_del(d);
+    xs.watch_del(c);
+    xs.watch_del(b);
+    xs.watch_del(a);
+    xs.watch_del(z1);
+    xs.watch_del(z2);
+}